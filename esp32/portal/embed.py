@@ -0,0 +1,68 @@
+"""Compresses the captive-portal page into a flash constant.
+
+Runs as a PlatformIO pre-script (extra_scripts = pre:portal/embed.py) and by hand:
+
+  python3 portal/embed.py
+
+Leading indentation is stripped and the page is gzipped with a fixed mtime, so
+the same index.html always gives the same bytes and the same ETag. The header
+is only rewritten when its content changes, which keeps incremental builds
+incremental; it is committed so builds without this script still work.
+"""
+
+import gzip
+import hashlib
+import os
+
+HEADER_NAME = os.path.join("src", "servers", "PortalAssets.h")
+BYTES_PER_LINE = 16
+
+
+def minify(text):
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip()) + "\n"
+
+
+def render(raw, compressed):
+    etag = hashlib.sha256(compressed).hexdigest()[:16]
+    lines = [
+        "#pragma once",
+        "",
+        "// Generated by portal/embed.py from portal/index.html; do not edit.",
+        "// %d bytes minified, %d bytes gzipped." % (len(raw), len(compressed)),
+        "",
+        "#include <Arduino.h>",
+        "",
+        '#define PORTAL_INDEX_ETAG "\\"%s\\""' % etag,
+        "",
+        "static const size_t PORTAL_INDEX_GZ_LENGTH = %d;" % len(compressed),
+        "static const uint8_t PORTAL_INDEX_GZ[] PROGMEM = {",
+    ]
+    for i in range(0, len(compressed), BYTES_PER_LINE):
+        chunk = compressed[i:i + BYTES_PER_LINE]
+        lines.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def embed(project_dir):
+    with open(os.path.join(project_dir, "portal", "index.html"), encoding="utf-8") as f:
+        raw = minify(f.read()).encode("utf-8")
+    compressed = gzip.compress(raw, compresslevel=9, mtime=0)
+    header = render(raw, compressed)
+
+    path = os.path.join(project_dir, HEADER_NAME)
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            if f.read() == header:
+                return
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(header)
+    print("portal: %d bytes -> %d bytes gzipped" % (len(raw), len(compressed)))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    embed(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        embed(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
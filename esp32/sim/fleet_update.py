@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""Times a firmware update across a fleet of simulated subcontrollers.
+
+Plays the hub: serves the OTA manifest and image over a throttled link, starts
+one simulator per board with its own image file, and triggers updates through
+POST /api/system/update. A board counts as updated once
+/api/system/firmware/info reports the new image's SHA-256.
+
+  fleet_update.py --sim .pio/build/native/program --boards 1 2 4 8 16
+
+In "hub" mode the manifest lists no peers and every board downloads from the
+hub at once. In "peers" mode the manifest lists the boards already updated,
+and updates are started as fast as the sources can serve them: one download
+from the hub plus one from each updated board.
+
+With --drop-kb the hub breaks off every firmware response after that much of
+it, as a marginal link would, and boards have to resume with Range requests:
+
+  fleet_update.py --boards 1 4 --modes hub --drop-kb 200
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import random
+import re
+import shutil
+import subprocess
+import tempfile
+import threading
+import time
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+MANIFEST_PATH = "/api/v2/subcontrollers/firmware/esp32/manifest"
+FIRMWARE_PATH = "/firmware/esp32.bin"
+NEW_VERSION = "v99.0.0"
+UPLOADS_PER_BOARD = 1  # FIRMWARE_MAX_UPLOADS
+SLICE_BYTES = 1460
+
+
+class Link:
+    """Airtime shared by every transfer on one link, taken in turn."""
+
+    def __init__(self, kbps):
+        self.kbps = kbps
+        self.free_at = 0.0
+        self.lock = threading.Lock()
+
+    def transfer(self, size):
+        if self.kbps <= 0:
+            return
+        with self.lock:
+            done = max(time.monotonic(), self.free_at) + size * 8 / (self.kbps * 1000)
+            self.free_at = done
+        time.sleep(max(0.0, done - time.monotonic()))
+
+
+class Hub:
+    def __init__(self, port, image, link, drop_bytes=0):
+        self.image = image
+        self.sha256 = hashlib.sha256(image).hexdigest()
+        self.etag = '"%s"' % self.sha256
+        self.link = link
+        self.drop_bytes = drop_bytes
+        self.peers = []
+        self.downloads = 0
+        self.resumes = 0
+        hub = self
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                if self.path == MANIFEST_PATH:
+                    data = {"version": NEW_VERSION, "sha256": hub.sha256, "path": FIRMWARE_PATH, "peers": list(hub.peers)}
+                    self.reply(json.dumps({"statusCode": 200, "content": {"data": data}}).encode(), "application/json")
+                elif self.path == FIRMWARE_PATH:
+                    self.send_firmware()
+                else:
+                    self.send_error(404)
+
+            def send_firmware(self):
+                size = len(hub.image)
+                match = re.fullmatch(r"bytes=(\d+)-", self.headers.get("Range", ""))
+                if_range = self.headers.get("If-Range")
+                if match and int(match.group(1)) < size and if_range in (None, hub.etag):
+                    first = int(match.group(1))
+                    hub.resumes += 1
+                    headers = {"Content-Range": "bytes %d-%d/%d" % (first, size - 1, size)}
+                    self.reply(hub.image[first:], "application/octet-stream", 206, headers, hub.drop_bytes)
+                else:
+                    hub.downloads += 1
+                    self.reply(hub.image, "application/octet-stream", 200, {}, hub.drop_bytes)
+
+            def reply(self, body, content_type, status=200, headers=None, drop_after=0):
+                self.send_response(status)
+                self.send_header("Content-Type", content_type)
+                self.send_header("Content-Length", str(len(body)))
+                self.send_header("Accept-Ranges", "bytes")
+                self.send_header("ETag", hub.etag)
+                for name, value in (headers or {}).items():
+                    self.send_header(name, value)
+                self.send_header("Connection", "close")
+                self.end_headers()
+                # The connection closes short of Content-Length, like a dropped link
+                end = min(len(body), drop_after) if drop_after > 0 else len(body)
+                try:
+                    for i in range(0, end, SLICE_BYTES):
+                        hub.link.transfer(min(SLICE_BYTES, end - i))
+                        self.wfile.write(body[i:min(i + SLICE_BYTES, end)])
+                except (BrokenPipeError, ConnectionResetError):
+                    pass
+
+            def log_message(self, *args):
+                pass
+
+        self.server = ThreadingHTTPServer(("127.0.0.1", port), Handler)
+        self.server.daemon_threads = True
+        threading.Thread(target=self.server.serve_forever, daemon=True).start()
+
+    def stop(self):
+        self.server.shutdown()
+        self.server.server_close()
+
+
+def request(url, body=None, timeout=5):
+    data = json.dumps(body).encode() if body is not None else None
+    with urllib.request.urlopen(urllib.request.Request(url, data=data, method="POST" if data else "GET"), timeout=timeout) as response:
+        return response.read()
+
+
+def firmware_sha(port):
+    try:
+        return json.loads(request("http://127.0.0.1:%d/api/system/firmware/info" % port, timeout=2))["sha256"]
+    except (OSError, ValueError, KeyError):
+        return None
+
+
+def trigger_update(port, hub_port):
+    # Answered only on failure: a successful update restarts the board mid-request
+    try:
+        request("http://127.0.0.1:%d/api/system/update" % port, {"host": "127.0.0.1:%d" % hub_port}, timeout=600)
+    except OSError:
+        pass
+
+
+def run(args, boards, mode, old_image, new_image):
+    workdir = tempfile.mkdtemp(prefix="sproot-fleet-")
+    hub = Hub(args.hub_port, new_image, Link(args.hub_kbps), args.drop_kb * 1024)
+    ports = [args.base_port + i for i in range(boards)]
+    processes = []
+    try:
+        for i, port in enumerate(ports):
+            image_path = os.path.join(workdir, "board-%d.bin" % port)
+            with open(image_path, "wb") as f:
+                f.write(old_image)
+            processes.append(subprocess.Popen(
+                [args.sim, "--port", str(port), "--seed", str(i + 1), "--latency", "0", "--noise", "0",
+                 "--ds18b20", "0", "--firmware", image_path, "--state", os.path.join(workdir, "board-%d.nvs" % port),
+                 "--link-kbps", str(args.board_kbps)],
+                stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+        old_sha = hashlib.sha256(old_image).hexdigest()
+        deadline = time.monotonic() + 10
+        while any(firmware_sha(port) != old_sha for port in ports):
+            if time.monotonic() > deadline:
+                raise RuntimeError("simulators did not start")
+            time.sleep(0.1)
+
+        start = time.monotonic()
+        pending = list(ports)
+        started = {}
+        updated = []
+        while len(updated) < boards:
+            if time.monotonic() - start > args.timeout:
+                raise RuntimeError("%d of %d boards updated after %ds" % (len(updated), boards, args.timeout))
+            for port in list(started):
+                if firmware_sha(port) == hub.sha256:
+                    updated.append(port)
+                    del started[port]
+            hub.peers = ["127.0.0.1:%d" % port for port in updated] if mode == "peers" else []
+            capacity = boards if mode == "hub" else 1 + UPLOADS_PER_BOARD * len(updated)
+            while pending and len(started) < capacity:
+                port = pending.pop(0)
+                started[port] = time.monotonic()
+                threading.Thread(target=trigger_update, args=(port, args.hub_port), daemon=True).start()
+            time.sleep(0.05)
+        return time.monotonic() - start, hub.downloads, hub.resumes
+    finally:
+        for process in processes:
+            process.kill()
+        for process in processes:
+            process.wait()
+        hub.stop()
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", default=".pio/build/native/program", help="simulator binary")
+    parser.add_argument("--boards", type=int, nargs="+", default=[1, 2, 4, 8], help="fleet sizes to time")
+    parser.add_argument("--modes", nargs="+", default=["hub", "peers"], choices=["hub", "peers"])
+    parser.add_argument("--image-kb", type=int, default=1024, help="size of the image, in KiB")
+    parser.add_argument("--hub-kbps", type=int, default=4000, help="throughput of the hub's link")
+    parser.add_argument("--board-kbps", type=int, default=4000, help="throughput of each board's link")
+    parser.add_argument("--drop-kb", type=int, default=0, help="break off each firmware response after this many KiB")
+    parser.add_argument("--hub-port", type=int, default=18300)
+    parser.add_argument("--base-port", type=int, default=18310)
+    parser.add_argument("--timeout", type=int, default=300, help="seconds before a run is abandoned")
+    args = parser.parse_args()
+
+    rng = random.Random(1)
+    old_image = bytes(rng.getrandbits(8) for _ in range(args.image_kb * 1024))
+    new_image = bytes(rng.getrandbits(8) for _ in range(args.image_kb * 1024))
+
+    print("%6s %6s %10s %14s %12s" % ("mode", "boards", "seconds", "hub downloads", "hub resumes"))
+    for mode in args.modes:
+        for boards in args.boards:
+            seconds, downloads, resumes = run(args, boards, mode, old_image, new_image)
+            print("%6s %6d %10.1f %14d %12d" % (mode, boards, seconds, downloads, resumes), flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Checks that attaching and detaching I2C devices does not leak or fragment the heap.
+
+Starts one simulator with BME280s, ADS1115s and PCA9685s, configures them, then
+unplugs and replugs them over and over with SIGUSR1:
+
+  heap_soak.py --sim .pio/build/native/program --cycles 20
+
+Each cycle unplugs the devices twice. The short unplug lasts only as long as
+one read of each device, which finds it missing, so the next read re-initializes
+it in its slot. The long unplug lasts until the inventory has missed every
+device often enough to detach it, so the next read constructs it again.
+
+After --warmup cycles, free_heap and max_alloc_heap from /api/system/status are
+sampled at the same point of every cycle. The run fails if either falls in more
+than half the cycles, as a leak in the attach path would make it, or falls more
+than --tolerance bytes in all. The tolerance covers what the firmware creates
+once on first use, such as a job slot's semaphore the first time two jobs
+overlap.
+"""
+
+import argparse
+import json
+import os
+import signal
+import subprocess
+import sys
+import time
+import urllib.error
+import urllib.request
+
+BME280_ADDRESSES = ["0x76", "0x77"]
+ADS1115_ADDRESSES = ["0x48", "0x49", "0x4a", "0x4b"]
+PCA9685_ADDRESSES = ["0x%02x" % (0x40 + i) for i in range(16)]
+
+
+def request(port, path, body=None, method=None, timeout=5):
+    data = json.dumps(body).encode() if body is not None else None
+    url = "http://127.0.0.1:%d%s" % (port, path)
+    try:
+        with urllib.request.urlopen(urllib.request.Request(url, data=data, method=method), timeout=timeout) as response:
+            return json.loads(response.read())
+    except urllib.error.HTTPError as error:
+        return {"status": error.code}
+
+
+def attached(port):
+    devices = request(port, "/api/system/inventory")["devices"]
+    return {kind: sorted(devices.get(kind, [])) for kind in ("bme280", "ads1115", "pca9685")}
+
+
+def read_all(port, args):
+    """Reads every device once, which attaches or re-initializes it if it answers."""
+    for address in BME280_ADDRESSES[:args.bme280]:
+        request(port, "/api/sensors/bme280/%s" % address)
+    for address in ADS1115_ADDRESSES[:args.ads1115]:
+        request(port, "/api/sensors/ads1115/%s/0" % address)
+    for address in PCA9685_ADDRESSES[:args.pca9685]:
+        request(port, "/api/outputs/pca9685/%s" % address)
+
+
+def wait_for(condition, what, timeout):
+    deadline = time.monotonic() + timeout
+    while True:
+        try:
+            if condition():
+                return
+        except OSError:
+            pass  # still starting
+        if time.monotonic() > deadline:
+            raise RuntimeError("timed out waiting for %s" % what)
+        time.sleep(0.2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", default=".pio/build/native/program", help="simulator binary")
+    parser.add_argument("--cycles", type=int, default=20, help="unplug cycles to sample")
+    parser.add_argument("--warmup", type=int, default=3, help="cycles run before the first sample")
+    parser.add_argument("--tolerance", type=int, default=1024, help="bytes either figure may fall by in all")
+    parser.add_argument("--bme280", type=int, default=2, choices=range(0, 3))
+    parser.add_argument("--ads1115", type=int, default=2, choices=range(0, 5))
+    parser.add_argument("--pca9685", type=int, default=2, choices=range(0, 17))
+    parser.add_argument("--port", type=int, default=18400)
+    args = parser.parse_args()
+
+    expected = {
+        "bme280": BME280_ADDRESSES[:args.bme280],
+        "ads1115": ADS1115_ADDRESSES[:args.ads1115],
+        "pca9685": PCA9685_ADDRESSES[:args.pca9685],
+    }
+    process = subprocess.Popen(
+        [args.sim, "--port", str(args.port), "--latency", "0", "--noise", "0", "--ds18b20", "0",
+         "--bme280", str(args.bme280), "--ads1115", str(args.ads1115), "--pca9685", str(args.pca9685)],
+        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+        # Blocks held in glibc's per-thread caches count as allocated, so the heap figures would wander
+        env=dict(os.environ, GLIBC_TUNABLES="glibc.malloc.tcache_count=0:glibc.malloc.arena_max=1"))
+    samples = []
+    try:
+        wait_for(lambda: attached(args.port) == expected, "the devices to attach", 20)
+
+        # Non-default state, so every re-attach has settings, a frequency and duties to restore
+        for address in expected["bme280"]:
+            request(args.port, "/api/sensors/bme280/%s" % address, {"temperature_oversampling": 4}, "PUT")
+        for address in expected["pca9685"]:
+            request(args.port, "/api/outputs/pca9685/%s" % address, {"frequency": 1000}, "PUT")
+            request(args.port, "/api/outputs/pca9685/%s/3" % address, {"value": 50}, "PUT")
+
+        print("%5s %10s %14s" % ("cycle", "free_heap", "max_alloc_heap"))
+        for cycle in range(args.warmup + args.cycles):
+            # Short unplug: each device is found missing once, then re-initialized in place
+            process.send_signal(signal.SIGUSR1)
+            read_all(args.port, args)
+            process.send_signal(signal.SIGUSR1)
+            read_all(args.port, args)
+
+            # Long unplug: the inventory detaches everything, and the reads construct it again
+            process.send_signal(signal.SIGUSR1)
+            wait_for(lambda: not any(attached(args.port).values()), "the devices to detach", 30)
+            process.send_signal(signal.SIGUSR1)
+            read_all(args.port, args)
+            wait_for(lambda: attached(args.port) == expected, "the devices to re-attach", 30)
+
+            if cycle >= args.warmup:
+                heap = request(args.port, "/api/system/status")["heap"]
+                samples.append((heap["free_heap"], heap["max_alloc_heap"]))
+                print("%5d %10d %14d" % (cycle - args.warmup + 1, samples[-1][0], samples[-1][1]), flush=True)
+    finally:
+        process.kill()
+        process.wait()
+
+    failed = False
+    for index, name in enumerate(("free_heap", "max_alloc_heap")):
+        drop = samples[0][index] - min(sample[index] for sample in samples)
+        falls = sum(1 for before, after in zip(samples, samples[1:]) if after[index] < before[index])
+        print("%s fell by at most %d bytes, in %d of %d cycles" % (name, drop, falls, len(samples) - 1))
+        failed = failed or drop > args.tolerance or falls > (len(samples) - 1) / 2
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Adafruit_I2CDevice.h>
+
+typedef enum
+{
+  GAIN_TWOTHIRDS = 0x0000,
+  GAIN_ONE = 0x0200,
+  GAIN_TWO = 0x0400,
+  GAIN_FOUR = 0x0600,
+  GAIN_EIGHT = 0x0800,
+  GAIN_SIXTEEN = 0x0A00
+} adsGain_t;
+
+#define RATE_ADS1115_8SPS (0x0000)
+#define RATE_ADS1115_16SPS (0x0020)
+#define RATE_ADS1115_32SPS (0x0040)
+#define RATE_ADS1115_64SPS (0x0060)
+#define RATE_ADS1115_128SPS (0x0080)
+#define RATE_ADS1115_250SPS (0x00A0)
+#define RATE_ADS1115_475SPS (0x00C0)
+#define RATE_ADS1115_860SPS (0x00E0)
+
+#define ADS1X15_ADDRESS (0x48)
+
+// Same interface as the Adafruit driver; conversions read the simulated
+// channel voltage and take as long as the configured data rate implies.
+class Adafruit_ADS1X15
+{
+public:
+  bool begin(uint8_t address = ADS1X15_ADDRESS, TwoWire *wire = &Wire);
+  int16_t readADC_SingleEnded(uint8_t channel);
+  float computeVolts(int16_t counts);
+  void setGain(adsGain_t gain) { m_gain = gain; }
+  adsGain_t getGain() { return m_gain; }
+  void setDataRate(uint16_t rate) { m_dataRate = rate; }
+  uint16_t getDataRate() { return m_dataRate; }
+
+protected:
+  uint8_t m_bitShift = 0;
+  adsGain_t m_gain = GAIN_TWOTHIRDS;
+  uint16_t m_dataRate = RATE_ADS1115_128SPS;
+  TwoWire *m_wire = nullptr;
+  uint8_t m_address = 0;
+};
+
+class Adafruit_ADS1115 : public Adafruit_ADS1X15
+{
+public:
+  Adafruit_ADS1115() {}
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Adafruit_I2CDevice.h>
+
+#define BME280_ADDRESS (0x77)
+#define BME280_ADDRESS_ALTERNATE (0x76)
+
+enum
+{
+  BME280_REGISTER_CHIPID = 0xD0,
+  BME280_REGISTER_CONTROL = 0xF4,
+  BME280_REGISTER_PRESSUREDATA = 0xF7,
+  BME280_REGISTER_TEMPDATA = 0xFA,
+  BME280_REGISTER_HUMIDDATA = 0xFD,
+};
+
+typedef struct
+{
+  uint16_t dig_T1;
+  int16_t dig_T2;
+  int16_t dig_T3;
+  uint16_t dig_P1;
+  int16_t dig_P2;
+  int16_t dig_P3;
+  int16_t dig_P4;
+  int16_t dig_P5;
+  int16_t dig_P6;
+  int16_t dig_P7;
+  int16_t dig_P8;
+  int16_t dig_P9;
+  uint8_t dig_H1;
+  int16_t dig_H2;
+  uint8_t dig_H3;
+  int16_t dig_H4;
+  int16_t dig_H5;
+  int8_t dig_H6;
+} bme280_calib_data;
+
+// Same interface as the Adafruit driver. init() loads the simulated chip's
+// calibration, and the measurement registers hold raw ADC values, so the
+// firmware's own compensation code runs unchanged.
+class Adafruit_BME280
+{
+public:
+  enum sensor_sampling
+  {
+    SAMPLING_NONE = 0b000,
+    SAMPLING_X1 = 0b001,
+    SAMPLING_X2 = 0b010,
+    SAMPLING_X4 = 0b011,
+    SAMPLING_X8 = 0b100,
+    SAMPLING_X16 = 0b101
+  };
+  enum sensor_mode
+  {
+    MODE_SLEEP = 0b00,
+    MODE_FORCED = 0b01,
+    MODE_NORMAL = 0b11
+  };
+  enum sensor_filter
+  {
+    FILTER_OFF = 0b000,
+    FILTER_X2 = 0b001,
+    FILTER_X4 = 0b010,
+    FILTER_X8 = 0b011,
+    FILTER_X16 = 0b100
+  };
+  enum standby_duration
+  {
+    STANDBY_MS_0_5 = 0b000,
+    STANDBY_MS_10 = 0b110,
+    STANDBY_MS_20 = 0b111,
+    STANDBY_MS_62_5 = 0b001,
+    STANDBY_MS_125 = 0b010,
+    STANDBY_MS_250 = 0b011,
+    STANDBY_MS_500 = 0b100,
+    STANDBY_MS_1000 = 0b101
+  };
+
+  Adafruit_BME280() {}
+  ~Adafruit_BME280();
+
+  bool begin(uint8_t address = BME280_ADDRESS, TwoWire *wire = &Wire);
+  bool init();
+  void setSampling(sensor_mode mode = MODE_NORMAL, sensor_sampling tempSampling = SAMPLING_X16,
+                   sensor_sampling pressSampling = SAMPLING_X16, sensor_sampling humSampling = SAMPLING_X16,
+                   sensor_filter filter = FILTER_OFF, standby_duration duration = STANDBY_MS_0_5);
+  bool takeForcedMeasurement();
+  float readTemperature();
+  float readPressure();
+  float readHumidity();
+  uint32_t sensorID() { return _sensorID; }
+
+protected:
+  TwoWire *_wire = nullptr;
+  Adafruit_I2CDevice *i2c_dev = nullptr;
+  int32_t t_fine = 0;
+  int32_t t_fine_adjust = 0;
+  int32_t _sensorID = 0;
+  bme280_calib_data _bme280_calib = {};
+  uint8_t _address = 0;
+};
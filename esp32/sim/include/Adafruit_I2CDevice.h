@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Wire.h>
+
+// Register-level access to a simulated I2C device
+class Adafruit_I2CDevice
+{
+public:
+  Adafruit_I2CDevice(uint8_t address, TwoWire *wire = &Wire) : _address(address), _wire(wire) {}
+
+  bool begin(bool addrDetect = true) { return !addrDetect || detected(); }
+  bool detected();
+  uint8_t address() { return _address; }
+  TwoWire *wire() { return _wire; } // not in the library; lets the simulated drivers charge bus time
+  bool write(const uint8_t *buffer, size_t len, bool stop = true, const uint8_t *prefix_buffer = nullptr, size_t prefix_len = 0);
+  bool write_then_read(const uint8_t *writeBuffer, size_t writeLen, uint8_t *readBuffer, size_t readLen, bool stop = false);
+
+private:
+  uint8_t _address;
+  TwoWire *_wire;
+};
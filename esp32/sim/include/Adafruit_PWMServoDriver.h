@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Adafruit_I2CDevice.h>
+
+#define PCA9685_I2C_ADDRESS 0x40
+#define FREQUENCY_OSCILLATOR 25000000
+#define PCA9685_PRESCALE_MIN 3
+#define PCA9685_PRESCALE_MAX 255
+
+// Same interface as the Adafruit driver, writing the simulated chip's LED
+// registers with the same full-on/full-off encoding as the hardware. Like the
+// library, begin() allocates an I2C device that nothing frees.
+class Adafruit_PWMServoDriver
+{
+public:
+  Adafruit_PWMServoDriver() : Adafruit_PWMServoDriver(PCA9685_I2C_ADDRESS, Wire) {}
+  Adafruit_PWMServoDriver(const uint8_t address) : Adafruit_PWMServoDriver(address, Wire) {}
+  Adafruit_PWMServoDriver(const uint8_t address, TwoWire &wire) : _i2caddr(address), _wire(&wire) {}
+
+  bool begin(uint8_t prescale = 0);
+  void reset();
+  void sleep();
+  void wakeup();
+  void setPWMFreq(float frequency);
+  uint16_t getPWM(uint8_t num, bool off = false);
+  uint8_t setPWM(uint8_t num, uint16_t on, uint16_t off);
+  void setPin(uint8_t num, uint16_t value, bool invert = false);
+  uint8_t readPrescale();
+  void setOscillatorFrequency(uint32_t frequency) { _oscillator_freq = frequency; }
+  uint32_t getOscillatorFrequency() { return _oscillator_freq; }
+
+private:
+  uint8_t _i2caddr;
+  TwoWire *_wire;
+  Adafruit_I2CDevice *i2c_dev = nullptr;
+  uint32_t _oscillator_freq = FREQUENCY_OSCILLATOR;
+};
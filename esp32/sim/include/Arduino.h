@@ -0,0 +1,111 @@
+#pragma once
+
+// Host build of the parts of the Arduino-ESP32 core the firmware uses.
+// Timing, heap and chip queries are answered by the simulator runtime.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <math.h>
+#include <time.h>
+
+#include "WString.h"
+#include "IPAddress.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#define IRAM_ATTR
+#define PROGMEM
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+
+uint32_t getCpuFrequencyMhz();
+bool setCpuFrequencyMhz(uint32_t mhz);
+
+// The host clock is already synchronized, so SNTP reports a sync as soon as it starts
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+
+  size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  template <typename T>
+  size_t print(T value) { return print(String(value)); }
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &value) { return print(value) + println(); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  size_t readBytes(uint8_t *buffer, size_t length);
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+protected:
+  unsigned long _timeout = 1000;
+};
+
+// Serial writes to the process's stdout, prefixed with the simulated board's port
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint64_t getEfuseMac();
+  uint32_t getCpuFreqMHz() { return getCpuFrequencyMhz(); }
+  uint32_t getSketchSize();
+  void restart();
+};
+extern EspClass ESP;
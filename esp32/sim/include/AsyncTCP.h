@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+
+// One accepted TCP connection of the simulated web server
+class AsyncClient
+{
+public:
+  AsyncClient(int fd, IPAddress remoteIP, uint16_t remotePort, uint16_t localPort)
+      : _fd(fd), _remoteIP(remoteIP), _remotePort(remotePort), _localPort(localPort) {}
+
+  IPAddress remoteIP() const { return _remoteIP; }
+  uint16_t remotePort() const { return _remotePort; }
+  uint16_t localPort() const { return _localPort; }
+  bool connected() const { return _fd >= 0; }
+
+  // Seconds without received data before the connection is dropped; 0 disables the limit
+  void setRxTimeout(uint32_t timeout) { _rxTimeout = timeout; }
+  uint32_t getRxTimeout() const { return _rxTimeout; }
+  void setNoDelay(bool noDelay);
+  void close(bool now = false);
+
+  int fd() const { return _fd; }
+
+private:
+  int _fd;
+  IPAddress _remoteIP;
+  uint16_t _remotePort;
+  uint16_t _localPort;
+  uint32_t _rxTimeout = 0;
+};
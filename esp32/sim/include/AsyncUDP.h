@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <memory>
+
+// One received datagram; the data is only valid during the callback
+class AsyncUDPPacket
+{
+public:
+  AsyncUDPPacket(uint8_t *data, size_t length, IPAddress remoteIP, uint16_t remotePort, bool multicast)
+      : _data(data), _length(length), _remoteIP(remoteIP), _remotePort(remotePort), _multicast(multicast) {}
+
+  uint8_t *data() { return _data; }
+  size_t length() { return _length; }
+  IPAddress remoteIP() { return _remoteIP; }
+  uint16_t remotePort() { return _remotePort; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  bool isMulticast() { return _multicast; }
+
+private:
+  uint8_t *_data;
+  size_t _length;
+  IPAddress _remoteIP;
+  uint16_t _remotePort;
+  bool _multicast;
+};
+
+typedef std::function<void(AsyncUDPPacket &packet)> AuPacketHandlerFunction;
+
+// Socket-backed listener. Each one gets a receive thread that runs the packet
+// callback, as the async_udp task does on the device. Multicast groups are
+// joined on the loopback interface, and the port is shared, so every instance
+// on the host receives the same datagrams.
+class AsyncUDP
+{
+public:
+  ~AsyncUDP() { close(); }
+
+  bool listen(uint16_t port);
+  bool listenMulticast(const IPAddress &address, uint16_t port, uint8_t ttl = 1);
+  void onPacket(AuPacketHandlerFunction callback);
+  void close();
+  bool connected() const { return _listener != nullptr; }
+
+  struct Listener;
+
+private:
+  bool start(const IPAddress &bindAddress, uint16_t port, bool multicast);
+
+  std::shared_ptr<Listener> _listener;
+  AuPacketHandlerFunction _callback;
+};
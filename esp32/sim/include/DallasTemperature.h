@@ -0,0 +1,42 @@
+#pragma once
+
+#include <OneWire.h>
+
+typedef uint8_t DeviceAddress[8];
+
+#define DEVICE_DISCONNECTED_C -127
+
+// Conversions block for the simulated conversion time, like the library's default wait-for-conversion mode
+class DallasTemperature
+{
+public:
+  struct request_t
+  {
+    bool result;
+    unsigned long timestamp;
+    operator bool() { return result; }
+  };
+
+  DallasTemperature() {}
+  DallasTemperature(OneWire *wire) : _wire(wire) {}
+
+  void begin();
+  uint8_t getDeviceCount();
+  bool getAddress(uint8_t *address, uint8_t index);
+  bool isConnected(const uint8_t *address);
+  request_t requestTemperatures();
+  request_t requestTemperaturesByAddress(const uint8_t *address);
+  float getTempC(const uint8_t *address);
+  void setResolution(uint8_t bits) { _resolution = bits; }
+  uint8_t getResolution() { return _resolution; }
+  void setWaitForConversion(bool wait) { _waitForConversion = wait; }
+  bool getWaitForConversion() { return _waitForConversion; }
+  bool isConversionComplete();
+  static uint16_t millisToWaitForConversion(uint8_t bits);
+
+private:
+  OneWire *_wire = nullptr;
+  uint8_t _resolution = 12;
+  bool _waitForConversion = true;
+  int64_t _conversionEndUs = 0; // when the last conversion started without waiting is done
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+// Host implementation of the ESPAsyncWebServer API used by the firmware.
+//
+// Behaviour follows the library where it matters for load testing:
+// - handlers and middleware all run on one thread, like the async_tcp task,
+//   so a slow handler delays every other request
+// - the connection is closed after each response
+// - routes match in registration order, with the same "/path/*" rules
+// Connections beyond the simulated lwIP socket limit are reset on accept.
+
+#include <Arduino.h>
+#include <AsyncTCP.h>
+
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+typedef enum
+{
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+
+class AsyncWebParameter
+{
+public:
+  AsyncWebParameter(const String &name, const String &value, bool post) : _name(name), _value(value), _post(post) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+  bool isPost() const { return _post; }
+
+private:
+  String _name;
+  String _value;
+  bool _post;
+};
+
+class AsyncWebHeader
+{
+public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+private:
+  String _name;
+  String _value;
+};
+
+class AsyncWebServerResponse
+{
+public:
+  AsyncWebServerResponse(int code, const String &contentType, const String &content)
+      : _code(code), _contentType(contentType), _content(content) {}
+  virtual ~AsyncWebServerResponse() {}
+
+  bool addHeader(const char *name, const char *value, bool replace = true);
+  bool addHeader(const String &name, const String &value, bool replace = true) { return addHeader(name.c_str(), value.c_str(), replace); }
+  bool addHeader(const char *name, long value, bool replace = true) { return addHeader(name, String(value).c_str(), replace); }
+  void setCode(int code) { _code = code; }
+  void setContentType(const char *type) { _contentType = type; }
+
+  int code() const { return _code; }
+  virtual String content() const { return _content; }
+  String serialize() const;
+  // Writes the whole response to a connected socket
+  virtual void writeTo(int fd) const;
+
+protected:
+  String head(size_t contentLength) const;
+  bool hasBody() const { return _code != 204 && _code != 304 && !(_code >= 100 && _code < 200); }
+
+  int _code;
+  String _contentType;
+  String _content;
+  std::vector<AsyncWebHeader> _headers;
+};
+
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+public:
+  AsyncResponseStream(const String &contentType) : AsyncWebServerResponse(200, contentType, String()) {}
+  size_t write(uint8_t c) override
+  {
+    _content.concat((char)c);
+    return 1;
+  }
+  size_t write(const uint8_t *data, size_t len) override
+  {
+    _content.concat((const char *)data, len);
+    return len;
+  }
+  using Print::write;
+};
+
+typedef std::function<void()> ArMiddlewareNext;
+typedef std::function<void(AsyncWebServerRequest *request, ArMiddlewareNext next)> ArMiddlewareCallback;
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+
+class AsyncWebServerRequest
+{
+public:
+  AsyncWebServerRequest(AsyncWebServer *server, AsyncClient *client) : _server(server), _client(client) {}
+  ~AsyncWebServerRequest();
+
+  AsyncClient *client() { return _client; }
+  const String &url() const { return _url; }
+  WebRequestMethodComposite method() const { return _method; }
+  const char *methodToString() const;
+  String host() const { return header("Host"); }
+  String contentType() const { return header("Content-Type"); }
+  size_t contentLength() const { return _body.length(); }
+
+  size_t params() const { return _params.size(); }
+  bool hasParam(const char *name, bool post = false, bool file = false) const { return getParam(name, post, file) != nullptr; }
+  bool hasParam(const String &name, bool post = false, bool file = false) const { return hasParam(name.c_str(), post, file); }
+  const AsyncWebParameter *getParam(const char *name, bool post = false, bool file = false) const;
+  const AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const { return getParam(name.c_str(), post, file); }
+  const AsyncWebParameter *getParam(size_t index) const { return index < _params.size() ? &_params[index] : nullptr; }
+
+  size_t headers() const { return _headers.size(); }
+  bool hasHeader(const char *name) const { return getHeader(name) != nullptr; }
+  const AsyncWebHeader *getHeader(const char *name) const;
+  const String &header(const char *name) const;
+
+  static String urlDecode(const String &text);
+
+  void send(AsyncWebServerResponse *response);
+  void send(int code, const char *contentType = "", const char *content = "") { send(beginResponse(code, contentType, content)); }
+  void send(int code, const String &contentType, const String &content = String()) { send(beginResponse(code, contentType, content)); }
+  void send(int code, const char *contentType, const uint8_t *content, size_t len) { send(beginResponse(code, contentType, content, len)); }
+
+  AsyncWebServerResponse *beginResponse(int code, const char *contentType = "", const char *content = "") { return new AsyncWebServerResponse(code, contentType, content); }
+  AsyncWebServerResponse *beginResponse(int code, const String &contentType, const String &content = String()) { return new AsyncWebServerResponse(code, contentType, content); }
+  AsyncWebServerResponse *beginResponse(int code, const char *contentType, const uint8_t *content, size_t len);
+  AsyncWebServerResponse *beginResponse(const char *contentType, size_t len, AwsResponseFiller filler);
+  AsyncWebServerResponse *beginResponse(const String &contentType, size_t len, AwsResponseFiller filler) { return beginResponse(contentType.c_str(), len, filler); }
+  AsyncWebServerResponse *beginChunkedResponse(const char *contentType, AwsResponseFiller filler);
+  AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller filler) { return beginChunkedResponse(contentType.c_str(), filler); }
+  AsyncResponseStream *beginResponseStream(const char *contentType, size_t bufferSize = 1460) { return new AsyncResponseStream(contentType); }
+
+  void redirect(const char *url, int code = 302);
+  void requestAuthentication();
+  void onDisconnect(std::function<void()> callback) { _onDisconnect = callback; }
+
+  void *_tempObject = nullptr;
+
+  // Used by the simulated server
+  bool parse(const std::string &head, const std::string &body);
+  AsyncWebServerResponse *response() { return _response; }
+  const String &body() const { return _body; }
+  void disconnected();
+
+private:
+  AsyncWebServer *_server;
+  AsyncClient *_client;
+  String _url;
+  WebRequestMethodComposite _method = 0;
+  std::vector<AsyncWebParameter> _params;
+  std::vector<AsyncWebHeader> _headers;
+  String _body;
+  AsyncWebServerResponse *_response = nullptr;
+  std::function<void()> _onDisconnect;
+};
+
+class AsyncWebHandler
+{
+public:
+  virtual ~AsyncWebHandler() {}
+  virtual bool canHandle(AsyncWebServerRequest *request) const { return false; }
+  virtual void handleRequest(AsyncWebServerRequest *request) {}
+  virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {}
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+public:
+  AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                          ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+      : _uri(uri), _method(method), _onRequest(onRequest), _onUpload(onUpload), _onBody(onBody) {}
+
+  bool canHandle(AsyncWebServerRequest *request) const override;
+  void handleRequest(AsyncWebServerRequest *request) override
+  {
+    if (_onRequest)
+      _onRequest(request);
+  }
+  void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override
+  {
+    if (_onBody)
+      _onBody(request, data, len, index, total);
+  }
+  AsyncCallbackWebHandler &setFilter(std::function<bool(AsyncWebServerRequest *)> filter)
+  {
+    _filter = filter;
+    return *this;
+  }
+
+private:
+  String _uri;
+  WebRequestMethodComposite _method;
+  ArRequestHandlerFunction _onRequest;
+  ArUploadHandlerFunction _onUpload;
+  ArBodyHandlerFunction _onBody;
+  std::function<bool(AsyncWebServerRequest *)> _filter;
+};
+
+class AsyncWebServer
+{
+public:
+  AsyncWebServer(uint16_t port) : _port(port) {}
+  ~AsyncWebServer() { end(); }
+
+  void begin();
+  void end();
+
+  AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest) { return on(uri, HTTP_ANY, onRequest); }
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                              ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr);
+  void onNotFound(ArRequestHandlerFunction onNotFound) { _notFound = onNotFound; }
+  void addMiddleware(ArMiddlewareCallback middleware) { _middleware.push_back(middleware); }
+  void reset();
+
+  uint16_t port() const { return _port; }
+  // Runs routing, body and middleware for one parsed request on the handler thread
+  void handle(AsyncWebServerRequest *request);
+
+private:
+  void runChain(AsyncWebServerRequest *request, AsyncWebHandler *handler, size_t index);
+
+  uint16_t _port;
+  int _listenFd = -1;
+  std::vector<std::unique_ptr<AsyncWebHandler>> _handlers;
+  std::vector<ArMiddlewareCallback> _middleware;
+  ArRequestHandlerFunction _notFound;
+};
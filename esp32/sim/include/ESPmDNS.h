@@ -0,0 +1,20 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Records the advertisement and logs it instead of multicasting, so many
+// simulated boards can share one host without answering each other's queries.
+class MDNSResponder
+{
+public:
+  bool begin(const String &hostname);
+  void end();
+  bool addService(const char *service, const char *proto, uint16_t port);
+  bool addServiceTxt(const char *service, const char *proto, const char *key, const char *value);
+  bool addServiceTxt(const String &service, const String &proto, const String &key, const String &value)
+  {
+    return addServiceTxt(service.c_str(), proto.c_str(), key.c_str(), value.c_str());
+  }
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+// Plain-HTTP client over a host socket, for "http://host[:port]/path" URLs.
+// Requests go out with "Connection: close", so the body ends with the connection
+// when the server sends no Content-Length.
+class HTTPClient
+{
+public:
+  bool begin(const String &url);
+  void end() { _stream.stop(); }
+  int GET() { return sendRequest("GET", String()); }
+  int POST(const String &payload) { return sendRequest("POST", payload); }
+  String getString();
+  WiFiClient *getStreamPtr() { return &_stream; }
+  int getSize() { return _size; }
+  bool connected() { return _stream.connected(); }
+  void setTimeout(uint16_t timeout) { _timeoutMs = timeout; }
+  void addHeader(const String &name, const String &value, bool first = false, bool replace = true);
+  // Every response header is kept, so collecting is a no-op
+  void collectHeaders(const char *headerKeys[], const size_t headerKeysCount) {}
+  String header(const char *name);
+
+private:
+  int sendRequest(const char *method, const String &payload);
+
+  String _host;
+  uint16_t _port = 80;
+  String _path;
+  String _headers;
+  uint16_t _timeoutMs = 5000;
+  int _size = -1;
+  std::string _responseHead;
+  WiFiClient _stream;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+#include "WString.h"
+
+class IPAddress
+{
+public:
+  IPAddress() : _address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t address) : _address(address) {}
+
+  operator uint32_t() const { return _address; }
+  uint8_t operator[](int index) const { return (uint8_t)(_address >> (index * 8)); }
+  bool operator==(const IPAddress &other) const { return _address == other._address; }
+  bool fromString(const char *address);
+  bool fromString(const String &address) { return fromString(address.c_str()); }
+  String toString() const;
+
+private:
+  uint32_t _address; // network byte order, as on the ESP32
+};
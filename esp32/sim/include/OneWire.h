@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+// 1-Wire bus backed by the simulated ROM list. search() walks it one device per
+// call, like the real ROM search, and costs about as much bus time.
+class OneWire
+{
+public:
+  OneWire() {}
+  OneWire(uint8_t pin) : _pin(pin) {}
+  void begin(uint8_t pin) { _pin = pin; }
+
+  uint8_t reset();
+  void reset_search() { _searchIndex = 0; }
+  bool search(uint8_t *newAddr, bool searchMode = true);
+  static uint8_t crc8(const uint8_t *addr, uint8_t len);
+
+private:
+  uint8_t _pin = 0;
+  size_t _searchIndex = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+// NVS stand-in. Namespaces live in memory and, when the simulator was started
+// with --state, are written to that file on end() so they survive ESP.restart().
+class Preferences
+{
+public:
+  ~Preferences() { end(); }
+
+  bool begin(const char *name, bool readOnly = false, const char *partition = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putBool(const char *key, bool value) { return putValue(key, value); }
+  size_t putUChar(const char *key, uint8_t value) { return putValue(key, value); }
+  size_t putUShort(const char *key, uint16_t value) { return putValue(key, value); }
+  size_t putInt(const char *key, int32_t value) { return putValue(key, value); }
+  size_t putUInt(const char *key, uint32_t value) { return putValue(key, value); }
+  size_t putULong64(const char *key, uint64_t value) { return putValue(key, value); }
+  size_t putFloat(const char *key, float value) { return putValue(key, value); }
+  size_t putString(const char *key, const String &value) { return putBytes(key, value.c_str(), value.length()); }
+  size_t putBytes(const char *key, const void *value, size_t len);
+
+  bool getBool(const char *key, bool defaultValue = false) { return getValue(key, defaultValue); }
+  uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int32_t getInt(const char *key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint64_t getULong64(const char *key, uint64_t defaultValue = 0) { return getValue(key, defaultValue); }
+  float getFloat(const char *key, float defaultValue = NAN) { return getValue(key, defaultValue); }
+  String getString(const char *key, const String &defaultValue = String());
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buffer, size_t maxLen);
+
+private:
+  template <typename T>
+  size_t putValue(const char *key, T value) { return putBytes(key, &value, sizeof(value)); }
+  template <typename T>
+  T getValue(const char *key, T defaultValue)
+  {
+    T value;
+    return getBytesLength(key) == sizeof(T) && getBytes(key, &value, sizeof(T)) == sizeof(T) ? value : defaultValue;
+  }
+
+  String _namespace;
+  bool _open = false;
+  bool _readOnly = false;
+  bool _dirty = false;
+};
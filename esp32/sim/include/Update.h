@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdio>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_ABORT 8
+
+// Stages an image next to the --firmware file; end() moves it over that file,
+// so the board boots the new image after ESP.restart(). Without --firmware
+// there is no flash to write and begin() fails.
+class UpdateClass
+{
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH);
+  size_t write(uint8_t *data, size_t len);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+  uint8_t getError() { return _error; }
+
+private:
+  FILE *_file = nullptr;
+  size_t _size = 0;
+  size_t _written = 0;
+  bool _active = false;
+  uint8_t _error = UPDATE_ERROR_OK;
+};
+
+extern UpdateClass Update;
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Host stand-in for the Arduino String class, backed by std::string.
+class String
+{
+public:
+  String() {}
+  String(const char *s) : _s(s ? s : "") {}
+  String(const std::string &s) : _s(s) {}
+  String(char c) : _s(1, c) {}
+  String(unsigned char value, unsigned char base = 10);
+  String(int value, unsigned char base = 10);
+  String(unsigned int value, unsigned char base = 10);
+  String(long value, unsigned char base = 10);
+  String(unsigned long value, unsigned char base = 10);
+  String(long long value, unsigned char base = 10);
+  String(unsigned long long value, unsigned char base = 10);
+  String(float value, unsigned int decimalPlaces = 2);
+  String(double value, unsigned int decimalPlaces = 2);
+
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return (unsigned int)_s.length(); }
+  bool isEmpty() const { return _s.empty(); }
+  bool reserve(unsigned int size)
+  {
+    _s.reserve(size);
+    return true;
+  }
+
+  bool concat(const String &s)
+  {
+    _s += s._s;
+    return true;
+  }
+  bool concat(const char *s)
+  {
+    _s += s ? s : "";
+    return true;
+  }
+  bool concat(const char *s, unsigned int len)
+  {
+    _s.append(s, len);
+    return true;
+  }
+  bool concat(char c)
+  {
+    _s += c;
+    return true;
+  }
+  template <typename T>
+  bool concat(T value) { return concat(String(value)); }
+
+  template <typename T>
+  String &operator+=(const T &value)
+  {
+    concat(value);
+    return *this;
+  }
+
+  char charAt(unsigned int index) const { return index < _s.length() ? _s[index] : 0; }
+  void setCharAt(unsigned int index, char c)
+  {
+    if (index < _s.length())
+      _s[index] = c;
+  }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char &operator[](unsigned int index) { return _s[index]; }
+
+  int indexOf(char c, unsigned int from = 0) const { return find(_s.find(c, from)); }
+  int indexOf(const String &s, unsigned int from = 0) const { return find(_s.find(s._s, from)); }
+  int lastIndexOf(char c) const { return find(_s.rfind(c)); }
+  int lastIndexOf(char c, unsigned int from) const { return find(_s.rfind(c, from)); }
+  int lastIndexOf(const String &s) const { return find(_s.rfind(s._s)); }
+  int lastIndexOf(const String &s, unsigned int from) const { return find(_s.rfind(s._s, from)); }
+
+  String substring(unsigned int from) const { return from < _s.length() ? String(_s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  bool startsWith(const String &prefix) const { return _s.compare(0, prefix._s.length(), prefix._s) == 0; }
+  bool endsWith(const String &suffix) const;
+  bool equals(const String &s) const { return _s == s._s; }
+  bool equalsIgnoreCase(const String &s) const;
+
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+  void replace(const String &from, const String &to);
+  void remove(unsigned int index) { remove(index, (unsigned int)-1); }
+  void remove(unsigned int index, unsigned int count);
+
+  long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(_s.c_str(), nullptr); }
+  double toDouble() const { return strtod(_s.c_str(), nullptr); }
+
+  void getBytes(unsigned char *buf, unsigned int size, unsigned int index = 0) const;
+  void toCharArray(char *buf, unsigned int size, unsigned int index = 0) const { getBytes((unsigned char *)buf, size, index); }
+
+  bool operator==(const String &s) const { return _s == s._s; }
+  bool operator==(const char *s) const { return _s == (s ? s : ""); }
+  bool operator!=(const String &s) const { return _s != s._s; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool operator<(const String &s) const { return _s < s._s; }
+  explicit operator bool() const { return true; }
+
+  const std::string &str() const { return _s; }
+
+private:
+  static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+  std::string _s;
+};
+
+inline String operator+(const String &a, const String &b)
+{
+  String r(a);
+  r.concat(b);
+  return r;
+}
+inline String operator+(const String &a, const char *b)
+{
+  String r(a);
+  r.concat(b);
+  return r;
+}
+inline String operator+(const char *a, const String &b)
+{
+  String r(a);
+  r.concat(b);
+  return r;
+}
+inline String operator+(const String &a, char b)
+{
+  String r(a);
+  r.concat(b);
+  return r;
+}
+inline String operator+(const String &a, int b) { return a + String(b); }
+inline String operator+(const String &a, unsigned int b) { return a + String(b); }
+inline String operator+(const String &a, long b) { return a + String(b); }
+inline String operator+(const String &a, unsigned long b) { return a + String(b); }
+inline bool operator==(const char *a, const String &b) { return b == a; }
+inline bool operator!=(const char *a, const String &b) { return b != a; }
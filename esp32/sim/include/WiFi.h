@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+typedef enum
+{
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum
+{
+  WIFI_PS_NONE,
+  WIFI_PS_MIN_MODEM,
+  WIFI_PS_MAX_MODEM
+} wifi_ps_type_t;
+
+// The simulated board is always associated; its address is the loopback interface
+class WiFiClass
+{
+public:
+  bool mode(wifi_mode_t mode) { return true; }
+  wl_status_t begin(const char *ssid, const char *pass = nullptr) { return WL_CONNECTED; }
+  wl_status_t status() { return WL_CONNECTED; }
+  uint8_t waitForConnectResult(unsigned long timeout = 60000) { return WL_CONNECTED; }
+  bool disconnect(bool wifiOff = false) { return true; }
+  bool reconnect() { return true; }
+  bool setSleep(bool enabled) { return setSleep(enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE); }
+  bool setSleep(wifi_ps_type_t type)
+  {
+    _sleep = type;
+    return true;
+  }
+  wifi_ps_type_t getSleep() { return _sleep; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  String macAddress();
+  int8_t RSSI() { return -50; }
+
+private:
+  wifi_ps_type_t _sleep = WIFI_PS_MIN_MODEM;
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <string>
+
+// A blocking TCP socket, as HTTPClient uses it: bytes already received are
+// buffered so available() never blocks, and read() waits up to the stream timeout.
+class WiFiClient : public Stream
+{
+public:
+  ~WiFiClient() { stop(); }
+
+  bool connect(const char *host, uint16_t port, uint32_t timeoutMs = 5000);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  bool connected();
+  void stop();
+
+private:
+  bool fill(uint32_t timeoutMs);
+
+  int _fd = -1;
+  std::string _buffer;
+  size_t _position = 0;
+  bool _closed = false;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define I2C_BUFFER_LENGTH 128
+
+// I2C controller backed by the simulated bus. A transmission is acknowledged
+// when a simulated device answers at the address and no fault is injected.
+class TwoWire : public Stream
+{
+public:
+  explicit TwoWire(uint8_t busNum) : _bus(busNum) {}
+
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  bool end();
+  bool setClock(uint32_t frequency);
+  uint32_t getClock() { return _frequency; }
+  void setTimeOut(uint16_t timeoutMs) {}
+
+  void beginTransmission(uint8_t address);
+  uint8_t endTransmission(bool sendStop = true);
+  size_t requestFrom(uint8_t address, size_t size, bool sendStop = true);
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t *data, size_t size) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+
+  uint8_t busNum() const { return _bus; }
+  // Sleeps for the time `bytes` take on the wire at the current clock
+  void simulateTransfer(size_t bytes);
+
+private:
+  uint8_t _bus;
+  uint8_t _address = 0;
+  uint8_t _buffer[I2C_BUFFER_LENGTH];
+  size_t _pending = 0;
+  uint32_t _frequency = 100000;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
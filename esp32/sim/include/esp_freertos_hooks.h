@@ -0,0 +1,9 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef bool (*esp_freertos_idle_cb_t)();
+typedef void (*esp_freertos_tick_cb_t)();
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t callback, unsigned cpu);
+void esp_deregister_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t callback, unsigned cpu);
@@ -0,0 +1,6 @@
+#pragma once
+
+// The simulator mirrors the IDF 4.4 APIs shipped with Arduino-ESP32 2.x
+#define ESP_IDF_VERSION_MAJOR 4
+#define ESP_IDF_VERSION_MINOR 4
+#define ESP_IDF_VERSION_PATCH 0
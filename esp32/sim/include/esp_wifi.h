@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef enum
+{
+  WIFI_IF_STA = 0,
+  WIFI_IF_AP = 1,
+} wifi_interface_t;
+
+typedef struct
+{
+  uint8_t ssid[32];
+  uint8_t password[64];
+  uint16_t listen_interval;
+} wifi_sta_config_t;
+
+typedef union
+{
+  wifi_sta_config_t sta;
+} wifi_config_t;
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *config);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *config);
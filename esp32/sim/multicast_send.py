@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Sends signed output commands to subcontrollers on the multicast command channel.
+
+Each entry is NODE:DEVICE:PIN:PERCENT. NODE is a board's node_id from
+/api/system/multicast (or "all"), DEVICE a PCA9685 address as used in URLs,
+e.g. 0x40 or 1:0x41.
+
+  multicast_send.py --key $KEY all:0x40:3:50
+  multicast_send.py --key $KEY --count 100 --interval 0.05 --repeat 2 8101:0x40:0:25 8102:0x40:0:25
+
+Each run uses the current time as its epoch, so consecutive runs are always
+newer than the last; pass --epoch and --sequence to replay or reorder on purpose.
+"""
+
+import argparse
+import hashlib
+import hmac
+import socket
+import struct
+import time
+
+MAGIC = b"SP"
+VERSION = 1
+MAX_ENTRIES = 64
+TAG_SIZE = 16
+ALL_NODES = 0xFFFF
+
+
+def parse_entry(text):
+    node, rest = text.split(":", 1)
+    parts = rest.split(":")
+    bus = int(parts[0]) if len(parts) == 4 else 0
+    address, pin, percent = (int(parts[-3], 16), int(parts[-2]), int(parts[-1]))
+    node_id = ALL_NODES if node == "all" else int(node, 0)
+    return struct.pack(">HBBB", node_id, (bus << 7) | address, pin, percent)
+
+
+def build_packet(key, epoch, sequence, entries):
+    body = MAGIC + struct.pack(">BBII", VERSION, len(entries), epoch, sequence) + b"".join(entries)
+    return body + hmac.new(key, body, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("entries", nargs="+", metavar="NODE:DEVICE:PIN:PERCENT")
+    parser.add_argument("--key", required=True, help="shared key, 64 hex digits")
+    parser.add_argument("--group", default="239.255.83.80")
+    parser.add_argument("--port", type=int, default=47800)
+    parser.add_argument("--interface", default="127.0.0.1", help="address of the interface to send from")
+    parser.add_argument("--epoch", type=int, default=int(time.time()))
+    parser.add_argument("--sequence", type=int, default=1, help="sequence number of the first packet")
+    parser.add_argument("--count", type=int, default=1, help="packets to send, each with the next sequence number")
+    parser.add_argument("--interval", type=float, default=0.1, help="seconds between packets")
+    parser.add_argument("--repeat", type=int, default=1, help="copies of each packet, to ride out loss")
+    args = parser.parse_args()
+
+    key = bytes.fromhex(args.key)
+    entries = [parse_entry(e) for e in args.entries]
+    if len(key) != 32 or not 1 <= len(entries) <= MAX_ENTRIES:
+        parser.error("key must be 32 bytes and there must be 1-%d entries" % MAX_ENTRIES)
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(args.interface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    for i in range(args.count):
+        packet = build_packet(key, args.epoch, args.sequence + i, entries)
+        for _ in range(args.repeat):
+            sock.sendto(packet, (args.group, args.port))
+        if i + 1 < args.count:
+            time.sleep(args.interval)
+
+
+if __name__ == "__main__":
+    main()
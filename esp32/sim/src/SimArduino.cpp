@@ -0,0 +1,411 @@
+// Arduino core pieces: String, IPAddress, Print/Serial, ESP and the random and CPU helpers.
+
+#include <Arduino.h>
+#include <esp_sntp.h>
+
+#include <malloc.h>
+#include <mutex>
+#include <random>
+
+#include "SimDevices.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// ===== String =====
+
+static std::string formatInteger(unsigned long long value, bool negative, unsigned char base)
+{
+  if (base < 2 || base > 36)
+  {
+    base = 10;
+  }
+  std::string digits;
+  do
+  {
+    unsigned digit = (unsigned)(value % base);
+    digits.insert(digits.begin(), (char)(digit < 10 ? '0' + digit : 'a' + digit - 10));
+    value /= base;
+  } while (value != 0);
+  return negative ? "-" + digits : digits;
+}
+
+// Like the core, negative numbers only get a sign in base 10; other bases print the two's complement
+static std::string formatSigned(long long value, unsigned char base, unsigned long long mask)
+{
+  if (base == 10 && value < 0)
+  {
+    return formatInteger(0ULL - (unsigned long long)value, true, base);
+  }
+  return formatInteger((unsigned long long)value & mask, false, base);
+}
+
+String::String(unsigned char value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(int value, unsigned char base) : _s(formatSigned(value, base, 0xFFFFFFFFULL)) {}
+String::String(unsigned int value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(long value, unsigned char base) : _s(formatSigned(value, base, 0xFFFFFFFFULL)) {}
+String::String(unsigned long value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(long long value, unsigned char base) : _s(formatSigned(value, base, ~0ULL)) {}
+String::String(unsigned long long value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+
+String::String(float value, unsigned int decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned int decimalPlaces)
+{
+  if (std::isnan(value))
+  {
+    _s = "nan";
+  }
+  else if (std::isinf(value))
+  {
+    _s = value > 0 ? "inf" : "-inf";
+  }
+  else
+  {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimalPlaces, value);
+    _s = buf;
+  }
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+  if (from > to)
+  {
+    std::swap(from, to);
+  }
+  if (from >= _s.length())
+  {
+    return String();
+  }
+  return String(_s.substr(from, std::min<size_t>(to, _s.length()) - from));
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  return _s.length() >= suffix._s.length() &&
+         _s.compare(_s.length() - suffix._s.length(), suffix._s.length(), suffix._s) == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+  if (_s.length() != s._s.length())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < _s.length(); i++)
+  {
+    if (tolower((unsigned char)_s[i]) != tolower((unsigned char)s._s[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void String::toLowerCase()
+{
+  for (char &c : _s)
+  {
+    c = (char)tolower((unsigned char)c);
+  }
+}
+
+void String::toUpperCase()
+{
+  for (char &c : _s)
+  {
+    c = (char)toupper((unsigned char)c);
+  }
+}
+
+void String::trim()
+{
+  size_t start = _s.find_first_not_of(" \t\r\n\f\v");
+  if (start == std::string::npos)
+  {
+    _s.clear();
+    return;
+  }
+  size_t end = _s.find_last_not_of(" \t\r\n\f\v");
+  _s = _s.substr(start, end - start + 1);
+}
+
+void String::replace(const String &from, const String &to)
+{
+  if (from._s.empty())
+  {
+    return;
+  }
+  size_t pos = 0;
+  while ((pos = _s.find(from._s, pos)) != std::string::npos)
+  {
+    _s.replace(pos, from._s.length(), to._s);
+    pos += to._s.length();
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+  if (index < _s.length())
+  {
+    _s.erase(index, count);
+  }
+}
+
+void String::getBytes(unsigned char *buf, unsigned int size, unsigned int index) const
+{
+  if (size == 0)
+  {
+    return;
+  }
+  size_t n = index < _s.length() ? std::min<size_t>(size - 1, _s.length() - index) : 0;
+  if (n > 0)
+  {
+    memcpy(buf, _s.data() + index, n);
+  }
+  buf[n] = 0;
+}
+
+// ===== IPAddress =====
+
+bool IPAddress::fromString(const char *address)
+{
+  unsigned a, b, c, d;
+  char extra;
+  if (address == nullptr || sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 ||
+      a > 255 || b > 255 || c > 255 || d > 255)
+  {
+    return false;
+  }
+  *this = IPAddress(a, b, c, d);
+  return true;
+}
+
+String IPAddress::toString() const
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(buf);
+}
+
+// ===== Print / Stream / Serial =====
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(nullptr, 0, format, copy);
+  va_end(copy);
+  if (len < 0)
+  {
+    va_end(args);
+    return 0;
+  }
+  std::string buf((size_t)len + 1, '\0');
+  vsnprintf(&buf[0], buf.size(), format, args);
+  va_end(args);
+  return write((const uint8_t *)buf.data(), (size_t)len);
+}
+
+size_t Stream::readBytes(uint8_t *buffer, size_t length)
+{
+  size_t n = 0;
+  uint32_t start = millis();
+  while (n < length && millis() - start < _timeout)
+  {
+    int c = read();
+    if (c < 0)
+    {
+      delay(1);
+      continue;
+    }
+    buffer[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
+// Each thread collects a line and emits it whole, tagged with the board's port,
+// so output from many handlers and instances stays readable when interleaved
+static std::mutex serialMutex;
+static thread_local std::string serialLine;
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    char c = (char)buffer[i];
+    if (c == '\r')
+    {
+      continue;
+    }
+    if (c != '\n')
+    {
+      serialLine += c;
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(serialMutex);
+    fprintf(stdout, "[%u] %s\n", simConfig.port, serialLine.c_str());
+    fflush(stdout);
+    serialLine.clear();
+  }
+  return size;
+}
+
+// ===== ESP =====
+// Heap figures model an ESP32 with Wi-Fi up: a fixed budget, minus whatever the
+// process allocated since the simulation started, so leaks and large responses show.
+
+static const uint32_t SIM_HEAP_SIZE = 327680;
+static const uint32_t SIM_HEAP_FREE_AT_BOOT = 220000;
+static const uint32_t SIM_LARGEST_BLOCK = 110580;
+
+static size_t baselineAllocated = 0;
+static uint32_t minFreeHeap = SIM_HEAP_FREE_AT_BOOT;
+static std::mutex heapMutex;
+
+static size_t allocatedBytes()
+{
+  return mallinfo2().uordblks;
+}
+
+uint32_t EspClass::getHeapSize()
+{
+  return SIM_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  std::lock_guard<std::mutex> lock(heapMutex);
+  size_t allocated = allocatedBytes();
+  if (baselineAllocated == 0)
+  {
+    baselineAllocated = allocated;
+  }
+  size_t used = allocated > baselineAllocated ? allocated - baselineAllocated : 0;
+  uint32_t free = used >= SIM_HEAP_FREE_AT_BOOT ? 0 : (uint32_t)(SIM_HEAP_FREE_AT_BOOT - used);
+  minFreeHeap = std::min(minFreeHeap, free);
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+  getFreeHeap();
+  std::lock_guard<std::mutex> lock(heapMutex);
+  return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap()
+{
+  return std::min(getFreeHeap(), SIM_LARGEST_BLOCK);
+}
+
+// Derived from the port so that every instance gets its own hostname
+uint64_t EspClass::getEfuseMac()
+{
+  return ((uint64_t)simConfig.port << 32) | 0x00C40A24ULL;
+}
+
+void EspClass::restart()
+{
+  restartSimulation();
+}
+
+// ===== Misc =====
+
+static std::mutex randomMutex;
+static std::mt19937 arduinoRandom(1);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  long divisor = inMax - inMin;
+  if (divisor == 0)
+  {
+    return -1; // same as the core: avoid a division by zero
+  }
+  return (x - inMin) * (outMax - outMin) / divisor + outMin;
+}
+
+long random(long max)
+{
+  return max <= 0 ? 0 : random(0, max);
+}
+
+long random(long min, long max)
+{
+  if (min >= max)
+  {
+    return min;
+  }
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return std::uniform_int_distribution<long>(min, max - 1)(arduinoRandom);
+}
+
+void randomSeed(unsigned long seed)
+{
+  std::lock_guard<std::mutex> lock(randomMutex);
+  arduinoRandom.seed(seed);
+}
+
+uint32_t esp_random()
+{
+  static std::random_device device;
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return device();
+}
+
+static std::atomic<uint32_t> cpuFrequencyMhz(240);
+
+static sntp_sync_time_cb_t timeSyncCallback = nullptr;
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+  timeSyncCallback = callback;
+}
+
+void sntp_stop()
+{
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2, const char *server3)
+{
+  if (server1 == nullptr || server1[0] == '\0' || timeSyncCallback == nullptr)
+  {
+    return;
+  }
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  timeSyncCallback(&now);
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+  return cpuFrequencyMhz.load();
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+  if (mhz != 80 && mhz != 160 && mhz != 240)
+  {
+    return false;
+  }
+  cpuFrequencyMhz = mhz;
+  return true;
+}
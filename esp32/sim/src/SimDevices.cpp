@@ -0,0 +1,429 @@
+#include "SimDevices.h"
+
+#include <OneWire.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+SimConfig simConfig;
+
+static std::mt19937 rng;
+static std::mutex rngMutex;
+static std::chrono::steady_clock::time_point simStart = std::chrono::steady_clock::now();
+
+static std::vector<SimBme280> bme280s;
+static std::vector<SimAds1115> ads1115s;
+static std::vector<SimPca9685> pca9685s;
+static std::vector<std::vector<uint8_t>> roms;
+static std::atomic<bool> i2cUnplugged(false);
+
+// Calibration words read from a production BME280
+static const bme280_calib_data BME280_CALIBRATION = {
+    28463, 26605, 50,
+    37736, -10536, 3024, 7059, -84, -7, 9900, -10230, 4285,
+    75, 362, 0, 313, 50, 30};
+
+static float uniform()
+{
+  std::lock_guard<std::mutex> lock(rngMutex);
+  return std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+}
+
+static float secondsSinceStart()
+{
+  return std::chrono::duration<float>(std::chrono::steady_clock::now() - simStart).count();
+}
+
+// A slow sine around base, so repeated polls see a plausible, changing signal
+static float drift(float base, float amplitude, float periodS, uint32_t phase)
+{
+  return base + amplitude * sinf(2.0f * (float)M_PI * secondsSinceStart() / periodS + (phase % 628) / 100.0f);
+}
+
+// Register contents after power-on; the calibration words and signal phases are fixed per part
+static void powerOnI2CDevices()
+{
+  for (SimBme280 &device : bme280s)
+  {
+    device.temperatureSampling = Adafruit_BME280::SAMPLING_X16;
+    device.pressureSampling = Adafruit_BME280::SAMPLING_X16;
+    device.humiditySampling = Adafruit_BME280::SAMPLING_X16;
+  }
+  for (SimAds1115 &device : ads1115s)
+  {
+    device.config = 0x8583; // idle, AIN0-AIN1, +-2.048 V, single-shot, 128 SPS
+    device.conversionEndUs = 0;
+    device.conversion = 0;
+  }
+  for (SimPca9685 &device : pca9685s)
+  {
+    for (uint8_t pin = 0; pin < 16; pin++)
+    {
+      device.on[pin] = 0;
+      device.off[pin] = 4096; // full off
+    }
+    device.prescale = 0x1E;
+    device.mode1 = 0x11; // asleep, answering ALL_CALL
+    device.subaddress[0] = 0xE2;
+    device.subaddress[1] = 0xE4;
+    device.subaddress[2] = 0xE8;
+    device.subaddress[3] = 0xE0;
+  }
+}
+
+/**
+ * @brief Lays out the simulated devices: everything on bus 0, at the lowest addresses of each family.
+ */
+void beginSimulation(const SimConfig &config)
+{
+  simConfig = config;
+  rng.seed(config.seed);
+
+  for (uint8_t i = 0; i < config.bme280Count && i < 2; i++)
+  {
+    SimBme280 device = {};
+    device.address = 0x76 + i;
+    device.calib = BME280_CALIBRATION;
+    device.phase = rng();
+    bme280s.push_back(device);
+  }
+  for (uint8_t i = 0; i < config.ads1115Count && i < 4; i++)
+  {
+    SimAds1115 device = {};
+    device.address = 0x48 + i;
+    ads1115s.push_back(device);
+  }
+  for (uint8_t i = 0; i < config.pca9685Count && i < 8; i++)
+  {
+    SimPca9685 device = {};
+    device.address = 0x40 + i;
+    pca9685s.push_back(device);
+  }
+  powerOnI2CDevices();
+  for (uint8_t i = 0; i < config.ds18b20Count; i++)
+  {
+    std::vector<uint8_t> rom(8);
+    rom[0] = 0x28;
+    for (uint8_t j = 1; j < 7; j++)
+    {
+      rom[j] = (uint8_t)rng();
+    }
+    rom[7] = OneWire::crc8(rom.data(), 7);
+    roms.push_back(rom);
+  }
+}
+
+/**
+ * @brief Sleeps for a device or bus time, scaled by --latency.
+ */
+void simulateDelayUs(uint32_t us)
+{
+  uint32_t scaled = (uint32_t)(us * simConfig.latencyScale);
+  if (scaled > 0)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(scaled));
+  }
+}
+
+static std::mutex linkMutex;
+static std::chrono::steady_clock::time_point linkFreeAt;
+
+/**
+ * @brief Sleeps for a transfer's airtime at --link-kbps.
+ *
+ * Transfers take the link in turn: each one is scheduled after the airtime
+ * already reserved, so concurrent uploads and downloads split the throughput
+ * rather than each getting all of it.
+ */
+void simulateLinkTransfer(size_t bytes)
+{
+  if (simConfig.linkKbps == 0 || bytes == 0)
+  {
+    return;
+  }
+  std::chrono::microseconds airtime((uint64_t)bytes * 8000 / simConfig.linkKbps);
+  std::chrono::steady_clock::time_point done;
+  {
+    std::lock_guard<std::mutex> lock(linkMutex);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    done = std::max(now, linkFreeAt) + airtime;
+    linkFreeAt = done;
+  }
+  std::this_thread::sleep_until(done);
+}
+
+bool injectFault()
+{
+  return simConfig.faultRate > 0 && uniform() < simConfig.faultRate;
+}
+
+float gaussianNoise(float sigma)
+{
+  if (simConfig.noiseScale <= 0 || sigma <= 0)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(rngMutex);
+  return std::normal_distribution<float>(0.0f, sigma * simConfig.noiseScale)(rng);
+}
+
+/**
+ * @brief Takes every I2C device off the bus, or puts them back as if just powered on.
+ *
+ * A transaction already under way when they go may still land; the next one sees the change.
+ */
+void setSimulatedI2CDevicesPlugged(bool plugged)
+{
+  if (plugged == !i2cUnplugged)
+  {
+    return;
+  }
+  if (plugged)
+  {
+    powerOnI2CDevices();
+  }
+  i2cUnplugged = !plugged;
+}
+
+bool areSimulatedI2CDevicesPlugged()
+{
+  return !i2cUnplugged;
+}
+
+bool isSimulatedI2CDevicePresent(uint8_t bus, uint8_t address)
+{
+  if (bus != 0 || i2cUnplugged)
+  {
+    return false;
+  }
+  return findSimulatedBme280(bus, address) != nullptr || findSimulatedAds1115(bus, address) != nullptr ||
+         !simulatedPca9685sAnswering(bus, address).empty();
+}
+
+// ===== BME280 =====
+// The firmware compensates raw ADC values with the Bosch integer formulas. To
+// produce registers for a chosen physical value, the same formulas are inverted
+// here by bisection: each is monotonic in its ADC input.
+
+static int32_t compensateTemperature(const bme280_calib_data &c, int32_t adc_T, int32_t &t_fine)
+{
+  int32_t var1 = ((((adc_T >> 3) - ((int32_t)c.dig_T1 << 1))) * ((int32_t)c.dig_T2)) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - ((int32_t)c.dig_T1)) * ((adc_T >> 4) - ((int32_t)c.dig_T1))) >> 12) *
+                  ((int32_t)c.dig_T3)) >> 14;
+  t_fine = var1 + var2;
+  return (t_fine * 5 + 128) >> 8; // 0.01 degC
+}
+
+static int64_t compensatePressure(const bme280_calib_data &c, int32_t adc_P, int32_t t_fine)
+{
+  int64_t p1 = ((int64_t)t_fine) - 128000;
+  int64_t p2 = p1 * p1 * (int64_t)c.dig_P6;
+  p2 = p2 + ((p1 * (int64_t)c.dig_P5) << 17);
+  p2 = p2 + (((int64_t)c.dig_P4) << 35);
+  p1 = ((p1 * p1 * (int64_t)c.dig_P3) >> 8) + ((p1 * (int64_t)c.dig_P2) << 12);
+  p1 = (((((int64_t)1) << 47) + p1)) * ((int64_t)c.dig_P1) >> 33;
+  if (p1 == 0)
+  {
+    return 0;
+  }
+  int64_t p = 1048576 - adc_P;
+  p = (((p << 31) - p2) * 3125) / p1;
+  p1 = (((int64_t)c.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+  p2 = (((int64_t)c.dig_P8) * p) >> 19;
+  return ((p + p1 + p2) >> 8) + (((int64_t)c.dig_P7) << 4); // Pa * 256
+}
+
+static int32_t compensateHumidity(const bme280_calib_data &c, int32_t adc_H, int32_t t_fine)
+{
+  int32_t h = (t_fine - ((int32_t)76800));
+  h = (((((adc_H << 14) - (((int32_t)c.dig_H4) << 20) - (((int32_t)c.dig_H5) * h)) + ((int32_t)16384)) >> 15) *
+       (((((((h * ((int32_t)c.dig_H6)) >> 10) * (((h * ((int32_t)c.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+          ((int32_t)2097152)) * ((int32_t)c.dig_H2) + 8192) >> 14));
+  h = (h - (((((h >> 15) * (h >> 15)) >> 7) * ((int32_t)c.dig_H1)) >> 4));
+  h = (h < 0) ? 0 : h;
+  h = (h > 419430400) ? 419430400 : h;
+  return h >> 12; // %RH * 1024
+}
+
+// Smallest x in [lo, hi] with f(x) >= target, for f non-decreasing
+template <typename F>
+static int32_t bisect(int32_t lo, int32_t hi, int64_t target, F f)
+{
+  while (lo < hi)
+  {
+    int32_t mid = lo + (hi - lo) / 2;
+    if (f(mid) >= target)
+    {
+      hi = mid;
+    }
+    else
+    {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+SimBme280 *findSimulatedBme280(uint8_t bus, uint8_t address)
+{
+  for (SimBme280 &device : bme280s)
+  {
+    if (bus == 0 && device.address == address)
+    {
+      return &device;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Fills the 8-byte measurement block (0xF7-0xFE) for the device's current environment.
+ */
+void readSimulatedBme280Block(SimBme280 &device, uint8_t *block)
+{
+  const bme280_calib_data &c = device.calib;
+  float temperature = drift(22.0f, 2.0f, 900.0f, device.phase) + gaussianNoise(0.01f);
+  float pressure = drift(1013.25f, 1.5f, 3600.0f, device.phase) + gaussianNoise(0.02f);
+  float humidity = std::min(100.0f, std::max(0.0f, drift(45.0f, 8.0f, 1200.0f, device.phase) + gaussianNoise(0.1f)));
+
+  int32_t t_fine;
+  int32_t adc_T = bisect(0, 0xFFFFF, (int64_t)lroundf(temperature * 100), [&](int32_t adc)
+                         { return (int64_t)compensateTemperature(c, adc, t_fine); });
+  compensateTemperature(c, adc_T, t_fine);
+  // Pressure falls as the ADC value rises, so search on the negated output
+  int32_t adc_P = bisect(0, 0xFFFFF, -(int64_t)llroundf(pressure * 100 * 256), [&](int32_t adc)
+                         { return -compensatePressure(c, adc, t_fine); });
+  int32_t adc_H = bisect(0, 0xFFFF, (int64_t)lroundf(humidity * 1024), [&](int32_t adc)
+                         { return (int64_t)compensateHumidity(c, adc, t_fine); });
+
+  // 0x80000 / 0x8000 mean "channel skipped"; a real conversion never lands exactly there
+  if (adc_T == 0x80000)
+    adc_T++;
+  if (adc_P == 0x80000)
+    adc_P++;
+  if (adc_H == 0x8000)
+    adc_H++;
+  if (device.pressureSampling == Adafruit_BME280::SAMPLING_NONE)
+    adc_P = 0x80000;
+  if (device.humiditySampling == Adafruit_BME280::SAMPLING_NONE)
+    adc_H = 0x8000;
+  if (device.temperatureSampling == Adafruit_BME280::SAMPLING_NONE)
+    adc_T = 0x80000;
+
+  block[0] = (uint8_t)(adc_P >> 12);
+  block[1] = (uint8_t)(adc_P >> 4);
+  block[2] = (uint8_t)(adc_P << 4);
+  block[3] = (uint8_t)(adc_T >> 12);
+  block[4] = (uint8_t)(adc_T >> 4);
+  block[5] = (uint8_t)(adc_T << 4);
+  block[6] = (uint8_t)(adc_H >> 8);
+  block[7] = (uint8_t)adc_H;
+}
+
+static uint32_t oversamplingFactor(Adafruit_BME280::sensor_sampling sampling)
+{
+  return sampling == Adafruit_BME280::SAMPLING_NONE ? 0 : 1u << (sampling - 1);
+}
+
+/**
+ * @brief Typical forced-mode measurement time from the datasheet (section 9.1).
+ */
+uint32_t simulatedBme280MeasurementUs(const SimBme280 &device)
+{
+  uint32_t t = oversamplingFactor(device.temperatureSampling);
+  uint32_t p = oversamplingFactor(device.pressureSampling);
+  uint32_t h = oversamplingFactor(device.humiditySampling);
+  return 1000 + 2000 * t + (p ? 2000 * p + 500 : 0) + (h ? 2000 * h + 500 : 0);
+}
+
+// ===== ADS1115 =====
+
+SimAds1115 *findSimulatedAds1115(uint8_t bus, uint8_t address)
+{
+  for (SimAds1115 &device : ads1115s)
+  {
+    if (bus == 0 && device.address == address)
+    {
+      return &device;
+    }
+  }
+  return nullptr;
+}
+
+float readSimulatedAds1115Volts(uint8_t bus, uint8_t address, uint8_t channel)
+{
+  static const float bases[4] = {1.0f, 2.5f, 0.2f, 3.0f};
+  float volts = drift(bases[channel & 3], 0.3f, 300.0f + 60.0f * channel, address * 7 + channel * 100) + gaussianNoise(0.002f);
+  return std::max(0.0f, volts);
+}
+
+// ===== PCA9685 =====
+
+SimPca9685 *findSimulatedPca9685(uint8_t bus, uint8_t address)
+{
+  for (SimPca9685 &device : pca9685s)
+  {
+    if (bus == 0 && device.address == address)
+    {
+      return &device;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<SimPca9685 *> simulatedPca9685sAnswering(uint8_t bus, uint8_t address)
+{
+  // MODE1 enable bits for SUBADR1, SUBADR2, SUBADR3 and ALLCALL
+  static const uint8_t groupBits[4] = {0x08, 0x04, 0x02, 0x01};
+  std::vector<SimPca9685 *> answering;
+  for (SimPca9685 &device : pca9685s)
+  {
+    bool answers = bus == 0 && device.address == address;
+    for (uint8_t g = 0; g < 4 && bus == 0 && !answers; g++)
+    {
+      answers = (device.mode1 & groupBits[g]) && device.subaddress[g] >> 1 == address;
+    }
+    if (answers)
+    {
+      answering.push_back(&device);
+    }
+  }
+  return answering;
+}
+
+// ===== DS18B20 =====
+
+const std::vector<std::vector<uint8_t>> &simulatedRoms()
+{
+  return roms;
+}
+
+static int findRom(const uint8_t *rom)
+{
+  for (size_t i = 0; i < roms.size(); i++)
+  {
+    if (memcmp(roms[i].data(), rom, 8) == 0)
+    {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+bool isSimulatedRomPresent(const uint8_t *rom)
+{
+  return findRom(rom) >= 0;
+}
+
+/**
+ * @brief Returns the probe's temperature at 12-bit resolution (1/16 degC steps).
+ */
+float readSimulatedDs18b20(const uint8_t *rom)
+{
+  int index = findRom(rom);
+  float temperature = drift(20.0f + 0.7f * index, 1.5f, 600.0f, rom[1] * 31 + rom[2]) + gaussianNoise(0.03f);
+  return roundf(temperature * 16.0f) / 16.0f;
+}
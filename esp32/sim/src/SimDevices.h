@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Adafruit_BME280.h>
+
+#include <vector>
+
+/**
+ * @brief Options for one simulated board, set from the command line.
+ *
+ * Latency and noise are scale factors on the real parts' figures: 1.0 gives
+ * datasheet conversion times and typical sensor noise, 0 makes everything instant
+ * and exact. faultRate is the probability that any single bus transaction fails.
+ */
+struct SimConfig
+{
+  uint16_t port = 8080;
+  uint8_t ds18b20Count = 2;
+  uint8_t bme280Count = 1;
+  uint8_t ads1115Count = 1;
+  uint8_t pca9685Count = 1;
+  float latencyScale = 1.0f;
+  float noiseScale = 1.0f;
+  float faultRate = 0.0f;
+  uint32_t seed = 1;
+  uint16_t maxConnections = 16; // CONFIG_LWIP_MAX_ACTIVE_TCP on the ESP32
+  String statePath;
+  String firmwarePath;   // app image the board runs and OTA replaces
+  uint32_t linkKbps = 0; // Wi-Fi throughput shared by every transfer, 0 = unlimited
+  bool verbose = false;
+};
+
+extern SimConfig simConfig;
+
+void beginSimulation(const SimConfig &config);
+
+// ===== Tasks =====
+// Runs the calling thread as the named task, created on first use. Threads
+// that bind the same name share one handle, as connection threads do for async_tcp.
+void simBindCurrentTask(const char *name);
+
+// ===== Timing and faults =====
+void simulateDelayUs(uint32_t us);
+bool injectFault();
+// Waits for the link to carry this many bytes, behind transfers already queued on it
+void simulateLinkTransfer(size_t bytes);
+float gaussianNoise(float sigma);
+
+// ===== I2C =====
+bool isSimulatedI2CDevicePresent(uint8_t bus, uint8_t address);
+// Unplugging takes every I2C device off the bus; plugging them back in resets their registers to power-on
+void setSimulatedI2CDevicesPlugged(bool plugged);
+bool areSimulatedI2CDevicesPlugged();
+// Applies a raw write (register address, then data) to the device, if it models its registers
+void writeSimulatedI2CRegisters(uint8_t bus, uint8_t address, const uint8_t *data, size_t length);
+
+struct SimBme280
+{
+  uint8_t address;
+  bme280_calib_data calib;
+  Adafruit_BME280::sensor_sampling temperatureSampling;
+  Adafruit_BME280::sensor_sampling pressureSampling;
+  Adafruit_BME280::sensor_sampling humiditySampling;
+  uint32_t phase;
+};
+SimBme280 *findSimulatedBme280(uint8_t bus, uint8_t address);
+void readSimulatedBme280Block(SimBme280 &device, uint8_t *block);
+uint32_t simulatedBme280MeasurementUs(const SimBme280 &device);
+
+struct SimAds1115
+{
+  uint8_t address;
+  uint16_t config;         // config register; OS (bit 15) reads back 1 once a conversion is done
+  int64_t conversionEndUs; // esp_timer time the running single-shot conversion finishes
+  int16_t conversion;      // conversion register
+};
+SimAds1115 *findSimulatedAds1115(uint8_t bus, uint8_t address);
+float readSimulatedAds1115Volts(uint8_t bus, uint8_t address, uint8_t channel);
+
+struct SimPca9685
+{
+  uint8_t address;
+  uint8_t mode1;
+  uint8_t subaddress[4]; // SUBADR1-3 and ALLCALLADR (registers 0x02-0x05), 8-bit form
+  uint16_t on[16];
+  uint16_t off[16];
+  uint8_t prescale;
+};
+SimPca9685 *findSimulatedPca9685(uint8_t bus, uint8_t address);
+// Chips that answer an address, either their own or a group address enabled in MODE1
+std::vector<SimPca9685 *> simulatedPca9685sAnswering(uint8_t bus, uint8_t address);
+
+// ===== 1-Wire =====
+const std::vector<std::vector<uint8_t>> &simulatedRoms();
+bool isSimulatedRomPresent(const uint8_t *rom);
+float readSimulatedDs18b20(const uint8_t *rom);
+
+// ===== Flash =====
+// The app image is the --firmware file as it was at start; an update replaces
+// the file, which the running board keeps reading until it restarts.
+size_t simulatedFirmwareSize();
+bool readSimulatedFirmware(size_t offset, uint8_t *buffer, size_t length);
+
+// ===== Runtime hooks =====
+void markHandlerBusy(bool busy);
+void restartSimulation();
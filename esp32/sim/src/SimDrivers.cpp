@@ -0,0 +1,668 @@
+// Sensor and output libraries on top of the simulated devices. Each call costs
+// the bus and conversion time the real part would, and can fail by injection.
+
+#include <Adafruit_ADS1X15.h>
+#include <Adafruit_BME280.h>
+#include <Adafruit_PWMServoDriver.h>
+#include <DallasTemperature.h>
+#include <OneWire.h>
+#include <Wire.h>
+#include <esp_timer.h>
+
+#include <mutex>
+
+#include "SimDevices.h"
+
+TwoWire Wire(0);
+TwoWire Wire1(1);
+
+// ===== I2C =====
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency)
+{
+  if (frequency != 0)
+  {
+    _frequency = frequency;
+  }
+  return true;
+}
+
+bool TwoWire::end()
+{
+  return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency)
+{
+  _frequency = frequency;
+  return true;
+}
+
+void TwoWire::simulateTransfer(size_t bytes)
+{
+  // 9 clocks per byte (8 data + ACK), plus start/stop
+  simulateDelayUs((uint32_t)((bytes * 9 + 2) * 1000000ULL / _frequency));
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  _address = address;
+  _pending = 0;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  size_t length = _pending;
+  simulateTransfer(1 + length);
+  _pending = 0;
+  if (!isSimulatedI2CDevicePresent(_bus, _address))
+  {
+    return 2; // NACK on address
+  }
+  if (injectFault())
+  {
+    return 4;
+  }
+  writeSimulatedI2CRegisters(_bus, _address, _buffer, length);
+  return 0;
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t size, bool sendStop)
+{
+  simulateTransfer(1 + size);
+  return 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  return write(&data, 1);
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t size)
+{
+  size = std::min(size, sizeof(_buffer) - _pending); // the ESP32 driver drops bytes past its buffer too
+  memcpy(_buffer + _pending, data, size);
+  _pending += size;
+  return size;
+}
+
+bool Adafruit_I2CDevice::detected()
+{
+  _wire->beginTransmission(_address);
+  return _wire->endTransmission() == 0;
+}
+
+bool Adafruit_I2CDevice::write(const uint8_t *buffer, size_t len, bool stop, const uint8_t *prefix_buffer, size_t prefix_len)
+{
+  _wire->beginTransmission(_address);
+  if (prefix_len > 0)
+  {
+    _wire->write(prefix_buffer, prefix_len);
+  }
+  _wire->write(buffer, len);
+  return _wire->endTransmission(stop) == 0;
+}
+
+static std::mutex pca9685Mutex;
+static std::mutex ads1115Mutex;
+
+static float ads1115FullScale(adsGain_t gain)
+{
+  switch (gain)
+  {
+  case GAIN_TWOTHIRDS:
+    return 6.144f;
+  case GAIN_ONE:
+    return 4.096f;
+  case GAIN_TWO:
+    return 2.048f;
+  case GAIN_FOUR:
+    return 1.024f;
+  case GAIN_EIGHT:
+    return 0.512f;
+  case GAIN_SIXTEEN:
+    return 0.256f;
+  default:
+    return 2.048f;
+  }
+}
+
+static uint16_t readAds1115Register(const SimAds1115 &device, uint8_t reg)
+{
+  if (reg == 0x00)
+  {
+    return (uint16_t)device.conversion;
+  }
+  if (reg == 0x01)
+  {
+    return esp_timer_get_time() >= device.conversionEndUs ? device.config | 0x8000 : device.config & 0x7FFF;
+  }
+  if (reg == 0x02)
+  {
+    return 0x8000; // Lo_thresh
+  }
+  if (reg == 0x03)
+  {
+    return 0x7FFF; // Hi_thresh
+  }
+  return 0;
+}
+
+// Setting OS while idle starts a single-shot conversion: the input is sampled now and lands in the conversion register
+static void writeAds1115Config(uint8_t bus, SimAds1115 &device, uint16_t config)
+{
+  bool idle = esp_timer_get_time() >= device.conversionEndUs;
+  device.config = config & 0x7FFF;
+  if (!(config & 0x8000) || !idle)
+  {
+    return;
+  }
+  // MUX: 0-3 are the differential pairs, 4-7 the inputs against GND
+  static const uint8_t positive[8] = {0, 0, 1, 2, 0, 1, 2, 3};
+  static const int8_t negative[4] = {1, 3, 3, 3};
+  uint8_t mux = (config >> 12) & 7;
+  float volts = readSimulatedAds1115Volts(bus, device.address, positive[mux]);
+  if (mux < 4)
+  {
+    volts -= readSimulatedAds1115Volts(bus, device.address, negative[mux]);
+  }
+  float counts = volts / ads1115FullScale((adsGain_t)std::min(config & 0x0E00, 0x0A00)) * 32768.0f;
+  device.conversion = (int16_t)std::max(-32768.0f, std::min(32767.0f, roundf(counts)));
+
+  static const uint16_t rates[8] = {8, 16, 32, 64, 128, 250, 475, 860};
+  device.conversionEndUs = esp_timer_get_time() + (int64_t)(1000000.0f / rates[(config >> 5) & 7] * simConfig.latencyScale);
+}
+
+static uint8_t readPca9685Register(const SimPca9685 &device, uint8_t reg)
+{
+  if (reg == 0x00)
+  {
+    return device.mode1;
+  }
+  if (reg >= 0x02 && reg <= 0x05)
+  {
+    return device.subaddress[reg - 0x02];
+  }
+  if (reg >= 0x06 && reg < 0x46)
+  {
+    uint8_t channel = (reg - 0x06) / 4;
+    uint16_t value = (reg - 0x06) % 4 >= 2 ? device.off[channel] : device.on[channel];
+    return (reg - 0x06) % 2 == 0 ? (uint8_t)value : (uint8_t)(value >> 8);
+  }
+  if (reg == 0xFE)
+  {
+    return device.prescale;
+  }
+  return 0;
+}
+
+bool Adafruit_I2CDevice::write_then_read(const uint8_t *writeBuffer, size_t writeLen, uint8_t *readBuffer, size_t readLen, bool stop)
+{
+  _wire->simulateTransfer(2 + writeLen + readLen);
+  if (!isSimulatedI2CDevicePresent(_wire->busNum(), _address) || injectFault())
+  {
+    return false;
+  }
+
+  SimBme280 *bme280 = findSimulatedBme280(_wire->busNum(), _address);
+  if (bme280 != nullptr && writeLen == 1 && writeBuffer[0] == BME280_REGISTER_PRESSUREDATA && readLen <= 8)
+  {
+    uint8_t block[8];
+    readSimulatedBme280Block(*bme280, block);
+    memcpy(readBuffer, block, readLen);
+    return true;
+  }
+
+  SimAds1115 *ads1115 = findSimulatedAds1115(_wire->busNum(), _address);
+  if (ads1115 != nullptr && writeLen == 1)
+  {
+    // Registers are 16 bits, most significant byte first
+    std::lock_guard<std::mutex> lock(ads1115Mutex);
+    uint16_t value = readAds1115Register(*ads1115, writeBuffer[0]);
+    uint8_t bytes[2] = {(uint8_t)(value >> 8), (uint8_t)value};
+    memset(readBuffer, 0, readLen);
+    memcpy(readBuffer, bytes, std::min(readLen, sizeof(bytes)));
+    return true;
+  }
+
+  SimPca9685 *pca9685 = findSimulatedPca9685(_wire->busNum(), _address);
+  if (pca9685 != nullptr && writeLen == 1)
+  {
+    // Register auto-increment, as the driver enables it: each byte read comes from the next register
+    std::lock_guard<std::mutex> lock(pca9685Mutex);
+    uint8_t reg = writeBuffer[0];
+    for (size_t i = 0; i < readLen; i++)
+    {
+      readBuffer[i] = readPca9685Register(*pca9685, reg);
+      reg = (pca9685->mode1 & 0x20) ? reg + 1 : reg;
+    }
+    return true;
+  }
+
+  memset(readBuffer, 0, readLen);
+  return true;
+}
+
+// ===== BME280 =====
+
+Adafruit_BME280::~Adafruit_BME280()
+{
+  delete i2c_dev;
+}
+
+// Like the library: a new I2C device on every call, freed by the next call or the destructor
+bool Adafruit_BME280::begin(uint8_t address, TwoWire *wire)
+{
+  delete i2c_dev;
+  i2c_dev = new Adafruit_I2CDevice(address, wire);
+  if (!i2c_dev->begin())
+  {
+    return false;
+  }
+  return init();
+}
+
+bool Adafruit_BME280::init()
+{
+  _address = i2c_dev->address();
+  _wire = i2c_dev->wire();
+  SimBme280 *device = findSimulatedBme280(_wire->busNum(), _address);
+  if (device == nullptr || !i2c_dev->detected())
+  {
+    return false;
+  }
+  // Chip ID, soft reset, NVM copy wait and the calibration block reads
+  _wire->simulateTransfer(4 + 4 + 2 + 26 + 2 + 7);
+  simulateDelayUs(10000);
+  _sensorID = 0x60;
+  _bme280_calib = device->calib;
+  setSampling();
+  return true;
+}
+
+void Adafruit_BME280::setSampling(sensor_mode mode, sensor_sampling tempSampling, sensor_sampling pressSampling,
+                                  sensor_sampling humSampling, sensor_filter filter, standby_duration duration)
+{
+  _wire->simulateTransfer(2 * 4);
+  SimBme280 *device = findSimulatedBme280(_wire->busNum(), _address);
+  if (device != nullptr)
+  {
+    device->temperatureSampling = tempSampling;
+    device->pressureSampling = pressSampling;
+    device->humiditySampling = humSampling;
+  }
+}
+
+bool Adafruit_BME280::takeForcedMeasurement()
+{
+  SimBme280 *device = findSimulatedBme280(_wire->busNum(), _address);
+  _wire->simulateTransfer(3);
+  if (device == nullptr || injectFault())
+  {
+    return false;
+  }
+  simulateDelayUs(simulatedBme280MeasurementUs(*device));
+  _wire->simulateTransfer(3); // status poll
+  return true;
+}
+
+// The firmware reads all channels through its own burst read; these cover any stock-driver callers
+float Adafruit_BME280::readTemperature()
+{
+  uint8_t reg = BME280_REGISTER_PRESSUREDATA;
+  uint8_t buf[8];
+  if (i2c_dev == nullptr || !i2c_dev->write_then_read(&reg, 1, buf, sizeof(buf)))
+  {
+    return NAN;
+  }
+  int32_t adc_T = ((uint32_t)buf[3] << 12) | ((uint32_t)buf[4] << 4) | (buf[5] >> 4);
+  int32_t var1 = ((((adc_T >> 3) - ((int32_t)_bme280_calib.dig_T1 << 1))) * ((int32_t)_bme280_calib.dig_T2)) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - ((int32_t)_bme280_calib.dig_T1)) * ((adc_T >> 4) - ((int32_t)_bme280_calib.dig_T1))) >> 12) *
+                  ((int32_t)_bme280_calib.dig_T3)) >> 14;
+  t_fine = var1 + var2 + t_fine_adjust;
+  return (float)((t_fine * 5 + 128) >> 8) / 100.0F;
+}
+
+float Adafruit_BME280::readPressure()
+{
+  return NAN;
+}
+
+float Adafruit_BME280::readHumidity()
+{
+  return NAN;
+}
+
+// ===== ADS1115 =====
+
+bool Adafruit_ADS1X15::begin(uint8_t address, TwoWire *wire)
+{
+  m_address = address;
+  m_wire = wire;
+  wire->beginTransmission(address);
+  return wire->endTransmission() == 0;
+}
+
+// The firmware converts through the chip's registers; this covers any stock-driver callers
+int16_t Adafruit_ADS1X15::readADC_SingleEnded(uint8_t channel)
+{
+  if (channel > 3)
+  {
+    return 0;
+  }
+  static const uint16_t rates[8] = {8, 16, 32, 64, 128, 250, 475, 860};
+  uint16_t sps = rates[(m_dataRate >> 5) & 7];
+
+  m_wire->simulateTransfer(4);     // config write
+  simulateDelayUs(1000000 / sps);  // single-shot conversion
+  m_wire->simulateTransfer(2 + 3); // conversion register read
+  if (injectFault())
+  {
+    return 0; // the library cannot report a failed read either
+  }
+
+  float counts = readSimulatedAds1115Volts(m_wire->busNum(), m_address, channel) / ads1115FullScale(m_gain) * 32768.0f;
+  return (int16_t)std::max(-32768.0f, std::min(32767.0f, roundf(counts)));
+}
+
+float Adafruit_ADS1X15::computeVolts(int16_t counts)
+{
+  return counts * (ads1115FullScale(m_gain) / 32768.0f);
+}
+
+// ===== PCA9685 =====
+
+bool Adafruit_PWMServoDriver::begin(uint8_t prescale)
+{
+  delete i2c_dev;
+  i2c_dev = new Adafruit_I2CDevice(_i2caddr, _wire);
+  i2c_dev->begin();
+  reset();
+  if (prescale)
+  {
+    SimPca9685 *device = findSimulatedPca9685(_wire->busNum(), _i2caddr);
+    if (device != nullptr)
+    {
+      device->prescale = prescale;
+    }
+  }
+  else
+  {
+    setPWMFreq(1000);
+  }
+  return true;
+}
+
+void Adafruit_PWMServoDriver::reset()
+{
+  _wire->simulateTransfer(2);
+  simulateDelayUs(10000);
+  SimPca9685 *device = findSimulatedPca9685(_wire->busNum(), _i2caddr);
+  if (device != nullptr)
+  {
+    device->mode1 = 0x00; // writing RESTART alone also clears SLEEP and ALLCALL
+  }
+}
+
+void Adafruit_PWMServoDriver::sleep()
+{
+  _wire->simulateTransfer(4);
+}
+
+void Adafruit_PWMServoDriver::wakeup()
+{
+  _wire->simulateTransfer(4);
+}
+
+void Adafruit_PWMServoDriver::setPWMFreq(float frequency)
+{
+  frequency = std::max(1.0f, std::min(3500.0f, frequency));
+  float prescale = ((_oscillator_freq / (frequency * 4096.0f)) + 0.5f) - 1;
+  prescale = std::max((float)PCA9685_PRESCALE_MIN, std::min((float)PCA9685_PRESCALE_MAX, prescale));
+  _wire->simulateTransfer(4 * 3); // sleep, prescale, wake, restart
+  simulateDelayUs(5000);
+  SimPca9685 *device = findSimulatedPca9685(_wire->busNum(), _i2caddr);
+  if (device != nullptr)
+  {
+    device->prescale = (uint8_t)prescale;
+    device->mode1 |= 0x20; // the driver leaves auto-increment on
+  }
+}
+
+uint8_t Adafruit_PWMServoDriver::readPrescale()
+{
+  _wire->simulateTransfer(4);
+  SimPca9685 *device = findSimulatedPca9685(_wire->busNum(), _i2caddr);
+  return device != nullptr ? device->prescale : 0;
+}
+
+uint16_t Adafruit_PWMServoDriver::getPWM(uint8_t num, bool off)
+{
+  uint8_t reg = (uint8_t)(0x06 + 4 * num + (off ? 2 : 0));
+  uint8_t buf[2] = {0, 0};
+  Adafruit_I2CDevice device(_i2caddr, _wire);
+  device.write_then_read(&reg, 1, buf, 2);
+  return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static void writePca9685Register(SimPca9685 &device, uint8_t reg, uint8_t data)
+{
+  if (reg == 0x00)
+  {
+    device.mode1 = data & 0x7F; // RESTART clears itself
+  }
+  else if (reg >= 0x02 && reg <= 0x05)
+  {
+    device.subaddress[reg - 0x02] = data;
+  }
+  else if (reg >= 0x06 && reg < 0x46)
+  {
+    uint8_t channel = (reg - 0x06) / 4;
+    uint16_t &value = (reg - 0x06) % 4 >= 2 ? device.off[channel] : device.on[channel];
+    value = (reg - 0x06) % 2 == 0 ? (value & 0x1F00) | data : (value & 0x00FF) | ((data & 0x1F) << 8);
+  }
+  else if (reg == 0xFE && (device.mode1 & 0x10))
+  {
+    device.prescale = data; // the chip ignores the prescaler unless its oscillator sleeps
+  }
+}
+
+void writeSimulatedI2CRegisters(uint8_t bus, uint8_t address, const uint8_t *data, size_t length)
+{
+  if (length < 2)
+  {
+    return;
+  }
+  SimAds1115 *ads1115 = findSimulatedAds1115(bus, address);
+  if (ads1115 != nullptr)
+  {
+    if (length >= 3 && data[0] == 0x01)
+    {
+      std::lock_guard<std::mutex> lock(ads1115Mutex);
+      writeAds1115Config(bus, *ads1115, (uint16_t)((data[1] << 8) | data[2]));
+    }
+    return;
+  }
+  // Every chip answering a group address takes the same bytes, as they all see the one transaction
+  std::lock_guard<std::mutex> lock(pca9685Mutex);
+  for (SimPca9685 *device : simulatedPca9685sAnswering(bus, address))
+  {
+    // Register auto-increment, as the driver enables it: bytes after the first land in consecutive registers
+    uint8_t reg = data[0];
+    for (size_t i = 1; i < length; i++)
+    {
+      writePca9685Register(*device, reg, data[i]);
+      reg = (device->mode1 & 0x20) ? reg + 1 : reg;
+    }
+  }
+}
+
+uint8_t Adafruit_PWMServoDriver::setPWM(uint8_t num, uint16_t on, uint16_t off)
+{
+  _wire->simulateTransfer(1 + 5);
+  SimPca9685 *device = findSimulatedPca9685(_wire->busNum(), _i2caddr);
+  if (device == nullptr || num > 15 || injectFault())
+  {
+    return 2;
+  }
+  std::lock_guard<std::mutex> lock(pca9685Mutex);
+  device->on[num] = on & 0x1FFF;
+  device->off[num] = off & 0x1FFF;
+  return 0;
+}
+
+void Adafruit_PWMServoDriver::setPin(uint8_t num, uint16_t value, bool invert)
+{
+  value = std::min(value, (uint16_t)4095);
+  if (invert)
+  {
+    value = 4095 - value;
+  }
+  if (value == 4095)
+  {
+    setPWM(num, 4096, 0); // full on
+  }
+  else if (value == 0)
+  {
+    setPWM(num, 0, 4096); // full off
+  }
+  else
+  {
+    setPWM(num, 0, value);
+  }
+}
+
+// ===== 1-Wire =====
+
+// Reset pulse and presence detect
+static const uint32_t ONEWIRE_RESET_US = 960;
+// One ROM search pass: 64 bits x (2 read slots + 1 write slot) at ~65 us per slot
+static const uint32_t ONEWIRE_SEARCH_US = 64 * 3 * 65;
+// MATCH ROM, function command and a scratchpad read of 9 bytes
+static const uint32_t ONEWIRE_SCRATCHPAD_US = (8 + 64 + 8 + 72) * 65;
+
+uint8_t OneWire::reset()
+{
+  simulateDelayUs(ONEWIRE_RESET_US);
+  return simulatedRoms().empty() ? 0 : 1;
+}
+
+bool OneWire::search(uint8_t *newAddr, bool searchMode)
+{
+  const std::vector<std::vector<uint8_t>> &roms = simulatedRoms();
+  simulateDelayUs(ONEWIRE_RESET_US + ONEWIRE_SEARCH_US);
+  if (_searchIndex >= roms.size() || injectFault())
+  {
+    _searchIndex = 0;
+    return false;
+  }
+  memcpy(newAddr, roms[_searchIndex].data(), 8);
+  _searchIndex++;
+  return true;
+}
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+  uint8_t crc = 0;
+  while (len--)
+  {
+    uint8_t inbyte = *addr++;
+    for (uint8_t i = 8; i; i--)
+    {
+      uint8_t mix = (crc ^ inbyte) & 0x01;
+      crc >>= 1;
+      if (mix)
+        crc ^= 0x8C;
+      inbyte >>= 1;
+    }
+  }
+  return crc;
+}
+
+void DallasTemperature::begin()
+{
+  _wire->reset_search();
+  uint8_t address[8];
+  while (_wire->search(address))
+  {
+  }
+}
+
+uint8_t DallasTemperature::getDeviceCount()
+{
+  return (uint8_t)simulatedRoms().size();
+}
+
+bool DallasTemperature::getAddress(uint8_t *address, uint8_t index)
+{
+  if (index >= simulatedRoms().size())
+  {
+    return false;
+  }
+  memcpy(address, simulatedRoms()[index].data(), 8);
+  return true;
+}
+
+bool DallasTemperature::isConnected(const uint8_t *address)
+{
+  simulateDelayUs(ONEWIRE_RESET_US + ONEWIRE_SCRATCHPAD_US);
+  return isSimulatedRomPresent(address) && !injectFault();
+}
+
+uint16_t DallasTemperature::millisToWaitForConversion(uint8_t bits)
+{
+  switch (bits)
+  {
+  case 9:
+    return 94;
+  case 10:
+    return 188;
+  case 11:
+    return 375;
+  default:
+    return 750;
+  }
+}
+
+DallasTemperature::request_t DallasTemperature::requestTemperatures()
+{
+  simulateDelayUs(ONEWIRE_RESET_US + 16 * 65); // SKIP ROM + CONVERT T
+  if (_waitForConversion)
+  {
+    simulateDelayUs(millisToWaitForConversion(_resolution) * 1000);
+  }
+  else
+  {
+    _conversionEndUs = esp_timer_get_time() + millisToWaitForConversion(_resolution) * 1000;
+  }
+  request_t request = {true, millis()};
+  return request;
+}
+
+// Probes hold the bus low while converting, so one read slot tells
+bool DallasTemperature::isConversionComplete()
+{
+  simulateDelayUs(65);
+  return esp_timer_get_time() >= _conversionEndUs;
+}
+
+DallasTemperature::request_t DallasTemperature::requestTemperaturesByAddress(const uint8_t *address)
+{
+  simulateDelayUs(ONEWIRE_RESET_US + 72 * 65); // MATCH ROM + CONVERT T
+  if (_waitForConversion)
+  {
+    simulateDelayUs(millisToWaitForConversion(_resolution) * 1000);
+  }
+  request_t request = {isSimulatedRomPresent(address), millis()};
+  return request;
+}
+
+float DallasTemperature::getTempC(const uint8_t *address)
+{
+  simulateDelayUs(ONEWIRE_RESET_US + ONEWIRE_SCRATCHPAD_US);
+  if (!isSimulatedRomPresent(address) || injectFault())
+  {
+    return DEVICE_DISCONNECTED_C;
+  }
+  return readSimulatedDs18b20(address);
+}
@@ -0,0 +1,621 @@
+// ESP-IDF and network services: power management, Wi-Fi config, mDNS, NVS, flash, OTA and SHA-256.
+
+#include <Arduino.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <esp_ota_ops.h>
+#include <esp_pm.h>
+#include <esp_wifi.h>
+#include <mbedtls/sha256.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SimDevices.h"
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+UpdateClass Update;
+
+// ===== Power management =====
+
+struct esp_pm_lock
+{
+};
+
+esp_err_t esp_pm_configure(const void *config)
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char *name, esp_pm_lock_handle_t *handle)
+{
+  *handle = new esp_pm_lock();
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+  return ESP_OK;
+}
+
+// ===== Wi-Fi =====
+
+static wifi_config_t staConfig = {};
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *config)
+{
+  if (interface != WIFI_IF_STA)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (staConfig.sta.listen_interval == 0)
+  {
+    staConfig.sta.listen_interval = 3; // what WiFi.begin() writes
+  }
+  *config = staConfig;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *config)
+{
+  if (interface != WIFI_IF_STA)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  staConfig = *config;
+  return ESP_OK;
+}
+
+String WiFiClass::macAddress()
+{
+  uint64_t mac = ESP.getEfuseMac();
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", (uint8_t)mac, (uint8_t)(mac >> 8), (uint8_t)(mac >> 16),
+           (uint8_t)(mac >> 24), (uint8_t)(mac >> 32), (uint8_t)(mac >> 40));
+  return String(buf);
+}
+
+// ===== mDNS =====
+
+bool MDNSResponder::begin(const String &hostname)
+{
+  if (simConfig.verbose)
+  {
+    Serial.printf("mDNS: hostname %s.local\n", hostname.c_str());
+  }
+  return true;
+}
+
+void MDNSResponder::end()
+{
+}
+
+bool MDNSResponder::addService(const char *service, const char *proto, uint16_t port)
+{
+  if (simConfig.verbose)
+  {
+    Serial.printf("mDNS: _%s._%s on port %u\n", service, proto, simConfig.port);
+  }
+  return true;
+}
+
+bool MDNSResponder::addServiceTxt(const char *service, const char *proto, const char *key, const char *value)
+{
+  if (simConfig.verbose)
+  {
+    Serial.printf("mDNS: _%s._%s TXT %s=%s\n", service, proto, key, value);
+  }
+  return true;
+}
+
+// ===== NVS =====
+// All namespaces share one store. With --state it is loaded on first use and
+// rewritten whenever a namespace that changed is closed. Each line of the file
+// is "<namespace> <key> <hex bytes>".
+
+typedef std::map<std::string, std::vector<uint8_t>> NvsNamespace;
+
+static std::mutex nvsMutex;
+static std::map<std::string, NvsNamespace> nvs;
+static bool nvsLoaded = false;
+
+// NVS limits namespace and key names to 15 characters
+static const size_t NVS_KEY_NAME_MAX_SIZE = 15;
+
+static void loadNvs()
+{
+  if (nvsLoaded)
+  {
+    return;
+  }
+  nvsLoaded = true;
+  if (simConfig.statePath.isEmpty())
+  {
+    return;
+  }
+  std::ifstream file(simConfig.statePath.c_str());
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream fields(line);
+    std::string ns, key, hex;
+    if (!(fields >> ns >> key))
+    {
+      continue;
+    }
+    fields >> hex;
+    std::vector<uint8_t> value;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+    {
+      value.push_back((uint8_t)strtoul(hex.substr(i, 2).c_str(), nullptr, 16));
+    }
+    nvs[ns][key] = value;
+  }
+}
+
+static void saveNvs()
+{
+  if (simConfig.statePath.isEmpty())
+  {
+    return;
+  }
+  std::string tmpPath = simConfig.statePath.str() + ".tmp";
+  {
+    std::ofstream file(tmpPath.c_str(), std::ios::trunc);
+    for (const auto &ns : nvs)
+    {
+      for (const auto &entry : ns.second)
+      {
+        file << ns.first << ' ' << entry.first << ' ';
+        for (uint8_t b : entry.second)
+        {
+          char hex[3];
+          snprintf(hex, sizeof(hex), "%02x", b);
+          file << hex;
+        }
+        file << '\n';
+      }
+    }
+  }
+  rename(tmpPath.c_str(), simConfig.statePath.c_str());
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partition)
+{
+  end();
+  if (name == nullptr || strlen(name) == 0 || strlen(name) > NVS_KEY_NAME_MAX_SIZE)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  loadNvs();
+  // Opening a namespace that was never written fails in read-only mode, as on the chip
+  if (readOnly && nvs.find(name) == nvs.end())
+  {
+    return false;
+  }
+  nvs[name];
+  _namespace = name;
+  _readOnly = readOnly;
+  _dirty = false;
+  _open = true;
+  return true;
+}
+
+void Preferences::end()
+{
+  if (!_open)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  if (_dirty)
+  {
+    saveNvs();
+  }
+  _open = false;
+  _dirty = false;
+}
+
+bool Preferences::clear()
+{
+  if (!_open || _readOnly)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvs[_namespace.str()].clear();
+  _dirty = true;
+  return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+  if (!_open || _readOnly)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  bool removed = nvs[_namespace.str()].erase(key) > 0;
+  _dirty = _dirty || removed;
+  return removed;
+}
+
+bool Preferences::isKey(const char *key)
+{
+  if (!_open)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  const NvsNamespace &ns = nvs[_namespace.str()];
+  return ns.find(key) != ns.end();
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+  if (!_open || _readOnly || key == nullptr || strlen(key) > NVS_KEY_NAME_MAX_SIZE)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  const uint8_t *bytes = (const uint8_t *)value;
+  nvs[_namespace.str()][key] = std::vector<uint8_t>(bytes, bytes + len);
+  _dirty = true;
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+  if (!_open)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  const NvsNamespace &ns = nvs[_namespace.str()];
+  NvsNamespace::const_iterator entry = ns.find(key);
+  return entry == ns.end() ? 0 : entry->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLen)
+{
+  if (!_open)
+  {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  const NvsNamespace &ns = nvs[_namespace.str()];
+  NvsNamespace::const_iterator entry = ns.find(key);
+  if (entry == ns.end() || entry->second.size() > maxLen)
+  {
+    return 0;
+  }
+  memcpy(buffer, entry->second.data(), entry->second.size());
+  return entry->second.size();
+}
+
+String Preferences::getString(const char *key, const String &defaultValue)
+{
+  size_t len = getBytesLength(key);
+  if (len == 0)
+  {
+    return isKey(key) ? String() : defaultValue;
+  }
+  std::string value(len, '\0');
+  getBytes(key, &value[0], len);
+  return String(value);
+}
+
+// ===== Flash and OTA =====
+// The default partition table's app slots; an image must fit one
+static const uint32_t APP_PARTITION_SIZE = 0x140000;
+
+static int firmwareFd = -2; // not opened yet
+static size_t firmwareSize = 0;
+static std::mutex firmwareMutex;
+
+// Opened once, so the board keeps the image it started with after an update renames a new one into place
+static bool openFirmware()
+{
+  std::lock_guard<std::mutex> lock(firmwareMutex);
+  if (firmwareFd == -2)
+  {
+    firmwareFd = simConfig.firmwarePath.isEmpty() ? -1 : open(simConfig.firmwarePath.c_str(), O_RDONLY | O_CLOEXEC);
+    off_t end = firmwareFd >= 0 ? lseek(firmwareFd, 0, SEEK_END) : 0;
+    firmwareSize = end > 0 ? (size_t)end : 0;
+  }
+  return firmwareFd >= 0;
+}
+
+size_t simulatedFirmwareSize()
+{
+  return openFirmware() ? firmwareSize : 0;
+}
+
+bool readSimulatedFirmware(size_t offset, uint8_t *buffer, size_t length)
+{
+  return openFirmware() && offset + length <= firmwareSize && pread(firmwareFd, buffer, length, (off_t)offset) == (ssize_t)length;
+}
+
+uint32_t EspClass::getSketchSize()
+{
+  return (uint32_t)simulatedFirmwareSize();
+}
+
+static const esp_partition_t app0 = {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, APP_PARTITION_SIZE, "app0"};
+static const esp_partition_t spiffs = {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x290000, 0x160000, "spiffs"};
+static const size_t FLASH_SECTOR_SIZE = 4096;
+static std::vector<uint8_t> spiffsData(spiffs.size, 0xFF);
+static std::mutex spiffsMutex;
+
+const esp_partition_t *esp_ota_get_running_partition()
+{
+  return &app0;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+  for (const esp_partition_t *partition : {&app0, &spiffs})
+  {
+    if (partition->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || partition->subtype == subtype) &&
+        (label == nullptr || strcmp(label, partition->label) == 0))
+    {
+      return partition;
+    }
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t srcOffset, void *dst, size_t size)
+{
+  if (partition == nullptr || srcOffset + size > partition->size)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (partition == &spiffs)
+  {
+    std::lock_guard<std::mutex> lock(spiffsMutex);
+    memcpy(dst, &spiffsData[srcOffset], size);
+    return ESP_OK;
+  }
+  return readSimulatedFirmware(srcOffset, (uint8_t *)dst, size) ? ESP_OK : ESP_FAIL;
+}
+
+// Like NOR flash, a write can only clear bits; erasing sets a whole sector back to 0xFF
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dstOffset, const void *src, size_t size)
+{
+  if (partition != &spiffs || dstOffset + size > partition->size)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(spiffsMutex);
+  for (size_t i = 0; i < size; i++)
+  {
+    spiffsData[dstOffset + i] &= ((const uint8_t *)src)[i];
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+  if (partition != &spiffs || offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0 || offset + size > partition->size)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(spiffsMutex);
+  memset(&spiffsData[offset], 0xFF, size);
+  return ESP_OK;
+}
+
+static std::string stagedFirmwarePath()
+{
+  return simConfig.firmwarePath.str() + ".staged";
+}
+
+bool UpdateClass::begin(size_t size, int command)
+{
+  abort();
+  if (simConfig.firmwarePath.isEmpty())
+  {
+    _error = UPDATE_ERROR_WRITE;
+    return false;
+  }
+  if (size != UPDATE_SIZE_UNKNOWN && size > APP_PARTITION_SIZE)
+  {
+    _error = UPDATE_ERROR_SPACE;
+    return false;
+  }
+  _file = fopen(stagedFirmwarePath().c_str(), "wb");
+  if (_file == nullptr)
+  {
+    _error = UPDATE_ERROR_WRITE;
+    return false;
+  }
+  _size = size;
+  _written = 0;
+  _error = UPDATE_ERROR_OK;
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t *data, size_t len)
+{
+  if (_file == nullptr || _written + len > APP_PARTITION_SIZE)
+  {
+    _error = _file == nullptr ? UPDATE_ERROR_WRITE : UPDATE_ERROR_SPACE;
+    return 0;
+  }
+  size_t n = fwrite(data, 1, len, _file);
+  _written += n;
+  return n;
+}
+
+bool UpdateClass::end(bool evenIfRemaining)
+{
+  if (_file == nullptr)
+  {
+    _error = UPDATE_ERROR_ABORT;
+    return false;
+  }
+  if (!evenIfRemaining && _size != UPDATE_SIZE_UNKNOWN && _written != _size)
+  {
+    _error = UPDATE_ERROR_SIZE;
+    abort();
+    return false;
+  }
+  bool flushed = fclose(_file) == 0;
+  _file = nullptr;
+  if (!flushed || rename(stagedFirmwarePath().c_str(), simConfig.firmwarePath.c_str()) != 0)
+  {
+    _error = UPDATE_ERROR_WRITE;
+    ::remove(stagedFirmwarePath().c_str());
+    return false;
+  }
+  return true;
+}
+
+void UpdateClass::abort()
+{
+  if (_file != nullptr)
+  {
+    fclose(_file);
+    _file = nullptr;
+    ::remove(stagedFirmwarePath().c_str());
+  }
+}
+
+// ===== SHA-256 (FIPS 180-4) =====
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t rotr(uint32_t x, unsigned n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+static void sha256Block(mbedtls_sha256_context *ctx, const unsigned char *block)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+  {
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++)
+  {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+  uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+  for (int i = 0; i < 64; i++)
+  {
+    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+  static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  if (is224)
+  {
+    return -1; // SHA-224 is not used by the firmware
+  }
+  memcpy(ctx->state, init, sizeof(init));
+  ctx->total[0] = ctx->total[1] = 0;
+  ctx->is224 = 0;
+  return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t len)
+{
+  size_t fill = ctx->total[0] & 63;
+  uint64_t total = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) + len;
+  ctx->total[0] = (uint32_t)total;
+  ctx->total[1] = (uint32_t)(total >> 32);
+  while (len > 0)
+  {
+    size_t n = std::min(len, 64 - fill);
+    memcpy(ctx->buffer + fill, input, n);
+    fill += n;
+    input += n;
+    len -= n;
+    if (fill == 64)
+    {
+      sha256Block(ctx, ctx->buffer);
+      fill = 0;
+    }
+  }
+  return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+  uint64_t bits = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) * 8;
+  unsigned char pad[72] = {0x80};
+  size_t fill = ctx->total[0] & 63;
+  size_t padLen = fill < 56 ? 56 - fill : 120 - fill;
+  for (int i = 0; i < 8; i++)
+  {
+    pad[padLen + i] = (unsigned char)(bits >> (56 - 8 * i));
+  }
+  mbedtls_sha256_update(ctx, pad, padLen + 8);
+  for (int i = 0; i < 8; i++)
+  {
+    output[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+    output[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+    output[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+    output[i * 4 + 3] = (unsigned char)ctx->state[i];
+  }
+  return 0;
+}
@@ -0,0 +1,515 @@
+// FreeRTOS primitives on host threads. Only the semantics the firmware relies
+// on are modelled: task notifications, mutexes, software timers and tick hooks.
+
+#include <Arduino.h>
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SimDevices.h"
+
+struct SimTask
+{
+  char name[configMAX_TASK_NAME_LEN] = "";
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notifyValue = 0;
+  bool notifyPending = false;
+};
+
+struct SimSemaphore
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  UBaseType_t count;
+  UBaseType_t maxCount;
+};
+
+struct SimTimer
+{
+  TickType_t period;
+  bool autoReload;
+  void *id;
+  TimerCallbackFunction_t callback;
+  bool active = false;
+  std::chrono::steady_clock::time_point due;
+};
+
+// Thrown by vTaskDelete(NULL) to unwind the calling task's thread
+struct SimTaskExit
+{
+};
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+static thread_local SimTask *currentTask = nullptr;
+
+// Core 0 runs the web server and the handlers; a handle that is not the idle
+// task is reported while a handler is on it, which is what the idle sampler looks at
+static SimTask idleTasks[portNUM_PROCESSORS];
+static SimTask busyTask;
+static std::atomic<int> handlersBusy(0);
+
+static std::mutex timersMutex;
+static std::condition_variable timersCv;
+static std::vector<SimTimer *> timers;
+static bool timerThreadStarted = false;
+
+static std::mutex hooksMutex;
+static std::vector<esp_freertos_tick_cb_t> tickHooks[portNUM_PROCESSORS];
+static bool tickThreadStarted = false;
+
+static std::chrono::steady_clock::time_point deadlineFor(TickType_t ticks)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  return std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+}
+
+// ===== Critical sections =====
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+  while (mux->locked.test_and_set(std::memory_order_acquire))
+  {
+    std::this_thread::yield();
+  }
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+  mux->locked.clear(std::memory_order_release);
+}
+
+// ===== Tasks =====
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  SimTask *created = new SimTask();
+  strncpy(created->name, name, sizeof(created->name) - 1);
+  if (handle != nullptr)
+  {
+    *handle = created;
+  }
+  std::thread([task, param, created]()
+              {
+    currentTask = created;
+    try
+    {
+      task(param);
+    }
+    catch (const SimTaskExit &)
+    {
+    } })
+      .detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stackDepth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+  return xTaskCreatePinnedToCore(task, name, stackDepth, param, priority, handle, 1);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  // Handles are never freed: a late xTaskNotifyGive() on a finished task must stay harmless
+  if (task == nullptr || task == currentTask)
+  {
+    throw SimTaskExit();
+  }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  if (currentTask == nullptr)
+  {
+    currentTask = new SimTask(); // a thread the simulator started, e.g. main()
+  }
+  return currentTask;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+  return (task != nullptr ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+void simBindCurrentTask(const char *name)
+{
+  static std::mutex namedTasksMutex;
+  static std::vector<SimTask *> namedTasks;
+  std::lock_guard<std::mutex> lock(namedTasksMutex);
+  for (SimTask *task : namedTasks)
+  {
+    if (strcmp(task->name, name) == 0)
+    {
+      currentTask = task;
+      return;
+    }
+  }
+  currentTask = new SimTask();
+  strncpy(currentTask->name, name, sizeof(currentTask->name) - 1);
+  namedTasks.push_back(currentTask);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t core)
+{
+  return core == 0 && handlersBusy.load() > 0 ? &busyTask : &idleTasks[core];
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t core)
+{
+  return &idleTasks[core];
+}
+
+void markHandlerBusy(bool busy)
+{
+  handlersBusy += busy ? 1 : -1;
+}
+
+// ===== Notifications =====
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+  std::lock_guard<std::mutex> lock(task->mutex);
+  switch (action)
+  {
+  case eSetBits:
+    task->notifyValue |= value;
+    break;
+  case eIncrement:
+    task->notifyValue++;
+    break;
+  case eSetValueWithOverwrite:
+    task->notifyValue = value;
+    break;
+  case eSetValueWithoutOverwrite:
+    if (task->notifyPending)
+    {
+      return pdFAIL;
+    }
+    task->notifyValue = value;
+    break;
+  case eNoAction:
+    break;
+  }
+  task->notifyPending = true;
+  task->cv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks)
+{
+  SimTask *task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (!task->notifyPending)
+  {
+    task->notifyValue &= ~clearOnEntry;
+  }
+  bool notified = task->cv.wait_until(lock, deadlineFor(ticks), [task]
+                                      { return task->notifyPending; });
+  if (value != nullptr)
+  {
+    *value = task->notifyValue;
+  }
+  if (!notified)
+  {
+    return pdFALSE;
+  }
+  task->notifyValue &= ~clearOnExit;
+  task->notifyPending = false;
+  return pdTRUE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  return xTaskNotify(task, 0, eIncrement);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+  SimTask *task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  task->cv.wait_until(lock, deadlineFor(ticks), [task]
+                      { return task->notifyValue != 0; });
+  uint32_t value = task->notifyValue;
+  if (value != 0)
+  {
+    task->notifyValue = clearOnExit ? 0 : value - 1;
+  }
+  task->notifyPending = false;
+  return value;
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t task)
+{
+  task = task != nullptr ? task : xTaskGetCurrentTaskHandle();
+  std::lock_guard<std::mutex> lock(task->mutex);
+  BaseType_t wasPending = task->notifyPending ? pdTRUE : pdFALSE;
+  task->notifyPending = false;
+  return wasPending;
+}
+
+// ===== Semaphores =====
+// Mutexes are modelled as binary semaphores that start available; the firmware
+// never takes one recursively or relies on priority inheritance.
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+  return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+  SimSemaphore *semaphore = new SimSemaphore();
+  semaphore->count = initialCount;
+  semaphore->maxCount = maxCount;
+  return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+  std::unique_lock<std::mutex> lock(semaphore->mutex);
+  if (!semaphore->cv.wait_until(lock, deadlineFor(ticks), [semaphore]
+                                { return semaphore->count > 0; }))
+  {
+    return pdFALSE;
+  }
+  semaphore->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  std::lock_guard<std::mutex> lock(semaphore->mutex);
+  if (semaphore->count >= semaphore->maxCount)
+  {
+    return pdFALSE;
+  }
+  semaphore->count++;
+  semaphore->cv.notify_one();
+  return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore)
+{
+  std::lock_guard<std::mutex> lock(semaphore->mutex);
+  return semaphore->count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+  delete semaphore;
+}
+
+// ===== Software timers =====
+// One service thread runs every callback, in due order, like the timer task.
+
+static void runTimers()
+{
+  simBindCurrentTask("Tmr Svc");
+  std::unique_lock<std::mutex> lock(timersMutex);
+  while (true)
+  {
+    SimTimer *next = nullptr;
+    for (SimTimer *timer : timers)
+    {
+      if (timer->active && (next == nullptr || timer->due < next->due))
+      {
+        next = timer;
+      }
+    }
+    if (next == nullptr)
+    {
+      timersCv.wait(lock);
+      continue;
+    }
+    if (timersCv.wait_until(lock, next->due) != std::cv_status::timeout)
+    {
+      continue; // the timer set changed; re-evaluate
+    }
+    if (!next->active || next->due > std::chrono::steady_clock::now())
+    {
+      continue;
+    }
+    if (next->autoReload)
+    {
+      next->due += std::chrono::milliseconds(next->period);
+    }
+    else
+    {
+      next->active = false;
+    }
+    lock.unlock();
+    next->callback(next);
+    lock.lock();
+  }
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t autoReload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+  SimTimer *timer = new SimTimer();
+  timer->period = period;
+  timer->autoReload = autoReload != pdFALSE;
+  timer->id = id;
+  timer->callback = callback;
+
+  std::lock_guard<std::mutex> lock(timersMutex);
+  timers.push_back(timer);
+  if (!timerThreadStarted)
+  {
+    std::thread(runTimers).detach();
+    timerThreadStarted = true;
+  }
+  return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+  std::lock_guard<std::mutex> lock(timersMutex);
+  timer->active = true;
+  timer->due = std::chrono::steady_clock::now() + std::chrono::milliseconds(timer->period);
+  timersCv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks)
+{
+  return xTimerStart(timer, ticks);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+  std::lock_guard<std::mutex> lock(timersMutex);
+  timer->active = false;
+  timersCv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks)
+{
+  {
+    std::lock_guard<std::mutex> lock(timersMutex);
+    timer->period = period;
+  }
+  return xTimerStart(timer, ticks);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks)
+{
+  std::lock_guard<std::mutex> lock(timersMutex);
+  timer->active = false; // kept allocated so a callback already in flight stays valid
+  timersCv.notify_all();
+  return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+  return timer->id;
+}
+
+// ===== Tick hooks =====
+
+static void runTicks()
+{
+  const std::chrono::microseconds period(1000000 / configTICK_RATE_HZ);
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  while (true)
+  {
+    next += period;
+    std::this_thread::sleep_until(next);
+    std::lock_guard<std::mutex> lock(hooksMutex);
+    for (unsigned core = 0; core < portNUM_PROCESSORS; core++)
+    {
+      for (esp_freertos_tick_cb_t hook : tickHooks[core])
+      {
+        hook();
+      }
+    }
+  }
+}
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t callback, unsigned cpu)
+{
+  if (cpu >= portNUM_PROCESSORS)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(hooksMutex);
+  tickHooks[cpu].push_back(callback);
+  if (!tickThreadStarted)
+  {
+    std::thread(runTicks).detach();
+    tickThreadStarted = true;
+  }
+  return ESP_OK;
+}
+
+void esp_deregister_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t callback, unsigned cpu)
+{
+  std::lock_guard<std::mutex> lock(hooksMutex);
+  std::vector<esp_freertos_tick_cb_t> &hooks = tickHooks[cpu];
+  for (size_t i = 0; i < hooks.size(); i++)
+  {
+    if (hooks[i] == callback)
+    {
+      hooks.erase(hooks.begin() + i);
+      return;
+    }
+  }
+}
+
+// ===== Time =====
+
+int64_t esp_timer_get_time()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+uint32_t millis()
+{
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+uint32_t micros()
+{
+  return (uint32_t)esp_timer_get_time();
+}
+
+void delay(uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+  std::this_thread::yield();
+}
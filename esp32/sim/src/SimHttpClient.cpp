@@ -0,0 +1,272 @@
+// Outbound HTTP for the simulator: a blocking TCP client and the subset of
+// HTTPClient the firmware uses, so that OTA can pull from a hub stub or from
+// other simulated boards. Received bytes count against --link-kbps.
+
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "SimDevices.h"
+
+static const size_t RECEIVE_BYTES = 1460;
+
+// ===== WiFiClient =====
+
+bool WiFiClient::connect(const char *host, uint16_t port, uint32_t timeoutMs)
+{
+  stop();
+  struct addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *result = nullptr;
+  char service[6];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &result) != 0 || result == nullptr)
+  {
+    return false;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  int rc = ::connect(fd, result->ai_addr, result->ai_addrlen);
+  freeaddrinfo(result);
+  if (rc != 0 && errno == EINPROGRESS)
+  {
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    rc = poll(&pfd, 1, (int)timeoutMs) > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) == 0 && error == 0 ? 0 : -1;
+  }
+  if (rc != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, flags);
+  int noDelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+  _fd = fd;
+  _buffer.clear();
+  _position = 0;
+  _closed = false;
+  return true;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+  size_t sent = 0;
+  while (_fd >= 0 && sent < size)
+  {
+    ssize_t n = ::send(_fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      return sent;
+    }
+    sent += (size_t)n;
+  }
+  return sent;
+}
+
+// Receives whatever arrives within timeoutMs into the buffer; false once nothing more will
+bool WiFiClient::fill(uint32_t timeoutMs)
+{
+  if (_position < _buffer.size())
+  {
+    return true;
+  }
+  if (_fd < 0 || _closed)
+  {
+    return false;
+  }
+  struct pollfd pfd = {_fd, POLLIN, 0};
+  if (poll(&pfd, 1, (int)timeoutMs) <= 0)
+  {
+    return false;
+  }
+  char data[RECEIVE_BYTES];
+  ssize_t n = recv(_fd, data, sizeof(data), 0);
+  if (n <= 0)
+  {
+    _closed = true;
+    return false;
+  }
+  simulateLinkTransfer((size_t)n);
+  _buffer.assign(data, (size_t)n);
+  _position = 0;
+  return true;
+}
+
+int WiFiClient::available()
+{
+  fill(0);
+  return (int)(_buffer.size() - _position);
+}
+
+int WiFiClient::read()
+{
+  if (!fill(_timeout))
+  {
+    return -1;
+  }
+  return (uint8_t)_buffer[_position++];
+}
+
+int WiFiClient::peek()
+{
+  if (!fill(_timeout))
+  {
+    return -1;
+  }
+  return (uint8_t)_buffer[_position];
+}
+
+bool WiFiClient::connected()
+{
+  if (_position < _buffer.size())
+  {
+    return true;
+  }
+  fill(0);
+  return _fd >= 0 && !_closed;
+}
+
+void WiFiClient::stop()
+{
+  if (_fd >= 0)
+  {
+    ::close(_fd);
+  }
+  _fd = -1;
+  _buffer.clear();
+  _position = 0;
+  _closed = false;
+}
+
+// ===== HTTPClient =====
+
+bool HTTPClient::begin(const String &url)
+{
+  end();
+  _size = -1;
+  _headers = String();
+  _responseHead.clear();
+  if (!url.startsWith("http://"))
+  {
+    _host = String();
+    return false; // no TLS in the simulator
+  }
+  String rest = url.substring(7);
+  int slash = rest.indexOf('/');
+  String authority = slash < 0 ? rest : rest.substring(0, slash);
+  _path = slash < 0 ? String("/") : rest.substring(slash);
+  int colon = authority.indexOf(':');
+  _host = colon < 0 ? authority : authority.substring(0, colon);
+  _port = colon < 0 ? 80 : (uint16_t)authority.substring(colon + 1).toInt();
+  return _host.length() > 0;
+}
+
+void HTTPClient::addHeader(const String &name, const String &value, bool first, bool replace)
+{
+  _headers += name + ": " + value + "\r\n";
+}
+
+int HTTPClient::sendRequest(const char *method, const String &payload)
+{
+  if (_host.length() == 0 || !_stream.connect(_host.c_str(), _port, _timeoutMs))
+  {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  _stream.setTimeout(_timeoutMs);
+
+  String request = String(method) + " " + _path + " HTTP/1.1\r\nHost: " + _host + ":" + String(_port) + "\r\n";
+  request += "User-Agent: ESP32HTTPClient\r\nConnection: close\r\n" + _headers;
+  if (payload.length() > 0)
+  {
+    request += "Content-Length: " + String(payload.length()) + "\r\n";
+  }
+  request += "\r\n" + payload;
+  if (_stream.write((const uint8_t *)request.c_str(), request.length()) != request.length())
+  {
+    _stream.stop();
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+
+  // Headers are read a byte at a time so the body stays in the stream
+  std::string head;
+  while (head.size() < 4 || head.compare(head.size() - 4, 4, "\r\n\r\n") != 0)
+  {
+    int c = _stream.read();
+    if (c < 0)
+    {
+      _stream.stop();
+      return head.empty() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    }
+    head += (char)c;
+  }
+
+  int code = 0;
+  if (sscanf(head.c_str(), "HTTP/1.%*d %d", &code) != 1)
+  {
+    _stream.stop();
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+  std::string lower = head;
+  for (char &c : lower)
+  {
+    c = (char)tolower((unsigned char)c);
+  }
+  size_t field = lower.find("\r\ncontent-length:");
+  _size = field == std::string::npos ? -1 : (int)strtol(head.c_str() + field + 17, nullptr, 10);
+  _responseHead = head;
+  return code;
+}
+
+String HTTPClient::header(const char *name)
+{
+  std::string lower = _responseHead;
+  for (char &c : lower)
+  {
+    c = (char)tolower((unsigned char)c);
+  }
+  std::string key = "\r\n";
+  for (const char *p = name; *p; p++)
+  {
+    key += (char)tolower((unsigned char)*p);
+  }
+  key += ":";
+  size_t field = lower.find(key);
+  if (field == std::string::npos)
+  {
+    return String();
+  }
+  size_t begin = field + key.size();
+  while (begin < _responseHead.size() && _responseHead[begin] == ' ')
+  {
+    begin++;
+  }
+  return String(_responseHead.substr(begin, _responseHead.find("\r\n", begin) - begin));
+}
+
+String HTTPClient::getString()
+{
+  std::string body;
+  while (_size < 0 || body.size() < (size_t)_size)
+  {
+    int c = _stream.read();
+    if (c < 0)
+    {
+      break;
+    }
+    body += (char)c;
+  }
+  return String(body);
+}
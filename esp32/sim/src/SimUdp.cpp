@@ -0,0 +1,135 @@
+// Blocking-socket implementation of the AsyncUDP API.
+
+#include <AsyncUDP.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "SimDevices.h"
+
+// Largest datagram an Ethernet-sized frame carries
+static const size_t MAX_DATAGRAM_BYTES = 1472;
+// How often a receive thread checks whether it was closed
+static const int CLOSE_POLL_MS = 100;
+
+// Shared with the receive thread, which outlives close() by up to one poll interval
+struct AsyncUDP::Listener
+{
+  int fd;
+  bool multicast;
+  std::atomic<bool> closed{false};
+  std::mutex callbackMutex;
+  AuPacketHandlerFunction callback;
+};
+
+static void receivePackets(std::shared_ptr<AsyncUDP::Listener> listener)
+{
+  simBindCurrentTask("async_udp");
+  uint8_t buffer[MAX_DATAGRAM_BYTES];
+  struct pollfd pfd = {listener->fd, POLLIN, 0};
+  while (!listener->closed.load())
+  {
+    if (poll(&pfd, 1, CLOSE_POLL_MS) <= 0)
+    {
+      continue;
+    }
+    struct sockaddr_in peer;
+    socklen_t peerLen = sizeof(peer);
+    ssize_t n = recvfrom(listener->fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&peer, &peerLen);
+    if (n < 0)
+    {
+      continue;
+    }
+    AuPacketHandlerFunction callback;
+    {
+      std::lock_guard<std::mutex> lock(listener->callbackMutex);
+      callback = listener->callback;
+    }
+    if (callback && !listener->closed.load())
+    {
+      AsyncUDPPacket packet(buffer, (size_t)n, IPAddress(peer.sin_addr.s_addr), ntohs(peer.sin_port), listener->multicast);
+      callback(packet);
+    }
+  }
+  ::close(listener->fd);
+}
+
+bool AsyncUDP::start(const IPAddress &bindAddress, uint16_t port, bool multicast)
+{
+  close();
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = (uint32_t)bindAddress;
+  address.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+  {
+    Serial.printf("Cannot bind UDP port %u: %s\n", port, strerror(errno));
+    ::close(fd);
+    return false;
+  }
+  if (multicast)
+  {
+    struct ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = (uint32_t)bindAddress;
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)
+    {
+      Serial.printf("Cannot join multicast group %s: %s\n", bindAddress.toString().c_str(), strerror(errno));
+      ::close(fd);
+      return false;
+    }
+  }
+
+  _listener = std::make_shared<Listener>();
+  _listener->fd = fd;
+  _listener->multicast = multicast;
+  _listener->callback = _callback;
+  std::thread(receivePackets, _listener).detach();
+  return true;
+}
+
+bool AsyncUDP::listen(uint16_t port)
+{
+  return start(IPAddress(), port, false);
+}
+
+// Binding to the group address keeps unicast traffic to the same port out
+bool AsyncUDP::listenMulticast(const IPAddress &address, uint16_t port, uint8_t ttl)
+{
+  return start(address, port, true);
+}
+
+void AsyncUDP::onPacket(AuPacketHandlerFunction callback)
+{
+  _callback = callback;
+  if (_listener != nullptr)
+  {
+    std::lock_guard<std::mutex> lock(_listener->callbackMutex);
+    _listener->callback = callback;
+  }
+}
+
+void AsyncUDP::close()
+{
+  if (_listener == nullptr)
+  {
+    return;
+  }
+  _listener->closed.store(true);
+  _listener.reset();
+}
@@ -0,0 +1,698 @@
+// Blocking-socket implementation of the ESPAsyncWebServer API.
+//
+// Each connection gets a reader thread, but requests are dispatched one at a
+// time under handlerMutex, the way the single async_tcp task runs every
+// handler on the device. Reading, writing and queueing happen in parallel;
+// handler execution does not.
+
+#include <ESPAsyncWebServer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "SimDevices.h"
+
+static std::mutex handlerMutex;
+static std::atomic<int> openConnections(0);
+
+// Cap on waiting for a request that never completes, when the firmware set no idle limit
+static const uint32_t DEFAULT_RX_TIMEOUT_S = 30;
+static const size_t MAX_HEADER_BYTES = 8192;
+
+static const char *reasonPhrase(int code)
+{
+  switch (code)
+  {
+  case 200:
+    return "OK";
+  case 201:
+    return "Created";
+  case 202:
+    return "Accepted";
+  case 204:
+    return "No Content";
+  case 206:
+    return "Partial Content";
+  case 301:
+    return "Moved Permanently";
+  case 302:
+    return "Found";
+  case 304:
+    return "Not Modified";
+  case 400:
+    return "Bad Request";
+  case 401:
+    return "Unauthorized";
+  case 403:
+    return "Forbidden";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 409:
+    return "Conflict";
+  case 413:
+    return "Payload Too Large";
+  case 429:
+    return "Too Many Requests";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "";
+  }
+}
+
+// ===== Responses =====
+
+bool AsyncWebServerResponse::addHeader(const char *name, const char *value, bool replace)
+{
+  for (AsyncWebHeader &header : _headers)
+  {
+    if (strcasecmp(header.name().c_str(), name) == 0)
+    {
+      if (!replace)
+      {
+        return false;
+      }
+      header = AsyncWebHeader(name, value);
+      return true;
+    }
+  }
+  _headers.push_back(AsyncWebHeader(name, value));
+  return true;
+}
+
+String AsyncWebServerResponse::head(size_t contentLength) const
+{
+  String out = "HTTP/1.1 " + String(_code) + " " + reasonPhrase(_code) + "\r\n";
+  if (hasBody())
+  {
+    if (_contentType.length() > 0)
+    {
+      out += "Content-Type: " + _contentType + "\r\n";
+    }
+    out += "Content-Length: " + String((unsigned long)contentLength) + "\r\n";
+  }
+  for (const AsyncWebHeader &header : _headers)
+  {
+    out += header.name() + ": " + header.value() + "\r\n";
+  }
+  out += "Connection: close\r\n\r\n";
+  return out;
+}
+
+String AsyncWebServerResponse::serialize() const
+{
+  String body = content();
+  String out = head(body.length());
+  if (hasBody())
+  {
+    out += body;
+  }
+  return out;
+}
+
+// The filler is drained when the response is written, after the handler returned,
+// as the library does; it is sent with a Content-Length instead of chunked framing
+class SimChunkedResponse : public AsyncWebServerResponse
+{
+public:
+  SimChunkedResponse(const char *contentType, AwsResponseFiller filler)
+      : AsyncWebServerResponse(200, contentType, String()), _filler(filler) {}
+
+  String content() const override
+  {
+    String body;
+    uint8_t buffer[1460];
+    size_t len;
+    while ((len = _filler(buffer, sizeof(buffer), body.length())) > 0)
+    {
+      body.concat((const char *)buffer, (unsigned int)len);
+    }
+    return body;
+  }
+
+private:
+  AwsResponseFiller _filler;
+};
+
+// A filler with a known length is streamed as it is drained, the way the
+// library sends a large body without holding it in memory
+class SimFillerResponse : public AsyncWebServerResponse
+{
+public:
+  SimFillerResponse(const char *contentType, size_t length, AwsResponseFiller filler)
+      : AsyncWebServerResponse(200, contentType, String()), _length(length), _filler(filler) {}
+
+  void writeTo(int fd) const override;
+
+private:
+  size_t _length;
+  AwsResponseFiller _filler;
+};
+
+// ===== Requests =====
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+  delete _response;
+  free(_tempObject); // as the library does
+}
+
+const char *AsyncWebServerRequest::methodToString() const
+{
+  switch (_method)
+  {
+  case HTTP_GET:
+    return "GET";
+  case HTTP_POST:
+    return "POST";
+  case HTTP_DELETE:
+    return "DELETE";
+  case HTTP_PUT:
+    return "PUT";
+  case HTTP_PATCH:
+    return "PATCH";
+  case HTTP_HEAD:
+    return "HEAD";
+  case HTTP_OPTIONS:
+    return "OPTIONS";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(const char *name, bool post, bool file) const
+{
+  for (const AsyncWebParameter &param : _params)
+  {
+    if (param.name() == name && param.isPost() == post)
+    {
+      return &param;
+    }
+  }
+  return nullptr;
+}
+
+const AsyncWebHeader *AsyncWebServerRequest::getHeader(const char *name) const
+{
+  for (const AsyncWebHeader &header : _headers)
+  {
+    if (strcasecmp(header.name().c_str(), name) == 0)
+    {
+      return &header;
+    }
+  }
+  return nullptr;
+}
+
+const String &AsyncWebServerRequest::header(const char *name) const
+{
+  static const String empty;
+  const AsyncWebHeader *header = getHeader(name);
+  return header != nullptr ? header->value() : empty;
+}
+
+String AsyncWebServerRequest::urlDecode(const String &text)
+{
+  std::string decoded;
+  const std::string &s = text.str();
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2]))
+    {
+      decoded += (char)strtoul(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    }
+    else
+    {
+      decoded += s[i] == '+' ? ' ' : s[i];
+    }
+  }
+  return String(decoded);
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+  if (_response != nullptr)
+  {
+    delete response; // the library ignores a second response as well
+    return;
+  }
+  _response = response;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const char *contentType, const uint8_t *content, size_t len)
+{
+  return new AsyncWebServerResponse(code, contentType, String(std::string((const char *)content, len)));
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(const char *contentType, size_t len, AwsResponseFiller filler)
+{
+  return new SimFillerResponse(contentType, len, filler);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const char *contentType, AwsResponseFiller filler)
+{
+  return new SimChunkedResponse(contentType, filler);
+}
+
+void AsyncWebServerRequest::redirect(const char *url, int code)
+{
+  AsyncWebServerResponse *response = beginResponse(code);
+  response->addHeader("Location", url);
+  send(response);
+}
+
+void AsyncWebServerRequest::requestAuthentication()
+{
+  AsyncWebServerResponse *response = beginResponse(401);
+  response->addHeader("WWW-Authenticate", "Basic realm=\"Login Required\"");
+  send(response);
+}
+
+void AsyncWebServerRequest::disconnected()
+{
+  if (_onDisconnect)
+  {
+    _onDisconnect();
+  }
+}
+
+static void parseParams(const std::string &query, bool post, std::vector<AsyncWebParameter> &params)
+{
+  size_t start = 0;
+  while (start < query.size())
+  {
+    size_t end = query.find('&', start);
+    if (end == std::string::npos)
+    {
+      end = query.size();
+    }
+    std::string pair = query.substr(start, end - start);
+    if (!pair.empty())
+    {
+      size_t eq = pair.find('=');
+      String name = AsyncWebServerRequest::urlDecode(String(pair.substr(0, eq)));
+      String value = eq == std::string::npos ? String() : AsyncWebServerRequest::urlDecode(String(pair.substr(eq + 1)));
+      params.push_back(AsyncWebParameter(name, value, post));
+    }
+    start = end + 1;
+  }
+}
+
+bool AsyncWebServerRequest::parse(const std::string &head, const std::string &body)
+{
+  size_t lineEnd = head.find("\r\n");
+  std::string requestLine = head.substr(0, lineEnd);
+  size_t sp1 = requestLine.find(' ');
+  size_t sp2 = requestLine.find(' ', sp1 + 1);
+  if (sp1 == std::string::npos || sp2 == std::string::npos)
+  {
+    return false;
+  }
+
+  std::string method = requestLine.substr(0, sp1);
+  static const struct
+  {
+    const char *name;
+    WebRequestMethod method;
+  } methods[] = {{"GET", HTTP_GET}, {"POST", HTTP_POST}, {"DELETE", HTTP_DELETE}, {"PUT", HTTP_PUT}, {"PATCH", HTTP_PATCH}, {"HEAD", HTTP_HEAD}, {"OPTIONS", HTTP_OPTIONS}};
+  for (const auto &m : methods)
+  {
+    if (method == m.name)
+    {
+      _method = m.method;
+    }
+  }
+  if (_method == 0)
+  {
+    return false;
+  }
+
+  std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+  size_t question = target.find('?');
+  _url = urlDecode(String(target.substr(0, question)));
+  if (question != std::string::npos)
+  {
+    parseParams(target.substr(question + 1), false, _params);
+  }
+
+  size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+  while (pos < head.size())
+  {
+    size_t end = head.find("\r\n", pos);
+    if (end == std::string::npos)
+    {
+      end = head.size();
+    }
+    std::string line = head.substr(pos, end - pos);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos)
+    {
+      size_t valueStart = line.find_first_not_of(' ', colon + 1);
+      _headers.push_back(AsyncWebHeader(String(line.substr(0, colon)),
+                                        String(valueStart == std::string::npos ? std::string() : line.substr(valueStart))));
+    }
+    pos = end + 2;
+  }
+
+  _body = String(body);
+  if (contentType().startsWith("application/x-www-form-urlencoded"))
+  {
+    parseParams(body, true, _params);
+  }
+  return true;
+}
+
+// ===== Routing =====
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request) const
+{
+  if (!(_method & request->method()))
+  {
+    return false;
+  }
+  if (_uri.length() > 0 && _uri.startsWith("/*."))
+  {
+    if (!request->url().endsWith(_uri.substring(2)))
+    {
+      return false;
+    }
+  }
+  else if (_uri.length() > 0 && _uri.endsWith("*"))
+  {
+    if (!request->url().startsWith(_uri.substring(0, _uri.length() - 1)))
+    {
+      return false;
+    }
+  }
+  else if (_uri.length() > 0 && _uri != request->url() && !request->url().startsWith(_uri + "/"))
+  {
+    return false;
+  }
+  return !_filter || _filter(request);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+{
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest, onUpload, onBody);
+  _handlers.push_back(std::unique_ptr<AsyncWebHandler>(handler));
+  return *handler;
+}
+
+void AsyncWebServer::reset()
+{
+  _handlers.clear();
+  _notFound = nullptr;
+}
+
+void AsyncWebServer::runChain(AsyncWebServerRequest *request, AsyncWebHandler *handler, size_t index)
+{
+  if (index < _middleware.size())
+  {
+    _middleware[index](request, [this, request, handler, index]()
+                       { runChain(request, handler, index + 1); });
+    return;
+  }
+  if (handler != nullptr)
+  {
+    handler->handleRequest(request);
+  }
+  else if (_notFound)
+  {
+    _notFound(request);
+  }
+  else
+  {
+    request->send(404);
+  }
+}
+
+void AsyncWebServer::handle(AsyncWebServerRequest *request)
+{
+  AsyncWebHandler *handler = nullptr;
+  for (const std::unique_ptr<AsyncWebHandler> &candidate : _handlers)
+  {
+    if (candidate->canHandle(request))
+    {
+      handler = candidate.get();
+      break;
+    }
+  }
+
+  // Body callbacks fire while the request is still being received, before the middleware chain
+  if (handler != nullptr && request->body().length() > 0)
+  {
+    std::string body = request->body().str();
+    handler->handleBody(request, (uint8_t *)&body[0], body.size(), 0, body.size());
+  }
+  runChain(request, handler, 0);
+}
+
+// ===== Connections =====
+
+static bool waitReadable(int fd, uint32_t timeoutS)
+{
+  struct pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, (int)(timeoutS * 1000)) > 0;
+}
+
+static bool readRequest(AsyncClient &client, std::string &head, std::string &body)
+{
+  std::string data;
+  char buffer[2048];
+  size_t headerEnd;
+  while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+  {
+    uint32_t timeout = client.getRxTimeout() > 0 ? client.getRxTimeout() : DEFAULT_RX_TIMEOUT_S;
+    if (data.size() > MAX_HEADER_BYTES || !waitReadable(client.fd(), timeout))
+    {
+      return false;
+    }
+    ssize_t n = recv(client.fd(), buffer, sizeof(buffer), 0);
+    if (n <= 0)
+    {
+      return false;
+    }
+    data.append(buffer, (size_t)n);
+  }
+  head = data.substr(0, headerEnd);
+  body = data.substr(headerEnd + 4);
+
+  size_t contentLength = 0;
+  std::string lower = head;
+  for (char &c : lower)
+  {
+    c = (char)tolower((unsigned char)c);
+  }
+  size_t field = lower.find("\r\ncontent-length:");
+  if (field != std::string::npos)
+  {
+    contentLength = strtoul(head.c_str() + field + 17, nullptr, 10);
+  }
+  while (body.size() < contentLength)
+  {
+    if (!waitReadable(client.fd(), DEFAULT_RX_TIMEOUT_S))
+    {
+      return false;
+    }
+    ssize_t n = recv(client.fd(), buffer, std::min(sizeof(buffer), contentLength - body.size()), 0);
+    if (n <= 0)
+    {
+      return false;
+    }
+    body.append(buffer, (size_t)n);
+  }
+  body.resize(contentLength);
+  return true;
+}
+
+// One TCP segment's worth, so that transfers sharing a throttled link interleave
+static const size_t LINK_SLICE_BYTES = 1460;
+
+static bool writeAll(int fd, const char *data, size_t length)
+{
+  size_t sent = 0;
+  while (sent < length)
+  {
+    size_t slice = std::min(length - sent, LINK_SLICE_BYTES);
+    simulateLinkTransfer(slice);
+    ssize_t n = ::send(fd, data + sent, slice, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      return false;
+    }
+    sent += (size_t)n;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const std::string &data)
+{
+  return writeAll(fd, data.data(), data.size());
+}
+
+void AsyncWebServerResponse::writeTo(int fd) const
+{
+  writeAll(fd, serialize().str());
+}
+
+// Runs on the connection's thread, outside handlerMutex, as the library's
+// filler runs from the TCP callbacks between other handlers
+void SimFillerResponse::writeTo(int fd) const
+{
+  if (!writeAll(fd, head(_length).str()) || !hasBody())
+  {
+    return;
+  }
+  uint8_t buffer[LINK_SLICE_BYTES];
+  size_t index = 0;
+  while (index < _length)
+  {
+    size_t len = _filler(buffer, std::min(sizeof(buffer), _length - index), index);
+    if (len == 0 || !writeAll(fd, (const char *)buffer, len))
+    {
+      return; // the client sees the connection close short of Content-Length
+    }
+    index += len;
+  }
+}
+
+static void serveConnection(AsyncWebServer *server, AsyncClient *client)
+{
+  simBindCurrentTask("async_tcp"); // stands in for the task that runs handlers on the chip
+  std::string head, body;
+  if (readRequest(*client, head, body))
+  {
+    AsyncWebServerRequest request(server, client);
+    if (!request.parse(head, body))
+    {
+      writeAll(client->fd(), AsyncWebServerResponse(400, "text/plain", "Bad Request").serialize().str());
+    }
+    else
+    {
+      uint32_t start = micros();
+      {
+        std::lock_guard<std::mutex> lock(handlerMutex);
+        markHandlerBusy(true);
+        server->handle(&request);
+        markHandlerBusy(false);
+      }
+      if (request.response() == nullptr)
+      {
+        request.send(500, "application/json", "{\"error\":\"no response\"}");
+      }
+      request.response()->writeTo(client->fd());
+      if (simConfig.verbose)
+      {
+        Serial.printf("%s %s -> %d (%u us)\n", request.methodToString(), request.url().c_str(), request.response()->code(), (unsigned)(micros() - start));
+      }
+    }
+    request.disconnected();
+  }
+  client->close();
+  delete client;
+  openConnections--;
+}
+
+void AsyncClient::setNoDelay(bool noDelay)
+{
+  int flag = noDelay ? 1 : 0;
+  setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+void AsyncClient::close(bool now)
+{
+  if (_fd < 0)
+  {
+    return;
+  }
+  if (now)
+  {
+    struct linger reset = {1, 0};
+    setsockopt(_fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+  }
+  else
+  {
+    shutdown(_fd, SHUT_WR);
+  }
+  ::close(_fd);
+  _fd = -1;
+}
+
+static void acceptConnections(AsyncWebServer *server, int listenFd)
+{
+  while (true)
+  {
+    struct sockaddr_in peer;
+    socklen_t peerLen = sizeof(peer);
+    int fd = accept4(listenFd, (struct sockaddr *)&peer, &peerLen, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+      return; // listening socket closed by end()
+    }
+
+    AsyncClient *client = new AsyncClient(fd, IPAddress(peer.sin_addr.s_addr), ntohs(peer.sin_port), server->port());
+    // lwIP refuses connections beyond its PCB pool with a reset
+    if (openConnections.load() >= simConfig.maxConnections)
+    {
+      client->close(true);
+      delete client;
+      continue;
+    }
+    openConnections++;
+    client->setNoDelay(true);
+    std::thread(serveConnection, server, client).detach();
+  }
+}
+
+void AsyncWebServer::begin()
+{
+  if (_listenFd >= 0)
+  {
+    return;
+  }
+  // Close-on-exec, so that ESP.restart() re-executing the process can listen on the port again
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(_port);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 128) != 0)
+  {
+    Serial.printf("Cannot listen on port %u: %s\n", _port, strerror(errno));
+    ::close(fd);
+    return;
+  }
+  _listenFd = fd;
+  std::thread(acceptConnections, this, fd).detach();
+}
+
+void AsyncWebServer::end()
+{
+  if (_listenFd < 0)
+  {
+    return;
+  }
+  shutdown(_listenFd, SHUT_RDWR);
+  ::close(_listenFd);
+  _listenFd = -1;
+}
@@ -0,0 +1,191 @@
+// Entry point of the simulated subcontroller: runs the firmware's normal mode
+// against simulated devices, serving the real HTTP API on a host port.
+
+#include <ESPAsyncWebServer.h>
+
+#include <csignal>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "SimDevices.h"
+#include "servers/Normal.h"
+#include "Features.h"
+#if FEATURE_DS18B20
+#include "sensors/Ds18b20.h"
+#else
+#define DS18B20_SCAN_SLICE_MS 1000
+#endif
+#if FEATURE_PCA9685
+#include "outputs/Pca9685.h"
+#endif
+#include "utils/cpuUtils.h"
+#include "utils/i2cUtils.h"
+#include "utils/inventoryUtils.h"
+#include "utils/logUtils.h"
+#include "utils/powerUtils.h"
+
+static std::vector<std::string> savedArgs;
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --port N             HTTP port (default 8080)\n"
+          "  --ds18b20 N          DS18B20 probes on the 1-Wire bus (default 2)\n"
+          "  --bme280 N           BME280s at 0x76.. on bus 0, max 2 (default 1)\n"
+          "  --ads1115 N          ADS1115s at 0x48.. on bus 0, max 4 (default 1)\n"
+          "  --pca9685 N          PCA9685s at 0x40.. on bus 0, max 8 (default 1)\n"
+          "  --latency X          scale on device and bus timings, 0 = instant (default 1)\n"
+          "  --noise X            scale on sensor noise, 0 = exact readings (default 1)\n"
+          "  --fault-rate P       probability that a bus transaction fails (default 0)\n"
+          "  --seed N             seed for ROM codes and noise (default 1)\n"
+          "  --max-connections N  concurrent TCP connections before resets (default 16)\n"
+          "  --state FILE         persist NVS to FILE across runs and restarts\n"
+          "  --firmware FILE      app image the board runs, serves to peers and OTA replaces\n"
+          "  --link-kbps N        Wi-Fi throughput shared by all HTTP transfers, 0 = unlimited (default 0)\n"
+          "  --verbose            log requests and mDNS records\n"
+          "SIGUSR1 unplugs every I2C device; the next one plugs them back in at power-on state.\n",
+          program);
+}
+
+static bool parseArgs(int argc, char **argv, SimConfig &config)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--verbose")
+    {
+      config.verbose = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--port")
+      config.port = (uint16_t)atoi(value);
+    else if (arg == "--ds18b20")
+      config.ds18b20Count = (uint8_t)atoi(value);
+    else if (arg == "--bme280")
+      config.bme280Count = (uint8_t)atoi(value);
+    else if (arg == "--ads1115")
+      config.ads1115Count = (uint8_t)atoi(value);
+    else if (arg == "--pca9685")
+      config.pca9685Count = (uint8_t)atoi(value);
+    else if (arg == "--latency")
+      config.latencyScale = (float)atof(value);
+    else if (arg == "--noise")
+      config.noiseScale = (float)atof(value);
+    else if (arg == "--fault-rate")
+      config.faultRate = (float)atof(value);
+    else if (arg == "--seed")
+      config.seed = (uint32_t)strtoul(value, nullptr, 10);
+    else if (arg == "--max-connections")
+      config.maxConnections = (uint16_t)atoi(value);
+    else if (arg == "--state")
+      config.statePath = value;
+    else if (arg == "--firmware")
+      config.firmwarePath = value;
+    else if (arg == "--link-kbps")
+      config.linkKbps = (uint32_t)strtoul(value, nullptr, 10);
+    else
+      return false;
+  }
+  return config.port != 0;
+}
+
+/**
+ * @brief Re-executes the simulator with its original arguments.
+ *
+ * Deferred briefly so that a handler calling ESP.restart() still gets its
+ * response onto the wire. NVS survives only when --state is set, as it would
+ * survive on the chip.
+ */
+void restartSimulation()
+{
+  Serial.println("Restarting...");
+  std::thread([]()
+              {
+    delay(200);
+    std::vector<char *> argv;
+    for (std::string &arg : savedArgs)
+    {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    execv("/proc/self/exe", argv.data());
+    perror("execv");
+    _exit(1); })
+      .detach();
+}
+
+/**
+ * @brief Toggles the I2C devices on every SIGUSR1, so scripts can exercise hot-plug.
+ *
+ * The signal is blocked before any other thread starts and taken here with
+ * sigwait(), so the toggle runs as ordinary code rather than in a handler.
+ */
+static void watchPlugSignal()
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  std::thread([signals]()
+              {
+    while (true)
+    {
+      int signal;
+      if (sigwait(&signals, &signal) == 0)
+      {
+        bool plugged = !areSimulatedI2CDevicesPlugged();
+        setSimulatedI2CDevicesPlugged(plugged);
+        Serial.printf("I2C devices %s\n", plugged ? "plugged in" : "unplugged");
+      }
+    } })
+      .detach();
+}
+
+int main(int argc, char **argv)
+{
+  SimConfig config;
+  if (!parseArgs(argc, argv, config))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  savedArgs.assign(argv, argv + argc);
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  watchPlugSignal();
+
+  simBindCurrentTask("loopTask");
+  beginSimulation(config);
+
+  // Same order as setup() on the board, minus Wi-Fi provisioning: the simulated station is always connected
+  beginLogging();
+  beginCpuIdleMonitor();
+  beginPowerManagement();
+  beginI2CBuses();
+#if FEATURE_PCA9685
+  restorePCA9685Outputs();
+#endif
+  AsyncWebServer server(config.port);
+  startNormalMode(server);
+  Serial.printf("Simulated subcontroller on port %u: %u DS18B20, %u BME280, %u ADS1115, %u PCA9685\n", config.port,
+                config.ds18b20Count, config.bme280Count, config.ads1115Count, config.pca9685Count);
+
+  // The loop task's only periodic work in normal mode is the hot-plug scan of the 1-Wire and I2C buses
+  while (true)
+  {
+    delay(DS18B20_SCAN_SLICE_MS);
+#if FEATURE_DS18B20
+    stepDS18B20Scan();
+#endif
+    probeI2CInventory();
+    advertiseInventory();
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Compile-time firmware profile. Each FEATURE_* flag builds one driver or
+// service together with its routes; setting it to 0 leaves the code, and with
+// the matching platformio.ini environment the library, out of the image.
+// Everything is on unless a build flag says otherwise.
+
+#ifndef FEATURE_DS18B20
+#define FEATURE_DS18B20 1
+#endif
+
+#ifndef FEATURE_BME280
+#define FEATURE_BME280 1
+#endif
+
+#ifndef FEATURE_ADS1115
+#define FEATURE_ADS1115 1
+#endif
+
+#ifndef FEATURE_PCA9685
+#define FEATURE_PCA9685 1
+#endif
+
+// Firmware updates pulled over HTTP (HTTPClient, Update, SHA-256)
+#ifndef FEATURE_OTA
+#define FEATURE_OTA 1
+#endif
+
+// UDP multicast output commands; only meaningful with PCA9685 outputs
+#ifndef FEATURE_MULTICAST
+#define FEATURE_MULTICAST FEATURE_PCA9685
+#endif
+
+#if FEATURE_MULTICAST && !FEATURE_PCA9685
+#error "FEATURE_MULTICAST needs FEATURE_PCA9685"
+#endif
+
+// Reported in /api/system/status and the inventory
+#ifndef FIRMWARE_PROFILE
+#define FIRMWARE_PROFILE "full"
+#endif
+
+struct FirmwareModule
+{
+  const char *name;
+  bool enabled;
+};
+
+// Every optional module and whether this image carries it
+static constexpr FirmwareModule FIRMWARE_MODULES[] = {
+  {"ds18b20", FEATURE_DS18B20},
+  {"bme280", FEATURE_BME280},
+  {"ads1115", FEATURE_ADS1115},
+  {"pca9685", FEATURE_PCA9685},
+  {"ota", FEATURE_OTA},
+  {"multicast", FEATURE_MULTICAST},
+};
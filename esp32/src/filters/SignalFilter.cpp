@@ -0,0 +1,354 @@
+#include "SignalFilter.h"
+
+#include <Preferences.h>
+
+struct SignalFilterSlot
+{
+  bool used;
+  char channel[SIGNAL_FILTER_CHANNEL_LENGTH];
+  SignalFilter filter;
+};
+
+// What is persisted for each slot, keyed "c<slot>" in the "filters" namespace
+struct StoredSignalFilter
+{
+  char channel[SIGNAL_FILTER_CHANNEL_LENGTH];
+  SignalFilterConfig config;
+};
+
+static SignalFilterSlot signalFilterSlots[SIGNAL_FILTER_MAX_CHANNELS];
+// Guards the slot table. A filter's history is only touched by the worker that reads its channel,
+// which is also where the handlers configure and remove it, so a found filter stays valid for a read.
+static SemaphoreHandle_t signalFilterMutex = NULL;
+
+void SignalFilter::configure(const SignalFilterConfig &config)
+{
+  _config = config;
+  reset();
+}
+
+void SignalFilter::reset()
+{
+  _medianCount = 0;
+  _medianNext = 0;
+  _emaPrimed = false;
+}
+
+/**
+ * @brief Clears filter history when the meaning of the raw samples changes (e.g. ADC gain).
+ */
+void SignalFilter::resetIfContextChanged(uint32_t context)
+{
+  if (context != _context)
+  {
+    _context = context;
+    reset();
+  }
+}
+
+/**
+ * @brief Runs the decimation, median and EMA stages on one batch of raw samples.
+ * @param samples Raw samples from one acquisition, normally oversampling() of them.
+ * @param count Number of samples (at least 1).
+ * @return The conditioned value, before calibration.
+ */
+fixed_t SignalFilter::process(const fixed_t *samples, uint8_t count)
+{
+  int64_t sum = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    sum += samples[i];
+  }
+  fixed_t value = (fixed_t)(sum / count);
+
+  if (_config.medianWindow > 1)
+  {
+    _median[_medianNext] = value;
+    _medianNext = (_medianNext + 1) % _config.medianWindow;
+    if (_medianCount < _config.medianWindow)
+    {
+      _medianCount++;
+    }
+
+    // Insertion sort; the window is at most 7 entries
+    fixed_t sorted[SIGNAL_FILTER_MAX_MEDIAN];
+    for (uint8_t i = 0; i < _medianCount; i++)
+    {
+      fixed_t v = _median[i];
+      uint8_t j = i;
+      while (j > 0 && sorted[j - 1] > v)
+      {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = v;
+    }
+    value = sorted[_medianCount / 2];
+  }
+
+  if (_config.emaAlpha < FIXED_ONE)
+  {
+    if (!_emaPrimed)
+    {
+      _ema = value;
+      _emaPrimed = true;
+    }
+    else
+    {
+      _ema += (fixed_t)(((int64_t)_config.emaAlpha * (value - _ema)) >> 16);
+    }
+    value = _ema;
+  }
+
+  return value;
+}
+
+/**
+ * @brief Maps a value through the calibration table by piecewise-linear interpolation.
+ *
+ * Values outside the table are clamped to the first/last point.
+ */
+fixed_t SignalFilter::calibrate(fixed_t value) const
+{
+  uint8_t n = _config.calibrationPoints;
+  if (n < 2)
+  {
+    return value;
+  }
+  const fixed_t *x = _config.calibrationX;
+  const fixed_t *y = _config.calibrationY;
+  if (value <= x[0])
+  {
+    return y[0];
+  }
+  for (uint8_t i = 1; i < n; i++)
+  {
+    if (value <= x[i])
+    {
+      return y[i - 1] + (fixed_t)((int64_t)(value - x[i - 1]) * (y[i] - y[i - 1]) / (x[i] - x[i - 1]));
+    }
+  }
+  return y[n - 1];
+}
+
+bool isValidSignalFilterConfig(const SignalFilterConfig &config)
+{
+  if (config.oversampling < 1 || config.oversampling > SIGNAL_FILTER_MAX_OVERSAMPLING)
+  {
+    return false;
+  }
+  if (config.medianWindow < 1 || config.medianWindow > SIGNAL_FILTER_MAX_MEDIAN || config.medianWindow % 2 == 0)
+  {
+    return false;
+  }
+  if (config.emaAlpha <= 0 || config.emaAlpha > FIXED_ONE)
+  {
+    return false;
+  }
+  if (config.calibrationPoints == 1 || config.calibrationPoints > SIGNAL_FILTER_MAX_CALIBRATION_POINTS)
+  {
+    return false;
+  }
+  for (uint8_t i = 1; i < config.calibrationPoints; i++)
+  {
+    if (config.calibrationX[i] <= config.calibrationX[i - 1])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Runs a channel's full pipeline, or plain averaging if the channel has no filter.
+ * @param filter The channel's filter from findSignalFilter(), may be nullptr.
+ * @param samples Raw samples from one acquisition.
+ * @param count Number of samples (at least 1).
+ * @return The conditioned and calibrated value.
+ */
+fixed_t conditionSamples(SignalFilter *filter, const fixed_t *samples, uint8_t count)
+{
+  if (filter != nullptr)
+  {
+    return filter->calibrate(filter->process(samples, count));
+  }
+  int64_t sum = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    sum += samples[i];
+  }
+  return (fixed_t)(sum / count);
+}
+
+static SignalFilterSlot *findSlot(const String &channel)
+{
+  for (uint8_t i = 0; i < SIGNAL_FILTER_MAX_CHANNELS; i++)
+  {
+    if (signalFilterSlots[i].used && channel == signalFilterSlots[i].channel)
+    {
+      return &signalFilterSlots[i];
+    }
+  }
+  return nullptr;
+}
+
+static String slotKey(uint8_t slot)
+{
+  return "c" + String(slot);
+}
+
+/**
+ * @brief Loads persisted filter configurations.
+ */
+void beginSignalFilters()
+{
+  signalFilterMutex = xSemaphoreCreateMutex();
+  Preferences prefs;
+  prefs.begin("filters", true);
+  for (uint8_t i = 0; i < SIGNAL_FILTER_MAX_CHANNELS; i++)
+  {
+    StoredSignalFilter stored;
+    String key = slotKey(i);
+    // Skip entries written by a firmware with a different layout
+    if (prefs.getBytesLength(key.c_str()) != sizeof(stored) ||
+        prefs.getBytes(key.c_str(), &stored, sizeof(stored)) != sizeof(stored) ||
+        !isValidSignalFilterConfig(stored.config))
+    {
+      continue;
+    }
+    stored.channel[SIGNAL_FILTER_CHANNEL_LENGTH - 1] = '\0';
+    signalFilterSlots[i].used = true;
+    strcpy(signalFilterSlots[i].channel, stored.channel);
+    signalFilterSlots[i].filter.configure(stored.config);
+  }
+  prefs.end();
+}
+
+/**
+ * @brief Returns the filter for a channel, or nullptr if the channel is unfiltered.
+ * @param channel Channel name, e.g. "ads1115/0x48/0" or "bme280/0x76/humidity".
+ */
+SignalFilter *findSignalFilter(const String &channel)
+{
+  xSemaphoreTake(signalFilterMutex, portMAX_DELAY);
+  SignalFilterSlot *slot = findSlot(channel);
+  xSemaphoreGive(signalFilterMutex);
+  return slot != nullptr ? &slot->filter : nullptr;
+}
+
+/**
+ * @brief Copies a channel's filter settings.
+ * @return false if the channel is unfiltered.
+ */
+bool getSignalFilterConfig(const String &channel, SignalFilterConfig &config)
+{
+  xSemaphoreTake(signalFilterMutex, portMAX_DELAY);
+  SignalFilterSlot *slot = findSlot(channel);
+  if (slot != nullptr)
+  {
+    config = slot->filter.config();
+  }
+  xSemaphoreGive(signalFilterMutex);
+  return slot != nullptr;
+}
+
+/**
+ * @brief Creates or replaces the filter for a channel and persists it.
+ * @return false if the config is invalid, the name is too long or all slots are taken.
+ */
+bool configureSignalFilter(const String &channel, const SignalFilterConfig &config)
+{
+  if (!isValidSignalFilterConfig(config) || channel.length() == 0 || channel.length() >= SIGNAL_FILTER_CHANNEL_LENGTH)
+  {
+    return false;
+  }
+
+  xSemaphoreTake(signalFilterMutex, portMAX_DELAY);
+  SignalFilterSlot *slot = findSlot(channel);
+  for (uint8_t i = 0; slot == nullptr && i < SIGNAL_FILTER_MAX_CHANNELS; i++)
+  {
+    if (!signalFilterSlots[i].used)
+    {
+      slot = &signalFilterSlots[i];
+      slot->used = true;
+      strcpy(slot->channel, channel.c_str());
+    }
+  }
+  if (slot == nullptr)
+  {
+    xSemaphoreGive(signalFilterMutex);
+    return false;
+  }
+  slot->filter.configure(config);
+
+  StoredSignalFilter stored = StoredSignalFilter(); // zero-filled so the blob is deterministic
+  strcpy(stored.channel, slot->channel);
+  stored.config = config;
+
+  Preferences prefs;
+  prefs.begin("filters", false);
+  prefs.putBytes(slotKey(slot - signalFilterSlots).c_str(), &stored, sizeof(stored));
+  prefs.end();
+  xSemaphoreGive(signalFilterMutex);
+  return true;
+}
+
+/**
+ * @brief Removes the filter for a channel, so its readings pass through unchanged.
+ * @return false if the channel had no filter.
+ */
+bool removeSignalFilter(const String &channel)
+{
+  xSemaphoreTake(signalFilterMutex, portMAX_DELAY);
+  SignalFilterSlot *slot = findSlot(channel);
+  if (slot == nullptr)
+  {
+    xSemaphoreGive(signalFilterMutex);
+    return false;
+  }
+  slot->used = false;
+
+  Preferences prefs;
+  prefs.begin("filters", false);
+  prefs.remove(slotKey(slot - signalFilterSlots).c_str());
+  prefs.end();
+  xSemaphoreGive(signalFilterMutex);
+  return true;
+}
+
+String getSignalFiltersJson()
+{
+  String json = "{ \"filters\": [";
+  bool first = true;
+  xSemaphoreTake(signalFilterMutex, portMAX_DELAY);
+  for (uint8_t i = 0; i < SIGNAL_FILTER_MAX_CHANNELS; i++)
+  {
+    if (!signalFilterSlots[i].used)
+    {
+      continue;
+    }
+    const SignalFilterConfig &config = signalFilterSlots[i].filter.config();
+    if (!first)
+    {
+      json += ", ";
+    }
+    first = false;
+    json += "{ \"channel\":\"" + String(signalFilterSlots[i].channel) + "\", ";
+    json += "\"oversampling\":" + String(config.oversampling) + ", ";
+    json += "\"median\":" + String(config.medianWindow) + ", ";
+    json += "\"ema_alpha\":" + String(fromFixed(config.emaAlpha), 4) + ", ";
+    json += "\"calibration\":[";
+    for (uint8_t p = 0; p < config.calibrationPoints; p++)
+    {
+      if (p > 0)
+      {
+        json += ", ";
+      }
+      json += "[" + String(fromFixed(config.calibrationX[p]), 4) + ", " + String(fromFixed(config.calibrationY[p]), 4) + "]";
+    }
+    json += "] }";
+  }
+  xSemaphoreGive(signalFilterMutex);
+  json += "] }";
+  return json;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Q16.16 fixed point: 16 integer bits cover ADC counts, degrees, %RH and hPa.
+typedef int32_t fixed_t;
+#define FIXED_ONE ((fixed_t)1 << 16)
+
+inline fixed_t toFixed(float value)
+{
+  return (fixed_t)lroundf(value * FIXED_ONE);
+}
+
+inline float fromFixed(fixed_t value)
+{
+  return (float)value / FIXED_ONE;
+}
+
+#define SIGNAL_FILTER_MAX_OVERSAMPLING 16
+#define SIGNAL_FILTER_MAX_MEDIAN 7
+#define SIGNAL_FILTER_MAX_CALIBRATION_POINTS 8
+#define SIGNAL_FILTER_MAX_CHANNELS 16
+#define SIGNAL_FILTER_CHANNEL_LENGTH 32
+
+/**
+ * @brief Per-channel conditioning settings. The defaults pass samples through unchanged.
+ *
+ * Stages run in order: oversampling (boxcar average of N reads), median-of-N spike
+ * rejection over recent outputs, exponential moving average, then an optional
+ * piecewise-linear calibration table. All values are in the channel's own units.
+ */
+struct SignalFilterConfig
+{
+  uint8_t oversampling = 1;
+  uint8_t medianWindow = 1;
+  fixed_t emaAlpha = FIXED_ONE;
+  uint8_t calibrationPoints = 0;
+  fixed_t calibrationX[SIGNAL_FILTER_MAX_CALIBRATION_POINTS];
+  fixed_t calibrationY[SIGNAL_FILTER_MAX_CALIBRATION_POINTS];
+};
+
+class SignalFilter
+{
+public:
+  void configure(const SignalFilterConfig &config);
+  void reset();
+  void resetIfContextChanged(uint32_t context);
+
+  uint8_t oversampling() const { return _config.oversampling; }
+  bool hasCalibration() const { return _config.calibrationPoints >= 2; }
+  const SignalFilterConfig &config() const { return _config; }
+
+  fixed_t process(const fixed_t *samples, uint8_t count);
+  fixed_t calibrate(fixed_t value) const;
+
+private:
+  SignalFilterConfig _config;
+  uint32_t _context = 0;
+  fixed_t _median[SIGNAL_FILTER_MAX_MEDIAN];
+  uint8_t _medianCount = 0;
+  uint8_t _medianNext = 0;
+  fixed_t _ema = 0;
+  bool _emaPrimed = false;
+};
+
+bool isValidSignalFilterConfig(const SignalFilterConfig &config);
+fixed_t conditionSamples(SignalFilter *filter, const fixed_t *samples, uint8_t count);
+
+void beginSignalFilters();
+SignalFilter *findSignalFilter(const String &channel);
+bool getSignalFilterConfig(const String &channel, SignalFilterConfig &config);
+bool configureSignalFilter(const String &channel, const SignalFilterConfig &config);
+bool removeSignalFilter(const String &channel);
+String getSignalFiltersJson();
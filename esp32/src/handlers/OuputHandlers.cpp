@@ -1,13 +1,77 @@
+#include "Features.h"
+
+#if FEATURE_PCA9685
+
 #include "handlers/OutputHandlers.h"
 #include <AsyncTCP.h>
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 
 #include "utils/i2cUtils.h"
+#include "utils/httpUtils.h"
+#include "utils/traceUtils.h"
 #include "outputs/Pca9685.h"
 
+static bool parsePin(const String &pinStr, uint8_t &pin)
+{
+  if ((pinStr.length() == 2 && pinStr.charAt(0) != '1') ||
+      (pinStr.length() == 2 && pinStr.charAt(0) == '1' && pinStr.charAt(1) > '5') ||
+      (pinStr.length() == 1 && (pinStr.charAt(0) < '0' || pinStr.charAt(0) > '9')) ||
+      pinStr.length() == 0 || pinStr.length() > 2)
+  {
+    return false;
+  }
+  pin = (uint8_t)strtoul(pinStr.c_str(), nullptr, 0);
+  return true;
+}
+
+static String pinResultJson(const char *status, uint8_t bus, uint8_t address, uint8_t pin, uint16_t percentage_on)
+{
+  String response_json = "{ ";
+  response_json += "\"status\":\"" + String(status) + "\", ";
+  response_json += "\"address\":\"" + formatI2CDeviceAddress(bus, address) + "\", ";
+  response_json += "\"pin\":" + String(pin) + ", ";
+  response_json += "\"percentage_on\":" + String(percentage_on);
+  response_json += " }";
+  return response_json;
+}
+
+static String groupToJson(uint8_t g)
+{
+  Pca9685Group group = getPCA9685Group(g);
+  String json = "{ ";
+  json += "\"group\":" + String(g) + ", ";
+  json += "\"type\":\"" + String(g == 0 ? "all_call" : "subaddress") + "\", ";
+  if (group.address == 0)
+  {
+    json += "\"address\":null, ";
+  }
+  else
+  {
+    json += "\"address\":\"" + formatI2CDeviceAddress(group.bus, group.address) + "\", ";
+  }
+  json += "\"members\":[";
+  bool first = true;
+  for (uint8_t i = 0; group.address != 0 && i < 64; i++)
+  {
+    if (!(group.members & (1ULL << i)))
+    {
+      continue;
+    }
+    if (!first)
+    {
+      json += ", ";
+    }
+    first = false;
+    json += "\"" + formatI2CDeviceAddress(group.bus, 0x40 + i) + "\"";
+  }
+  json += "] }";
+  return json;
+}
+
 void handlePCA9685Put(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
 {
+  TRACE_SCOPE(__func__);
   // Assemble the body
   static String body;
   if (index == 0)
@@ -33,12 +97,6 @@ void handlePCA9685Put(AsyncWebServerRequest *request, uint8_t *data, size_t len,
     request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
     return;
   }
-  if (!doc["value"].is<int>())
-  {
-    request->send(400, "application/json", "{\"error\":\"missing required field: value\"}");
-    return;
-  }
-  int value = doc["value"];
 
   // Extract address and pin from URL
   String url = request->url();
@@ -48,28 +106,63 @@ void handlePCA9685Put(AsyncWebServerRequest *request, uint8_t *data, size_t len,
   String addressStr = before.substring(prevSlash + 1);
   if (addressStr == "pca9685")
   {
-    request->send(400, "application/json", "{\"error\":\"Missing PCA9685 pin\"}");
+    // No pin: a PUT to the chip itself sets its PWM frequency
+    if (!doc["frequency"].is<int>())
+    {
+      request->send(400, "application/json", "{\"error\":\"Missing PCA9685 pin\"}");
+      return;
+    }
+    I2CDeviceAddress chip = validateI2CDeviceAddress(url.substring(url.lastIndexOf('/') + 1), 0x40, 0x7F);
+    if (chip.address == 0)
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 address\"}");
+      return;
+    }
+    int frequency = doc["frequency"];
+    if (frequency < PCA9685_MIN_FREQUENCY || frequency > PCA9685_MAX_FREQUENCY)
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid frequency\"}");
+      return;
+    }
+    DriverError error = setPCA9685Frequency(chip.bus, chip.address, frequency);
+    if (error != DRIVER_OK)
+    {
+      sendDriverError(request, error, "Failed to retrieve PCA9685 at address " + formatI2CDeviceAddress(chip.bus, chip.address));
+      return;
+    }
+    String response_json = "{ ";
+    response_json += "\"status\":\"ok\", ";
+    response_json += "\"address\":\"" + formatI2CDeviceAddress(chip.bus, chip.address) + "\", ";
+    response_json += "\"frequency\":" + String(frequency);
+    response_json += " }";
+    request->send(200, "application/json", response_json);
+    return;
+  }
+
+  if (!doc["value"].is<int>())
+  {
+    request->send(400, "application/json", "{\"error\":\"missing required field: value\"}");
     return;
   }
+  int value = doc["value"];
+  // By default the change is queued and acknowledged at once; "sync" waits for the write
+  bool sync = doc["sync"] | false;
 
   // Get address
-  uint8_t address = validateI2CHexAddress(addressStr, 0x40, 0x7F);
-  if (address == 0)
+  I2CDeviceAddress device = validateI2CDeviceAddress(addressStr, 0x40, 0x7F);
+  if (device.address == 0)
   {
     request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 address\"}");
     return;
   }
 
   // Get pin
-  String pinStr = url.substring(url.lastIndexOf('/') + 1);
-  if ((pinStr.length() == 2 && pinStr.charAt(0) != '1') ||
-      (pinStr.length() == 2 && pinStr.charAt(0) == '1' && pinStr.charAt(1) > '5') ||
-      (pinStr.length() == 1 && (pinStr.charAt(0) < '0' || pinStr.charAt(0) > '9')))
+  uint8_t pin;
+  if (!parsePin(url.substring(url.lastIndexOf('/') + 1), pin))
   {
     request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 pin\"}");
     return;
   }
-  uint8_t pin = (uint8_t)strtoul(pinStr.c_str(), nullptr, 0);
 
   // Validate inputs
   if (value < 0 || value > 100)
@@ -79,32 +172,232 @@ void handlePCA9685Put(AsyncWebServerRequest *request, uint8_t *data, size_t len,
   }
 
   // Effect change
-  String result_json = setPCA9685Pin(address, pin, value);
-
-  if (result_json.indexOf("error") == -1)
-  {
-    request->send(200, "application/json", result_json);
-  }
-  else
+  bool queued = false;
+  DriverError error = sync ? setPCA9685Pin(device.bus, device.address, pin, value)
+                           : queuePCA9685Pin(device.bus, device.address, pin, value, &queued);
+  if (error != DRIVER_OK)
   {
-    request->send(400, "application/json", result_json);
+    sendDriverError(request, error, "Failed to set PWM on PCA9685 at address " + formatI2CDeviceAddress(device.bus, device.address) + ", pin " + String(pin));
+    return;
   }
+  request->send(queued ? 202 : 200, "application/json",
+                pinResultJson(queued ? "queued" : "ok", device.bus, device.address, pin, value));
 };
 
 void handlePCA9685Get(AsyncWebServerRequest *request)
 {
+  TRACE_SCOPE(__func__);
   // Extract address from URL
   String url = request->url();
   String addressStr = url.substring(url.lastIndexOf('/') + 1);
 
   // Get address
-  uint8_t address = validateI2CHexAddress(addressStr, 0x40, 0x7F);
-  if (address == 0)
+  I2CDeviceAddress device = validateI2CDeviceAddress(addressStr, 0x40, 0x7F);
+  if (device.address == 0)
   {
     request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 address\"}");
     return;
   }
 
-  String response = getPCA9685Status(address);
-  request->send(200, "application/json", response);
-}
\ No newline at end of file
+  // Outputs only change through this firmware, so a matching ETag means the chip needn't be read
+  if (sendIfNotModified(request, pca9685StateCache))
+  {
+    return;
+  }
+  Pca9685Status status;
+  DriverError error = readPCA9685Status(device.bus, device.address, status);
+  if (error != DRIVER_OK)
+  {
+    sendDriverError(request, error, "Failed to retrieve PCA9685 at address " + formatI2CDeviceAddress(device.bus, device.address));
+    return;
+  }
+  String response_json = "{ ";
+  response_json += "\"status\":\"ok\", ";
+  response_json += "\"address\":\"" + formatI2CDeviceAddress(device.bus, device.address) + "\", ";
+  response_json += "\"frequency\":" + String(status.frequency) + ", ";
+  response_json += "\"pins\":{ ";
+  for (uint8_t pin = 0; pin < 16; pin++)
+  {
+    response_json += "\"" + String(pin) + "\":" + String(status.percentageOn[pin]);
+    if (pin < 15)
+    {
+      response_json += ", ";
+    }
+  }
+  response_json += " } }";
+  sendCacheable(request, 200, response_json, pca9685StateCache);
+}
+
+void handlePCA9685GroupsGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  String json = "{ \"groups\": [";
+  for (uint8_t g = 0; g < PCA9685_GROUP_COUNT; g++)
+  {
+    if (g > 0)
+    {
+      json += ", ";
+    }
+    json += groupToJson(g);
+  }
+  json += "] }";
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Parses "/api/outputs/pca9685/groups/<group>[/<pin>]".
+ * @return false if the group is missing or not a single digit.
+ */
+static bool parseGroupUrl(const String &url, uint8_t &group, String &pinStr)
+{
+  const char *prefix = "/api/outputs/pca9685/groups/";
+  if (!url.startsWith(prefix))
+  {
+    return false;
+  }
+  String rest = url.substring(strlen(prefix));
+  int slash = rest.indexOf('/');
+  String groupStr = slash == -1 ? rest : rest.substring(0, slash);
+  pinStr = slash == -1 ? "" : rest.substring(slash + 1);
+  if (groupStr.length() != 1 || groupStr.charAt(0) < '0' || groupStr.charAt(0) >= '0' + PCA9685_GROUP_COUNT)
+  {
+    return false;
+  }
+  group = groupStr.charAt(0) - '0';
+  return true;
+}
+
+void handlePCA9685GroupPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  // Assemble the body
+  static String body;
+  if (index == 0)
+  {
+    body = ""; // first chunk
+  }
+
+  for (size_t i = 0; i < len; i++)
+  {
+    body += (char)data[i];
+  }
+
+  // Only process once the full body is received
+  if (index + len != total)
+  {
+    return;
+  }
+
+  JsonDocument doc;
+  if (deserializeJson(doc, body))
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  uint8_t group;
+  String pinStr;
+  if (!parseGroupUrl(request->url(), group, pinStr))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 group\"}");
+    return;
+  }
+
+  if (pinStr.length() > 0)
+  {
+    // Group write: one transaction to the group address
+    uint8_t pin;
+    if (!parsePin(pinStr, pin))
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 pin\"}");
+      return;
+    }
+    if (!doc["value"].is<int>() || doc["value"].as<int>() < 0 || doc["value"].as<int>() > 100)
+    {
+      request->send(400, "application/json", "{\"error\":\"missing or invalid field: value\"}");
+      return;
+    }
+    int value = doc["value"];
+    DriverError error = setPCA9685GroupPin(group, pin, value);
+    if (error != DRIVER_OK)
+    {
+      Pca9685Group target = getPCA9685Group(group);
+      sendDriverError(request, error, error == DRIVER_NOT_CONFIGURED
+                                          ? "PCA9685 group " + String(group) + " is not configured"
+                                          : "No PCA9685 answered group " + String(group) + " at address " + formatI2CDeviceAddress(target.bus, target.address));
+      return;
+    }
+    Pca9685Group target = getPCA9685Group(group);
+    String response_json = "{ ";
+    response_json += "\"status\":\"ok\", ";
+    response_json += "\"group\":" + String(group) + ", ";
+    response_json += "\"address\":\"" + formatI2CDeviceAddress(target.bus, target.address) + "\", ";
+    response_json += "\"pin\":" + String(pin) + ", ";
+    response_json += "\"percentage_on\":" + String(value);
+    response_json += " }";
+    request->send(200, "application/json", response_json);
+    return;
+  }
+  else
+  {
+    // Group configuration: its address, member chips and optionally a common frequency
+    I2CDeviceAddress address = validateI2CDeviceAddress(doc["address"] | "", 0x08, 0x77);
+    if (address.address == 0)
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid group address\"}");
+      return;
+    }
+    if (!doc["members"].is<JsonArrayConst>())
+    {
+      request->send(400, "application/json", "{\"error\":\"missing required field: members\"}");
+      return;
+    }
+    uint64_t memberMask = 0;
+    for (JsonVariantConst member : doc["members"].as<JsonArrayConst>())
+    {
+      I2CDeviceAddress chip = validateI2CDeviceAddress(member | "", 0x40, 0x7F);
+      if (chip.address == 0 || chip.bus != address.bus)
+      {
+        request->send(400, "application/json", "{\"error\":\"Members must be PCA9685 addresses on the group's bus\"}");
+        return;
+      }
+      memberMask |= 1ULL << (chip.address - 0x40);
+    }
+    // 0 leaves the members' frequencies alone
+    int frequency = doc["frequency"] | 0;
+    if (frequency != 0 && (frequency < PCA9685_MIN_FREQUENCY || frequency > PCA9685_MAX_FREQUENCY))
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid frequency\"}");
+      return;
+    }
+    DriverError error = configurePCA9685Group(group, address, memberMask, frequency);
+    if (error != DRIVER_OK)
+    {
+      sendDriverError(request, error, error == DRIVER_CONFLICT
+                                          ? "Address " + formatI2CDeviceAddress(address.bus, address.address) + " is already in use"
+                                          : String("A group cannot use the address of one of its members"));
+      return;
+    }
+    request->send(200, "application/json", groupToJson(group));
+  }
+}
+
+void handlePCA9685GroupDelete(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  uint8_t group;
+  String pinStr;
+  if (!parseGroupUrl(request->url(), group, pinStr) || pinStr.length() > 0)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid PCA9685 group\"}");
+    return;
+  }
+  if (!removePCA9685Group(group))
+  {
+    request->send(404, "application/json", "{\"error\":\"PCA9685 group is not configured\"}");
+    return;
+  }
+  handlePCA9685GroupsGet(request);
+}
+
+#endif
@@ -3,4 +3,7 @@
 #include <ESPAsyncWebServer.h>
 
 void handlePCA9685Put(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
-void handlePCA9685Get(AsyncWebServerRequest *request);
\ No newline at end of file
+void handlePCA9685Get(AsyncWebServerRequest *request);
+void handlePCA9685GroupsGet(AsyncWebServerRequest *request);
+void handlePCA9685GroupPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handlePCA9685GroupDelete(AsyncWebServerRequest *request);
@@ -1,14 +1,69 @@
 #include "handlers/SensorHandlers.h"
 #include <AsyncTCP.h>
+#include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 
+#include "utils/deadlineUtils.h"
 #include "utils/i2cUtils.h"
+#include "utils/httpUtils.h"
+#include "utils/traceUtils.h"
+#include "Features.h"
+#if FEATURE_DS18B20
 #include "sensors/Ds18b20.h"
+#endif
+#if FEATURE_BME280
 #include "sensors/Bme280.h"
+#endif
+#if FEATURE_ADS1115
 #include "sensors/Ads1115.h"
+#endif
+
+/**
+ * @brief Reads ?deadline_ms=, the longest the client will wait for a fresh reading.
+ *
+ * @param deadlineMs Receives the deadline, or 0 when the request has none.
+ * @return false if the value is not a whole number of 1-DEADLINE_MAX_MS ms; a 400 has been sent.
+ */
+static bool parseDeadline(AsyncWebServerRequest *request, uint32_t &deadlineMs)
+{
+  deadlineMs = 0;
+  if (!request->hasParam("deadline_ms"))
+  {
+    return true;
+  }
+  const String &value = request->getParam("deadline_ms")->value();
+  char *end;
+  unsigned long ms = strtoul(value.c_str(), &end, 10);
+  if (value.length() == 0 || *end != '\0' || !isdigit((unsigned char)value[0]) || ms < 1 || ms > DEADLINE_MAX_MS)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid deadline_ms, expected 1-" + String(DEADLINE_MAX_MS) + "\"}");
+    return false;
+  }
+  deadlineMs = ms;
+  return true;
+}
+
+// Sends a failed read; a missed deadline reads the same for every sensor
+static void sendReadError(AsyncWebServerRequest *request, DriverError error, const String &message)
+{
+  sendDriverError(request, error, error == DRIVER_TIMEOUT ? String("No reading within deadline_ms") : message);
+}
+
+#if FEATURE_DS18B20
+struct Ds18b20Channel
+{
+  char address[17];
+};
+
+static DriverError readDs18b20Channel(const void *params, void *reading)
+{
+  const Ds18b20Channel *channel = (const Ds18b20Channel *)params;
+  return readDS18B20ByAddress(String(channel->address), *(Ds18b20Reading *)reading);
+}
 
 void handleDs18b20Get(AsyncWebServerRequest *request)
 {
+  TRACE_SCOPE(__func__);
   String url = request->url();
   int lastSlash = url.lastIndexOf('/');
 
@@ -21,57 +76,366 @@ void handleDs18b20Get(AsyncWebServerRequest *request)
     return;
   }
 
-  String response_json = readDS18B20ByAddress(address);
-  if (response_json.indexOf("error") == -1)
+  uint32_t deadlineMs;
+  if (!parseDeadline(request, deadlineMs))
   {
-    request->send(200, "application/json", response_json);
+    return;
   }
-  else
+
+  Ds18b20Channel channel;
+  strncpy(channel.address, address.c_str(), sizeof(channel.address));
+  Ds18b20Reading reading;
+  DeadlineRead read = readWithDeadline(("ds18b20/" + address).c_str(), DEADLINE_WORKER_ONEWIRE, readDs18b20Channel,
+                                       &channel, sizeof(channel), &reading, sizeof(reading), deadlineMs);
+  if (read.error != DRIVER_OK)
   {
-    request->send(404, "application/json", response_json);
+    sendReadError(request, read.error, read.error == DRIVER_NOT_FOUND ? "Sensor not connected at given address"
+                                                                      : "Failed to read DS18B20 at address " + address);
+    return;
   }
+  request->send(200, "application/json", "{\"address\":\"" + address + "\",\"temperature\":" + String(reading.temperature, 2) + "," + sampleStampJson(reading.sample, read.stale) + "}");
 }
 
 void handleDs18b20AddressesGet(AsyncWebServerRequest *request)
 {
-  String response_json = getDS1820AddressesJson();
-  request->send(200, "application/json", response_json);
+  TRACE_SCOPE(__func__);
+  if (sendIfNotModified(request, ds18b20AddressesCache))
+  {
+    return;
+  }
+  sendCacheable(request, 200, getDS1820AddressesJson(), ds18b20AddressesCache);
+}
+
+void handleDs18b20InventoryGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  request->send(200, "application/json", getDS18B20InventoryJson());
+}
+
+#endif
+
+#if FEATURE_BME280
+// A channel switched off reads NAN, which JSON cannot carry
+static String jsonNumber(float value, unsigned int decimals)
+{
+  return isnan(value) ? String("null") : String(value, decimals);
+}
+
+struct Bme280Channel
+{
+  uint8_t bus;
+  uint8_t address;
+};
+
+static DriverError readBme280Channel(const void *params, void *reading)
+{
+  const Bme280Channel *channel = (const Bme280Channel *)params;
+  return readBME280(channel->bus, channel->address, *(Bme280Reading *)reading);
 }
 
 void handleBme280Get(AsyncWebServerRequest *request)
 {
+  TRACE_SCOPE(__func__);
   const String deviceName = "BME280";
   String url = request->url();
   int lastSlash = url.lastIndexOf('/');
   String address_str = request->urlDecode(url.substring(lastSlash + 1));
 
   // Get address
-  uint8_t address = validateI2CHexAddress(address_str, 0x76, 0x77);
-  if (address == 0)
+  I2CDeviceAddress device = validateI2CDeviceAddress(address_str, 0x76, 0x77);
+  if (device.address == 0)
   {
     String error_json = "{\"error\":\"Invalid " + deviceName + " address format\"}";
     request->send(400, "application/json", error_json);
+    return;
+  }
+
+  uint32_t deadlineMs;
+  if (!parseDeadline(request, deadlineMs))
+  {
+    return;
+  }
+
+  Bme280Channel channel = {device.bus, device.address};
+  Bme280Reading reading;
+  DeadlineRead read = readWithDeadline(("bme280/" + formatI2CDeviceAddress(device.bus, device.address)).c_str(), deadlineWorkerForI2CBus(device.bus),
+                                       readBme280Channel, &channel, sizeof(channel), &reading, sizeof(reading), deadlineMs);
+  if (read.error != DRIVER_OK)
+  {
+    sendReadError(request, read.error, read.error == DRIVER_NOT_FOUND ? "BME280 not found at address " + address_str
+                                                                      : "Failed to read BME280 at address " + address_str);
+    return;
+  }
+  String response_json = "{ \"readings\": { \"temperature\":" + jsonNumber(reading.temperature, 2) + ", ";
+  response_json += "\"humidity\":" + jsonNumber(reading.humidity, 2) + ", ";
+  response_json += "\"pressure\":" + jsonNumber(reading.pressure, 2) + " }, ";
+  response_json += sampleStampJson(reading.sample, read.stale) + " }";
+  request->send(200, "application/json", response_json);
+}
+
+static bool parseBme280Sampling(JsonVariantConst value, Adafruit_BME280::sensor_sampling &sampling)
+{
+  if (value.isNull())
+  {
+    return true;
+  }
+  if (!value.is<int>())
+  {
+    return false;
+  }
+  switch (value.as<int>())
+  {
+  case 0: sampling = Adafruit_BME280::SAMPLING_NONE; return true;
+  case 1: sampling = Adafruit_BME280::SAMPLING_X1; return true;
+  case 2: sampling = Adafruit_BME280::SAMPLING_X2; return true;
+  case 4: sampling = Adafruit_BME280::SAMPLING_X4; return true;
+  case 8: sampling = Adafruit_BME280::SAMPLING_X8; return true;
+  case 16: sampling = Adafruit_BME280::SAMPLING_X16; return true;
+  default: return false;
+  }
+}
+
+static bool parseBme280Filter(JsonVariantConst value, Adafruit_BME280::sensor_filter &filter)
+{
+  if (value.isNull())
+  {
+    return true;
+  }
+  if (!value.is<int>())
+  {
+    return false;
+  }
+  switch (value.as<int>())
+  {
+  case 0: filter = Adafruit_BME280::FILTER_OFF; return true;
+  case 2: filter = Adafruit_BME280::FILTER_X2; return true;
+  case 4: filter = Adafruit_BME280::FILTER_X4; return true;
+  case 8: filter = Adafruit_BME280::FILTER_X8; return true;
+  case 16: filter = Adafruit_BME280::FILTER_X16; return true;
+  default: return false;
+  }
+}
+
+static bool parseBme280Standby(JsonVariantConst value, Adafruit_BME280::standby_duration &standby)
+{
+  if (value.isNull())
+  {
+    return true;
+  }
+  if (!value.is<float>())
+  {
+    return false;
+  }
+  float ms = value.as<float>();
+  if (ms == 0.5F) standby = Adafruit_BME280::STANDBY_MS_0_5;
+  else if (ms == 10) standby = Adafruit_BME280::STANDBY_MS_10;
+  else if (ms == 20) standby = Adafruit_BME280::STANDBY_MS_20;
+  else if (ms == 62.5F) standby = Adafruit_BME280::STANDBY_MS_62_5;
+  else if (ms == 125) standby = Adafruit_BME280::STANDBY_MS_125;
+  else if (ms == 250) standby = Adafruit_BME280::STANDBY_MS_250;
+  else if (ms == 500) standby = Adafruit_BME280::STANDBY_MS_500;
+  else if (ms == 1000) standby = Adafruit_BME280::STANDBY_MS_1000;
+  else return false;
+  return true;
+}
+
+static uint8_t samplingToFactor(Adafruit_BME280::sensor_sampling sampling)
+{
+  return sampling == Adafruit_BME280::SAMPLING_NONE ? 0 : 1 << (sampling - 1);
+}
+
+static uint8_t filterToCoefficient(Adafruit_BME280::sensor_filter filter)
+{
+  return filter == Adafruit_BME280::FILTER_OFF ? 0 : 1 << filter;
+}
+
+static const char *standbyToString(Adafruit_BME280::standby_duration standby)
+{
+  switch (standby)
+  {
+  case Adafruit_BME280::STANDBY_MS_0_5: return "0.5";
+  case Adafruit_BME280::STANDBY_MS_10: return "10";
+  case Adafruit_BME280::STANDBY_MS_20: return "20";
+  case Adafruit_BME280::STANDBY_MS_62_5: return "62.5";
+  case Adafruit_BME280::STANDBY_MS_125: return "125";
+  case Adafruit_BME280::STANDBY_MS_250: return "250";
+  case Adafruit_BME280::STANDBY_MS_500: return "500";
+  default: return "1000";
+  }
+}
+
+static String bme280SettingsToJson(uint8_t bus, uint8_t address, const Bme280Settings &settings)
+{
+  String json = "{ ";
+  json += "\"address\":\"" + formatI2CDeviceAddress(bus, address) + "\", ";
+  json += "\"mode\":\"" + String(settings.mode == Adafruit_BME280::MODE_NORMAL ? "normal" : "forced") + "\", ";
+  json += "\"temperature_oversampling\":" + String(samplingToFactor(settings.temperatureSampling)) + ", ";
+  json += "\"pressure_oversampling\":" + String(samplingToFactor(settings.pressureSampling)) + ", ";
+  json += "\"humidity_oversampling\":" + String(samplingToFactor(settings.humiditySampling)) + ", ";
+  json += "\"filter\":" + String(filterToCoefficient(settings.filter)) + ", ";
+  json += "\"standby_ms\":" + String(standbyToString(settings.standby));
+  json += " }";
+  return json;
+}
+
+struct Bme280SettingsJob
+{
+  uint8_t bus;
+  uint8_t address;
+  Bme280Settings settings;
+  DriverError error;
+};
+
+// The driver belongs to its bus's read worker, so settings are read and changed there
+static void readBme280SettingsJob(void *arg)
+{
+  Bme280SettingsJob *job = (Bme280SettingsJob *)arg;
+  job->error = readBME280Settings(job->bus, job->address, job->settings);
+}
+
+static void configureBme280Job(void *arg)
+{
+  Bme280SettingsJob *job = (Bme280SettingsJob *)arg;
+  job->error = configureBME280(job->bus, job->address, job->settings);
+}
+
+/**
+ * @brief Runs a settings job on the bus's worker, answering 503 or 504 if it does not get done.
+ * @return true if the job ran; job then holds its result.
+ */
+static bool runBme280Job(AsyncWebServerRequest *request, uint8_t bus, DeadlineJobFunction run, Bme280SettingsJob &job)
+{
+  DeadlineJobResult result = runOnDeadlineWorker(deadlineWorkerForI2CBus(bus), run, &job, sizeof(job), DEADLINE_JOB_TIMEOUT_MS);
+  if (result == DEADLINE_JOB_BUSY)
+  {
+    request->send(503, "application/json", "{\"error\":\"I2C bus is too far behind to take a change\"}");
+    return false;
+  }
+  if (result == DEADLINE_JOB_TIMEOUT)
+  {
+    sendDriverError(request, DRIVER_TIMEOUT, "I2C bus " + String(bus) + " did not get to the BME280 within " + String(DEADLINE_JOB_TIMEOUT_MS) + " ms");
+    return false;
   }
+  return true;
+}
 
-  Adafruit_BME280 *bme280 = getBME280(address);
-  if (bme280 == nullptr)
+void handleBme280Put(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  // Assemble the body
+  static String body;
+  if (index == 0)
   {
-    request->send(404, "application/json", "{\"error\":\"BME280 not found at address " + address_str + "\"}");
+    body = ""; // first chunk
+  }
+
+  for (size_t i = 0; i < len; i++)
+  {
+    body += (char)data[i];
+  }
+
+  // Only process once the full body is received
+  if (index + len != total)
+  {
+    return;
+  }
+
+  String url = request->url();
+  String address_str = request->urlDecode(url.substring(url.lastIndexOf('/') + 1));
+  I2CDeviceAddress device = validateI2CDeviceAddress(address_str, 0x76, 0x77);
+  if (device.address == 0)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid BME280 address format\"}");
+    return;
+  }
+
+  JsonDocument doc;
+  if (deserializeJson(doc, body))
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
     return;
   }
-  String response_json = readBME280s(address);
-  if (response_json.indexOf("error") == -1)
+
+  Bme280SettingsJob job = {device.bus, device.address, Bme280Settings(), DRIVER_OK};
+  if (!runBme280Job(request, device.bus, readBme280SettingsJob, job))
   {
-    request->send(200, "application/json", response_json);
+    return;
   }
-  else
+  if (job.error != DRIVER_OK)
   {
-    request->send(404, "application/json", response_json);
+    sendDriverError(request, job.error, "BME280 not found at address " + address_str);
+    return;
   }
+
+  // Unspecified fields keep their current value
+  Bme280Settings &settings = job.settings;
+  if (!doc["mode"].isNull())
+  {
+    String mode = doc["mode"].as<String>();
+    if (mode == "normal")
+    {
+      settings.mode = Adafruit_BME280::MODE_NORMAL;
+    }
+    else if (mode == "forced")
+    {
+      settings.mode = Adafruit_BME280::MODE_FORCED;
+    }
+    else
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid mode, expected normal or forced\"}");
+      return;
+    }
+  }
+  if (!parseBme280Sampling(doc["temperature_oversampling"], settings.temperatureSampling) ||
+      !parseBme280Sampling(doc["pressure_oversampling"], settings.pressureSampling) ||
+      !parseBme280Sampling(doc["humidity_oversampling"], settings.humiditySampling))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid oversampling, expected 0, 1, 2, 4, 8 or 16\"}");
+    return;
+  }
+  if (!parseBme280Filter(doc["filter"], settings.filter))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid filter, expected 0, 2, 4, 8 or 16\"}");
+    return;
+  }
+  if (!parseBme280Standby(doc["standby_ms"], settings.standby))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid standby_ms\"}");
+    return;
+  }
+
+  if (!runBme280Job(request, device.bus, configureBme280Job, job))
+  {
+    return;
+  }
+  if (job.error != DRIVER_OK)
+  {
+    sendDriverError(request, job.error, "BME280 not found at address " + address_str);
+    return;
+  }
+  request->send(200, "application/json", bme280SettingsToJson(device.bus, device.address, settings));
+}
+
+#endif
+
+#if FEATURE_ADS1115
+struct Ads1115Channel
+{
+  uint8_t bus;
+  uint8_t address;
+  uint8_t pin;
+  adsGain_t gain;
+};
+
+static DriverError readAds1115Channel(const void *params, void *reading)
+{
+  const Ads1115Channel *channel = (const Ads1115Channel *)params;
+  return readADS1115(channel->bus, channel->address, channel->pin, channel->gain, *(Ads1115Reading *)reading);
 }
 
 void handleADS1115Get(AsyncWebServerRequest *request)
 {
+  TRACE_SCOPE(__func__);
   adsGain_t gain = GAIN_ONE; // Default gain
 
   // Extract address and pin from URL
@@ -89,8 +453,8 @@ void handleADS1115Get(AsyncWebServerRequest *request)
   }
   
   // Get address
-  uint8_t address = validateI2CHexAddress(addressStr, 0x48, 0x4B);
-  if (address == 0)
+  I2CDeviceAddress device = validateI2CDeviceAddress(addressStr, 0x48, 0x4B);
+  if (device.address == 0)
   {
     request->send(400, "application/json", "{\"error\":\"Invalid ADS1115 address\"}");
     return;
@@ -105,13 +469,6 @@ void handleADS1115Get(AsyncWebServerRequest *request)
   uint8_t pin = (uint8_t)strtoul(pinStr.c_str(), nullptr, 0);
 
 
-  Adafruit_ADS1X15 *ads1115 = getADS1115(address);
-  if (ads1115 == nullptr)
-  {
-    request->send(404, "application/json", "{\"error\":\"ADS1115 not found at address " + addressStr + "\"}");
-    return;
-  }
-
   if (request->hasParam("gain"))
   {
     String gainStr = request->urlDecode(request->getParam("gain")->value());
@@ -146,13 +503,32 @@ void handleADS1115Get(AsyncWebServerRequest *request)
     }
   }
 
-  String response_json = readADS1115(address, pin, gain);
-  if (response_json.indexOf("error") == -1)
+  uint32_t deadlineMs;
+  if (!parseDeadline(request, deadlineMs))
+  {
+    return;
+  }
+
+  // The gain is part of the key, since a value read at another gain is not the same reading
+  Ads1115Channel channel = {device.bus, device.address, pin, gain};
+  Ads1115Reading reading;
+  String key = "ads1115/" + formatI2CDeviceAddress(device.bus, device.address) + "/" + String(pin) + "/" + String((int)gain);
+  DeadlineRead read = readWithDeadline(key.c_str(), deadlineWorkerForI2CBus(device.bus), readAds1115Channel,
+                                       &channel, sizeof(channel), &reading, sizeof(reading), deadlineMs);
+  if (read.error != DRIVER_OK)
   {
-    request->send(200, "application/json", response_json);
+    sendReadError(request, read.error, read.error == DRIVER_NOT_FOUND ? "ADS1115 not found at address " + addressStr
+                                                                      : "Failed to read ADS1115 at address " + addressStr);
+    return;
   }
-  else
+  String response_json = "{ \"readings\": { \"raw\":" + String(reading.raw) + ", ";
+  response_json += "\"voltage\":" + String(reading.voltage, 4);
+  if (reading.hasCalibrated)
   {
-    request->send(404, "application/json", response_json);
+    response_json += ", \"calibrated\":" + String(reading.calibrated, 4);
   }
-}
\ No newline at end of file
+  response_json += " }, ";
+  response_json += sampleStampJson(reading.sample, read.stale) + " }";
+  request->send(200, "application/json", response_json);
+}
+#endif
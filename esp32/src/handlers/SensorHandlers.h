@@ -4,5 +4,7 @@
 
 void handleDs18b20Get(AsyncWebServerRequest *request);
 void handleDs18b20AddressesGet(AsyncWebServerRequest *request);
+void handleDs18b20InventoryGet(AsyncWebServerRequest *request);
 void handleBme280Get(AsyncWebServerRequest *request);
+void handleBme280Put(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
 void handleADS1115Get(AsyncWebServerRequest *request);
\ No newline at end of file
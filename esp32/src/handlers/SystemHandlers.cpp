@@ -1,12 +1,41 @@
 #include "handlers/SystemHandlers.h"
+#include "Features.h"
+#if FEATURE_OTA
+#include "otaUpdates/firmwareImage.h"
 #include "otaUpdates/otaUpdates.h"
+#endif
+#include "utils/admissionUtils.h"
+#include "utils/benchmarkUtils.h"
+#include "utils/i2cUtils.h"
+#include "utils/cpuUtils.h"
+#include "utils/deadlineUtils.h"
+#include "utils/powerUtils.h"
+#include "utils/timeUtils.h"
+#include "utils/httpUtils.h"
+#include "utils/inventoryUtils.h"
+#include "utils/logUtils.h"
+#include "utils/traceUtils.h"
+#include "filters/SignalFilter.h"
+#if FEATURE_DS18B20
+#include "sensors/Ds18b20.h"
+#endif
+#if FEATURE_PCA9685
+#include "outputs/Pca9685.h"
+#endif
+#if FEATURE_MULTICAST
+#include "servers/Multicast.h"
+#endif
+#include "servers/Normal.h"
 #include "Version.h"
 
+#include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <Preferences.h>
+#include <esp_timer.h>
 
 void handlePairPost(AsyncWebServerRequest *request)
 {
+  TRACE_SCOPE(__func__);
   String token;
   if (request->hasParam("token", true))
     token = request->getParam("token", true)->value();
@@ -14,12 +43,12 @@ void handlePairPost(AsyncWebServerRequest *request)
   if (token == "my-secure-token")
   {
     request->send(200, "application/json", "{\"status\":\"paired\"}");
-    Serial.println("Device paired successfully");
+    logInfo("Device paired successfully");
   }
   else
   {
     request->send(403, "application/json", "{\"status\":\"forbidden\"}");
-    Serial.println("Invalid pairing token");
+    logWarn("Invalid pairing token");
   }
 }
 
@@ -27,6 +56,7 @@ void handlePairPost(AsyncWebServerRequest *request)
 // and verify it - if valid, it should clear all stored preferences (Wifi, app pairing, etc)
 void handleResetPost(AsyncWebServerRequest *request)
 {
+  TRACE_SCOPE(__func__);
   // Clear stored preferences
   Preferences prefs;
   prefs.begin("app", false);
@@ -34,7 +64,7 @@ void handleResetPost(AsyncWebServerRequest *request)
   if (request->header("Authorization") != "Bearer " + token)
   {
     request->send(403, "application/json", "{\"status\":\"forbidden\"}");
-    Serial.println("Unauthorized OTA update attempt");
+    logWarn("Unauthorized reset attempt");
     return;
   }
 
@@ -46,8 +76,24 @@ void handleResetPost(AsyncWebServerRequest *request)
   ESP.restart();
 }
 
+#if FEATURE_OTA
+static const char *otaErrorName(OtaUpdateError error)
+{
+  switch (error)
+  {
+  case OTA_ERROR_DOWNLOAD: return "download_failed";
+  case OTA_ERROR_NO_SPACE: return "no_space";
+  case OTA_ERROR_WRITE: return "write_failed";
+  case OTA_ERROR_INCOMPLETE: return "incomplete";
+  case OTA_ERROR_HASH_MISMATCH: return "hash_mismatch";
+  case OTA_ERROR_FINALIZE: return "finalize_failed";
+  default: return "none";
+  }
+}
+
 void handleTriggerOTAUpdatePost(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
 {
+  TRACE_SCOPE(__func__);
   Preferences prefs;
   prefs.begin("app", false);
   String token = prefs.getString("secureToken", "");
@@ -94,14 +140,862 @@ void handleTriggerOTAUpdatePost(AsyncWebServerRequest *request, uint8_t *data, s
     return;
   }
 
-  // Perform update
-  String firmwareURL = "http://" + host + manifest.path;
-  String result = performOTAUpdate(firmwareURL.c_str(), manifest.sha256.c_str(), manifest.version);
-  if (result.indexOf("error") != -1)
+  // Perform update, from boards already running the image when the manifest lists any
+  String sources[OTA_MAX_SOURCES];
+  uint8_t sourceCount = buildFirmwareSources(manifest, "http://" + host + manifest.path, sources);
+  String message;
+  OtaUpdateError error = performOTAUpdate(sources, sourceCount, manifest.sha256, manifest.version, message);
+  if (error != OTA_ERROR_NONE)
+  {
+    request->send(500, "application/json", "{\"error\":\"" + message + "\", \"code\":\"" + String(otaErrorName(error)) + "\"}");
+    return;
+  }
+  request->send(202, "application/json", "{ \"status\": \"started\" }");
+}
+
+void handleFirmwareInfoGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  FirmwareImageInfo image;
+  if (!getRunningFirmwareImage(image))
+  {
+    request->send(500, "application/json", "{\"error\":\"Running image unreadable\"}");
+    return;
+  }
+  FirmwareUploadStats uploads = getFirmwareUploadStats();
+
+  String response_json = "{ \"version\":\"" + String(VERSION) + "\", ";
+  response_json += "\"size\":" + String((unsigned long)image.size) + ", ";
+  response_json += "\"sha256\":\"" + image.sha256 + "\", ";
+  response_json += "\"updated_from\":\"" + getOTAUpdateSource() + "\", ";
+  response_json += "\"uploads\":{ \"active\":" + String(uploads.active) + ", ";
+  response_json += "\"max\":" + String(FIRMWARE_MAX_UPLOADS) + ", ";
+  response_json += "\"completed\":" + String(uploads.completed) + ", ";
+  response_json += "\"refused\":" + String(uploads.refused) + ", ";
+  response_json += "\"bytes\":" + String(uploads.bytes) + " } }";
+  request->send(200, "application/json", response_json);
+}
+
+/**
+ * @brief Streams the running image to a peer that is updating to it.
+ *
+ * With ?sha256= the request is refused unless this board runs exactly that
+ * image, so a peer listed by a stale manifest is skipped rather than flashed
+ * with the wrong bytes. The peer still checks the digest of what it receives.
+ * Range requests let a peer resume a download that broke off.
+ */
+void handleFirmwareGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  FirmwareImageInfo image;
+  if (!getRunningFirmwareImage(image))
+  {
+    request->send(500, "application/json", "{\"error\":\"Running image unreadable\"}");
+    return;
+  }
+  if (request->hasParam("sha256") && !request->getParam("sha256")->value().equalsIgnoreCase(image.sha256))
+  {
+    request->send(404, "application/json", "{\"error\":\"Not running the requested image\"}");
+    return;
+  }
+  // A board resuming a broken download asks for the rest, with If-Range so a
+  // different image is sent whole; other forms of Range are answered in full
+  String etag = "\"" + image.sha256 + "\"";
+  size_t first = 0;
+  size_t last = image.size - 1;
+  bool partial = false;
+  if (request->hasHeader("Range") && (!request->hasHeader("If-Range") || request->header("If-Range") == etag))
+  {
+    String range = request->header("Range");
+    unsigned long rangeFirst, rangeLast;
+    // Suffix ranges ("bytes=-N") start with no digit and are answered in full
+    int fields = range.length() > 6 && isdigit((unsigned char)range[6]) ? sscanf(range.c_str(), "bytes=%lu-%lu", &rangeFirst, &rangeLast) : 0;
+    if (fields >= 1 && rangeFirst >= image.size)
+    {
+      AsyncWebServerResponse *response = request->beginResponse(416, "application/json", "{\"error\":\"Range beyond the image\"}");
+      response->addHeader("Content-Range", "bytes */" + String((unsigned)image.size));
+      request->send(response);
+      return;
+    }
+    if (fields >= 1 && (fields == 1 || rangeLast >= rangeFirst))
+    {
+      first = rangeFirst;
+      last = fields == 2 && rangeLast < image.size ? rangeLast : image.size - 1;
+      partial = true;
+    }
+  }
+
+  if (!beginFirmwareUpload())
+  {
+    AsyncWebServerResponse *response = request->beginResponse(503, "application/json", "{\"error\":\"Too many firmware downloads in progress\", \"code\":\"busy\"}");
+    response->addHeader("Retry-After", "5");
+    request->send(response);
+    return;
+  }
+
+  size_t length = last - first + 1;
+  AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", length, [first, length](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+  {
+    size_t len = readRunningFirmwareImage(first + index, buffer, min(maxLen, length - index));
+    recordFirmwareUploadBytes(len, len > 0 && index + len == length);
+    return len;
+  });
+  if (partial)
+  {
+    response->setCode(206);
+    response->addHeader("Content-Range", "bytes " + String((unsigned)first) + "-" + String((unsigned)last) + "/" + String((unsigned)image.size));
+  }
+  response->addHeader("Accept-Ranges", "bytes");
+  response->addHeader("ETag", etag);
+  response->addHeader("X-Firmware-Version", VERSION);
+  request->onDisconnect([]()
+                        { endFirmwareUpload(); });
+  request->send(response);
+}
+#endif
+
+void handleI2CGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  String response_json = "{ \"buses\": [";
+  for (uint8_t bus = 0; bus < I2C_BUS_COUNT; bus++)
+  {
+    I2CBusConfig config = getI2CBusConfig(bus);
+    I2CBusStats stats = getI2CBusStats(bus);
+    if (bus > 0)
+    {
+      response_json += ", ";
+    }
+    response_json += "{ \"bus\":" + String(bus) + ", ";
+    response_json += "\"enabled\":" + String(isI2CBusEnabled(bus) ? "true" : "false") + ", ";
+    response_json += "\"sda\":" + String(config.sda) + ", ";
+    response_json += "\"scl\":" + String(config.scl) + ", ";
+    response_json += "\"frequency\":" + String(config.frequency) + ", ";
+    response_json += "\"transactions\":" + String(stats.transactions) + ", ";
+    response_json += "\"errors\":" + String(stats.errors) + ", ";
+    response_json += "\"transactions_per_second\":" + String(stats.transactionsPerSecond) + " }";
+  }
+  response_json += "] }";
+  request->send(200, "application/json", response_json);
+}
+
+struct I2CBusJob
+{
+  uint8_t bus;
+  I2CBusConfig config;
+  bool ok;
+};
+
+// Restarts the bus on its own read worker with PCA9685 writes held off, so no driver is mid-transfer
+static void configureI2CBusJob(void *arg)
+{
+  I2CBusJob *job = (I2CBusJob *)arg;
+#if FEATURE_PCA9685
+  lockPCA9685Outputs();
+#endif
+  job->ok = configureI2CBus(job->bus, job->config);
+#if FEATURE_PCA9685
+  unlockPCA9685Outputs();
+#endif
+}
+
+void handleI2CPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  if (!doc["bus"].is<int>() || doc["bus"].as<int>() < 0 || doc["bus"].as<int>() >= I2C_BUS_COUNT)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid I2C bus\"}");
+    return;
+  }
+  uint8_t bus = doc["bus"].as<int>();
+
+  // Unspecified fields keep their current value
+  I2CBusConfig config = getI2CBusConfig(bus);
+  if (doc["sda"].is<int>())
+  {
+    config.sda = doc["sda"].as<int>();
+  }
+  if (doc["scl"].is<int>())
+  {
+    config.scl = doc["scl"].as<int>();
+  }
+  if (doc["frequency"].is<uint32_t>())
+  {
+    config.frequency = doc["frequency"].as<uint32_t>();
+  }
+  if (!isValidI2CFrequency(config.frequency))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid frequency, expected 100000, 400000 or 1000000\"}");
+    return;
+  }
+
+  I2CBusJob job = {bus, config, false};
+  DeadlineJobResult result = runOnDeadlineWorker(deadlineWorkerForI2CBus(bus), configureI2CBusJob, &job, sizeof(job), DEADLINE_JOB_TIMEOUT_MS);
+  if (result == DEADLINE_JOB_BUSY)
+  {
+    request->send(503, "application/json", "{\"error\":\"I2C bus " + String(bus) + " is too far behind to take a change\"}");
+    return;
+  }
+  if (result == DEADLINE_JOB_TIMEOUT)
+  {
+    sendDriverError(request, DRIVER_TIMEOUT, "I2C bus " + String(bus) + " did not restart within " + String(DEADLINE_JOB_TIMEOUT_MS) + " ms");
+    return;
+  }
+  if (!job.ok)
+  {
+    request->send(500, "application/json", "{\"error\":\"Failed to start I2C bus " + String(bus) + "\"}");
+    return;
+  }
+  handleI2CGet(request);
+}
+
+// Heap figures are here so fragmentation can be tracked over a long run:
+// a shrinking max_alloc_heap with steady free_heap means the heap is fragmenting.
+void handleStatusGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  String response_json = "{ ";
+  response_json += "\"version\":\"" + String(VERSION) + "\", ";
+  response_json += "\"profile\":\"" FIRMWARE_PROFILE "\", ";
+  response_json += "\"uptime_ms\":" + String(millis()) + ", ";
+  NormalModeStartup startup = getNormalModeStartup();
+  response_json += "\"startup\":{ ";
+  response_json += "\"ready_ms\":" + String(startup.readyMs) + ", ";
+  response_json += "\"drivers_us\":" + String(startup.driversUs) + " }, ";
+  response_json += "\"heap\":{ ";
+  response_json += "\"free_heap\":" + String(ESP.getFreeHeap()) + ", ";
+  response_json += "\"min_free_heap\":" + String(ESP.getMinFreeHeap()) + ", ";
+  response_json += "\"max_alloc_heap\":" + String(ESP.getMaxAllocHeap()) + " }, ";
+  response_json += "\"cpu_idle_percent\":[";
+  for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    if (core > 0)
+    {
+      response_json += ", ";
+    }
+    response_json += String(getCpuIdlePercent(core));
+  }
+  response_json += "], ";
+  HttpStats http = getHttpStats();
+  response_json += "\"http\":{ ";
+  response_json += "\"requests\":" + String(http.requests) + ", ";
+  response_json += "\"connections\":" + String(http.connections) + ", ";
+  response_json += "\"not_modified\":" + String(http.notModified) + ", ";
+  response_json += "\"rejected\":" + String(getAdmissionRejectedTotal()) + ", ";
+  response_json += "\"requests_per_second\":" + String(http.requestsPerSecond) + " }, ";
+  DeadlineStats reads = getDeadlineStats();
+  response_json += "\"sensor_reads\":{ ";
+  response_json += "\"fresh\":" + String(reads.fresh) + ", ";
+  response_json += "\"stale\":" + String(reads.stale) + ", ";
+  response_json += "\"timeouts\":" + String(reads.timeouts) + ", ";
+  response_json += "\"refreshes\":" + String(reads.refreshes) + " }, ";
+#if FEATURE_PCA9685
+  Pca9685SchedulerStats outputs = getPCA9685SchedulerStats();
+  response_json += "\"pca9685_writes\":{ ";
+  response_json += "\"requests\":" + String(outputs.requests) + ", ";
+  response_json += "\"coalesced\":" + String(outputs.coalesced) + ", ";
+  response_json += "\"flushes\":" + String(outputs.flushes) + ", ";
+  response_json += "\"transactions\":" + String(outputs.transactions) + ", ";
+  response_json += "\"transactions_saved\":" + String(outputs.requests > outputs.transactions ? outputs.requests - outputs.transactions : 0) + ", ";
+  response_json += "\"failed\":" + String(outputs.failed) + ", ";
+  response_json += "\"avg_latency_us\":" + String(outputs.averageLatencyUs) + ", ";
+  response_json += "\"max_latency_us\":" + String(outputs.maxLatencyUs) + ", ";
+  response_json += "\"saves\":" + String(outputs.saves) + " }, ";
+  Pca9685RestoreStats restore = getPCA9685RestoreStats();
+  response_json += "\"pca9685_restore\":{ ";
+  response_json += "\"restored_ms\":" + String(restore.restoredMs) + ", ";
+  response_json += "\"duration_us\":" + String(restore.durationUs) + ", ";
+  response_json += "\"chips\":" + String(restore.chips) + ", ";
+  response_json += "\"channels\":" + String(restore.channels) + ", ";
+  response_json += "\"failed\":" + String(restore.failed) + " }, ";
+#endif
+  InventoryCounts devices = getInventoryCounts();
+  response_json += "\"devices\":{ ";
+  response_json += "\"ads1115\":" + String(devices.ads1115) + ", ";
+  response_json += "\"bme280\":" + String(devices.bme280) + ", ";
+  response_json += "\"pca9685\":" + String(devices.pca9685) + " }";
+  response_json += " }";
+  request->send(200, "application/json", response_json);
+}
+
+void handleInventoryGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  refreshInventory();
+  if (sendIfNotModified(request, getInventoryCacheState()))
+  {
+    return;
+  }
+  sendCacheable(request, 200, getInventoryJson(), getInventoryCacheState());
+}
+
+void handlePowerGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  PowerSettings settings = getPowerSettings();
+  PowerStatus status = getPowerStatus();
+
+  String response_json = "{ ";
+  response_json += "\"low_power\":" + String(settings.lowPower ? "true" : "false") + ", ";
+  response_json += "\"listen_interval\":" + String(settings.listenInterval) + ", ";
+  response_json += "\"min_cpu_mhz\":" + String(settings.minCpuMhz) + ", ";
+  response_json += "\"light_sleep\":" + String(settings.lightSleep ? "true" : "false") + ", ";
+  response_json += "\"status\":{ ";
+  response_json += "\"dynamic_frequency_scaling\":" + String(status.dynamicFrequencyScaling ? "true" : "false") + ", ";
+  response_json += "\"light_sleep_active\":" + String(status.lightSleepActive ? "true" : "false") + ", ";
+  response_json += "\"cpu_mhz\":" + String(status.cpuMhz) + ", ";
+  response_json += "\"estimated_duty_cycle_percent\":" + String(status.awakePercent) + ", ";
+  response_json += "\"estimated_wake_latency_ms\":" + String(status.estimatedWakeLatencyMs) + ", ";
+  response_json += "\"average_handler_us\":" + String(status.averageHandlerUs) + ", ";
+  response_json += "\"max_handler_us\":" + String(status.maxHandlerUs) + " }";
+  response_json += " }";
+  request->send(200, "application/json", response_json);
+}
+
+void handlePowerPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  // Unspecified fields keep their current value
+  PowerSettings settings = getPowerSettings();
+  if (doc["low_power"].is<bool>())
   {
-    request->send(500, "application/json", result);
-  } else {
-    request->send(202, "application/json", result);
+    settings.lowPower = doc["low_power"].as<bool>();
   }
-  return;
-}
\ No newline at end of file
+  if (doc["listen_interval"].is<int>())
+  {
+    int listenInterval = doc["listen_interval"].as<int>();
+    settings.listenInterval = (listenInterval >= 1 && listenInterval <= 10) ? listenInterval : 0;
+  }
+  if (doc["min_cpu_mhz"].is<int>())
+  {
+    settings.minCpuMhz = doc["min_cpu_mhz"].as<int>();
+  }
+  if (doc["light_sleep"].is<bool>())
+  {
+    settings.lightSleep = doc["light_sleep"].as<bool>();
+  }
+
+  if (!configurePower(settings))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid power settings, listen_interval must be 1-10 and min_cpu_mhz 80, 160 or 240\"}");
+    return;
+  }
+  handlePowerGet(request);
+}
+
+void handleTimeGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  TimeSyncStatus status = getTimeSyncStatus();
+  int64_t epochMs = getEpochMs();
+  int64_t now = esp_timer_get_time();
+
+  String response_json = "{ ";
+  response_json += "\"server\":\"" + getTimeServer() + "\", ";
+  response_json += "\"synced\":" + String(status.synced ? "true" : "false") + ", ";
+  response_json += "\"syncs\":" + String(status.syncs) + ", ";
+  response_json += "\"last_sync_age_ms\":" + (status.synced ? String((long long)((now - status.lastSyncUs) / 1000)) : String("null")) + ", ";
+  response_json += "\"time_ms\":" + (epochMs > 0 ? String((long long)epochMs) : String("null")) + ", ";
+  response_json += "\"uptime_us\":" + String((long long)now);
+  response_json += " }";
+  request->send(200, "application/json", response_json);
+}
+
+/**
+ * @brief Sets the SNTP server. Body: { "server":"192.168.1.10" }; "" turns SNTP off.
+ */
+void handleTimePut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  if (!doc["server"].is<const char *>() || !configureTimeServer(doc["server"].as<String>()))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid server, expected a host name or address of up to 63 characters\"}");
+    return;
+  }
+  handleTimeGet(request);
+}
+
+void handleBenchmarkGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  request->send(200, "application/json", getBenchmarkJson());
+}
+
+/**
+ * @brief Starts a benchmark run; poll GET /api/system/benchmark for the results.
+ *
+ * Body: { "budget_ms":2000, "slice_ms":20, "tests":["i2c","onewire","pca9685","ads1115","flash"] }, every field optional.
+ * budget_ms is the bus and flash time the run may take in all. slice_ms is the longest it holds a bus at once,
+ * and so the most it delays any one sensor read.
+ */
+void handleBenchmarkPost(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  BenchmarkConfig config = {doc["budget_ms"] | (uint32_t)BENCHMARK_DEFAULT_BUDGET_MS, doc["slice_ms"] | (uint32_t)BENCHMARK_DEFAULT_SLICE_MS, 0};
+  if (config.budgetMs < 1 || config.budgetMs > BENCHMARK_MAX_BUDGET_MS)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid budget_ms, expected 1-" + String(BENCHMARK_MAX_BUDGET_MS) + "\"}");
+    return;
+  }
+  if (config.sliceMs < BENCHMARK_MIN_SLICE_MS || config.sliceMs > BENCHMARK_MAX_SLICE_MS)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid slice_ms, expected " + String(BENCHMARK_MIN_SLICE_MS) + "-" + String(BENCHMARK_MAX_SLICE_MS) + "\"}");
+    return;
+  }
+  if (doc["tests"].isNull())
+  {
+    config.tests = BENCHMARK_ALL_TESTS;
+  }
+  else
+  {
+    for (JsonVariantConst name : doc["tests"].as<JsonArrayConst>())
+    {
+      uint8_t test = name.is<const char *>() ? parseBenchmarkTest(name.as<const char *>()) : 0;
+      if (test == 0)
+      {
+        request->send(400, "application/json", "{\"error\":\"Unknown test " + name.as<String>() + "\"}");
+        return;
+      }
+      config.tests |= test;
+    }
+    if (config.tests == 0)
+    {
+      request->send(400, "application/json", "{\"error\":\"No tests given\"}");
+      return;
+    }
+  }
+
+  if (!startBenchmark(config))
+  {
+    request->send(409, "application/json", "{\"error\":\"A benchmark is already running\"}");
+    return;
+  }
+  request->send(202, "application/json", getBenchmarkJson());
+}
+
+void handleAdmissionGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  String response_json = "{ ";
+  response_json += "\"min_free_heap\":" + String(getAdmissionMinFreeHeap()) + ", ";
+  response_json += "\"max_pending\":" + String(ADMISSION_MAX_PENDING) + ", ";
+  response_json += "\"classes\": [";
+  for (uint8_t i = 0; i < ADMISSION_CLASS_COUNT; i++)
+  {
+    AdmissionClass admissionClass = (AdmissionClass)i;
+    AdmissionLimits limits = getAdmissionLimits(admissionClass);
+    AdmissionClassStatus status = getAdmissionStatus(admissionClass);
+    if (i > 0)
+    {
+      response_json += ", ";
+    }
+    response_json += "{ \"class\":\"" + String(admissionClassName(admissionClass)) + "\", ";
+    response_json += "\"max_in_flight\":" + String(limits.maxInFlight) + ", ";
+    response_json += "\"max_queue_ms\":" + String(limits.maxQueueMs) + ", ";
+    response_json += "\"status\":{ ";
+    response_json += "\"in_flight\":" + String(status.inFlight) + ", ";
+    response_json += "\"queued_ms\":" + String(status.queuedMs) + ", ";
+    response_json += "\"admitted\":" + String(status.admitted) + ", ";
+    response_json += "\"rejected_in_flight\":" + String(status.rejectedInFlight) + ", ";
+    response_json += "\"rejected_queue\":" + String(status.rejectedQueue) + ", ";
+    response_json += "\"rejected_heap\":" + String(status.rejectedHeap) + " } }";
+  }
+  response_json += "] }";
+  request->send(200, "application/json", response_json);
+}
+
+/**
+ * @brief Changes the heap floor and/or one class's admission limits.
+ *
+ * Body: { "min_free_heap":24576, "class":"sensors", "max_in_flight":6, "max_queue_ms":4000 }. Unspecified fields keep their current value; class is only
+ * needed to change the per-class limits.
+ */
+void handleAdmissionPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  if (doc["min_free_heap"].is<uint32_t>() && !configureAdmissionMinFreeHeap(doc["min_free_heap"].as<uint32_t>()))
+  {
+    request->send(400, "application/json", "{\"error\":\"min_free_heap must be at most 131072\"}");
+    return;
+  }
+
+  if (!doc["class"].isNull())
+  {
+    AdmissionClass admissionClass;
+    if (!doc["class"].is<const char *>() || !parseAdmissionClass(doc["class"].as<const char *>(), admissionClass))
+    {
+      request->send(400, "application/json", "{\"error\":\"class must be sensors, outputs or system\"}");
+      return;
+    }
+
+    // Out-of-range values become 0 and fail validation
+    AdmissionLimits limits = getAdmissionLimits(admissionClass);
+    if (doc["max_in_flight"].is<int>())
+    {
+      int maxInFlight = doc["max_in_flight"].as<int>();
+      limits.maxInFlight = (maxInFlight >= 1 && maxInFlight <= 255) ? maxInFlight : 0;
+    }
+    if (doc["max_queue_ms"].is<int>())
+    {
+      int maxQueueMs = doc["max_queue_ms"].as<int>();
+      limits.maxQueueMs = (maxQueueMs >= 1 && maxQueueMs <= 65535) ? maxQueueMs : 0;
+    }
+    if (!configureAdmissionLimits(admissionClass, limits))
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid limits, max_in_flight must be 1-" + String(ADMISSION_MAX_PENDING) + " and max_queue_ms 100-30000\"}");
+      return;
+    }
+  }
+  handleAdmissionGet(request);
+}
+
+// Copied into the job's slot, so it holds the channel and settings themselves
+struct FilterJob
+{
+  char channel[SIGNAL_FILTER_CHANNEL_LENGTH];
+  SignalFilterConfig config;
+  bool ok;
+};
+static_assert(sizeof(FilterJob) <= DEADLINE_JOB_ARG_BYTES, "FilterJob must fit a deadline job slot");
+
+/**
+ * @brief Picks the worker that reads a channel, e.g. bus 1's for "bme280/1:0x76/humidity".
+ *
+ * Filters are changed there, so a read never sees its filter change or go away under it.
+ */
+static uint8_t filterChannelWorker(const String &channel)
+{
+  if (channel.startsWith("ds18b20/"))
+  {
+    return DEADLINE_WORKER_ONEWIRE;
+  }
+  int start = channel.indexOf('/') + 1;
+  uint8_t bus = 0;
+  if (start > 0 && channel.length() > (unsigned)start + 1 && channel.charAt(start + 1) == ':' &&
+      channel.charAt(start) >= '0' && channel.charAt(start) < '0' + I2C_BUS_COUNT)
+  {
+    bus = channel.charAt(start) - '0';
+  }
+  return deadlineWorkerForI2CBus(bus);
+}
+
+static void configureFilterJob(void *arg)
+{
+  FilterJob *job = (FilterJob *)arg;
+  job->ok = configureSignalFilter(job->channel, job->config);
+}
+
+static void removeFilterJob(void *arg)
+{
+  FilterJob *job = (FilterJob *)arg;
+  job->ok = removeSignalFilter(job->channel);
+}
+
+/**
+ * @brief Runs a filter job on the channel's worker, answering 400, 503 or 504 if it does not get done.
+ * @return true if the job ran; job then holds its result.
+ */
+static bool runFilterJob(AsyncWebServerRequest *request, const String &channel, DeadlineJobFunction run, FilterJob &job)
+{
+  // A longer name could not match a stored filter, and would be cut short in the job
+  if (channel.length() >= SIGNAL_FILTER_CHANNEL_LENGTH)
+  {
+    request->send(400, "application/json", "{\"error\":\"Channel name is too long\"}");
+    return false;
+  }
+  strncpy(job.channel, channel.c_str(), sizeof(job.channel));
+  DeadlineJobResult result = runOnDeadlineWorker(filterChannelWorker(channel), run, &job, sizeof(job), DEADLINE_JOB_TIMEOUT_MS);
+  if (result == DEADLINE_JOB_BUSY)
+  {
+    request->send(503, "application/json", "{\"error\":\"Sensor bus is too far behind to take a change\"}");
+    return false;
+  }
+  if (result == DEADLINE_JOB_TIMEOUT)
+  {
+    sendDriverError(request, DRIVER_TIMEOUT, "Sensor bus did not take the change within " + String(DEADLINE_JOB_TIMEOUT_MS) + " ms");
+    return false;
+  }
+  return true;
+}
+
+void handleFiltersGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  request->send(200, "application/json", getSignalFiltersJson());
+}
+
+/**
+ * @brief Creates or replaces the conditioning filter for one sensor channel.
+ *
+ * Body: { "channel":"ads1115/0x48/0", "oversampling":4, "median":3, "ema_alpha":0.25,
+ * "calibration":[[x, y], ...] }. Unspecified fields keep their current value, or the
+ * pass-through default for a new channel.
+ *
+ * DS18B20 channels take at most DS18B20_MAX_OVERSAMPLING, since each oversample is
+ * a full conversion. BME280 channels only oversample in forced mode.
+ */
+void handleFiltersPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  String channel = doc["channel"] | "";
+  SignalFilterConfig config;
+  getSignalFilterConfig(channel, config);
+
+  if (doc["oversampling"].is<int>())
+  {
+    int oversampling = doc["oversampling"].as<int>();
+    config.oversampling = (oversampling >= 1 && oversampling <= SIGNAL_FILTER_MAX_OVERSAMPLING) ? oversampling : 0;
+#if FEATURE_DS18B20
+    if (channel.startsWith("ds18b20/") && oversampling > DS18B20_MAX_OVERSAMPLING)
+    {
+      request->send(400, "application/json", "{\"error\":\"DS18B20 oversampling must be 1-" + String(DS18B20_MAX_OVERSAMPLING) + ", each sample is a conversion of up to 750 ms\"}");
+      return;
+    }
+#endif
+  }
+  if (doc["median"].is<int>())
+  {
+    int median = doc["median"].as<int>();
+    config.medianWindow = (median >= 1 && median <= SIGNAL_FILTER_MAX_MEDIAN) ? median : 0;
+  }
+  if (doc["ema_alpha"].is<float>())
+  {
+    float alpha = doc["ema_alpha"].as<float>();
+    config.emaAlpha = (alpha > 0 && alpha <= 1) ? toFixed(alpha) : 0;
+  }
+  if (doc["calibration"].is<JsonArrayConst>())
+  {
+    JsonArrayConst points = doc["calibration"].as<JsonArrayConst>();
+    if (points.size() > SIGNAL_FILTER_MAX_CALIBRATION_POINTS)
+    {
+      request->send(400, "application/json", "{\"error\":\"At most " + String(SIGNAL_FILTER_MAX_CALIBRATION_POINTS) + " calibration points are supported\"}");
+      return;
+    }
+    config.calibrationPoints = 0;
+    for (JsonArrayConst point : points)
+    {
+      if (point.size() != 2 || !point[0].is<float>() || !point[1].is<float>())
+      {
+        request->send(400, "application/json", "{\"error\":\"Calibration points must be [x, y] pairs\"}");
+        return;
+      }
+      config.calibrationX[config.calibrationPoints] = toFixed(point[0].as<float>());
+      config.calibrationY[config.calibrationPoints] = toFixed(point[1].as<float>());
+      config.calibrationPoints++;
+    }
+  }
+
+  FilterJob job;
+  job.config = config;
+  job.ok = false;
+  if (!runFilterJob(request, channel, configureFilterJob, job))
+  {
+    return;
+  }
+  if (!job.ok)
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid filter, oversampling must be 1-16, median an odd window of 1-7, ema_alpha in (0, 1] and calibration x values increasing\"}");
+    return;
+  }
+  handleFiltersGet(request);
+}
+
+void handleFiltersDelete(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  if (!request->hasParam("channel"))
+  {
+    request->send(400, "application/json", "{\"error\":\"Missing channel parameter\"}");
+    return;
+  }
+  String channel = request->getParam("channel")->value();
+  FilterJob job;
+  job.ok = false;
+  if (!runFilterJob(request, channel, removeFilterJob, job))
+  {
+    return;
+  }
+  if (!job.ok)
+  {
+    request->send(404, "application/json", "{\"error\":\"No filter for channel\"}");
+    return;
+  }
+  handleFiltersGet(request);
+}
+
+void handleLogsGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  uint32_t since = 0;
+  if (request->hasParam("since"))
+  {
+    since = strtoul(request->getParam("since")->value().c_str(), NULL, 10);
+  }
+  LogLevel level = LOG_LEVEL_DEBUG;
+  if (request->hasParam("level") && !parseLogLevel(request->getParam("level")->value(), level))
+  {
+    request->send(400, "application/json", "{\"error\":\"level must be debug, info, warn or error\"}");
+    return;
+  }
+  request->send(200, "application/json", getLogsJson(since, level));
+}
+
+void handleTraceGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+#if TRACE_ENABLED
+  request->send(200, "application/json", getTraceJson());
+#else
+  request->send(404, "application/json", "{\"error\":\"Tracing is not enabled in this build\"}");
+#endif
+}
+
+#if FEATURE_MULTICAST
+void handleMulticastGet(AsyncWebServerRequest *request)
+{
+  TRACE_SCOPE(__func__);
+  MulticastSettings settings = getMulticastSettings();
+  MulticastStats stats = getMulticastStats();
+
+  String response_json = "{ ";
+  response_json += "\"enabled\":" + String(settings.enabled ? "true" : "false") + ", ";
+  response_json += "\"group\":\"" + settings.group.toString() + "\", ";
+  response_json += "\"port\":" + String(settings.port) + ", ";
+  response_json += "\"key_set\":" + String(settings.hasKey ? "true" : "false") + ", ";
+  response_json += "\"node_id\":" + String(getMulticastNodeId()) + ", ";
+  response_json += "\"status\":{ ";
+  response_json += "\"listening\":" + String(isMulticastListening() ? "true" : "false") + ", ";
+  response_json += "\"received\":" + String(stats.received) + ", ";
+  response_json += "\"accepted\":" + String(stats.accepted) + ", ";
+  response_json += "\"duplicates\":" + String(stats.duplicates) + ", ";
+  response_json += "\"stale\":" + String(stats.stale) + ", ";
+  response_json += "\"auth_failed\":" + String(stats.authFailed) + ", ";
+  response_json += "\"malformed\":" + String(stats.malformed) + ", ";
+  response_json += "\"entries_applied\":" + String(stats.entriesApplied) + ", ";
+  response_json += "\"entries_failed\":" + String(stats.entriesFailed) + ", ";
+  response_json += "\"last_apply_us\":" + String(stats.lastApplyUs) + ", ";
+  response_json += "\"epoch\":" + String(stats.epoch) + ", ";
+  response_json += "\"sequence\":" + String(stats.sequence) + " }";
+  response_json += " }";
+  request->send(200, "application/json", response_json);
+}
+
+static bool parseMulticastKey(const String &hex, uint8_t *key)
+{
+  if (hex.length() != MULTICAST_KEY_LENGTH * 2)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < MULTICAST_KEY_LENGTH; i++)
+  {
+    char byte[3] = {hex.charAt(i * 2), hex.charAt(i * 2 + 1), '\0'};
+    char *end;
+    key[i] = (uint8_t)strtoul(byte, &end, 16);
+    if (*end != '\0')
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Configures the multicast output command channel.
+ *
+ * Body: { "enabled":true, "group":"239.255.83.80", "port":47800, "key":"<64 hex digits>" }.
+ * Unspecified fields keep their current value; an empty key clears it.
+ */
+void handleMulticastPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  TRACE_SCOPE(__func__);
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len);
+  if (err)
+  {
+    request->send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+    return;
+  }
+
+  MulticastSettings settings = getMulticastSettings();
+  if (doc["enabled"].is<bool>())
+  {
+    settings.enabled = doc["enabled"].as<bool>();
+  }
+  if (doc["group"].is<const char *>() && !settings.group.fromString(doc["group"].as<const char *>()))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid group address\"}");
+    return;
+  }
+  if (doc["port"].is<int>())
+  {
+    int port = doc["port"].as<int>();
+    settings.port = (port > 0 && port <= 65535) ? port : 0;
+  }
+  if (doc["key"].is<const char *>())
+  {
+    String key = doc["key"].as<const char *>();
+    settings.hasKey = key.length() > 0;
+    memset(settings.key, 0, sizeof(settings.key));
+    if (settings.hasKey && !parseMulticastKey(key, settings.key))
+    {
+      request->send(400, "application/json", "{\"error\":\"key must be " + String(MULTICAST_KEY_LENGTH * 2) + " hex digits\"}");
+      return;
+    }
+  }
+
+  if (!configureMulticast(settings))
+  {
+    request->send(400, "application/json", "{\"error\":\"Invalid multicast settings, group must be 224.0.0.0-239.255.255.255, port 1-65535, and a key is required to enable\"}");
+    return;
+  }
+  handleMulticastGet(request);
+}
+#endif
@@ -4,4 +4,25 @@
 
 void handlePairPost(AsyncWebServerRequest *request);
 void handleResetPost(AsyncWebServerRequest *request);
-void handleTriggerOTAUpdatePost(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
\ No newline at end of file
+void handleTriggerOTAUpdatePost(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleFirmwareInfoGet(AsyncWebServerRequest *request);
+void handleFirmwareGet(AsyncWebServerRequest *request);
+void handleI2CGet(AsyncWebServerRequest *request);
+void handleI2CPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleStatusGet(AsyncWebServerRequest *request);
+void handleInventoryGet(AsyncWebServerRequest *request);
+void handlePowerGet(AsyncWebServerRequest *request);
+void handlePowerPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleTimeGet(AsyncWebServerRequest *request);
+void handleTimePut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleBenchmarkGet(AsyncWebServerRequest *request);
+void handleBenchmarkPost(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleAdmissionGet(AsyncWebServerRequest *request);
+void handleAdmissionPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleFiltersGet(AsyncWebServerRequest *request);
+void handleFiltersPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleFiltersDelete(AsyncWebServerRequest *request);
+void handleLogsGet(AsyncWebServerRequest *request);
+void handleTraceGet(AsyncWebServerRequest *request);
+void handleMulticastGet(AsyncWebServerRequest *request);
+void handleMulticastPut(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
@@ -1,14 +1,28 @@
-#include <DNSServer.h>
 #include <ESPAsyncWebServer.h>
 #include <Preferences.h>
 #include <WiFi.h>
 
 #include "servers/Normal.h"
 #include "servers/SoftAP.h"
+#include "Features.h"
+#if FEATURE_DS18B20
+#include "sensors/Ds18b20.h"
+#else
+// The scan timer also paces the inventory refresh, so it runs without 1-Wire too
+#define DS18B20_SCAN_SLICE_MS 1000
+#endif
+#if FEATURE_PCA9685
+#include "outputs/Pca9685.h"
+#endif
+#include "utils/cpuUtils.h"
+#include "utils/i2cUtils.h"
+#include "utils/inventoryUtils.h"
+#include "utils/logUtils.h"
+#include "utils/powerUtils.h"
 
 AsyncWebServer server(80);
 Preferences prefs;
-DNSServer dnsServer;
+CaptiveDnsServer dnsServer;
 
 enum ServerMode {
   MODE_UNDEFINED = 0,
@@ -20,9 +34,25 @@ int server_mode = MODE_UNDEFINED;
 String savedSSID;
 String savedPASS;
 
-unsigned long lastWiFiCheck = 0;
 const unsigned long wifiCheckInterval = 10000; // 10 seconds
 
+// ===== Scheduler =====
+// loop() sleeps until one of these bits is notified, instead of polling millis().
+#define EVENT_WIFI_CHECK (1 << 0)
+#define EVENT_ONEWIRE_SCAN (1 << 1)
+
+TaskHandle_t loopTaskHandle = NULL;
+TimerHandle_t wifiCheckTimer = NULL;
+TimerHandle_t oneWireScanTimer = NULL;
+
+void onWiFiCheckTimer(TimerHandle_t timer) {
+  xTaskNotify(loopTaskHandle, EVENT_WIFI_CHECK, eSetBits);
+}
+
+void onOneWireScanTimer(TimerHandle_t timer) {
+  xTaskNotify(loopTaskHandle, EVENT_ONEWIRE_SCAN, eSetBits);
+}
+
 void switchToNormalMode() {
   stopSoftAPMode(server, dnsServer);
   WiFi.softAPdisconnect(true);
@@ -39,6 +69,24 @@ void switchToCaptivePortal() {
 void setup()
 {
   Serial.begin(115200);
+  beginLogging();
+  beginCpuIdleMonitor();
+  beginPowerManagement();
+
+  // setup() and loop() share the Arduino loop task
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  wifiCheckTimer = xTimerCreate("wifiCheck", pdMS_TO_TICKS(wifiCheckInterval), pdTRUE, NULL, onWiFiCheckTimer);
+  xTimerStart(wifiCheckTimer, portMAX_DELAY);
+  oneWireScanTimer = xTimerCreate("oneWireScan", pdMS_TO_TICKS(DS18B20_SCAN_SLICE_MS), pdTRUE, NULL, onOneWireScanTimer);
+  xTimerStart(oneWireScanTimer, portMAX_DELAY);
+
+  // Once per boot: restarting a bus under attached drivers would reset it mid-transfer
+  beginI2CBuses();
+#if FEATURE_PCA9685
+  // Outputs go back to their last duties now rather than after Wi-Fi and the hub, which take seconds
+  restorePCA9685Outputs();
+#endif
+
   prefs.begin("wifi", true);
   savedSSID = prefs.getString("ssid", "");
   savedPASS = prefs.getString("pass", "");
@@ -48,6 +96,10 @@ void setup()
     WiFi.mode(WIFI_STA);
     WiFi.begin(savedSSID.c_str(), savedPASS.c_str());
     if (WiFi.waitForConnectResult() == WL_CONNECTED) {
+      if (applyStationListenInterval()) {
+        delay(100); // let the disconnect land before waiting on the reconnect
+        WiFi.waitForConnectResult();
+      }
       startNormalMode(server);
       server_mode = MODE_NORMAL;
       return;
@@ -58,51 +110,69 @@ void setup()
   server_mode = MODE_SOFT_AP;
 }
 
-void loop() {
-  // --- If running captive portal ---
-  if (server_mode == MODE_SOFT_AP) {
-    dnsServer.processNextRequest();
-    
-    // Periodically re-check if Wi-Fi network is available
-    if (millis() - lastWiFiCheck > wifiCheckInterval) {
-      Serial.println("Updating in range Wi-Fi networks. . .");
-      lastWiFiCheck = millis();
-      prefs.begin("wifi", true);
-      savedSSID = prefs.getString("ssid", "");
-      savedPASS = prefs.getString("pass", "");
-      prefs.end();
-
-      if (savedSSID.length() > 0) {
-        WiFi.mode(WIFI_AP_STA); // allow scanning while keeping the AP
-        int n = WiFi.scanNetworks(false, true);
-        if (n < 0) {
-          Serial.printf("WiFi scan error: %d\n", n); // handle or retry later
-        } else {
-          Serial.printf("Looking for network: %s. %i networks detected.\n", savedSSID.c_str(), n);
-          for (int i = 0; i < n; i++) {
-            String networkName = WiFi.SSID(i);
-            if (networkName == savedSSID) {
-              Serial.printf("%s found in range, attempting connection.\n", networkName.c_str());
-              WiFi.begin(savedSSID.c_str(), savedPASS.c_str());
-              if (WiFi.waitForConnectResult() == WL_CONNECTED) {
-                Serial.println("Success! Switching to normal mode.\n");
-                switchToNormalMode();
-              } else {
-                Serial.println("Failed! Connection will be reattempted in 10 seconds.\n");
-              }
-              break;
-            }
+// Captive portal: periodically re-check if the saved Wi-Fi network is available
+void checkForSavedNetwork() {
+  logInfo("Updating in range Wi-Fi networks. . .");
+  prefs.begin("wifi", true);
+  savedSSID = prefs.getString("ssid", "");
+  savedPASS = prefs.getString("pass", "");
+  prefs.end();
+
+  if (savedSSID.length() > 0) {
+    WiFi.mode(WIFI_AP_STA); // allow scanning while keeping the AP
+    int n = WiFi.scanNetworks(false, true);
+    if (n < 0) {
+      logWarn("WiFi scan error: %d", n); // handle or retry later
+    } else {
+      logInfo("Looking for network: %s. %i networks detected.", savedSSID, n);
+      for (int i = 0; i < n; i++) {
+        String networkName = WiFi.SSID(i);
+        if (networkName == savedSSID) {
+          logInfo("%s found in range, attempting connection.", networkName);
+          WiFi.begin(savedSSID.c_str(), savedPASS.c_str());
+          if (WiFi.waitForConnectResult() == WL_CONNECTED) {
+            logInfo("Success! Switching to normal mode.");
+            switchToNormalMode();
+          } else {
+            logWarn("Failed! Connection will be reattempted in 10 seconds.");
           }
+          break;
         }
       }
     }
-  } else if (server_mode == MODE_NORMAL) {
-    if (millis() - lastWiFiCheck > wifiCheckInterval) {
-      lastWiFiCheck = millis();
-      if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("Wi-Fi connection lost, switching to captive portal mode.\n");
-        switchToCaptivePortal();
-      }
+  }
+}
+
+// Normal mode: fall back to the captive portal if the connection dropped
+void checkWiFiConnection() {
+  if (WiFi.status() != WL_CONNECTED) {
+    logWarn("Wi-Fi connection lost, switching to captive portal mode.");
+    switchToCaptivePortal();
+  }
+}
+
+void loop() {
+  // Block until there is work. DNS and HTTP are served from their own
+  // AsyncUDP/AsyncTCP tasks, so this task has nothing to do in between.
+  uint32_t events = 0;
+  xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+
+  if (events & EVENT_WIFI_CHECK) {
+    if (server_mode == MODE_SOFT_AP) {
+      checkForSavedNetwork();
+    } else if (server_mode == MODE_NORMAL) {
+      checkWiFiConnection();
     }
   }
+
+  // Hot-plug detection: one ROM search step per slice, between conversions, and a probe of
+  // the I2C addresses, queued on the bus workers without waiting for it; what a probe finds
+  // is advertised on the slice after it ran
+  if ((events & EVENT_ONEWIRE_SCAN) && server_mode == MODE_NORMAL) {
+#if FEATURE_DS18B20
+    stepDS18B20Scan();
+#endif
+    probeI2CInventory();
+    advertiseInventory();
+  }
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "Features.h"
+
+#if FEATURE_OTA
+
+#include "otaUpdates/firmwareImage.h"
+#include "utils/logUtils.h"
+#include "utils/traceUtils.h"
+
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+// Flash read per hashing step; small enough for the async_tcp stack
+#define FIRMWARE_HASH_CHUNK_BYTES 1024
+
+static FirmwareImageInfo runningImage;
+static bool runningImageHashed = false;
+
+static FirmwareUploadStats uploadStats;
+static portMUX_TYPE uploadStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Returns the running image's size and SHA-256.
+ *
+ * The digest is computed from flash on the first call, which reads the whole
+ * image once (a few hundred milliseconds for a 1 MB image), and cached after.
+ *
+ * @return false if the running partition cannot be read.
+ */
+bool getRunningFirmwareImage(FirmwareImageInfo &info)
+{
+  if (!runningImageHashed)
+  {
+    TRACE_SCOPE("firmware.hash");
+    const esp_partition_t *partition = esp_ota_get_running_partition();
+    size_t size = ESP.getSketchSize();
+    if (partition == NULL || size == 0 || size > partition->size)
+    {
+      return false;
+    }
+
+    mbedtls_sha256_context shaCtx;
+    mbedtls_sha256_init(&shaCtx);
+    mbedtls_sha256_starts(&shaCtx, 0);
+    uint8_t buf[FIRMWARE_HASH_CHUNK_BYTES];
+    for (size_t offset = 0; offset < size;)
+    {
+      size_t len = min(sizeof(buf), size - offset);
+      if (esp_partition_read(partition, offset, buf, len) != ESP_OK)
+      {
+        mbedtls_sha256_free(&shaCtx);
+        logError("Failed to read running image at %u", (unsigned)offset);
+        return false;
+      }
+      mbedtls_sha256_update(&shaCtx, buf, len);
+      offset += len;
+    }
+    uint8_t hashBuf[32];
+    mbedtls_sha256_finish(&shaCtx, hashBuf);
+    mbedtls_sha256_free(&shaCtx);
+
+    char hashHex[65];
+    for (int i = 0; i < 32; i++)
+      sprintf(hashHex + i * 2, "%02x", hashBuf[i]);
+    hashHex[64] = 0;
+
+    runningImage.size = size;
+    runningImage.sha256 = String(hashHex);
+    runningImageHashed = true;
+  }
+  info = runningImage;
+  return true;
+}
+
+/**
+ * @brief Copies part of the running image, clamped to its end.
+ *
+ * Uses the size cached by getRunningFirmwareImage(), which callers have
+ * already called to answer the request, rather than re-walking the image
+ * headers for every chunk.
+ *
+ * @return Bytes copied; 0 past the end, before the image was inspected or on a read error.
+ */
+size_t readRunningFirmwareImage(size_t offset, uint8_t *buffer, size_t length)
+{
+  const esp_partition_t *partition = esp_ota_get_running_partition();
+  size_t size = runningImageHashed ? runningImage.size : 0;
+  if (partition == NULL || offset >= size)
+  {
+    return 0;
+  }
+  length = min(length, size - offset);
+  return esp_partition_read(partition, offset, buffer, length) == ESP_OK ? length : 0;
+}
+
+/**
+ * @brief Takes one of the FIRMWARE_MAX_UPLOADS slots.
+ * @return false, counted as refused, if they are all in use.
+ */
+bool beginFirmwareUpload()
+{
+  portENTER_CRITICAL(&uploadStatsMux);
+  bool accepted = uploadStats.active < FIRMWARE_MAX_UPLOADS;
+  if (accepted)
+  {
+    uploadStats.active++;
+  }
+  else
+  {
+    uploadStats.refused++;
+  }
+  portEXIT_CRITICAL(&uploadStatsMux);
+  return accepted;
+}
+
+void recordFirmwareUploadBytes(size_t bytes, bool complete)
+{
+  portENTER_CRITICAL(&uploadStatsMux);
+  uploadStats.bytes += bytes;
+  if (complete)
+  {
+    uploadStats.completed++;
+  }
+  portEXIT_CRITICAL(&uploadStatsMux);
+}
+
+void endFirmwareUpload()
+{
+  portENTER_CRITICAL(&uploadStatsMux);
+  if (uploadStats.active > 0)
+  {
+    uploadStats.active--;
+  }
+  portEXIT_CRITICAL(&uploadStatsMux);
+}
+
+FirmwareUploadStats getFirmwareUploadStats()
+{
+  portENTER_CRITICAL(&uploadStatsMux);
+  FirmwareUploadStats stats = uploadStats;
+  portEXIT_CRITICAL(&uploadStatsMux);
+  return stats;
+}
+
+#endif
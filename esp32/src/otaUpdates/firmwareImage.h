@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Peers that may download this board's image at once. One upload already fills
+// the board's Wi-Fi link, so a second would only halve the speed of both and
+// delay the moment either peer can serve the image onward; extra peers are
+// refused and move on to their next source.
+#define FIRMWARE_MAX_UPLOADS 1
+
+/**
+ * @brief The app image this board booted from, as a peer would download it.
+ *
+ * sha256 is over the whole image file, the same digest the hub's manifest
+ * carries, so a peer verifies a download from this board exactly as one from
+ * the hub.
+ */
+struct FirmwareImageInfo
+{
+  size_t size;
+  String sha256;
+};
+
+struct FirmwareUploadStats
+{
+  uint8_t active;
+  uint32_t completed;
+  uint32_t refused;
+  uint32_t bytes;
+};
+
+bool getRunningFirmwareImage(FirmwareImageInfo &info);
+size_t readRunningFirmwareImage(size_t offset, uint8_t *buffer, size_t length);
+
+bool beginFirmwareUpload();
+void recordFirmwareUploadBytes(size_t bytes, bool complete);
+void endFirmwareUpload();
+FirmwareUploadStats getFirmwareUploadStats();
@@ -1,12 +1,31 @@
+#include "Features.h"
+
+#if FEATURE_OTA
+
 #include "otaUpdates/otaUpdates.h"
 #include "otaUpdates.h"
+#include "utils/logUtils.h"
+#include "utils/traceUtils.h"
 #include <Preferences.h>
 
-int otaUpdateResult = 0; // 0: idle, 1: in progress, 2: success, -1: failure
+// Progress is logged once per this many bytes rather than per chunk
+#define OTA_PROGRESS_LOG_BYTES 65536
+// A connection that delivers nothing for this long counts as broken
+#define OTA_STALL_TIMEOUT_MS 10000
+// Resumes allowed per source, and resumes in a row that may deliver nothing
+#define OTA_MAX_RESUMES 16
+#define OTA_MAX_STALLED_RESUMES 3
+// Wait before resuming, doubled for each resume in a row that delivered nothing
+#define OTA_RESUME_BACKOFF_MS 500
+
+// Written last, so the error and message are in place once a waiter sees the final value
+volatile int otaUpdateResult = 0; // 0: idle, 1: in progress, 2: success, -1: failure
+OtaUpdateError otaUpdateError = OTA_ERROR_NONE;
 String otaUpdateResultMessage;
 struct OTAParams
 {
-  String firmwareUrl;
+  String sources[OTA_MAX_SOURCES];
+  uint8_t sourceCount;
   String expectedSha;
   String firmwareVersion;
   TaskHandle_t callerHandle;
@@ -93,6 +112,7 @@ bool isNewerVersion(const char *latest, const char *current)
 
 Manifest fetchManifest(const char *manifestUrl)
 {
+  TRACE_SCOPE("ota.manifest");
   Manifest manifest;
   HTTPClient client;
   client.begin(manifestUrl);
@@ -107,25 +127,34 @@ Manifest fetchManifest(const char *manifestUrl)
       manifest.version = doc["content"]["data"]["version"].as<String>();
       manifest.sha256 = doc["content"]["data"]["sha256"].as<String>();
       manifest.path = doc["content"]["data"]["path"].as<String>();
+      // Optional; a hub that lists no peers serves every board itself
+      for (JsonVariantConst peer : doc["content"]["data"]["peers"].as<JsonArrayConst>())
+      {
+        if (manifest.peerCount < OTA_MAX_PEERS && peer.is<const char *>())
+        {
+          manifest.peers[manifest.peerCount++] = peer.as<String>();
+        }
+      }
     }
     else
     {
-      Serial.println("Failed to parse manifest JSON");
+      logWarn("Failed to parse manifest JSON");
     }
   }
   else
   {
-    Serial.printf("Failed to fetch manifest, code: %d\n", code);
+    logWarn("Failed to fetch manifest, code: %d", code);
   }
 
   client.end();
   return manifest;
 }
 
-void setOTAUpdateResult(int resultCode, const String &resultMessage)
+void setOTAUpdateResult(int resultCode, OtaUpdateError error, const String &resultMessage)
 {
-  otaUpdateResult = resultCode;
+  otaUpdateError = error;
   otaUpdateResultMessage = resultMessage;
+  otaUpdateResult = resultCode;
 }
 
 int getOTAUpdateResult()
@@ -138,142 +167,359 @@ String getOTAUpdateResultMessage()
   return otaUpdateResultMessage;
 }
 
-void otaTask(void *param)
+/**
+ * @brief What has been flashed so far, so a broken download can pick up where it stopped.
+ *
+ * The SHA-256 context covers exactly the bytes handed to Update, so a resumed
+ * download extends both from the same offset. It lives in RAM only: Update
+ * cannot reopen a partly written partition after a restart.
+ */
+struct OtaCheckpoint
 {
-  Serial.println("Starting Update Task");
-  Preferences prefs;
-  setOTAUpdateResult(1, "OTA update in progress");
-  OTAParams *p = static_cast<OTAParams *>(param);
-  String firmwareUrl = p->firmwareUrl;
-  String expectedSha = p->expectedSha;
-  String firmwareVersion = p->firmwareVersion;
-  TaskHandle_t callerHandle = p->callerHandle;
-  delete p;
+  bool started = false; // Update.begin() has been called
+  bool spliced = false; // part of the image came from a resumed request
+  size_t written = 0;
+  size_t total = 0; // 0 when the source sent no Content-Length
+  String etag;
+  mbedtls_sha256_context sha;
+};
+
+static void beginCheckpoint(OtaCheckpoint &checkpoint)
+{
+  mbedtls_sha256_init(&checkpoint.sha);
+  mbedtls_sha256_starts(&checkpoint.sha, 0);
+}
+
+/**
+ * @brief Drops whatever was staged so the next download starts from byte 0.
+ */
+static void resetCheckpoint(OtaCheckpoint &checkpoint)
+{
+  if (checkpoint.started)
+  {
+    Update.abort();
+  }
+  mbedtls_sha256_free(&checkpoint.sha);
+  checkpoint.started = false;
+  checkpoint.spliced = false;
+  checkpoint.written = 0;
+  checkpoint.total = 0;
+  checkpoint.etag = "";
+  beginCheckpoint(checkpoint);
+}
 
+/**
+ * @brief Checks that a 206 continues the checkpoint: same offset, same image size.
+ */
+static bool continuesCheckpoint(const String &contentRange, const OtaCheckpoint &checkpoint)
+{
+  unsigned long first, last, total;
+  if (sscanf(contentRange.c_str(), "bytes %lu-%lu/%lu", &first, &last, &total) != 3)
+  {
+    return false;
+  }
+  return first == checkpoint.written && total == checkpoint.total && last + 1 == total;
+}
+
+/**
+ * @brief Makes one request and flashes what it delivers onto the checkpoint.
+ *
+ * With bytes already written it asks for the rest with Range, and If-Range so a
+ * source whose image changed sends it whole; a whole image restarts the
+ * checkpoint rather than being spliced onto it.
+ * @param resumable Set when another request could continue from the checkpoint.
+ * @param message Receives the failure description.
+ * @return OTA_ERROR_NONE once the image is complete, OTA_ERROR_INCOMPLETE if
+ * the connection broke or stalled first.
+ */
+static OtaUpdateError downloadToCheckpoint(const String &firmwareUrl, OtaCheckpoint &checkpoint, bool &resumable, String &message)
+{
+  resumable = false;
   HTTPClient http;
   http.setTimeout(5000);
+  const char *headerKeys[] = {"Content-Range", "ETag"};
+  http.collectHeaders(headerKeys, 2);
+  TRACE_BEGIN("ota.connect");
   http.begin(firmwareUrl);
+  if (checkpoint.written > 0)
+  {
+    http.addHeader("Range", "bytes=" + String((unsigned)checkpoint.written) + "-");
+    if (checkpoint.etag.length() > 0)
+    {
+      http.addHeader("If-Range", checkpoint.etag);
+    }
+  }
   int httpCode = http.GET();
+  TRACE_END("ota.connect");
 
-  if (httpCode != HTTP_CODE_OK)
+  if (httpCode == HTTP_CODE_PARTIAL_CONTENT && checkpoint.written > 0)
   {
-    Serial.println("Failed firmware download");
-    setOTAUpdateResult(-1, "Failed to download firmware, HTTP code: " + String(httpCode));
-    http.end();
-    xTaskNotifyGive(callerHandle);
-    vTaskDelete(NULL);
-    return;
+    if (!continuesCheckpoint(http.header("Content-Range"), checkpoint))
+    {
+      logWarn("Source sent an unexpected range");
+      message = "Source sent an unexpected range";
+      http.end();
+      return OTA_ERROR_DOWNLOAD;
+    }
+    checkpoint.spliced = true;
   }
-
-  WiFiClient *stream = http.getStreamPtr();
-  int contentLength = http.getSize(); // use signed int to detect -1/unknown
-  bool unknownSize = (contentLength <= 0);
-
-  if (!Update.begin(unknownSize ? UPDATE_SIZE_UNKNOWN : (size_t)contentLength))
+  else if (httpCode == HTTP_CODE_OK)
   {
-    Serial.println("Not enough space");
-    setOTAUpdateResult(-1, "Not enough space to begin OTA");
+    if (checkpoint.started)
+    {
+      logWarn("Source sent the whole image, restarting");
+      resetCheckpoint(checkpoint);
+    }
+    int contentLength = http.getSize(); // use signed int to detect -1/unknown
+    checkpoint.total = contentLength > 0 ? (size_t)contentLength : 0;
+    checkpoint.etag = http.header("ETag");
+    if (!Update.begin(checkpoint.total > 0 ? checkpoint.total : UPDATE_SIZE_UNKNOWN))
+    {
+      logError("Not enough space");
+      message = "Not enough space to begin OTA";
+      http.end();
+      return OTA_ERROR_NO_SPACE;
+    }
+    checkpoint.started = true;
+  }
+  else
+  {
+    logWarn("Failed firmware download, HTTP code: %d", httpCode);
+    message = "Failed to download firmware, HTTP code: " + String(httpCode);
     http.end();
-    xTaskNotifyGive(callerHandle);
-    vTaskDelete(NULL);
-    return;
+    // A connection that failed may work on the next try; an HTTP answer will not change
+    resumable = checkpoint.started && httpCode < 0;
+    return OTA_ERROR_DOWNLOAD;
   }
 
-  // SHA256 calculation on the fly while flashing
-  mbedtls_sha256_context shaCtx;
-  mbedtls_sha256_init(&shaCtx);
-  mbedtls_sha256_starts(&shaCtx, 0);
-
+  WiFiClient *stream = http.getStreamPtr();
   uint8_t buf[512];
-  size_t written = 0;
+  uint32_t lastDataMs = millis();
+  TRACE_BEGIN("ota.flash");
 
   // continue while connection open or there's data available.
-  while ((http.connected() || stream->available()) && (unknownSize || written < (size_t)contentLength))
+  while ((http.connected() || stream->available()) && (checkpoint.total == 0 || checkpoint.written < checkpoint.total))
   {
     size_t available = stream->available();
-    if (available)
+    if (!available)
     {
-      size_t toRead = min(sizeof(buf), available);
-      size_t len = stream->readBytes(buf, toRead);
-      if (len == 0)
+      // A marginal link can hold the connection open without delivering anything
+      if (millis() - lastDataMs > OTA_STALL_TIMEOUT_MS)
       {
-        // nothing read this iteration
-        delay(1);
-        continue;
-      }
-
-      size_t w = Update.write(buf, len);
-      if (w != len)
-      {
-        Serial.printf("Update.write failed: wrote %u of %u\n", (unsigned)w, (unsigned)len);
-        setOTAUpdateResult(-1, "OTA write failed");
-        Update.abort();
-        http.end();
-        xTaskNotifyGive(callerHandle);
-        vTaskDelete(NULL);
-        return;
+        logWarn("Firmware download stalled");
+        break;
       }
+      delay(1);
+      continue;
+    }
 
-      mbedtls_sha256_update(&shaCtx, buf, len);
-      written += len;
-      Serial.printf("\rFlashed %d/%d bytes", (int)written, contentLength);
+    size_t toRead = min(sizeof(buf), available);
+    if (checkpoint.total > 0)
+    {
+      toRead = min(toRead, checkpoint.total - checkpoint.written);
     }
-    else
+    size_t len = stream->readBytes(buf, toRead);
+    if (len == 0)
     {
+      // nothing read this iteration
       delay(1);
+      continue;
+    }
+
+    size_t w = Update.write(buf, len);
+    if (w != len)
+    {
+      TRACE_END("ota.flash");
+      logError("Update.write failed: wrote %u of %u", (unsigned)w, (unsigned)len);
+      message = "OTA write failed";
+      http.end();
+      return OTA_ERROR_WRITE;
+    }
+
+    mbedtls_sha256_update(&checkpoint.sha, buf, len);
+    checkpoint.written += len;
+    lastDataMs = millis();
+    if (checkpoint.written / OTA_PROGRESS_LOG_BYTES != (checkpoint.written - len) / OTA_PROGRESS_LOG_BYTES)
+    {
+      logInfo("Flashed %u/%u bytes", (unsigned)checkpoint.written, (unsigned)checkpoint.total);
     }
   }
+  TRACE_END("ota.flash");
+  http.end();
 
   // If we knew the content length, ensure we received all bytes
-  if (!unknownSize && written != (size_t)contentLength)
+  if (checkpoint.total > 0 && checkpoint.written != checkpoint.total)
   {
-    Serial.printf("\nDownloaded size mismatch: got %u expected %d\n", (unsigned)written, contentLength);
-    setOTAUpdateResult(-1, "Incomplete download: size mismatch");
-    Update.abort();
-    http.end();
-    xTaskNotifyGive(callerHandle);
-    vTaskDelete(NULL);
-    return;
+    logWarn("Download stopped at %u of %u bytes", (unsigned)checkpoint.written, (unsigned)checkpoint.total);
+    message = "Incomplete download: size mismatch";
+    resumable = true;
+    return OTA_ERROR_INCOMPLETE;
   }
+  return OTA_ERROR_NONE;
+}
 
+/**
+ * @brief Downloads from one source until the checkpoint holds a whole image, resuming after breaks.
+ *
+ * A break is resumed after OTA_RESUME_BACKOFF_MS, doubled for each attempt in
+ * a row that delivered nothing. The source is given up after OTA_MAX_RESUMES
+ * resumes, or OTA_MAX_STALLED_RESUMES such attempts, and the checkpoint is
+ * kept for the next source.
+ */
+static OtaUpdateError resumeFromSource(const String &firmwareUrl, OtaCheckpoint &checkpoint, String &message)
+{
+  uint8_t resumes = 0;
+  uint8_t stalled = 0;
+  while (true)
+  {
+    size_t before = checkpoint.written;
+    bool resumable;
+    OtaUpdateError error = downloadToCheckpoint(firmwareUrl, checkpoint, resumable, message);
+    // Without a size there is no way to tell a resumed tail from a wrong one
+    if (error == OTA_ERROR_NONE || !resumable || checkpoint.total == 0)
+    {
+      return error;
+    }
+    stalled = checkpoint.written > before ? 0 : stalled + 1;
+    if (resumes >= OTA_MAX_RESUMES || stalled >= OTA_MAX_STALLED_RESUMES)
+    {
+      return error;
+    }
+    resumes++;
+    uint32_t backoffMs = OTA_RESUME_BACKOFF_MS << stalled;
+    logInfo("Resuming at %u bytes in %u ms", (unsigned)checkpoint.written, (unsigned)backoffMs);
+    delay(backoffMs);
+  }
+}
+
+/**
+ * @brief Finishes the checkpoint's hash and compares it with the manifest's.
+ */
+static bool checkpointMatches(OtaCheckpoint &checkpoint, const String &expectedSha)
+{
   // finish hash into a dedicated 32-byte buffer
+  TRACE_BEGIN("ota.verify");
   uint8_t hashBuf[32];
-  mbedtls_sha256_finish(&shaCtx, hashBuf);
-  mbedtls_sha256_free(&shaCtx);
+  mbedtls_sha256_finish(&checkpoint.sha, hashBuf);
 
   // Convert hash to hex
   char hashHex[65];
   for (int i = 0; i < 32; i++)
     sprintf(hashHex + i * 2, "%02x", hashBuf[i]);
   hashHex[64] = 0;
-
-  Serial.println("\n" + expectedSha);
-  Serial.println(String(hashHex));
+  TRACE_END("ota.verify");
 
   if (!expectedSha.equalsIgnoreCase(String(hashHex)))
   {
-    Serial.println("SHA Mismatch!");
-    setOTAUpdateResult(-1, "SHA256 mismatch! Aborting OTA.");
-    Update.abort();
-    http.end();
+    logWarn("SHA mismatch: got %s... expected %s...", String(hashHex).substring(0, 16).c_str(), expectedSha.substring(0, 16).c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Downloads one source into the update partition and checks its SHA-256.
+ *
+ * Continues from whatever the checkpoint already holds, possibly written from
+ * an earlier source; every source serves the same bytes and the hash covers
+ * the splice. An image that fails the hash is discarded, and if it was
+ * spliced, downloaded once more from byte 0, since only then can the source
+ * itself be blamed. Leaves the partition staged but not activated on success.
+ * @param message Receives the failure description.
+ */
+static OtaUpdateError flashFromSource(const String &firmwareUrl, const String &expectedSha, OtaCheckpoint &checkpoint, String &message)
+{
+  // A different source's ETag would only make it send the whole image
+  checkpoint.etag = "";
+  bool restarted = false;
+  while (true)
+  {
+    OtaUpdateError error = resumeFromSource(firmwareUrl, checkpoint, message);
+    if (error != OTA_ERROR_NONE)
+    {
+      return error;
+    }
+    if (checkpointMatches(checkpoint, expectedSha))
+    {
+      return OTA_ERROR_NONE;
+    }
+
+    bool spliced = checkpoint.spliced;
+    resetCheckpoint(checkpoint);
+    message = "SHA256 mismatch! Aborting OTA.";
+    if (!spliced || restarted)
+    {
+      return OTA_ERROR_HASH_MISMATCH;
+    }
+    logWarn("Spliced image corrupt, restarting");
+    restarted = true;
+  }
+}
+
+/**
+ * @brief Tries each source in turn until one delivers the expected image.
+ *
+ * A source that refuses, breaks off for good or serves other bytes only costs
+ * the next attempt, which resumes from what was already flashed; running out
+ * of space or failing to write flash ends the update, since no other source
+ * would fare better.
+ */
+void otaTask(void *param)
+{
+  logInfo("Starting Update Task");
+  setOTAUpdateResult(1, OTA_ERROR_NONE, "OTA update in progress");
+  OTAParams *p = static_cast<OTAParams *>(param);
+  OTAParams params = *p;
+  TaskHandle_t callerHandle = p->callerHandle;
+  delete p;
+
+  OtaCheckpoint checkpoint;
+  beginCheckpoint(checkpoint);
+  OtaUpdateError error = OTA_ERROR_DOWNLOAD;
+  String message = "No firmware source";
+  uint8_t source = 0;
+  for (; source < params.sourceCount; source++)
+  {
+    logInfo("Trying firmware source %u of %u: %s", (unsigned)source + 1, (unsigned)params.sourceCount, params.sources[source]);
+    error = flashFromSource(params.sources[source], params.expectedSha, checkpoint, message);
+    if (error == OTA_ERROR_NONE || error == OTA_ERROR_NO_SPACE || error == OTA_ERROR_WRITE)
+    {
+      break;
+    }
+  }
+
+  if (error != OTA_ERROR_NONE)
+  {
+    resetCheckpoint(checkpoint);
+    mbedtls_sha256_free(&checkpoint.sha);
+    logError("OTA update failed: %s", message.c_str());
+    setOTAUpdateResult(-1, error, message);
     xTaskNotifyGive(callerHandle);
     vTaskDelete(NULL);
     return;
   }
+  mbedtls_sha256_free(&checkpoint.sha);
 
-  if (!Update.end())
+  TRACE_BEGIN("ota.finalize");
+  bool finalized = Update.end();
+  TRACE_END("ota.finalize");
+  if (!finalized)
   {
-    Serial.println("Update failed!");
-    setOTAUpdateResult(-1, "OTA update failed. Error: " + String(Update.getError()));
-    http.end();
+    logError("Update failed, error %u", (unsigned)Update.getError());
+    setOTAUpdateResult(-1, OTA_ERROR_FINALIZE, "OTA update failed. Error: " + String(Update.getError()));
     xTaskNotifyGive(callerHandle);
     vTaskDelete(NULL);
     return;
   }
 
+  // Reported by /api/system/firmware/info after the restart
+  Preferences prefs;
+  prefs.begin("ota", false);
+  prefs.putString("source", params.sources[source]);
+  prefs.end();
+
   Serial.println("Success!");
-  setOTAUpdateResult(2, "OTA successful!");
-  http.end();
+  setOTAUpdateResult(2, OTA_ERROR_NONE, "OTA successful!");
 
   // Restart
   ESP.restart();
@@ -282,13 +528,65 @@ void otaTask(void *param)
   return;
 }
 
-String performOTAUpdate(String firmwareUrl, const String &expectedSha, const String firmwareVersion)
+/**
+ * @brief Lists where to download a manifest's image from, peers first.
+ *
+ * The peers are tried from a random starting point so that boards updating
+ * together spread over them, and the hub comes last as the source that always
+ * has the image.
+ * @param sources Receives up to OTA_MAX_SOURCES URLs.
+ * @return The number of sources written.
+ */
+uint8_t buildFirmwareSources(const Manifest &manifest, const String &hubUrl, String *sources)
+{
+  uint8_t count = 0;
+  uint8_t first = manifest.peerCount > 0 ? esp_random() % manifest.peerCount : 0;
+  for (uint8_t i = 0; i < manifest.peerCount; i++)
+  {
+    const String &peer = manifest.peers[(first + i) % manifest.peerCount];
+    sources[count++] = "http://" + peer + "/api/system/firmware?sha256=" + manifest.sha256;
+  }
+  sources[count++] = hubUrl;
+  return count;
+}
+
+/**
+ * @brief Returns the URL the running image was downloaded from, or "" if it was flashed over serial.
+ */
+String getOTAUpdateSource()
+{
+  Preferences prefs;
+  prefs.begin("ota", true);
+  String source = prefs.getString("source", "");
+  prefs.end();
+  return source;
+}
+
+/**
+ * @brief Runs an update in its own task and waits for it to finish or fail.
+ *
+ * A successful update restarts the board, so this only returns early on success
+ * if the restart itself is delayed.
+ * @param sources URLs serving the image, tried in order.
+ * @param message Receives the failure description.
+ * @return Why the update stopped, or OTA_ERROR_NONE.
+ */
+OtaUpdateError performOTAUpdate(const String *sources, uint8_t sourceCount, const String &expectedSha, const String firmwareVersion, String &message)
 {
-  setOTAUpdateResult(0, "");
+  setOTAUpdateResult(0, OTA_ERROR_NONE, "");
 
   TaskHandle_t caller = xTaskGetCurrentTaskHandle();
   xTaskNotifyStateClear(caller);
-  OTAParams *params = new OTAParams{firmwareUrl, expectedSha, firmwareVersion, caller};
+  OTAParams *params = new OTAParams;
+  sourceCount = min(sourceCount, (uint8_t)OTA_MAX_SOURCES);
+  for (uint8_t i = 0; i < sourceCount; i++)
+  {
+    params->sources[i] = sources[i];
+  }
+  params->sourceCount = sourceCount;
+  params->expectedSha = expectedSha;
+  params->firmwareVersion = firmwareVersion;
+  params->callerHandle = caller;
 
   xTaskCreatePinnedToCore(
       otaTask,
@@ -299,18 +597,14 @@ String performOTAUpdate(String firmwareUrl, const String &expectedSha, const Str
       NULL,
       1);
 
-  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-
-  int result = getOTAUpdateResult();
-  String message = getOTAUpdateResultMessage();
+  // A sensor read that missed its deadline can still notify this task, so a wake-up only counts once the task has set its result
+  while (otaUpdateResult == 0 || otaUpdateResult == 1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
 
-  return "{ \"status\": \"started\" }";
-  // if (result == 2)
-  // {
-  //   return
-  // }
-  // else
-  // {
-  //   return "{\"error\": \"" + message + "\", \"code\": " + String(result) + "}";
-  // }
+  message = getOTAUpdateResultMessage();
+  return otaUpdateError;
 }
+
+#endif
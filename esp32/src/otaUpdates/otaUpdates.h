@@ -5,14 +5,40 @@
 #include <ArduinoJson.h>
 #include <mbedtls/sha256.h>
 
+// Peers a manifest may list; the hub is always tried after them
+#define OTA_MAX_PEERS 8
+#define OTA_MAX_SOURCES (OTA_MAX_PEERS + 1)
+
+/**
+ * @brief The hub's description of the current image.
+ *
+ * peers are "host[:port]" of boards already running it, which serve the same
+ * bytes from /api/system/firmware.
+ */
 struct Manifest
 {
   String version;
   String sha256;
   String path;
+  String peers[OTA_MAX_PEERS];
+  uint8_t peerCount = 0;
+};
+
+// Why an update stopped; OTA_ERROR_NONE while it runs or once it succeeded
+enum OtaUpdateError : uint8_t
+{
+  OTA_ERROR_NONE,
+  OTA_ERROR_DOWNLOAD,
+  OTA_ERROR_NO_SPACE,
+  OTA_ERROR_WRITE,
+  OTA_ERROR_INCOMPLETE,
+  OTA_ERROR_HASH_MISMATCH,
+  OTA_ERROR_FINALIZE
 };
 
-String performOTAUpdate(const String firmwareUrl, const String &expectedSha, const String manifestVersion);
+uint8_t buildFirmwareSources(const Manifest &manifest, const String &hubUrl, String *sources);
+OtaUpdateError performOTAUpdate(const String *sources, uint8_t sourceCount, const String &expectedSha, const String manifestVersion, String &message);
+String getOTAUpdateSource();
 bool isNewerVersion(const char *latest, const char *current);
 Manifest fetchManifest(const char *manifestUrl);
 
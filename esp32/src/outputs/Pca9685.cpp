@@ -1,87 +1,999 @@
+#include "Features.h"
+
+#if FEATURE_PCA9685
+
 #include "Pca9685.h"
 
-#include <map>
+#include <Adafruit_I2CDevice.h>
 #include <Adafruit_PWMServoDriver.h>
+#include <Preferences.h>
 #include "Wire.h"
+#include "utils/i2cUtils.h"
+#include "utils/I2CDeviceRegistry.h"
+#include "utils/logUtils.h"
+#include "utils/traceUtils.h"
 
 // ===== Hardware Config =====
-std::map<uint8_t, Adafruit_PWMServoDriver*> pca9685Registry;
+I2CDeviceRegistry<Pca9685Device, 0x40, 0x7F> pca9685Registry;
+HttpCacheState pca9685StateCache = {0, 0};
+
+static const uint8_t PCA9685_CHANNELS = 16;
+static const uint8_t PCA9685_LED0_ON_L_REGISTER = 0x06; // each channel has ON_L, ON_H, OFF_L, OFF_H
+static const uint8_t PCA9685_MODE1_REGISTER = 0x00;
+static const uint8_t PCA9685_MODE2_REGISTER = 0x01;
+static const uint8_t PCA9685_MODE2_RESERVED = 0xE0; // always read back 0
+static const uint8_t PCA9685_MODE1_AUTO_INCREMENT = 0x20;
+static const uint8_t PCA9685_MODE1_SLEEP = 0x10;
+static const uint8_t PCA9685_MODE1_RESTART = 0x80;
+static const uint8_t PCA9685_PRESCALE_REGISTER = 0xFE;
+// Per group: the register holding its address and the MODE1 bit that makes the chip answer it
+static const uint8_t PCA9685_GROUP_REGISTERS[PCA9685_GROUP_COUNT] = {0x05, 0x02, 0x03, 0x04}; // ALLCALLADR, SUBADR1-3
+static const uint8_t PCA9685_GROUP_MODE1_BITS[PCA9685_GROUP_COUNT] = {0x01, 0x08, 0x04, 0x02};
+static const uint8_t PCA9685_FIRST_ADDRESS = 0x40;
+static const uint8_t PCA9685_POWER_ON_ALL_CALL = 0x70; // every chip answers it until initialized
+
+// Latest requested duties for one chip that have not been written yet
+struct PendingPca9685Outputs {
+    bool used;
+    uint8_t bus;
+    uint8_t address;
+    uint16_t dirty; // one bit per channel
+    uint16_t counts[PCA9685_CHANNELS];
+    uint32_t requestedUs[PCA9685_CHANNELS]; // when each dirty channel was first requested
+};
+
+// Last duty written to each channel of one chip, saved to NVS so that a reset can put it back
+struct Pca9685Duties {
+    uint8_t bus;
+    uint8_t address;
+    uint16_t known; // channels written at least once; the rest stay at the power-on full off
+    uint16_t counts[PCA9685_CHANNELS];
+};
+
+// Chips keep their slot once used; a board has only a handful
+static PendingPca9685Outputs pendingOutputs[PCA9685_SCHEDULER_MAX_CHIPS];
+// Claimed in order and never released, so the used slots are always the first dutyChips
+static Pca9685Duties duties[PCA9685_SCHEDULER_MAX_CHIPS];
+static uint8_t dutyChips = 0;
+// What NVS holds, so that a save which would change nothing is skipped
+static Pca9685Duties savedDuties[PCA9685_SCHEDULER_MAX_CHIPS];
+static uint8_t savedDutyChips = 0;
+static bool dutiesUnsaved = false;
+static uint32_t firstUnsavedMs = 0;
+static uint32_t lastDutyChangeMs = 0;
+static Pca9685RestoreStats restoreStats = {};
+static Pca9685SchedulerStats schedulerStats = {};
+static uint32_t schedulerApplied = 0;
+static uint64_t schedulerLatencyTotalUs = 0;
+static portMUX_TYPE pendingOutputsMux = portMUX_INITIALIZER_UNLOCKED;
+// Serializes driver and bus access between the flush task and handlers
+static SemaphoreHandle_t pca9685Mutex = NULL;
+static TaskHandle_t flushTask = NULL;
+
+static Pca9685Group pca9685Groups[PCA9685_GROUP_COUNT];
+
+static uint64_t memberBit(uint8_t address) {
+    return 1ULL << (address - PCA9685_FIRST_ADDRESS);
+}
+
+static bool isGroupAddress(uint8_t bus, uint8_t address) {
+    for (uint8_t g = 0; g < PCA9685_GROUP_COUNT; g++) {
+        if (pca9685Groups[g].address == address && pca9685Groups[g].bus == bus) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static String frequencyKey(uint8_t bus, uint8_t address) {
+    return "f" + String(bus) + "_" + String(address, HEX);
+}
+
+static uint16_t loadFrequency(uint8_t bus, uint8_t address) {
+    Preferences prefs;
+    if (!prefs.begin("pca9685", true)) {
+        return PCA9685_DEFAULT_FREQUENCY;
+    }
+    uint16_t frequency = prefs.getUShort(frequencyKey(bus, address).c_str(), PCA9685_DEFAULT_FREQUENCY);
+    prefs.end();
+    return frequency;
+}
+
+bool Pca9685Device::write8(uint8_t reg, uint8_t value) {
+    uint8_t buffer[2] = {reg, value};
+    return _device.write(buffer, sizeof(buffer));
+}
+
+bool Pca9685Device::read8(uint8_t reg, uint8_t &value) {
+    return _device.write_then_read(&reg, 1, &value, 1);
+}
+
+/// @brief Restarts the chip and sets its PWM frequency, as Adafruit_PWMServoDriver::begin() does.
+bool Pca9685Device::begin(uint16_t frequency) {
+    if (!write8(PCA9685_MODE1_REGISTER, PCA9685_MODE1_RESTART)) {
+        return false;
+    }
+    delay(10);
+    return setFrequency(frequency);
+}
+
+/// @brief Sets the prescaler, which only takes while the oscillator sleeps, then restarts the outputs
+/// with register auto-increment on.
+bool Pca9685Device::setFrequency(uint16_t frequency) {
+    float prescale = FREQUENCY_OSCILLATOR / (frequency * 4096.0f) + 0.5f - 1;
+    if (prescale < PCA9685_PRESCALE_MIN) {
+        prescale = PCA9685_PRESCALE_MIN;
+    } else if (prescale > PCA9685_PRESCALE_MAX) {
+        prescale = PCA9685_PRESCALE_MAX;
+    }
+    uint8_t mode1;
+    if (!read8(PCA9685_MODE1_REGISTER, mode1) ||
+        !write8(PCA9685_MODE1_REGISTER, (mode1 & ~PCA9685_MODE1_RESTART) | PCA9685_MODE1_SLEEP) ||
+        !write8(PCA9685_PRESCALE_REGISTER, (uint8_t)prescale) ||
+        !write8(PCA9685_MODE1_REGISTER, mode1)) {
+        return false;
+    }
+    delay(5);
+    return write8(PCA9685_MODE1_REGISTER, mode1 | PCA9685_MODE1_RESTART | PCA9685_MODE1_AUTO_INCREMENT);
+}
 
-/// @brief Retrieves or initializes an Adafruit_PWMServoDriver instance for the given I2C address.
+bool Pca9685Device::readPrescale(uint8_t &prescale) {
+    return read8(PCA9685_PRESCALE_REGISTER, prescale);
+}
+
+static bool writeRegister(uint8_t bus, uint8_t address, uint8_t reg, uint8_t value) {
+    TwoWire* wire = getI2CBus(bus);
+    wire->beginTransmission(address);
+    wire->write(reg);
+    wire->write(value);
+    bool ok = wire->endTransmission() == 0;
+    recordI2CTransaction(bus, ok);
+    return ok;
+}
+
+/// @brief Programs a chip's group addresses and MODE1 enable bits from the group table.
+///
+/// MODE1 is written whole: auto-increment on, awake, and one enable bit per group the chip is in.
+static bool applyGroupMembership(uint8_t bus, uint8_t address) {
+    uint8_t mode1 = PCA9685_MODE1_AUTO_INCREMENT;
+    bool ok = true;
+    for (uint8_t g = 0; g < PCA9685_GROUP_COUNT && ok; g++) {
+        const Pca9685Group& group = pca9685Groups[g];
+        if (group.address != 0 && group.bus == bus && (group.members & memberBit(address))) {
+            ok = writeRegister(bus, address, PCA9685_GROUP_REGISTERS[g], group.address << 1);
+            mode1 |= PCA9685_GROUP_MODE1_BITS[g];
+        }
+    }
+    return ok && writeRegister(bus, address, PCA9685_MODE1_REGISTER, mode1);
+}
+
+/// @brief Attaches a PCA9685 that the inventory's address sweep came across. Call with pca9685Mutex held.
+///
+/// Group addresses, and the ALL_CALL address every chip answers from power-on, ACK without being a
+/// chip, so they are skipped. Whatever else answers is only initialized if its MODE2 and ALLCALLADR
+/// registers read back as a PCA9685's can: another kind of device must not get begin()'s writes.
+/// An address where nothing answers is expected here, so it is left out of the bus error counts.
+/// @return The driver, or nullptr if there is no PCA9685 at the address.
+Pca9685Device* discoverPCA9685(uint8_t bus, uint8_t address) {
+    if (address == PCA9685_POWER_ON_ALL_CALL || isGroupAddress(bus, address)) {
+        return nullptr;
+    }
+    Adafruit_I2CDevice device(address, getI2CBus(bus));
+    uint8_t reg = PCA9685_MODE2_REGISTER;
+    uint8_t mode2;
+    if (!device.write_then_read(&reg, 1, &mode2, 1)) {
+        return nullptr;
+    }
+    reg = PCA9685_GROUP_REGISTERS[0];
+    uint8_t allCallAddress;
+    bool ok = device.write_then_read(&reg, 1, &allCallAddress, 1);
+    recordI2CTransaction(bus, ok);
+    // The low bit of every group address register is read-only 0
+    if (!ok || (mode2 & PCA9685_MODE2_RESERVED) || (allCallAddress & 0x01)) {
+        return nullptr;
+    }
+    return getPCA9685(bus, address);
+}
+
+/// @brief Encodes a 12-bit duty as the chip's ON/OFF register pair, using the full-on and full-off bits at the ends.
+static void encodeDuty(uint16_t counts, uint8_t *registers) {
+    uint16_t on = 0;
+    uint16_t off = counts;
+    if (counts >= 4095) {
+        on = 4096;
+        off = 0;
+    } else if (counts == 0) {
+        off = 4096;
+    }
+    registers[0] = on & 0xFF;
+    registers[1] = on >> 8;
+    registers[2] = off & 0xFF;
+    registers[3] = off >> 8;
+}
+
+/// @brief Decodes a channel's ON/OFF registers into a percentage, honouring the full-on and full-off bits.
+static uint8_t decodeDuty(const uint8_t *registers) {
+    uint16_t on = registers[0] | (registers[1] << 8);
+    uint16_t off = registers[2] | (registers[3] << 8);
+    if (off & 0x1000) {
+        return 0;
+    }
+    if (on & 0x1000) {
+        return 100;
+    }
+    return map((off - on) & 0xFFF, 0, 4095, 0, 100);
+}
+
+/// @brief Writes a run of adjacent channels in one transaction, relying on register auto-increment
+/// (enabled by the driver when it sets the PWM frequency).
+static bool writeChannelRun(uint8_t bus, uint8_t address, uint8_t first, uint8_t count, const uint16_t *counts) {
+    TRACE_SCOPE("pca9685.write");
+    TwoWire* wire = getI2CBus(bus);
+    wire->beginTransmission(address);
+    wire->write(PCA9685_LED0_ON_L_REGISTER + 4 * first);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t registers[4];
+        encodeDuty(counts[first + i], registers);
+        wire->write(registers, sizeof(registers));
+    }
+    bool ok = wire->endTransmission() == 0;
+    recordI2CTransaction(bus, ok);
+    return ok;
+}
+
+/// @brief Writes the duties last recorded for a chip back to it, all 16 channels in one transaction.
+/// Channels never written go to full off. A chip with no recorded duties is left alone.
+static bool writeRecordedDuties(uint8_t bus, uint8_t address) {
+    uint16_t counts[PCA9685_CHANNELS] = {};
+    uint16_t known = 0;
+    portENTER_CRITICAL(&pendingOutputsMux);
+    for (uint8_t i = 0; i < dutyChips; i++) {
+        if (duties[i].bus == bus && duties[i].address == address) {
+            known = duties[i].known;
+            for (uint8_t pin = 0; pin < PCA9685_CHANNELS; pin++) {
+                counts[pin] = (known & (1 << pin)) ? duties[i].counts[pin] : 0;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    return known == 0 || writeChannelRun(bus, address, 0, PCA9685_CHANNELS, counts);
+}
+
+/// @brief Retrieves or initializes the driver for the given I2C bus and address.
+/// The device is probed on every call; the driver is constructed in its registry slot the first time
+/// it answers, and re-initialized in place if it dropped off the bus in between.
+/// Initialization restarts the chip at its saved PWM frequency and programs its group memberships,
+/// then writes back the duties last recorded for it, since a chip that lost power has every output off.
+/// Only called with the scheduler's lock held; other code goes through setPCA9685Pin() or queuePCA9685Pin().
+/// @param bus The I2C bus the PCA9685 is attached to.
 /// @param address The I2C address of the PCA9685 device.
-/// @return A pointer to the Adafruit_PWMServoDriver instance, or nullptr if initialization failed
-Adafruit_PWMServoDriver* getPCA9685(uint8_t address){
-    if (pca9685Registry.count(address)) {
-      if(Wire.endTransmission() == 0) {
-        return pca9685Registry[address];
-      }
-      delete pca9685Registry[address];
-      pca9685Registry.erase(address);
-    }
-
-    Adafruit_PWMServoDriver* pca9685 = new Adafruit_PWMServoDriver(address);
-    if (!pca9685->begin()) {
-        delete pca9685;
+/// @return The driver, or nullptr if the device is absent, initialization failed, or the address
+/// belongs to a group (group addresses acknowledge writes but cannot be read).
+Pca9685Device* getPCA9685(uint8_t bus, uint8_t address){
+    if (isGroupAddress(bus, address)) {
         return nullptr;
     }
+    TwoWire* wire = getI2CBus(bus);
+    return pca9685Registry.acquire(bus, address, [&](Pca9685Device& pca9685) {
+        TRACE_SCOPE("pca9685.begin");
+        bool ok = pca9685.begin(loadFrequency(bus, address));
+        recordI2CTransaction(bus, ok);
+        if (ok) {
+            ok = applyGroupMembership(bus, address) && writeRecordedDuties(bus, address);
+            markHttpResourceChanged(pca9685StateCache);
+        }
+        return ok;
+    }, address, *wire);
+}
+
+/// @brief Returns the pending slot for a chip, claiming a free one if needed. Call with pendingOutputsMux held.
+/// @return nullptr if every slot belongs to another chip.
+static PendingPca9685Outputs* findPendingOutputs(uint8_t bus, uint8_t address) {
+    PendingPca9685Outputs* free = nullptr;
+    for (uint8_t i = 0; i < PCA9685_SCHEDULER_MAX_CHIPS; i++) {
+        PendingPca9685Outputs& pending = pendingOutputs[i];
+        if (pending.used && pending.bus == bus && pending.address == address) {
+            return &pending;
+        }
+        if (!pending.used && free == nullptr) {
+            free = &pending;
+        }
+    }
+    if (free != nullptr) {
+        free->used = true;
+        free->bus = bus;
+        free->address = address;
+        free->dirty = 0;
+    }
+    return free;
+}
+
+/// @brief Records the latest duty for a channel. A value still waiting to be written is replaced.
+/// @return The chip's pending slot, or nullptr if the scheduler has no room for the chip.
+static PendingPca9685Outputs* queueDuty(uint8_t bus, uint8_t address, uint8_t pin, uint16_t counts) {
+    portENTER_CRITICAL(&pendingOutputsMux);
+    PendingPca9685Outputs* pending = findPendingOutputs(bus, address);
+    if (pending != nullptr) {
+        uint16_t bit = 1 << pin;
+        if (pending->dirty & bit) {
+            schedulerStats.coalesced++;
+        } else {
+            pending->requestedUs[pin] = micros();
+        }
+        pending->dirty |= bit;
+        pending->counts[pin] = counts;
+        schedulerStats.requests++;
+    }
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    return pending;
+}
+
+/// @brief Records duties that reached a chip, for the next NVS save. Call with pendingOutputsMux held.
+/// @param channels One bit per channel of counts to record.
+/// @return true if this starts a new unsaved period, which the flush task has to be woken to time.
+static bool recordDuties(uint8_t bus, uint8_t address, uint16_t channels, const uint16_t *counts) {
+    Pca9685Duties* chip = nullptr;
+    for (uint8_t i = 0; i < dutyChips && chip == nullptr; i++) {
+        if (duties[i].bus == bus && duties[i].address == address) {
+            chip = &duties[i];
+        }
+    }
+    if (chip == nullptr) {
+        if (dutyChips >= PCA9685_SCHEDULER_MAX_CHIPS) {
+            return false;
+        }
+        chip = &duties[dutyChips++];
+        memset(chip, 0, sizeof(*chip));
+        chip->bus = bus;
+        chip->address = address;
+    }
+
+    bool changed = false;
+    for (uint8_t pin = 0; pin < PCA9685_CHANNELS; pin++) {
+        uint16_t bit = 1 << pin;
+        if ((channels & bit) && (!(chip->known & bit) || chip->counts[pin] != counts[pin])) {
+            chip->known |= bit;
+            chip->counts[pin] = counts[pin];
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return false;
+    }
+    lastDutyChangeMs = millis();
+    if (dutiesUnsaved) {
+        return false;
+    }
+    dutiesUnsaved = true;
+    firstUnsavedMs = lastDutyChangeMs;
+    return true;
+}
+
+/// @brief Wakes the flush task so that it times the save of newly changed duties.
+static void scheduleDutySave(bool newlyUnsaved) {
+    if (newlyUnsaved && flushTask != NULL) {
+        xTaskNotifyGive(flushTask);
+    }
+}
+
+/// @brief Writes a chip's changed channels, one transaction per run of adjacent channels.
+///
+/// Call with pca9685Mutex held. If the chip does not answer, the changes are dropped
+/// and counted as failed; the next request for a channel writes it again.
+/// @return false if the chip was absent or a write failed.
+static bool flushPendingOutputs(PendingPca9685Outputs& pending) {
+    uint16_t counts[PCA9685_CHANNELS];
+    uint32_t requestedUs[PCA9685_CHANNELS];
+    portENTER_CRITICAL(&pendingOutputsMux);
+    uint16_t dirty = pending.dirty;
+    memcpy(counts, pending.counts, sizeof(counts));
+    memcpy(requestedUs, pending.requestedUs, sizeof(requestedUs));
+    pending.dirty = 0;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    if (dirty == 0) {
+        return true;
+    }
+
+    bool ok = getPCA9685(pending.bus, pending.address) != nullptr;
+    uint32_t transactions = 0;
+    for (uint8_t first = 0; ok && first < PCA9685_CHANNELS;) {
+        if (!(dirty & (1 << first))) {
+            first++;
+            continue;
+        }
+        uint8_t count = 1;
+        while (first + count < PCA9685_CHANNELS && (dirty & (1 << (first + count)))) {
+            count++;
+        }
+        ok = writeChannelRun(pending.bus, pending.address, first, count, counts);
+        transactions++;
+        first += count;
+    }
+
+    uint32_t now = micros();
+    uint8_t channels = 0;
+    bool newlyUnsaved = false;
+    portENTER_CRITICAL(&pendingOutputsMux);
+    schedulerStats.transactions += transactions;
+    if (ok) {
+        newlyUnsaved = recordDuties(pending.bus, pending.address, dirty, counts);
+    }
+    for (uint8_t pin = 0; pin < PCA9685_CHANNELS; pin++) {
+        if (!(dirty & (1 << pin))) {
+            continue;
+        }
+        channels++;
+        if (ok) {
+            uint32_t latency = now - requestedUs[pin];
+            schedulerApplied++;
+            schedulerLatencyTotalUs += latency;
+            if (latency > schedulerStats.maxLatencyUs) {
+                schedulerStats.maxLatencyUs = latency;
+            }
+        }
+    }
+    if (!ok) {
+        schedulerStats.failed += channels;
+    }
+    portEXIT_CRITICAL(&pendingOutputsMux);
+
+    if (ok) {
+        markHttpResourceChanged(pca9685StateCache);
+        scheduleDutySave(newlyUnsaved);
+    } else {
+        logWarn("Dropped %u PCA9685 output writes at %s", channels, formatI2CDeviceAddress(pending.bus, pending.address));
+    }
+    return ok;
+}
+
+/// @brief Writes every queued output change now.
+void flushPCA9685Outputs() {
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&pendingOutputsMux);
+    schedulerStats.flushes++;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    for (uint8_t i = 0; i < PCA9685_SCHEDULER_MAX_CHIPS; i++) {
+        if (pendingOutputs[i].used) {
+            flushPendingOutputs(pendingOutputs[i]);
+        }
+    }
+    xSemaphoreGive(pca9685Mutex);
+}
+
+static bool hasPendingOutputs() {
+    bool pending = false;
+    portENTER_CRITICAL(&pendingOutputsMux);
+    for (uint8_t i = 0; i < PCA9685_SCHEDULER_MAX_CHIPS; i++) {
+        pending |= pendingOutputs[i].dirty != 0;
+    }
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    return pending;
+}
+
+/// @brief Ticks until the recorded duties are due for NVS, or portMAX_DELAY if they are saved.
+static TickType_t dutySaveWaitTicks() {
+    portENTER_CRITICAL(&pendingOutputsMux);
+    bool unsaved = dutiesUnsaved;
+    uint32_t quietAt = lastDutyChangeMs + PCA9685_PERSIST_QUIET_MS;
+    uint32_t deadline = firstUnsavedMs + PCA9685_PERSIST_MAX_DELAY_MS;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    if (!unsaved) {
+        return portMAX_DELAY;
+    }
+    uint32_t now = millis();
+    int32_t wait = min((int32_t)(quietAt - now), (int32_t)(deadline - now));
+    return wait > 0 ? pdMS_TO_TICKS(wait) : 0;
+}
+
+/// @brief Writes the recorded duties to NVS as one blob, unless NVS already holds them.
+///
+/// Only chips that have been written are stored, so the blob is a few dozen bytes per chip. NVS
+/// appends each write to its log and spreads erases over the partition's pages; waiting for
+/// outputs to settle bounds the writes to one per PCA9685_PERSIST_QUIET_MS of quiet, and to one a
+/// minute under a constant stream of changes.
+static void saveDuties() {
+    Pca9685Duties snapshot[PCA9685_SCHEDULER_MAX_CHIPS];
+    portENTER_CRITICAL(&pendingOutputsMux);
+    uint8_t chips = dutyChips;
+    memcpy(snapshot, duties, chips * sizeof(Pca9685Duties));
+    dutiesUnsaved = false;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+
+    size_t length = chips * sizeof(Pca9685Duties);
+    if (chips == savedDutyChips && memcmp(snapshot, savedDuties, length) == 0) {
+        return;
+    }
+    TRACE_SCOPE("pca9685.save");
+    Preferences prefs;
+    prefs.begin("pca9685", false);
+    bool ok = prefs.putBytes("duties", snapshot, length) == length;
+    prefs.end();
+    if (!ok) {
+        logWarn("Failed to save PCA9685 duties");
+        return;
+    }
+    memcpy(savedDuties, snapshot, length);
+    savedDutyChips = chips;
+    portENTER_CRITICAL(&pendingOutputsMux);
+    schedulerStats.saves++;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+}
 
-    pca9685->setPWMFreq(800);
-    pca9685Registry[address] = pca9685;
-    return pca9685;
+/// @brief Sleeps until something is queued, waits one flush interval for the rest of the burst, then writes it.
+/// Also saves the written duties to NVS once they are due.
+static void flushOutputsTask(void* param) {
+    while (true) {
+        bool notified = ulTaskNotifyTake(pdTRUE, dutySaveWaitTicks()) > 0;
+        if (notified && hasPendingOutputs()) {
+            vTaskDelay(pdMS_TO_TICKS(PCA9685_FLUSH_INTERVAL_MS));
+            // Anything queued up to here is written by this flush
+            ulTaskNotifyTake(pdTRUE, 0);
+            flushPCA9685Outputs();
+        }
+        if (dutySaveWaitTicks() == 0) {
+            saveDuties();
+        }
+    }
 }
 
-/// @brief Sets the PWM value for a specific pin on the PCA9685 at the given I2C address.
+static String groupKey(uint8_t group) {
+    return "g" + String(group);
+}
+
+/// @brief Loads the persisted groups, creates the lock shared by every PCA9685 access and starts the
+/// output flush task. Safe to call more than once.
+void beginPCA9685() {
+    if (pca9685Mutex != NULL) {
+        return;
+    }
+    Preferences prefs;
+    if (prefs.begin("pca9685", true)) {
+        for (uint8_t g = 0; g < PCA9685_GROUP_COUNT; g++) {
+            String key = groupKey(g);
+            Pca9685Group stored;
+            // Skip entries written by a firmware with a different layout
+            if (prefs.getBytesLength(key.c_str()) == sizeof(stored) &&
+                prefs.getBytes(key.c_str(), &stored, sizeof(stored)) == sizeof(stored)) {
+                pca9685Groups[g] = stored;
+            }
+        }
+        size_t length = prefs.getBytesLength("duties");
+        if (length % sizeof(Pca9685Duties) == 0 && length <= sizeof(duties) &&
+            prefs.getBytes("duties", duties, length) == length) {
+            dutyChips = length / sizeof(Pca9685Duties);
+            memcpy(savedDuties, duties, length);
+            savedDutyChips = dutyChips;
+        }
+        prefs.end();
+    }
+    pca9685Mutex = xSemaphoreCreateMutex();
+    // NVS writes from the task need more stack than the flushes alone
+    xTaskCreatePinnedToCore(flushOutputsTask, "pca9685Flush", 4096, NULL, 2, &flushTask, 1);
+}
+
+/// @brief Writes the saved duties back to their chips, all 16 channels of a chip in one transaction.
+///
+/// Meant for early in setup(), before Wi-Fi, so outputs do not wait for the hub. A chip that lost
+/// power comes up with every output off, and one that kept power is reset by its initialization, so
+/// either way the outputs are off until this runs. Channels never written go back to full off. A chip
+/// re-initialized later, after dropping off the bus, gets its duties back the same way.
+void restorePCA9685Outputs() {
+    beginPCA9685();
+    Pca9685Duties snapshot[PCA9685_SCHEDULER_MAX_CHIPS];
+    portENTER_CRITICAL(&pendingOutputsMux);
+    uint8_t chips = dutyChips;
+    memcpy(snapshot, duties, chips * sizeof(Pca9685Duties));
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    if (chips == 0) {
+        return;
+    }
+
+    TRACE_SCOPE("pca9685.restore");
+    Pca9685RestoreStats stats = {};
+    uint32_t start = micros();
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < chips; i++) {
+        // Nothing is attached yet, so this initializes the chip, which writes its duties back
+        const Pca9685Duties& chip = snapshot[i];
+        if (getPCA9685(chip.bus, chip.address) != nullptr) {
+            stats.chips++;
+            stats.channels += __builtin_popcount(chip.known);
+        } else {
+            stats.failed++;
+            logWarn("Could not restore PCA9685 at %s", formatI2CDeviceAddress(chip.bus, chip.address));
+        }
+    }
+    xSemaphoreGive(pca9685Mutex);
+    stats.durationUs = micros() - start;
+    stats.restoredMs = millis();
+    restoreStats = stats;
+    markHttpResourceChanged(pca9685StateCache);
+    logInfo("Restored %u PCA9685 outputs at %u ms", stats.channels, stats.restoredMs);
+}
+
+Pca9685RestoreStats getPCA9685RestoreStats() {
+    return restoreStats;
+}
+
+static DriverError validatePinRequest(uint8_t pin, uint16_t percentage_on) {
+    if (pin > 15 || percentage_on > 100) {
+        return DRIVER_INVALID_ARGUMENT;
+    }
+    return DRIVER_OK;
+}
+
+/// @brief Sets the PWM value for a specific pin and waits until it is on the chip.
+/// Other changes queued for the same chip go out in the same write.
+/// @param bus I2C bus the PCA9685 device is attached to.
 /// @param address I2C address of the PCA9685 device.
 /// @param pin Pin number (0-15) to set the PWM value for.
 /// @param percentage_on PWM value as a percentage (0-100).
-/// @return JSON string indicating success or failure of the operation.
-String setPCA9685Pin(uint8_t address, uint8_t pin, uint16_t percentage_on){
-    Adafruit_PWMServoDriver* pca9685 = getPCA9685(address);
+/// @return DRIVER_BUS_ERROR if the chip did not answer.
+DriverError setPCA9685Pin(uint8_t bus, uint8_t address, uint8_t pin, uint16_t percentage_on){
+    DriverError error = validatePinRequest(pin, percentage_on);
+    if (error != DRIVER_OK) {
+        return error;
+    }
+    uint16_t on_value = map(percentage_on, 0, 100, 0, 4095);
+
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    bool ok;
+    PendingPca9685Outputs* pending = queueDuty(bus, address, pin, on_value);
+    if (pending != nullptr) {
+        ok = flushPendingOutputs(*pending);
+    } else {
+        // No scheduler slot for this chip; write the one channel directly
+        uint16_t counts[PCA9685_CHANNELS];
+        counts[pin] = on_value;
+        ok = getPCA9685(bus, address) != nullptr && writeChannelRun(bus, address, pin, 1, counts);
+        if (ok) {
+            markHttpResourceChanged(pca9685StateCache);
+        }
+        portENTER_CRITICAL(&pendingOutputsMux);
+        schedulerStats.requests++;
+        schedulerStats.transactions++;
+        bool newlyUnsaved = ok && recordDuties(bus, address, 1 << pin, counts);
+        portEXIT_CRITICAL(&pendingOutputsMux);
+        scheduleDutySave(newlyUnsaved);
+    }
+    xSemaphoreGive(pca9685Mutex);
+
+    return ok ? DRIVER_OK : DRIVER_BUS_ERROR;
+}
 
-    if(pin < 0 || pin > 15) {
-        return "{ \"status\":\"error\", \"message\":\"Invalid pin number. Must be between 0 and 15.\" }";
+/// @brief Queues a PWM value for a pin and returns without touching the bus.
+///
+/// The flush task writes it within PCA9685_FLUSH_INTERVAL_MS. A newer value for the same pin
+/// that arrives first replaces it, so only the last of a burst reaches the chip. Chips that
+/// have never answered are written synchronously instead, so a wrong address still reports an error.
+/// @param queued If not null, set to whether the value was queued rather than written.
+/// @return DRIVER_OK once queued, or the result of the synchronous write.
+DriverError queuePCA9685Pin(uint8_t bus, uint8_t address, uint8_t pin, uint16_t percentage_on, bool *queued){
+    if (queued != nullptr) {
+        *queued = false;
     }
-    if (percentage_on < 0 || percentage_on > 100) {
-        return "{ \"status\":\"error\", \"message\":\"Invalid percentage_on value. Must be between 0 and 100.\" }";
+    DriverError error = validatePinRequest(pin, percentage_on);
+    if (error != DRIVER_OK) {
+        return error;
+    }
+    if (flushTask == NULL || pca9685Registry.find(bus, address) == nullptr) {
+        return setPCA9685Pin(bus, address, pin, percentage_on);
     }
     uint16_t on_value = map(percentage_on, 0, 100, 0, 4095);
-    
-    String response_json = "{ ";
-    if(pca9685 != nullptr) {
-        pca9685->setPin(pin, on_value);
-        response_json += "\"status\":\"ok\", ";
-        response_json += "\"address\":\"0x" + String(address, HEX) + "\", ";
-        response_json += "\"pin\":" + String(pin) + ", ";
-        response_json += "\"percentage_on\":" + String(percentage_on);
-    } else {
-        response_json += "\"status\":\"error\", ";
-        response_json += "\"message\":\"Failed to set PWM on PCA9685 at address 0x" + String(address, HEX) + ", pin " + String(pin) +"\"";
-    }
-
-    response_json += " }";
-    return response_json;
-}
-
-String getPCA9685Status(uint8_t address) {
-    Adafruit_PWMServoDriver* pca9685 = getPCA9685(address);
-    String response_json = "{ ";
-    if(pca9685 != nullptr) {
-        response_json += "\"status\":\"ok\", ";
-        response_json += "\"address\":\"0x" + String(address, HEX) + "\", ";
-        response_json += "\"pins\":{ ";
-        for(uint8_t pin = 0; pin < 16; pin++) {
-            uint16_t pwm_value = pca9685->getPWM(pin, true);
-            uint16_t percentage_on = map(pwm_value, 0, 4095, 0, 100);
-            response_json += "\"" + String(pin) + "\":" + String(percentage_on);
-            if(pin < 15) {
-                response_json += ", ";
-            }
+    if (queueDuty(bus, address, pin, on_value) == nullptr) {
+        return setPCA9685Pin(bus, address, pin, percentage_on);
+    }
+    xTaskNotifyGive(flushTask);
+    if (queued != nullptr) {
+        *queued = true;
+    }
+    return DRIVER_OK;
+}
+
+/// @brief Holds off every PCA9685 bus access, e.g. while an I2C bus is restarted under the chips.
+/// Pair with unlockPCA9685Outputs(). Does nothing before beginPCA9685().
+void lockPCA9685Outputs() {
+    if (pca9685Mutex != NULL) {
+        xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    }
+}
+
+void unlockPCA9685Outputs() {
+    if (pca9685Mutex != NULL) {
+        xSemaphoreGive(pca9685Mutex);
+    }
+}
+
+/// @brief Sets the PWM frequency of an attached chip and saves it. Call with pca9685Mutex held.
+static bool applyFrequency(uint8_t bus, uint8_t address, uint16_t frequency) {
+    Pca9685Device* pca9685 = getPCA9685(bus, address);
+    if (pca9685 == nullptr) {
+        return false;
+    }
+    bool ok = pca9685->setFrequency(frequency);
+    recordI2CTransaction(bus, ok);
+    if (!ok) {
+        return false;
+    }
+
+    Preferences prefs;
+    prefs.begin("pca9685", false);
+    prefs.putUShort(frequencyKey(bus, address).c_str(), frequency);
+    prefs.end();
+    return true;
+}
+
+/// @brief Sets and saves the PWM frequency of one chip. The chip keeps it across re-initialization.
+/// @param frequency Frequency in Hz, PCA9685_MIN_FREQUENCY to PCA9685_MAX_FREQUENCY.
+/// @return DRIVER_NOT_FOUND if the chip does not answer.
+DriverError setPCA9685Frequency(uint8_t bus, uint8_t address, uint16_t frequency) {
+    if (frequency < PCA9685_MIN_FREQUENCY || frequency > PCA9685_MAX_FREQUENCY) {
+        return DRIVER_INVALID_ARGUMENT;
+    }
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    bool ok = applyFrequency(bus, address, frequency);
+    xSemaphoreGive(pca9685Mutex);
+    if (!ok) {
+        return DRIVER_NOT_FOUND;
+    }
+    markHttpResourceChanged(pca9685StateCache);
+    return DRIVER_OK;
+}
+
+Pca9685Group getPCA9685Group(uint8_t group) {
+    if (group >= PCA9685_GROUP_COUNT) {
+        return Pca9685Group();
+    }
+    lockPCA9685Outputs();
+    Pca9685Group copy = pca9685Groups[group];
+    unlockPCA9685Outputs();
+    return copy;
+}
+
+/// @brief Re-programs every attached chip that was or is a member of a group. Call with pca9685Mutex held.
+static void reprogramMembers(const Pca9685Group& before, const Pca9685Group& after) {
+    for (uint8_t i = 0; i < 64; i++) {
+        uint64_t bit = 1ULL << i;
+        uint8_t address = PCA9685_FIRST_ADDRESS + i;
+        if ((before.members & bit) && before.address != 0 && pca9685Registry.find(before.bus, address) != nullptr) {
+            applyGroupMembership(before.bus, address);
         }
-        response_json += " }";
-    } else {
-        response_json += "\"status\":\"error\", ";
-        response_json += "\"message\":\"Failed to retrieve PCA9685 at address 0x" + String(address, HEX) + "\"";
+        // New members are initialized here if they answer; init programs the membership itself
+        if ((after.members & bit) && getPCA9685(after.bus, address) != nullptr) {
+            applyGroupMembership(after.bus, address);
+        }
+    }
+}
+
+/// @brief Creates or replaces an output group and programs its member chips to answer its address.
+///
+/// Members that are absent now are programmed when they first answer. The group address must not
+/// be used by any device on the bus, since every member acknowledges it.
+/// @param group 0 for the ALL_CALL address, 1-3 for the three sub-addresses.
+/// @param address Bus and 7-bit address for the group.
+/// @param members Chip addresses (0x40-0x7F) on the same bus, as a bitmask of address - 0x40.
+/// @param frequency If not 0, applied to and saved for every member that answers.
+/// @return DRIVER_INVALID_ARGUMENT for a bad group, frequency or member list, DRIVER_CONFLICT if the
+/// address is already in use.
+DriverError configurePCA9685Group(uint8_t group, I2CDeviceAddress address, uint64_t members, uint16_t frequency) {
+    if (group >= PCA9685_GROUP_COUNT) {
+        return DRIVER_INVALID_ARGUMENT;
+    }
+    if (frequency != 0 && (frequency < PCA9685_MIN_FREQUENCY || frequency > PCA9685_MAX_FREQUENCY)) {
+        return DRIVER_INVALID_ARGUMENT;
+    }
+    // A group cannot use the address of one of its members
+    if (address.address >= PCA9685_FIRST_ADDRESS && (members & memberBit(address.address))) {
+        return DRIVER_INVALID_ARGUMENT;
+    }
+
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    Pca9685Group before = pca9685Groups[group];
+    bool sameAddress = before.address == address.address && before.bus == address.bus;
+    bool taken = false;
+    for (uint8_t g = 0; g < PCA9685_GROUP_COUNT; g++) {
+        taken |= g != group && pca9685Groups[g].address == address.address && pca9685Groups[g].bus == address.bus;
+    }
+    // Anything answering at a new group address would collide with the members
+    if (taken || pca9685Registry.find(address.bus, address.address) != nullptr ||
+        (!sameAddress && probeI2CDevice(address.bus, address.address))) {
+        xSemaphoreGive(pca9685Mutex);
+        return DRIVER_CONFLICT;
+    }
+
+    Pca9685Group& after = pca9685Groups[group];
+    after.bus = address.bus;
+    after.address = address.address;
+    after.members = members;
+    reprogramMembers(before, after);
+    for (uint8_t i = 0; frequency != 0 && i < 64; i++) {
+        if (members & (1ULL << i)) {
+            applyFrequency(after.bus, PCA9685_FIRST_ADDRESS + i, frequency);
+        }
+    }
+
+    Preferences prefs;
+    prefs.begin("pca9685", false);
+    prefs.putBytes(groupKey(group).c_str(), &after, sizeof(after));
+    prefs.end();
+    xSemaphoreGive(pca9685Mutex);
+    markHttpResourceChanged(pca9685StateCache);
+    return DRIVER_OK;
+}
+
+/// @brief Removes a group; its members stop answering the group address.
+/// @return false if the group was not configured.
+bool removePCA9685Group(uint8_t group) {
+    if (group >= PCA9685_GROUP_COUNT) {
+        return false;
+    }
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    if (pca9685Groups[group].address == 0) {
+        xSemaphoreGive(pca9685Mutex);
+        return false;
+    }
+    Pca9685Group before = pca9685Groups[group];
+    pca9685Groups[group] = Pca9685Group();
+    reprogramMembers(before, pca9685Groups[group]);
+
+    Preferences prefs;
+    prefs.begin("pca9685", false);
+    prefs.remove(groupKey(group).c_str());
+    prefs.end();
+    xSemaphoreGive(pca9685Mutex);
+    return true;
+}
+
+/// @brief Sets one pin on every chip in a group with a single write to the group address.
+///
+/// All members receive the same transaction and, with outputs changing on STOP (the power-on
+/// default), update together. Changes still queued for that pin on a member are discarded.
+/// @param group Group number (0-3).
+/// @param pin Pin number (0-15).
+/// @param percentage_on PWM value as a percentage (0-100).
+/// @return DRIVER_NOT_CONFIGURED if the group has no address, DRIVER_BUS_ERROR if no member answered.
+DriverError setPCA9685GroupPin(uint8_t group, uint8_t pin, uint16_t percentage_on) {
+    DriverError error = validatePinRequest(pin, percentage_on);
+    if (error != DRIVER_OK) {
+        return error;
+    }
+    if (group >= PCA9685_GROUP_COUNT) {
+        return DRIVER_NOT_CONFIGURED;
     }
-    response_json += " }";
-    return response_json;
-}
\ No newline at end of file
+    uint16_t counts[PCA9685_CHANNELS];
+    counts[pin] = map(percentage_on, 0, 100, 0, 4095);
+
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    const Pca9685Group& target = pca9685Groups[group];
+    if (target.address == 0) {
+        xSemaphoreGive(pca9685Mutex);
+        return DRIVER_NOT_CONFIGURED;
+    }
+    uint32_t memberCount = 0;
+    portENTER_CRITICAL(&pendingOutputsMux);
+    for (uint8_t i = 0; i < 64; i++) {
+        memberCount += (target.members >> i) & 1;
+    }
+    for (uint8_t i = 0; i < PCA9685_SCHEDULER_MAX_CHIPS; i++) {
+        PendingPca9685Outputs& pending = pendingOutputs[i];
+        if (pending.used && pending.bus == target.bus && (target.members & memberBit(pending.address)) &&
+            (pending.dirty & (1 << pin))) {
+            pending.dirty &= ~(1 << pin);
+            schedulerStats.coalesced++;
+        }
+    }
+    schedulerStats.requests += memberCount;
+    schedulerStats.transactions++;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    bool ok = writeChannelRun(target.bus, target.address, pin, 1, counts);
+
+    // Every attached member took the write; record it for each as if written one by one
+    bool newlyUnsaved = false;
+    for (uint8_t i = 0; ok && i < 64; i++) {
+        uint8_t address = PCA9685_FIRST_ADDRESS + i;
+        if ((target.members & memberBit(address)) && pca9685Registry.find(target.bus, address) != nullptr) {
+            portENTER_CRITICAL(&pendingOutputsMux);
+            newlyUnsaved |= recordDuties(target.bus, address, 1 << pin, counts);
+            portEXIT_CRITICAL(&pendingOutputsMux);
+        }
+    }
+    xSemaphoreGive(pca9685Mutex);
+
+    if (!ok) {
+        return DRIVER_BUS_ERROR;
+    }
+    markHttpResourceChanged(pca9685StateCache);
+    scheduleDutySave(newlyUnsaved);
+    return DRIVER_OK;
+}
+
+Pca9685SchedulerStats getPCA9685SchedulerStats() {
+    portENTER_CRITICAL(&pendingOutputsMux);
+    Pca9685SchedulerStats stats = schedulerStats;
+    stats.averageLatencyUs = schedulerApplied > 0 ? (uint32_t)(schedulerLatencyTotalUs / schedulerApplied) : 0;
+    portEXIT_CRITICAL(&pendingOutputsMux);
+    return stats;
+}
+
+/// @brief Reads a chip's frequency and every channel's duty.
+///
+/// The 64 LED registers come back in one auto-increment read rather than a transaction per channel.
+/// @return DRIVER_NOT_FOUND if the chip does not answer, DRIVER_BUS_ERROR if the read failed.
+DriverError readPCA9685Status(uint8_t bus, uint8_t address, Pca9685Status &status) {
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    Pca9685Device* pca9685 = getPCA9685(bus, address);
+    if (pca9685 == nullptr) {
+        xSemaphoreGive(pca9685Mutex);
+        return DRIVER_NOT_FOUND;
+    }
+    uint8_t prescale;
+    bool ok = pca9685->readPrescale(prescale);
+    recordI2CTransaction(bus, ok);
+    if (!ok) {
+        xSemaphoreGive(pca9685Mutex);
+        return DRIVER_BUS_ERROR;
+    }
+    // The prescaler rounds, so this is the frequency the chip actually runs at
+    status.frequency = lroundf(FREQUENCY_OSCILLATOR / (4096.0f * (prescale + 1)));
+
+    uint8_t registers[4 * PCA9685_CHANNELS];
+    uint8_t first = PCA9685_LED0_ON_L_REGISTER;
+    Adafruit_I2CDevice device(address, getI2CBus(bus));
+    TRACE_BEGIN("pca9685.read");
+    ok = device.write_then_read(&first, 1, registers, sizeof(registers));
+    TRACE_END("pca9685.read");
+    recordI2CTransaction(bus, ok);
+    xSemaphoreGive(pca9685Mutex);
+    if (!ok) {
+        return DRIVER_BUS_ERROR;
+    }
+    for (uint8_t pin = 0; pin < PCA9685_CHANNELS; pin++) {
+        status.percentageOn[pin] = decodeDuty(registers + 4 * pin);
+    }
+    return DRIVER_OK;
+}
+
+/// @brief Times full-chip updates for one benchmark slice.
+///
+/// The LED registers are read once and written back unchanged, so the outputs hold while the writes are timed.
+/// The scheduler's lock is held for the slice, so no flush can land between the read and a write back.
+/// @param sliceUs Time to keep writing for; at least one update is timed.
+/// @return DRIVER_NOT_FOUND if the chip does not answer, DRIVER_BUS_ERROR if reading its registers failed.
+DriverError benchmarkPCA9685(uint8_t bus, uint8_t address, uint32_t sliceUs, Pca9685Benchmark &result) {
+    xSemaphoreTake(pca9685Mutex, portMAX_DELAY);
+    if (getPCA9685(bus, address) == nullptr) {
+        xSemaphoreGive(pca9685Mutex);
+        return DRIVER_NOT_FOUND;
+    }
+    uint8_t registers[4 * PCA9685_CHANNELS];
+    uint8_t first = PCA9685_LED0_ON_L_REGISTER;
+    TwoWire* wire = getI2CBus(bus);
+    Adafruit_I2CDevice device(address, wire);
+    if (!device.write_then_read(&first, 1, registers, sizeof(registers))) {
+        xSemaphoreGive(pca9685Mutex);
+        return DRIVER_BUS_ERROR;
+    }
+
+    uint32_t start = micros();
+    do {
+        TRACE_SCOPE("pca9685.write");
+        uint32_t writeStart = micros();
+        wire->beginTransmission(address);
+        wire->write(first);
+        wire->write(registers, sizeof(registers));
+        bool ok = wire->endTransmission() == 0;
+        uint32_t elapsed = micros() - writeStart;
+        result.updates++;
+        result.totalUs += elapsed;
+        if (elapsed > result.maxUs) {
+            result.maxUs = elapsed;
+        }
+        if (!ok) {
+            result.failed++;
+        }
+    } while (micros() - start < sliceUs);
+    xSemaphoreGive(pca9685Mutex);
+    return DRIVER_OK;
+}
+
+#endif
@@ -1,10 +1,115 @@
 #pragma once
 
-#include <map>
+#include <Adafruit_I2CDevice.h>
 #include <Adafruit_PWMServoDriver.h>
+#include "utils/I2CDeviceRegistry.h"
+#include "utils/driverError.h"
+#include "utils/httpUtils.h"
 
-extern std::map<uint8_t, Adafruit_PWMServoDriver*> pca9685Registry;
+// How long the flush task lets changes collect after the first one before writing them
+#define PCA9685_FLUSH_INTERVAL_MS 20
+// Chips the scheduler tracks; others are written synchronously
+#define PCA9685_SCHEDULER_MAX_CHIPS 8
+// Commanded duties are saved to NVS once outputs have been left alone this long,
+// or at the latest this long after the first unsaved change
+#define PCA9685_PERSIST_QUIET_MS 5000
+#define PCA9685_PERSIST_MAX_DELAY_MS 60000
+// ALL_CALL plus the three sub-addresses every chip can answer
+#define PCA9685_GROUP_COUNT 4
+#define PCA9685_DEFAULT_FREQUENCY 800
+// Range the prescaler can reach with the internal 25 MHz oscillator
+#define PCA9685_MIN_FREQUENCY 24
+#define PCA9685_MAX_FREQUENCY 1526
 
-Adafruit_PWMServoDriver* getPCA9685(uint8_t address);
-String setPCA9685Pin(uint8_t address, uint8_t channel, uint16_t value);
-String getPCA9685Status(uint8_t address);
+/// @brief Counters for the output scheduler since boot.
+struct Pca9685SchedulerStats
+{
+  uint32_t requests;     // duty changes accepted, queued or synchronous
+  uint32_t coalesced;    // replaced by a newer value before being written
+  uint32_t flushes;
+  uint32_t transactions; // register writes issued; without the scheduler each request costs one
+  uint32_t failed;       // channel writes dropped because the chip did not answer
+  uint32_t averageLatencyUs; // from the first request for a channel to its write completing
+  uint32_t maxLatencyUs;
+  uint32_t saves;        // NVS writes of the commanded duties
+};
+
+/// @brief How the saved duties were put back after the last reset.
+struct Pca9685RestoreStats
+{
+  uint32_t restoredMs; // millis() when the last chip was written, i.e. time since reset; 0 if nothing was saved
+  uint32_t durationUs; // chip initialization and writes
+  uint8_t chips;
+  uint8_t channels;    // commanded channels written back
+  uint8_t failed;      // chips that did not answer
+};
+
+/// @brief An output group. Group 0 uses the ALL_CALL address, groups 1-3 the three sub-addresses.
+/// Persisted as "g<group>" in the "pca9685" namespace.
+struct Pca9685Group
+{
+    uint8_t bus;
+    uint8_t address; // 7-bit group address; 0 if the group is not configured
+    uint64_t members; // bit (chip address - 0x40) for each member chip
+};
+
+/// @brief What a chip is running: the frequency its prescaler gives and each channel's duty.
+struct Pca9685Status
+{
+    uint16_t frequency;
+    uint8_t percentageOn[16];
+};
+
+/// @brief Full-chip updates one benchmark slice timed: all 64 LED registers in one transaction.
+struct Pca9685Benchmark
+{
+    uint32_t updates;
+    uint32_t failed;
+    uint32_t totalUs;
+    uint32_t maxUs;
+};
+
+/// @brief One chip's driver: the reset and prescaler sequences of Adafruit_PWMServoDriver over an I2C
+/// device of its own.
+///
+/// The stock begin() allocates a new Adafruit_I2CDevice on every call and the driver never frees it,
+/// so attaching and re-initializing chips went through the heap and leaked on every detach. This one
+/// keeps its device in the registry slot. LED registers are written in bursts by the scheduler instead.
+class Pca9685Device
+{
+public:
+    Pca9685Device(uint8_t address, TwoWire &wire) : _device(address, &wire) {}
+
+    bool begin(uint16_t frequency);
+    bool setFrequency(uint16_t frequency);
+    bool readPrescale(uint8_t &prescale);
+
+private:
+    bool write8(uint8_t reg, uint8_t value);
+    bool read8(uint8_t reg, uint8_t &value);
+
+    Adafruit_I2CDevice _device;
+};
+
+extern I2CDeviceRegistry<Pca9685Device, 0x40, 0x7F> pca9685Registry;
+// Shared by every PCA9685: bumped whenever any output changes or a chip is (re)initialized
+extern HttpCacheState pca9685StateCache;
+
+Pca9685Device* getPCA9685(uint8_t bus, uint8_t address);
+Pca9685Device* discoverPCA9685(uint8_t bus, uint8_t address);
+void beginPCA9685();
+void restorePCA9685Outputs();
+Pca9685RestoreStats getPCA9685RestoreStats();
+void flushPCA9685Outputs();
+void lockPCA9685Outputs();
+void unlockPCA9685Outputs();
+DriverError setPCA9685Pin(uint8_t bus, uint8_t address, uint8_t channel, uint16_t value);
+DriverError queuePCA9685Pin(uint8_t bus, uint8_t address, uint8_t channel, uint16_t value, bool *queued = nullptr);
+Pca9685SchedulerStats getPCA9685SchedulerStats();
+DriverError setPCA9685Frequency(uint8_t bus, uint8_t address, uint16_t frequency);
+Pca9685Group getPCA9685Group(uint8_t group);
+DriverError configurePCA9685Group(uint8_t group, I2CDeviceAddress address, uint64_t members, uint16_t frequency);
+bool removePCA9685Group(uint8_t group);
+DriverError setPCA9685GroupPin(uint8_t group, uint8_t pin, uint16_t percentage_on);
+DriverError readPCA9685Status(uint8_t bus, uint8_t address, Pca9685Status &status);
+DriverError benchmarkPCA9685(uint8_t bus, uint8_t address, uint32_t sliceUs, Pca9685Benchmark &result);
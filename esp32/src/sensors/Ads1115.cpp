@@ -1,61 +1,195 @@
+#include "Features.h"
+
+#if FEATURE_ADS1115
+
 #include "Ads1115.h"
 
-#include <map>
 #include <Adafruit_ADS1X15.h>
 #include "Wire.h"
+#include "utils/i2cUtils.h"
+#include "utils/I2CDeviceRegistry.h"
+#include "filters/SignalFilter.h"
+#include "utils/traceUtils.h"
 
 // ===== Hardware Config =====
-std::map<uint8_t, Adafruit_ADS1115*> ads1115Registry;
+I2CDeviceRegistry<Ads1115Device, 0x48, 0x4B> ads1115Registry;
+
+static const uint8_t ADS1115_REGISTER_CONVERSION = 0x00;
+static const uint8_t ADS1115_REGISTER_CONFIG = 0x01;
+static const uint16_t ADS1115_CONFIG_OS = 0x8000;          // write: start a conversion; read: 1 once idle
+static const uint16_t ADS1115_CONFIG_MUX_SINGLE_0 = 0x4000; // AIN0 against GND; AIN1-3 follow in steps of 0x1000
+static const uint16_t ADS1115_CONFIG_MODE_SINGLE = 0x0100;
+static const uint16_t ADS1115_CONFIG_COMPARATOR_OFF = 0x0003;
+
+static const uint16_t ADS1115_DATA_RATES[ADS1115_DATA_RATE_COUNT] = {
+    RATE_ADS1115_8SPS, RATE_ADS1115_16SPS, RATE_ADS1115_32SPS, RATE_ADS1115_64SPS,
+    RATE_ADS1115_128SPS, RATE_ADS1115_250SPS, RATE_ADS1115_475SPS, RATE_ADS1115_860SPS};
+static const uint16_t ADS1115_DATA_RATE_SPS[ADS1115_DATA_RATE_COUNT] = {8, 16, 32, 64, 128, 250, 475, 860};
+
+bool Ads1115Device::writeRegister(uint8_t reg, uint16_t value) {
+    uint8_t buffer[3] = {reg, (uint8_t)(value >> 8), (uint8_t)value};
+    return _device.write(buffer, sizeof(buffer));
+}
+
+bool Ads1115Device::readRegister(uint8_t reg, uint16_t &value) {
+    uint8_t buffer[2];
+    if (!_device.write_then_read(&reg, 1, buffer, sizeof(buffer))) {
+        return false;
+    }
+    value = (uint16_t)((buffer[0] << 8) | buffer[1]);
+    return true;
+}
 
 /**
- * @brief Retrieves or initializes an Adafruit_ADS1115 instance for the given I2C address.
- * 
- * This function checks if an Adafruit_ADS1115 instance already exists for the specified
- * I2C address in the adsRegistry. If it does, it returns the existing instance. If not,
- * it creates a new instance, initializes it, and stores it in the registry before returning it.
- * 
- * @param address The I2C address of the ADS1115 device.
- * @return A pointer to the Adafruit_ADS1115 instance, or nullptr if initialization failed.
+ * @brief Runs one single-shot conversion of an input against GND.
+ *
+ * The conversion takes 1/SPS, but the chip's clock is only good to 10 %, so the OS bit
+ * tells when it is done: one poll right away, a sleep for what is left of the nominal
+ * time, then polls until it reads idle. A chip still converting after twice the
+ * nominal time has stopped converting.
+ * @param pin Input channel (0-3).
+ * @param counts Receives the conversion register.
+ * @return DRIVER_BUS_ERROR if a transfer failed or the conversion never finished.
  */
-Adafruit_ADS1115* getADS1115(uint8_t address) {
-    if (ads1115Registry.count(address)) {
-      if(Wire.endTransmission() == 0) {
-        return ads1115Registry[address];
-      }
-      delete ads1115Registry[address];
-      ads1115Registry.erase(address);
+DriverError Ads1115Device::convert(uint8_t pin, int16_t &counts) {
+    uint16_t config = ADS1115_CONFIG_OS | (uint16_t)(ADS1115_CONFIG_MUX_SINGLE_0 + 0x1000 * pin) | getGain() |
+                      ADS1115_CONFIG_MODE_SINGLE | getDataRate() | ADS1115_CONFIG_COMPARATOR_OFF;
+    if (!writeRegister(ADS1115_REGISTER_CONFIG, config)) {
+        return DRIVER_BUS_ERROR;
     }
-
-    Adafruit_ADS1115* ads = new Adafruit_ADS1115();
-    if (!ads->begin()) {
-        delete ads;
-        return nullptr;
+    uint32_t conversionUs = 1000000UL / getADS1115DataRateSps((getDataRate() >> 5) & 7);
+    uint32_t start = micros();
+    uint16_t status = 0;
+    while (true) {
+        if (!readRegister(ADS1115_REGISTER_CONFIG, status)) {
+            return DRIVER_BUS_ERROR;
+        }
+        if (status & ADS1115_CONFIG_OS) {
+            break;
+        }
+        uint32_t elapsedUs = micros() - start;
+        if (elapsedUs > 2 * conversionUs + 1000) {
+            return DRIVER_BUS_ERROR;
+        }
+        if (elapsedUs + 1000 <= conversionUs) {
+            delay((conversionUs - elapsedUs) / 1000);
+        }
+    }
+    uint16_t value;
+    if (!readRegister(ADS1115_REGISTER_CONVERSION, value)) {
+        return DRIVER_BUS_ERROR;
     }
+    counts = (int16_t)value;
+    return DRIVER_OK;
+}
 
-    ads1115Registry[address] = ads;
-    return ads;
+/**
+ * @brief Retrieves or initializes the ADS1115 driver for the given I2C bus and address.
+ * 
+ * The device is probed on every call. The first time it answers, a driver is constructed
+ * in its registry slot; after that the existing instance is returned. Every conversion
+ * writes the whole config register, so the driver keeps no chip state that a device
+ * dropping off the bus could lose, and attaching takes nothing beyond the probe.
+ * 
+ * @param bus The I2C bus the ADS1115 is attached to.
+ * @param address The I2C address of the ADS1115 device.
+ * @return A pointer to the driver, or nullptr if the device is absent.
+ */
+Ads1115Device* getADS1115(uint8_t bus, uint8_t address) {
+    TwoWire* wire = getI2CBus(bus);
+    return ads1115Registry.acquire(bus, address, [](Ads1115Device&) { return true; }, address, *wire);
 }
 
 /**
- * @brief Reads data from ADS1115 sensor at the provided address and returns a JSON string with the readings.
+ * @brief Reads one input of the ADS1115 at the provided address.
+ * 
+ * If the channel has a signal filter, the raw count and voltage are the conditioned values,
+ * and a calibrated value is added when the filter has a calibration table.
+ * @param bus I2C bus the ADS1115 sensor is attached to.
  * @param address I2C address of the ADS1115 sensor.
+ * @param pin Input channel (0-3) to read.
  * @param gain Gain setting for the ADS1115 sensor.
- * @return JSON string containing voltage readings from all four channels.
+ * @param reading Receives the reading.
+ * @return DRIVER_NOT_FOUND if the sensor does not answer, DRIVER_BUS_ERROR if a conversion failed.
  */
-String readADS1115(uint8_t address, uint8_t pin, adsGain_t gain)
+DriverError readADS1115(uint8_t bus, uint8_t address, uint8_t pin, adsGain_t gain, Ads1115Reading &reading)
 {
-  String readingJsonString = "{ \"readings\": ";
+  if (pin > 3) {
+    return DRIVER_INVALID_ARGUMENT;
+  }
+  Ads1115Device* ads1115 = getADS1115(bus, address);
+  if (ads1115 == nullptr) {
+    return DRIVER_NOT_FOUND;
+  }
+  ads1115->setGain(gain);
 
-  Adafruit_ADS1X15* ads1115 = getADS1115(address);
+  // Conditioned channels take several conversions per request and report the filtered count
+  SignalFilter* filter = findSignalFilter("ads1115/" + formatI2CDeviceAddress(bus, address) + "/" + String(pin));
+  uint8_t count = filter != nullptr ? filter->oversampling() : 1;
+  fixed_t samples[SIGNAL_FILTER_MAX_OVERSAMPLING];
+  int64_t sampleStart = beginSample();
+  for (uint8_t i = 0; i < count; i++) {
+    TRACE_SCOPE("ads1115.convert");
+    int16_t counts = 0;
+    DriverError error = ads1115->convert(pin, counts);
+    recordI2CTransaction(bus, error == DRIVER_OK);
+    if (error != DRIVER_OK) {
+      return error;
+    }
+    samples[i] = (fixed_t)counts * FIXED_ONE;
+  }
+  endSample(reading.sample, sampleStart);
+
+  fixed_t conditioned = samples[0];
+  if (filter != nullptr) {
+    filter->resetIfContextChanged(gain);
+    conditioned = filter->process(samples, count);
+  }
+  reading.raw = (int16_t)((conditioned + FIXED_ONE / 2) >> 16);
+  reading.voltage = ads1115->computeVolts(reading.raw);
+  reading.hasCalibrated = filter != nullptr && filter->hasCalibration();
+  reading.calibrated = reading.hasCalibrated ? fromFixed(filter->calibrate(conditioned)) : NAN;
+  return DRIVER_OK;
+}
 
-  if (ads1115 != nullptr) {
-    ads1115->setGain(gain);
-    int16_t reading = ads1115->readADC_SingleEnded(pin);
-    float voltage = ads1115->computeVolts(reading);
+uint16_t getADS1115DataRateSps(uint8_t rateIndex) {
+    return rateIndex < ADS1115_DATA_RATE_COUNT ? ADS1115_DATA_RATE_SPS[rateIndex] : 0;
+}
 
-    readingJsonString += "{ \"raw\":" + String(reading) + ", ";
-    readingJsonString += "\"voltage\":" + String(voltage, 4) + " } ";
+/**
+ * @brief Runs single-shot conversions of input 0 at one data rate for a benchmark slice.
+ *
+ * At least one conversion is taken, however long it lasts. The chip's data rate is
+ * put back afterwards, so reads keep their usual timing.
+ * @param rateIndex 0-7, slowest first.
+ * @return DRIVER_NOT_FOUND if the sensor does not answer, or the error that ended the slice early.
+ */
+DriverError benchmarkADS1115Rate(uint8_t bus, uint8_t address, uint8_t rateIndex, uint32_t sliceUs, Ads1115RateBenchmark &result)
+{
+  if (rateIndex >= ADS1115_DATA_RATE_COUNT) {
+    return DRIVER_INVALID_ARGUMENT;
   }
-  readingJsonString += " }";
-  return readingJsonString;
-}
\ No newline at end of file
+  Ads1115Device* ads1115 = getADS1115(bus, address);
+  if (ads1115 == nullptr) {
+    return DRIVER_NOT_FOUND;
+  }
+  uint16_t rate = ads1115->getDataRate();
+  ads1115->setDataRate(ADS1115_DATA_RATES[rateIndex]);
+  uint32_t start = micros();
+  DriverError error = DRIVER_OK;
+  do {
+    TRACE_SCOPE("ads1115.convert");
+    int16_t counts;
+    error = ads1115->convert(0, counts);
+    recordI2CTransaction(bus, error == DRIVER_OK);
+    if (error != DRIVER_OK) {
+      break;
+    }
+    result.samples++;
+  } while (micros() - start < sliceUs);
+  result.elapsedUs += micros() - start;
+  ads1115->setDataRate(rate);
+  return error;
+}
+
+#endif
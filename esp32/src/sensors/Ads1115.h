@@ -1,10 +1,62 @@
 #pragma once
 
-#include <map>
 #include <Adafruit_ADS1X15.h>
+#include <Adafruit_I2CDevice.h>
+#include "utils/I2CDeviceRegistry.h"
+#include "utils/driverError.h"
+#include "utils/timeUtils.h"
 
-extern std::map<uint8_t, Adafruit_ADS1115*> ads1115Registry;
+/**
+ * @brief One single-ended reading. With a signal filter on the channel, raw and
+ * voltage are the conditioned values.
+ */
+struct Ads1115Reading
+{
+  int16_t raw;
+  float voltage;
+  bool hasCalibrated; // the channel's filter has a calibration table
+  float calibrated;
+  SampleStamp sample;
+};
 
-Adafruit_ADS1115* getADS1115(uint8_t address);
+// The chip's data rates, slowest first
+#define ADS1115_DATA_RATE_COUNT 8
 
-String readADS1115(uint8_t address, uint8_t pin, adsGain_t gain);
\ No newline at end of file
+/**
+ * @brief Conversions one benchmark slice got through at one data rate.
+ */
+struct Ads1115RateBenchmark
+{
+  uint32_t samples;
+  uint32_t elapsedUs;
+};
+
+/**
+ * @brief Adafruit_ADS1115 that runs its conversions through its own I2C device.
+ *
+ * The stock readADC_SingleEnded() returns a count whether or not the transfers
+ * went through, and spins for as long as the chip reports a conversion running.
+ * convert() checks every transfer and gives up after twice the conversion time.
+ * Gain and data rate still live in, and are set through, the base class.
+ */
+class Ads1115Device : public Adafruit_ADS1115
+{
+public:
+  Ads1115Device(uint8_t address, TwoWire &wire) : _device(address, &wire) {}
+
+  DriverError convert(uint8_t pin, int16_t &counts);
+
+private:
+  bool writeRegister(uint8_t reg, uint16_t value);
+  bool readRegister(uint8_t reg, uint16_t &value);
+
+  Adafruit_I2CDevice _device;
+};
+
+extern I2CDeviceRegistry<Ads1115Device, 0x48, 0x4B> ads1115Registry;
+
+Ads1115Device* getADS1115(uint8_t bus, uint8_t address);
+
+DriverError readADS1115(uint8_t bus, uint8_t address, uint8_t pin, adsGain_t gain, Ads1115Reading &reading);
+uint16_t getADS1115DataRateSps(uint8_t rateIndex);
+DriverError benchmarkADS1115Rate(uint8_t bus, uint8_t address, uint8_t rateIndex, uint32_t sliceUs, Ads1115RateBenchmark &result);
@@ -1,60 +1,259 @@
+#include "Features.h"
+
+#if FEATURE_BME280
+
 #include "Bme280.h"
 
-#include <map>
 #include <Adafruit_BME280.h>
 #include "Wire.h"
+#include "utils/i2cUtils.h"
+#include "utils/I2CDeviceRegistry.h"
+#include "filters/SignalFilter.h"
+#include "utils/traceUtils.h"
 
 // ===== Hardware Config =====
-std::map<uint8_t, Adafruit_BME280*> bme280Registry;
+I2CDeviceRegistry<Bme280Burst, 0x76, 0x77> bme280Registry;
+
+static const uint8_t BME280_MEASUREMENT_BLOCK_LENGTH = 8;
+static const uint8_t BME280_FIRST_ADDRESS = 0x76;
+
+// Settings per bus and address, kept outside the driver slots so that a sensor
+// detached while unplugged comes back configured as it was. Only touched by the bus's owner.
+static Bme280Settings bme280Settings[I2C_BUS_COUNT][2];
 
 /**
- * @brief Retrieves or initializes an Adafruit_BME280 instance for the given I2C address.
- * 
- * This function checks if an Adafruit_BME280 instance already exists for the specified
- * I2C address in the bmeRegistry. If it does, it returns the existing instance. If not,
- * it creates a new instance, initializes it, and stores it in the registry before returning it.
- * 
+ * @brief Applies sampling, filter and mode settings to the chip.
+ * @param settings Settings to apply.
+ */
+void Bme280Burst::applySettings(const Bme280Settings &settings)
+{
+  setSampling(settings.mode, settings.temperatureSampling, settings.pressureSampling,
+              settings.humiditySampling, settings.filter, settings.standby);
+  _settings = settings;
+}
+
+/**
+ * @brief Reads temperature, humidity and pressure with one burst read.
+ *
+ * In forced mode a single conversion is triggered first. The raw block is then
+ * compensated with the integer formulas from the Bosch datasheet (section 4.2.3).
+ *
+ * @param temperature Receives the temperature in degrees Celsius.
+ * @param humidity Receives the relative humidity in percent.
+ * @param pressure Receives the pressure in hPa.
+ * @return true if the read succeeded and all three channels were sampled.
+ */
+bool Bme280Burst::readAll(float &temperature, float &humidity, float &pressure)
+{
+  if (_settings.mode == MODE_FORCED && !takeForcedMeasurement()) {
+    return false;
+  }
+
+  uint8_t reg = BME280_REGISTER_PRESSUREDATA;
+  uint8_t buf[BME280_MEASUREMENT_BLOCK_LENGTH];
+  if (i2c_dev == nullptr || !i2c_dev->write_then_read(&reg, 1, buf, sizeof(buf))) {
+    return false;
+  }
+
+  int32_t adc_P = ((uint32_t)buf[0] << 12) | ((uint32_t)buf[1] << 4) | (buf[2] >> 4);
+  int32_t adc_T = ((uint32_t)buf[3] << 12) | ((uint32_t)buf[4] << 4) | (buf[5] >> 4);
+  int32_t adc_H = ((uint32_t)buf[6] << 8) | buf[7];
+
+  // 0x80000 / 0x8000 are what the chip reports for a channel that was skipped
+  if (adc_T == 0x80000) {
+    return false;
+  }
+
+  // Temperature (also produces t_fine for the other two channels)
+  int32_t var1 = ((((adc_T >> 3) - ((int32_t)_bme280_calib.dig_T1 << 1))) *
+                  ((int32_t)_bme280_calib.dig_T2)) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - ((int32_t)_bme280_calib.dig_T1)) *
+                    ((adc_T >> 4) - ((int32_t)_bme280_calib.dig_T1))) >> 12) *
+                  ((int32_t)_bme280_calib.dig_T3)) >> 14;
+  t_fine = var1 + var2 + t_fine_adjust;
+  temperature = (float)((t_fine * 5 + 128) >> 8) / 100.0F;
+
+  // Pressure
+  if (adc_P == 0x80000) {
+    pressure = NAN;
+  } else {
+    int64_t p1 = ((int64_t)t_fine) - 128000;
+    int64_t p2 = p1 * p1 * (int64_t)_bme280_calib.dig_P6;
+    p2 = p2 + ((p1 * (int64_t)_bme280_calib.dig_P5) << 17);
+    p2 = p2 + (((int64_t)_bme280_calib.dig_P4) << 35);
+    p1 = ((p1 * p1 * (int64_t)_bme280_calib.dig_P3) >> 8) +
+         ((p1 * (int64_t)_bme280_calib.dig_P2) << 12);
+    p1 = (((((int64_t)1) << 47) + p1)) * ((int64_t)_bme280_calib.dig_P1) >> 33;
+    if (p1 == 0) {
+      pressure = NAN;
+    } else {
+      int64_t p = 1048576 - adc_P;
+      p = (((p << 31) - p2) * 3125) / p1;
+      p1 = (((int64_t)_bme280_calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+      p2 = (((int64_t)_bme280_calib.dig_P8) * p) >> 19;
+      p = ((p + p1 + p2) >> 8) + (((int64_t)_bme280_calib.dig_P7) << 4);
+      pressure = (float)p / 256.0F / 100.0F;
+    }
+  }
+
+  // Humidity
+  if (adc_H == 0x8000) {
+    humidity = NAN;
+  } else {
+    int32_t h = (t_fine - ((int32_t)76800));
+    h = (((((adc_H << 14) - (((int32_t)_bme280_calib.dig_H4) << 20) -
+            (((int32_t)_bme280_calib.dig_H5) * h)) + ((int32_t)16384)) >> 15) *
+         (((((((h * ((int32_t)_bme280_calib.dig_H6)) >> 10) *
+              (((h * ((int32_t)_bme280_calib.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+            ((int32_t)2097152)) * ((int32_t)_bme280_calib.dig_H2) + 8192) >> 14));
+    h = (h - (((((h >> 15) * (h >> 15)) >> 7) * ((int32_t)_bme280_calib.dig_H1)) >> 4));
+    h = (h < 0) ? 0 : h;
+    h = (h > 419430400) ? 419430400 : h;
+    humidity = (float)(h >> 12) / 1024.0F;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Retrieves or initializes a Bme280Burst instance for the given I2C bus and address.
+ *
+ * The device is probed on every call. The first time it answers, a driver is constructed
+ * in its registry slot, initialized and given the address's sampling settings: the defaults,
+ * or whatever was last configured there. If the device later drops off the bus, it is
+ * re-initialized in place with the same settings.
+ *
+ * @param bus The I2C bus the BME280 is attached to.
  * @param address The I2C address of the BME280 device.
- * @return A pointer to the Adafruit_BME280 instance, or nullptr if initialization failed.
+ * @return A pointer to the Bme280Burst instance, or nullptr if the device is absent or initialization failed.
  */
-Adafruit_BME280* getBME280(uint8_t address) {
-    if (bme280Registry.count(address)) {
-      if(Wire.endTransmission() == 0) {
-        return bme280Registry[address];
-      } 
-      delete bme280Registry[address];
-      bme280Registry.erase(address);
+Bme280Burst* getBME280(uint8_t bus, uint8_t address) {
+    TwoWire* wire = getI2CBus(bus);
+    return bme280Registry.acquire(bus, address, [&](Bme280Burst& bme) {
+        TRACE_SCOPE("bme280.begin");
+        bool ok = bme.init();
+        recordI2CTransaction(bus, ok);
+        if (ok) {
+          bme.applySettings(bme280Settings[bus][address - BME280_FIRST_ADDRESS]);
+        }
+        return ok;
+    }, address, *wire);
+}
+
+static float conditionChannel(SignalFilter* filter, const float* samples, uint8_t count)
+{
+  fixed_t fixedSamples[SIGNAL_FILTER_MAX_OVERSAMPLING];
+  for (uint8_t i = 0; i < count; i++) {
+    if (isnan(samples[i])) {
+      return NAN; // channel is switched off on the chip
+    }
+    fixedSamples[i] = toFixed(samples[i]);
+  }
+  return fromFixed(conditionSamples(filter, fixedSamples, count));
+}
+
+/**
+ * @brief Takes as many burst reads as the most oversampled channel needs and conditions each channel.
+ *
+ * Only forced mode starts a conversion per read. In normal mode the chip updates
+ * its results once per standby period, so back-to-back reads would repeat one
+ * sample; a single read is taken and the chip's own oversampling and IIR filter
+ * do that job instead.
+ */
+static bool readConditioned(Bme280Burst* bme280, uint8_t bus, uint8_t address, float &temperature, float &humidity, float &pressure)
+{
+  String prefix = "bme280/" + formatI2CDeviceAddress(bus, address) + "/";
+  SignalFilter* temperatureFilter = findSignalFilter(prefix + "temperature");
+  SignalFilter* humidityFilter = findSignalFilter(prefix + "humidity");
+  SignalFilter* pressureFilter = findSignalFilter(prefix + "pressure");
+
+  uint8_t count = 1;
+  SignalFilter* filters[] = {temperatureFilter, humidityFilter, pressureFilter};
+  for (SignalFilter* filter : filters) {
+    if (filter != nullptr && filter->oversampling() > count && bme280->settings().mode == Adafruit_BME280::MODE_FORCED) {
+      count = filter->oversampling();
     }
+  }
 
-    Adafruit_BME280* bme = new Adafruit_BME280();
-    if (!bme->begin(address)) {
-        delete bme;
-        return nullptr;
+  float temperatures[SIGNAL_FILTER_MAX_OVERSAMPLING];
+  float humidities[SIGNAL_FILTER_MAX_OVERSAMPLING];
+  float pressures[SIGNAL_FILTER_MAX_OVERSAMPLING];
+  for (uint8_t i = 0; i < count; i++) {
+    TRACE_SCOPE("bme280.read");
+    bool ok = bme280->readAll(temperatures[i], humidities[i], pressures[i]);
+    recordI2CTransaction(bus, ok);
+    if (!ok) {
+      return false;
     }
+  }
 
-    bme280Registry[address] = bme;
-    return bme;
+  temperature = conditionChannel(temperatureFilter, temperatures, count);
+  humidity = conditionChannel(humidityFilter, humidities, count);
+  pressure = conditionChannel(pressureFilter, pressures, count);
+  return true;
+}
+
+/**
+ * @brief Reads temperature, humidity and pressure from the BME280 at the provided address.
+ * @param bus I2C bus the BME280 sensor is attached to.
+ * @param address I2C address of the BME280 sensor.
+ * @param reading Receives the conditioned readings.
+ * @return DRIVER_NOT_FOUND if the sensor does not answer, DRIVER_BUS_ERROR if a read failed.
+ */
+DriverError readBME280(uint8_t bus, uint8_t address, Bme280Reading &reading)
+{
+  Bme280Burst* bme280 = getBME280(bus, address);
+  if (bme280 == nullptr) {
+    return DRIVER_NOT_FOUND;
+  }
+  int64_t sampleStart = beginSample();
+  if (!readConditioned(bme280, bus, address, reading.temperature, reading.humidity, reading.pressure)) {
+    return DRIVER_BUS_ERROR;
+  }
+  endSample(reading.sample, sampleStart);
+  return DRIVER_OK;
 }
 
 /**
- * @brief Reads data from BME280 sensor at the provided address and returns a JSON string with the readings.
+ * @brief Copies the sampling settings of the BME280 at the given address.
+ *
+ * @param bus I2C bus the BME280 sensor is attached to.
  * @param address I2C address of the BME280 sensor.
- * @return JSON string containing temperature, humidity, and pressure readings.
+ * @param settings Receives the settings.
+ * @return DRIVER_NOT_FOUND if the sensor does not answer.
  */
-String readBME280s(uint8_t address)
+DriverError readBME280Settings(uint8_t bus, uint8_t address, Bme280Settings &settings)
 {
-  String readingJsonString = "{ \"readings\": ";
+  Bme280Burst* bme280 = getBME280(bus, address);
+  if (bme280 == nullptr) {
+    return DRIVER_NOT_FOUND;
+  }
+
+  settings = bme280->settings();
+  return DRIVER_OK;
+}
 
-  Adafruit_BME280* bme280 = getBME280(address);
-  if(bme280 != nullptr) {
-      float temperature = bme280->readTemperature();
-      float humidity = bme280->readHumidity();
-      float pressure = bme280->readPressure() / 100.0F;
-      readingJsonString += "{ \"temperature\":" + String(temperature, 2) + ", ";
-      readingJsonString += "\"humidity\":" + String(humidity, 2) + ", ";
-      readingJsonString += "\"pressure\":" + String(pressure, 2) + " } ";
+/**
+ * @brief Applies sampling settings to the BME280 at the given address.
+ *
+ * Settings are kept per address, so they are re-applied if the device is re-initialized
+ * or detached and attached again.
+ *
+ * @param bus I2C bus the BME280 sensor is attached to.
+ * @param address I2C address of the BME280 sensor.
+ * @param settings Settings to apply.
+ * @return DRIVER_NOT_FOUND if the sensor does not answer.
+ */
+DriverError configureBME280(uint8_t bus, uint8_t address, const Bme280Settings &settings)
+{
+  Bme280Burst* bme280 = getBME280(bus, address);
+  if (bme280 == nullptr) {
+    return DRIVER_NOT_FOUND;
   }
 
-  readingJsonString += " }";
-  return readingJsonString;
-}
\ No newline at end of file
+  bme280Settings[bus][address - BME280_FIRST_ADDRESS] = settings;
+  bme280->applySettings(settings);
+  return DRIVER_OK;
+}
+
+#endif
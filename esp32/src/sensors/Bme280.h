@@ -1,10 +1,71 @@
 #pragma once
 
-#include <map>
 #include <Adafruit_BME280.h>
+#include <Adafruit_I2CDevice.h>
+#include "utils/I2CDeviceRegistry.h"
+#include "utils/driverError.h"
+#include "utils/timeUtils.h"
 
-extern std::map<uint8_t, Adafruit_BME280*> bme280Registry;
+/**
+ * @brief Per-device BME280 sampling configuration.
+ *
+ * Defaults follow Bosch's "weather monitoring" recommendation: forced mode,
+ * 1x oversampling on every channel and no IIR filter. That is the cheapest
+ * setting in bus time and power, and matches the hub's polling cadence.
+ */
+struct Bme280Settings
+{
+  Adafruit_BME280::sensor_mode mode = Adafruit_BME280::MODE_FORCED;
+  Adafruit_BME280::sensor_sampling temperatureSampling = Adafruit_BME280::SAMPLING_X1;
+  Adafruit_BME280::sensor_sampling pressureSampling = Adafruit_BME280::SAMPLING_X1;
+  Adafruit_BME280::sensor_sampling humiditySampling = Adafruit_BME280::SAMPLING_X1;
+  Adafruit_BME280::sensor_filter filter = Adafruit_BME280::FILTER_OFF;
+  Adafruit_BME280::standby_duration standby = Adafruit_BME280::STANDBY_MS_1000;
+};
 
-Adafruit_BME280* getBME280(uint8_t address);
+/**
+ * @brief One conditioned reading. A channel switched off with oversampling 0 reads NAN.
+ */
+struct Bme280Reading
+{
+  float temperature; // degrees Celsius
+  float humidity;    // percent relative humidity
+  float pressure;    // hPa
+  SampleStamp sample;
+};
 
-String readBME280s(uint8_t address);
\ No newline at end of file
+/**
+ * @brief Adafruit_BME280 with a single-transfer read of all three channels.
+ *
+ * The stock driver re-reads temperature before humidity and pressure to refresh
+ * t_fine. readAll() instead fetches the 8-byte measurement block (0xF7-0xFE) in
+ * one I2C transaction and runs the compensation once.
+ *
+ * The stock begin() allocates a new I2C device on every call. This driver keeps
+ * its own in the registry slot and is initialized with init(), which goes through
+ * it, so attaching and re-initializing never touch the heap.
+ */
+class Bme280Burst : public Adafruit_BME280
+{
+public:
+  Bme280Burst(uint8_t address, TwoWire &wire) : _device(address, &wire) { i2c_dev = &_device; }
+  // The base destructor deletes i2c_dev, which is not on the heap here
+  ~Bme280Burst() { i2c_dev = nullptr; }
+
+  void applySettings(const Bme280Settings &settings);
+  bool readAll(float &temperature, float &humidity, float &pressure);
+
+  const Bme280Settings &settings() const { return _settings; }
+
+private:
+  Adafruit_I2CDevice _device;
+  Bme280Settings _settings;
+};
+
+extern I2CDeviceRegistry<Bme280Burst, 0x76, 0x77> bme280Registry;
+
+Bme280Burst* getBME280(uint8_t bus, uint8_t address);
+
+DriverError readBME280(uint8_t bus, uint8_t address, Bme280Reading &reading);
+DriverError readBME280Settings(uint8_t bus, uint8_t address, Bme280Settings &settings);
+DriverError configureBME280(uint8_t bus, uint8_t address, const Bme280Settings &settings);
@@ -1,21 +1,55 @@
+#include "Features.h"
+
+#if FEATURE_DS18B20
+
 #include "Ds18b20.h"
 
 #include <OneWire.h>
 #include <DallasTemperature.h>
 
+#include "filters/SignalFilter.h"
+#include "utils/httpUtils.h"
+#include "utils/traceUtils.h"
+
 // ===== Hardware Config =====
 #define ONE_WIRE_BUS 4 // DS18B20 Pin
 OneWire oneWire(ONE_WIRE_BUS);
 DallasTemperature ds18b20(&oneWire);
+// The benchmark's ROM search runs on its own instance, so it never moves the background scan's place in the tree
+static OneWire benchmarkWire(ONE_WIRE_BUS);
+
+HttpCacheState ds18b20AddressesCache = {0, 0};
+
+struct Ds18b20RomEntry
+{
+  DeviceAddress rom;
+  uint32_t firstSeen;
+  uint32_t lastSeen;
+  bool seenThisPass;
+};
+
+static Ds18b20RomEntry romInventory[DS18B20_MAX_DEVICES];
+static uint8_t romCount = 0;
+static String cachedAddressesJson = "{ \"addresses\": [] }";
+
+// Serializes bus access between the 1-Wire read worker (conversions, benchmark slices) and the loop task (scan slices)
+static SemaphoreHandle_t oneWireMutex = NULL;
+// Guards the inventory separately, so serving it never waits on a conversion
+static SemaphoreHandle_t inventoryMutex = NULL;
+// Conversions started by reads, so a benchmark can tell one overlapped its own
+static uint32_t conversionCount = 0;
 
 /**
- * @brief Reads data from the DS18B20 sensor at the given address and returns a JSON string with the reading.
+ * @brief Reads the DS18B20 at the given address.
+ * @param address ROM code as 16 hex digits.
+ * @param reading Receives the temperature.
+ * @return DRIVER_NOT_FOUND if no probe answers at the address, DRIVER_BUS_ERROR if a conversion failed.
  */
-String readDS18B20ByAddress(const String& address) {
+DriverError readDS18B20ByAddress(const String& address, Ds18b20Reading& reading) {
   DeviceAddress addr;
 
   if (address.length() != 16) {
-    return "{\"error\":\"Invalid address length\"}";
+    return DRIVER_INVALID_ARGUMENT;
   }
   
   for (uint8_t i = 0; i < 8; i++) {
@@ -23,41 +57,289 @@ String readDS18B20ByAddress(const String& address) {
     addr[i] = (uint8_t) strtoul(byteString.c_str(), nullptr, 16);
   }
 
-  if (!ds18b20.isConnected(addr)) {
-    return "{\"error\":\"Sensor not connected at given address\"}";
+  TRACE_BEGIN("onewire.wait");
+  xSemaphoreTake(oneWireMutex, portMAX_DELAY);
+  TRACE_END("onewire.wait");
+  TRACE_BEGIN("onewire.presence");
+  bool connected = ds18b20.isConnected(addr);
+  TRACE_END("onewire.presence");
+  xSemaphoreGive(oneWireMutex);
+  if (!connected) {
+    return DRIVER_NOT_FOUND;
   }
 
-  ds18b20.requestTemperatures();
-  float temperature = ds18b20.getTempC(addr);
-
-  String readingJsonString = "{";
-  readingJsonString += "\"address\":\"" + address + "\",";
-  readingJsonString += "\"temperature\":" + String(temperature, 2);
-  readingJsonString += "}";
+  // Conditioned channels take several conversions per request; filters saved before the cap are held to it
+  SignalFilter* filter = findSignalFilter("ds18b20/" + address);
+  uint8_t count = filter != nullptr ? min(filter->oversampling(), (uint8_t)DS18B20_MAX_OVERSAMPLING) : 1;
+  fixed_t samples[SIGNAL_FILTER_MAX_OVERSAMPLING];
+  TRACE_BEGIN("onewire.wait");
+  xSemaphoreTake(oneWireMutex, portMAX_DELAY);
+  TRACE_END("onewire.wait");
+  // Time waiting for the bus is queueing, not acquisition
+  int64_t sampleStart = beginSample();
+  for (uint8_t i = 0; i < count; i++) {
+    TRACE_SCOPE("ds18b20.convert");
+    conversionCount++;
+    ds18b20.requestTemperatures();
+    float sample = ds18b20.getTempC(addr);
+    if (sample == DEVICE_DISCONNECTED_C) {
+      xSemaphoreGive(oneWireMutex);
+      return DRIVER_BUS_ERROR;
+    }
+    samples[i] = toFixed(sample);
+  }
+  xSemaphoreGive(oneWireMutex);
+  endSample(reading.sample, sampleStart);
+  reading.temperature = fromFixed(conditionSamples(filter, samples, count));
+  return DRIVER_OK;
+}
 
-  return readingJsonString;
+static String romToString(const uint8_t *rom) {
+  String address;
+  for (uint8_t j = 0; j < 8; j++) {
+    if (rom[j] < 16) address += "0";
+    address += String(rom[j], HEX);
+  }
+  return address;
 }
 
-String getDS1820AddressesJson() {
+static void rebuildAddressesJson() {
   String addressesJsonString = "{ \"addresses\": [";
+  for (uint8_t i = 0; i < romCount; i++) {
+    if (i > 0) addressesJsonString += ",";
+    addressesJsonString += "\"" + romToString(romInventory[i].rom) + "\"";
+  }
+  addressesJsonString += "] }";
+  cachedAddressesJson = addressesJsonString;
+  markHttpResourceChanged(ds18b20AddressesCache);
+}
 
-  int count = ds18b20.getDeviceCount();
+// Records a ROM found by the search. Returns true if it was not in the inventory.
+static bool recordRom(const uint8_t *rom, uint32_t now) {
+  for (uint8_t i = 0; i < romCount; i++) {
+    if (memcmp(romInventory[i].rom, rom, 8) == 0) {
+      romInventory[i].lastSeen = now;
+      romInventory[i].seenThisPass = true;
+      return false;
+    }
+  }
+  if (romCount >= DS18B20_MAX_DEVICES) {
+    return false;
+  }
+  Ds18b20RomEntry &entry = romInventory[romCount++];
+  memcpy(entry.rom, rom, 8);
+  entry.firstSeen = now;
+  entry.lastSeen = now;
+  entry.seenThisPass = true;
+  return true;
+}
+
+// Drops ROMs that a complete search pass did not find. Returns true if any were removed.
+static bool finishPass() {
+  bool removed = false;
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < romCount; i++) {
+    if (romInventory[i].seenThisPass) {
+      romInventory[i].seenThisPass = false;
+      romInventory[kept++] = romInventory[i];
+    } else {
+      removed = true;
+    }
+  }
+  romCount = kept;
+  return removed;
+}
+
+/**
+ * @brief Advances the background ROM search by one device.
+ *
+ * Each call runs a single search pass step, which walks the 64-bit ROM tree once
+ * (a few milliseconds of bus time) and finds at most one device. When the search
+ * reports no more devices, the pass is complete and ROMs it did not see are dropped.
+ * The address list version is bumped whenever a ROM appears or disappears.
+ * The slice is skipped if a conversion currently holds the bus.
+ *
+ * @return true if the inventory changed.
+ */
+bool stepDS18B20Scan() {
+  if (oneWireMutex == NULL || xSemaphoreTake(oneWireMutex, 0) != pdTRUE) {
+    return false;
+  }
   DeviceAddress addr;
+  TRACE_BEGIN("onewire.search");
+  bool found = oneWire.search(addr);
+  TRACE_END("onewire.search");
+  xSemaphoreGive(oneWireMutex);
+
+  xSemaphoreTake(inventoryMutex, portMAX_DELAY);
+  bool changed;
+  if (found) {
+    changed = OneWire::crc8(addr, 7) == addr[7] && recordRom(addr, millis());
+  } else {
+    oneWire.reset_search();
+    changed = finishPass();
+  }
+  if (changed) {
+    rebuildAddressesJson();
+  }
+  xSemaphoreGive(inventoryMutex);
+  return changed;
+}
 
-  for (int i = 0; i < count; i++) {
-    if (ds18b20.getAddress(addr, i)) {
-      if (i > 0) addressesJsonString += ",";
-      addressesJsonString += "\"";
-      for (uint8_t j = 0; j < 8; j++) {
-        if (addr[j] < 16) addressesJsonString += "0";
-        addressesJsonString += String(addr[j], HEX);
-      }
-      addressesJsonString += "\"";
+/**
+ * @brief Initializes the sensors and fills the ROM inventory with one complete search pass.
+ */
+void beginDS18B20() {
+  if (oneWireMutex == NULL) {
+    oneWireMutex = xSemaphoreCreateMutex();
+    inventoryMutex = xSemaphoreCreateMutex();
+  }
+  ds18b20.begin();
+  oneWire.reset_search();
+  for (uint8_t i = 0; i <= DS18B20_MAX_DEVICES; i++) {
+    DeviceAddress addr;
+    // A full pass ends with the first call that finds nothing
+    bool more = oneWire.search(addr);
+    if (!more) {
+      break;
+    }
+    if (OneWire::crc8(addr, 7) == addr[7]) {
+      recordRom(addr, millis());
     }
   }
+  oneWire.reset_search();
+  finishPass();
+  rebuildAddressesJson();
+}
 
-  addressesJsonString += "] }";
-  return addressesJsonString;
+String getDS1820AddressesJson() {
+  if (inventoryMutex == NULL) {
+    return cachedAddressesJson;
+  }
+  xSemaphoreTake(inventoryMutex, portMAX_DELAY);
+  String json = cachedAddressesJson;
+  xSemaphoreGive(inventoryMutex);
+  return json;
+}
+
+/**
+ * @brief Returns the present ROMs as a JSON array of address strings.
+ */
+String getDS18B20AddressesArray() {
+  String json = "[";
+  xSemaphoreTake(inventoryMutex, portMAX_DELAY);
+  for (uint8_t i = 0; i < romCount; i++) {
+    if (i > 0) json += ",";
+    json += "\"" + romToString(romInventory[i].rom) + "\"";
+  }
+  xSemaphoreGive(inventoryMutex);
+  json += "]";
+  return json;
+}
+
+uint8_t getDS18B20Count() {
+  return romCount;
 }
 
+/**
+ * @brief Returns the present ROMs with the uptime (ms) each was first and last seen.
+ */
+String getDS18B20InventoryJson() {
+  String json = "{ \"devices\": [";
+  xSemaphoreTake(inventoryMutex, portMAX_DELAY);
+  for (uint8_t i = 0; i < romCount; i++) {
+    if (i > 0) json += ", ";
+    json += "{ \"address\":\"" + romToString(romInventory[i].rom) + "\", ";
+    json += "\"first_seen_ms\":" + String(romInventory[i].firstSeen) + ", ";
+    json += "\"last_seen_ms\":" + String(romInventory[i].lastSeen) + " }";
+  }
+  json += "], \"version\":" + String(ds18b20AddressesCache.version) + " }";
+  xSemaphoreGive(inventoryMutex);
+  return json;
+}
+
+/**
+ * @brief Times bus resets for one benchmark slice.
+ * @param sliceUs Time to keep resetting for; at least one reset is timed.
+ */
+void benchmarkOneWireResets(uint32_t sliceUs, OneWireBenchmark& result) {
+  xSemaphoreTake(oneWireMutex, portMAX_DELAY);
+  uint32_t start = micros();
+  do {
+    uint32_t resetStart = micros();
+    bool present = oneWire.reset();
+    uint32_t elapsed = micros() - resetStart;
+    result.resets++;
+    result.resetTotalUs += elapsed;
+    if (elapsed > result.resetMaxUs) {
+      result.resetMaxUs = elapsed;
+    }
+    if (!present) {
+      result.noPresence++;
+    }
+  } while (micros() - start < sliceUs);
+  xSemaphoreGive(oneWireMutex);
+}
+
+/**
+ * @brief Advances the benchmark's full ROM search pass for one slice.
+ *
+ * Runs search steps until the slice is used up, the same one-device steps the
+ * background scan takes, and adds up their bus time.
+ * @return true once the pass is complete.
+ */
+bool benchmarkOneWireSearch(uint32_t sliceUs, OneWireBenchmark& result) {
+  if (result.searchComplete) {
+    return true;
+  }
+  xSemaphoreTake(oneWireMutex, portMAX_DELAY);
+  if (!result.searchStarted) {
+    benchmarkWire.reset_search();
+    result.searchStarted = true;
+  }
+  uint32_t start = micros();
+  do {
+    DeviceAddress addr;
+    uint32_t stepStart = micros();
+    bool found = benchmarkWire.search(addr);
+    result.searchUs += micros() - stepStart;
+    if (!found || result.devices > DS18B20_MAX_DEVICES) {
+      result.searchComplete = true;
+      break;
+    }
+    result.devices++;
+  } while (micros() - start < sliceUs);
+  xSemaphoreGive(oneWireMutex);
+  return result.searchComplete;
+}
+
+/**
+ * @brief Starts or polls a conversion on every probe, for one benchmark slice.
+ *
+ * The conversion runs between slices with the bus free, so reads go on while it
+ * is timed. A read that converts in the meantime spoils the timing, and the
+ * conversion is started again.
+ * @return true once a conversion has been timed.
+ */
+bool benchmarkDS18B20Conversion(OneWireBenchmark& result) {
+  if (result.conversionUs > 0) {
+    return true;
+  }
+  xSemaphoreTake(oneWireMutex, portMAX_DELAY);
+  if (!result.conversionStarted || result.conversionsBefore != conversionCount) {
+    bool wait = ds18b20.getWaitForConversion();
+    ds18b20.setWaitForConversion(false);
+    result.conversionStartUs = micros();
+    ds18b20.requestTemperatures();
+    ds18b20.setWaitForConversion(wait);
+    result.conversionStarted = true;
+    result.conversionsBefore = conversionCount;
+    result.resolution = ds18b20.getResolution();
+  } else if (ds18b20.isConversionComplete()) {
+    result.conversionUs = micros() - result.conversionStartUs;
+  }
+  xSemaphoreGive(oneWireMutex);
+  return result.conversionUs > 0;
+}
 
+#endif
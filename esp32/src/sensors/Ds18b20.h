@@ -3,12 +3,60 @@
 #include <OneWire.h>
 #include <DallasTemperature.h>
 
+#include "utils/driverError.h"
+#include "utils/httpUtils.h"
+#include "utils/timeUtils.h"
+
 #ifndef ONE_WIRE_BUS
 #define ONE_WIRE_BUS 4
 #endif
 
+// Inventory capacity, and the interval between background ROM search slices
+#define DS18B20_MAX_DEVICES 16
+#define DS18B20_SCAN_SLICE_MS 1000
+// Each oversample is a conversion of up to 750 ms with the 1-Wire bus held, so a filter's
+// oversampling is capped here rather than at SIGNAL_FILTER_MAX_OVERSAMPLING
+#define DS18B20_MAX_OVERSAMPLING 4
+
+struct Ds18b20Reading
+{
+  float temperature; // degrees Celsius, after any conditioning filter
+  SampleStamp sample;
+};
+
+/**
+ * @brief 1-Wire timings for /api/system/benchmark, filled in over several slices.
+ */
+struct OneWireBenchmark
+{
+  uint32_t resets;
+  uint32_t noPresence; // resets no device answered
+  uint32_t resetTotalUs;
+  uint32_t resetMaxUs;
+  bool searchStarted;
+  bool searchComplete;
+  uint8_t devices;     // found by the benchmark's own search pass
+  uint32_t searchUs;   // bus time of the whole pass
+  bool conversionStarted;
+  uint8_t resolution;  // bits, of the conversion timed
+  uint32_t conversionStartUs;
+  uint32_t conversionsBefore; // conversions by sensor reads when this one started
+  uint32_t conversionUs;      // 0 until a conversion finished undisturbed
+};
+
 extern OneWire oneWire;
 extern DallasTemperature ds18b20;
+extern HttpCacheState ds18b20AddressesCache;
+
+void beginDS18B20();
+bool stepDS18B20Scan();
+
+DriverError readDS18B20ByAddress(const String& address, Ds18b20Reading& reading);
+String getDS1820AddressesJson();
+String getDS18B20InventoryJson();
+String getDS18B20AddressesArray();
+uint8_t getDS18B20Count();
 
-String readDS18B20ByAddress(const String& address);
-String getDS1820AddressesJson();
\ No newline at end of file
+void benchmarkOneWireResets(uint32_t sliceUs, OneWireBenchmark& result);
+bool benchmarkOneWireSearch(uint32_t sliceUs, OneWireBenchmark& result);
+bool benchmarkDS18B20Conversion(OneWireBenchmark& result);
\ No newline at end of file
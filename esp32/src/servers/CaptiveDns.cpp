@@ -0,0 +1,99 @@
+#include "CaptiveDns.h"
+
+static const size_t DNS_HEADER_SIZE = 12;
+static const size_t DNS_MAX_PACKET_SIZE = 512;
+static const size_t DNS_ANSWER_SIZE = 16;
+static const uint16_t DNS_TYPE_A = 1;
+static const uint16_t DNS_TYPE_ANY = 255;
+static const uint32_t DNS_TTL_SECONDS = 60;
+
+bool CaptiveDnsServer::start(uint16_t port, const IPAddress &resolvedIP)
+{
+  ip = resolvedIP;
+  if (!udp.listen(port))
+  {
+    return false;
+  }
+  udp.onPacket([this](AsyncUDPPacket &packet) { handlePacket(packet); });
+  return true;
+}
+
+void CaptiveDnsServer::stop()
+{
+  udp.close();
+}
+
+/**
+ * @brief Builds a reply to the first question in a query.
+ *
+ * A and ANY queries get one A record pointing at the portal. Other types get an
+ * empty NOERROR reply, so clients fall back to IPv4 rather than timing out.
+ */
+void CaptiveDnsServer::handlePacket(AsyncUDPPacket &packet)
+{
+  const uint8_t *query = packet.data();
+  size_t length = packet.length();
+  if (length < DNS_HEADER_SIZE || length > DNS_MAX_PACKET_SIZE)
+  {
+    return;
+  }
+
+  // Standard queries only (QR = 0, OPCODE = 0), with at least one question
+  if ((query[2] & 0xF8) != 0 || ((query[4] << 8) | query[5]) == 0)
+  {
+    return;
+  }
+
+  // Walk the QNAME labels to find the end of the first question
+  size_t offset = DNS_HEADER_SIZE;
+  while (offset < length && query[offset] != 0)
+  {
+    if ((query[offset] & 0xC0) != 0)
+    {
+      return; // compression is not valid in a question
+    }
+    offset += query[offset] + 1;
+  }
+  size_t questionEnd = offset + 1 + 4; // terminating zero, QTYPE, QCLASS
+  if (questionEnd > length)
+  {
+    return;
+  }
+  uint16_t qtype = (query[offset + 1] << 8) | query[offset + 2];
+  bool answer = qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY;
+
+  uint8_t response[DNS_MAX_PACKET_SIZE + DNS_ANSWER_SIZE];
+  memcpy(response, query, questionEnd);
+  response[2] = 0x84 | (query[2] & 0x01); // QR, AA, copy RD
+  response[3] = 0x00;                      // RA = 0, RCODE = NOERROR
+  response[4] = 0x00;
+  response[5] = 0x01; // QDCOUNT
+  response[6] = 0x00;
+  response[7] = answer ? 0x01 : 0x00; // ANCOUNT
+  memset(response + 8, 0, 4);         // NSCOUNT, ARCOUNT
+
+  size_t responseLength = questionEnd;
+  if (answer)
+  {
+    uint8_t *record = response + questionEnd;
+    record[0] = 0xC0; // pointer to the QNAME at offset 12
+    record[1] = 0x0C;
+    record[2] = 0x00; // TYPE A
+    record[3] = 0x01;
+    record[4] = 0x00; // CLASS IN
+    record[5] = 0x01;
+    record[6] = (DNS_TTL_SECONDS >> 24) & 0xFF;
+    record[7] = (DNS_TTL_SECONDS >> 16) & 0xFF;
+    record[8] = (DNS_TTL_SECONDS >> 8) & 0xFF;
+    record[9] = DNS_TTL_SECONDS & 0xFF;
+    record[10] = 0x00; // RDLENGTH
+    record[11] = 0x04;
+    for (int i = 0; i < 4; i++)
+    {
+      record[12 + i] = ip[i];
+    }
+    responseLength += DNS_ANSWER_SIZE;
+  }
+
+  packet.write(response, responseLength);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+
+/**
+ * @brief Minimal captive-portal DNS responder.
+ *
+ * Answers every A query with the portal's IP. Queries are handled from the
+ * AsyncUDP receive callback as packets arrive, so nothing has to poll it.
+ */
+class CaptiveDnsServer
+{
+public:
+  bool start(uint16_t port, const IPAddress &resolvedIP);
+  void stop();
+
+private:
+  void handlePacket(AsyncUDPPacket &packet);
+
+  AsyncUDP udp;
+  IPAddress ip;
+};
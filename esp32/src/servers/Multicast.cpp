@@ -0,0 +1,381 @@
+#include "Features.h"
+
+#if FEATURE_MULTICAST
+
+#include "Multicast.h"
+
+#include <Preferences.h>
+#include <mbedtls/sha256.h>
+
+#include "outputs/Pca9685.h"
+#include "utils/i2cUtils.h"
+#include "utils/logUtils.h"
+#include "utils/traceUtils.h"
+
+// Command packet, all integers big-endian:
+//   0   2  magic "SP"
+//   2   1  version (1)
+//   3   1  entry count n, 1 to MULTICAST_MAX_ENTRIES
+//   4   4  epoch: chosen by the sender, raised whenever its sequence restarts
+//   8   4  sequence number within the epoch
+//   12  5n entries: node id (2), device (bus << 7 | address), pin, percentage on
+//   ..  16 tag: first 16 bytes of HMAC-SHA256(key, everything before the tag)
+// Each board applies the entries carrying its node id, or MULTICAST_ALL_NODES,
+// and ignores the rest. Senders repeat a packet unchanged to ride out loss; the
+// copies are recognised by their sequence number and dropped.
+static const uint8_t MULTICAST_MAGIC[2] = {'S', 'P'};
+static const uint8_t MULTICAST_VERSION = 1;
+static const size_t MULTICAST_HEADER_SIZE = 12;
+static const size_t MULTICAST_ENTRY_SIZE = 5;
+static const size_t MULTICAST_TAG_SIZE = 16;
+static const uint16_t MULTICAST_ALL_NODES = 0xFFFF;
+
+static MulticastSettings multicastSettings;
+static bool settingsLoaded = false;
+static AsyncUDP multicastUdp;
+static bool listening = false;
+
+static portMUX_TYPE multicastMux = portMUX_INITIALIZER_UNLOCKED;
+static MulticastStats multicastStats = {};
+static uint32_t leasedSequence = 0; // mark in NVS: sequences up to it are refused after a reboot
+
+static uint32_t readUint32(const uint8_t *data)
+{
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void hmacSha256(const uint8_t *key, const uint8_t *data, size_t length, uint8_t *out)
+{
+  // The key is shorter than the 64-byte block, so it is used zero-padded as is
+  uint8_t pad[64];
+  uint8_t inner[32];
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+
+  memset(pad, 0x36, sizeof(pad));
+  for (size_t i = 0; i < MULTICAST_KEY_LENGTH; i++)
+  {
+    pad[i] ^= key[i];
+  }
+  mbedtls_sha256_starts(&ctx, 0);
+  mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+  mbedtls_sha256_update(&ctx, data, length);
+  mbedtls_sha256_finish(&ctx, inner);
+
+  memset(pad, 0x5C, sizeof(pad));
+  for (size_t i = 0; i < MULTICAST_KEY_LENGTH; i++)
+  {
+    pad[i] ^= key[i];
+  }
+  mbedtls_sha256_starts(&ctx, 0);
+  mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+  mbedtls_sha256_update(&ctx, inner, sizeof(inner));
+  mbedtls_sha256_finish(&ctx, out);
+  mbedtls_sha256_free(&ctx);
+}
+
+/**
+ * @brief Checks a packet's tag in constant time.
+ */
+static bool isAuthentic(const uint8_t *key, const uint8_t *packet, size_t length)
+{
+  uint8_t expected[32];
+  hmacSha256(key, packet, length - MULTICAST_TAG_SIZE, expected);
+  const uint8_t *tag = packet + length - MULTICAST_TAG_SIZE;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < MULTICAST_TAG_SIZE; i++)
+  {
+    diff |= expected[i] ^ tag[i];
+  }
+  return diff == 0;
+}
+
+static uint32_t leaseAfter(uint32_t sequence)
+{
+  return sequence > UINT32_MAX - MULTICAST_SEQUENCE_SAVE_INTERVAL ? UINT32_MAX : sequence + MULTICAST_SEQUENCE_SAVE_INTERVAL;
+}
+
+static void saveSequenceMark(uint32_t epoch, uint32_t mark)
+{
+  Preferences prefs;
+  prefs.begin("multicast", false);
+  prefs.putUInt("epoch", epoch);
+  prefs.putUInt("seq", mark);
+  prefs.end();
+  portENTER_CRITICAL(&multicastMux);
+  leasedSequence = mark;
+  portEXIT_CRITICAL(&multicastMux);
+}
+
+/**
+ * @brief Queues every entry addressed to this board, then writes them all at once.
+ *
+ * Flushing straight away instead of waiting for the flush task keeps the
+ * boards in a group within one packet's delivery time of each other.
+ */
+static void applyEntries(const uint8_t *entries, uint8_t count, uint32_t receivedUs)
+{
+  uint16_t nodeId = getMulticastNodeId();
+  uint32_t applied = 0;
+  uint32_t failed = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const uint8_t *entry = entries + i * MULTICAST_ENTRY_SIZE;
+    uint16_t node = (entry[0] << 8) | entry[1];
+    if (node != nodeId && node != MULTICAST_ALL_NODES)
+    {
+      continue;
+    }
+    uint8_t bus = entry[2] >> 7;
+    uint8_t address = entry[2] & 0x7F;
+    if (!isI2CBusEnabled(bus) || address < 0x40)
+    {
+      failed++;
+      continue;
+    }
+    if (queuePCA9685Pin(bus, address, entry[3], entry[4]) == DRIVER_OK)
+    {
+      applied++;
+    }
+    else
+    {
+      failed++;
+    }
+  }
+  if (applied > 0)
+  {
+    flushPCA9685Outputs();
+  }
+
+  portENTER_CRITICAL(&multicastMux);
+  multicastStats.entriesApplied += applied;
+  multicastStats.entriesFailed += failed;
+  if (applied > 0)
+  {
+    multicastStats.lastApplyUs = micros() - receivedUs;
+  }
+  portEXIT_CRITICAL(&multicastMux);
+}
+
+/**
+ * @brief Validates, authenticates and de-duplicates one command packet, then applies it.
+ *
+ * Runs on the AsyncUDP task. Only a packet newer than the last one accepted is
+ * applied, so repeats and reordered stragglers cannot move an output back.
+ * Every accepted packet is below the mark saved in NVS, which becomes the last
+ * accepted sequence after a reboot, so nothing sent before the reboot can be
+ * replayed after it. A packet past the mark, or from a new epoch, moves the mark
+ * before it is applied; otherwise the mark is moved on after the writes, while
+ * half of it is still left.
+ */
+static void handlePacket(AsyncUDPPacket &packet)
+{
+  TRACE_SCOPE("multicast.packet");
+  uint32_t receivedUs = micros();
+  const uint8_t *data = packet.data();
+  size_t length = packet.length();
+
+  uint8_t key[MULTICAST_KEY_LENGTH];
+  portENTER_CRITICAL(&multicastMux);
+  multicastStats.received++;
+  memcpy(key, multicastSettings.key, sizeof(key));
+  portEXIT_CRITICAL(&multicastMux);
+
+  if (length < MULTICAST_HEADER_SIZE + MULTICAST_TAG_SIZE || memcmp(data, MULTICAST_MAGIC, 2) != 0 ||
+      data[2] != MULTICAST_VERSION || data[3] == 0 || data[3] > MULTICAST_MAX_ENTRIES ||
+      length != MULTICAST_HEADER_SIZE + data[3] * MULTICAST_ENTRY_SIZE + MULTICAST_TAG_SIZE)
+  {
+    portENTER_CRITICAL(&multicastMux);
+    multicastStats.malformed++;
+    portEXIT_CRITICAL(&multicastMux);
+    return;
+  }
+  if (!isAuthentic(key, data, length))
+  {
+    portENTER_CRITICAL(&multicastMux);
+    multicastStats.authFailed++;
+    portEXIT_CRITICAL(&multicastMux);
+    logWarn("Multicast command with a bad tag from %s", packet.remoteIP().toString());
+    return;
+  }
+
+  uint32_t epoch = readUint32(data + 4);
+  uint32_t sequence = readUint32(data + 8);
+  portENTER_CRITICAL(&multicastMux);
+  bool newer = epoch > multicastStats.epoch || (epoch == multicastStats.epoch && sequence > multicastStats.sequence);
+  bool duplicate = epoch == multicastStats.epoch && sequence == multicastStats.sequence;
+  bool saveFirst = false;
+  bool renew = false;
+  if (newer)
+  {
+    saveFirst = epoch != multicastStats.epoch || sequence > leasedSequence;
+    renew = !saveFirst && leasedSequence != UINT32_MAX && leasedSequence - sequence < MULTICAST_SEQUENCE_SAVE_INTERVAL / 2;
+    multicastStats.epoch = epoch;
+    multicastStats.sequence = sequence;
+    multicastStats.accepted++;
+  }
+  else if (duplicate)
+  {
+    multicastStats.duplicates++;
+  }
+  else
+  {
+    multicastStats.stale++;
+  }
+  portEXIT_CRITICAL(&multicastMux);
+
+  if (!newer)
+  {
+    return;
+  }
+  if (saveFirst)
+  {
+    saveSequenceMark(epoch, leaseAfter(sequence));
+  }
+  applyEntries(data + MULTICAST_HEADER_SIZE, data[3], receivedUs);
+  // After the writes, so the NVS commit does not delay the outputs
+  if (renew)
+  {
+    saveSequenceMark(epoch, leaseAfter(sequence));
+  }
+}
+
+static void loadMulticastSettings()
+{
+  Preferences prefs;
+  prefs.begin("multicast", true);
+  multicastSettings.enabled = prefs.getBool("enabled", multicastSettings.enabled);
+  multicastSettings.group = IPAddress(prefs.getUInt("group", (uint32_t)multicastSettings.group));
+  multicastSettings.port = prefs.getUShort("port", multicastSettings.port);
+  multicastSettings.hasKey = prefs.getBytesLength("key") == MULTICAST_KEY_LENGTH &&
+                             prefs.getBytes("key", multicastSettings.key, MULTICAST_KEY_LENGTH) == MULTICAST_KEY_LENGTH;
+  // Resume from the saved mark, which is ahead of every sequence accepted before the reboot,
+  // so none of those packets can be replayed after it
+  multicastStats.epoch = prefs.getUInt("epoch", 0);
+  multicastStats.sequence = prefs.getUInt("seq", 0);
+  leasedSequence = multicastStats.sequence;
+  prefs.end();
+  settingsLoaded = true;
+}
+
+/**
+ * @brief Joins the configured group and starts accepting commands, if enabled and keyed.
+ *
+ * Call once the station is connected. Safe to call again; it does nothing while listening.
+ */
+void beginMulticastCommands()
+{
+  if (!settingsLoaded)
+  {
+    loadMulticastSettings();
+  }
+  if (listening || !multicastSettings.enabled || !multicastSettings.hasKey)
+  {
+    return;
+  }
+  if (!multicastUdp.listenMulticast(multicastSettings.group, multicastSettings.port))
+  {
+    logError("Cannot join multicast group %s:%u", multicastSettings.group.toString(), multicastSettings.port);
+    return;
+  }
+  multicastUdp.onPacket(handlePacket);
+  listening = true;
+  logInfo("Accepting output commands on %s:%u as node %u", multicastSettings.group.toString(), multicastSettings.port, getMulticastNodeId());
+}
+
+void stopMulticastCommands()
+{
+  if (!listening)
+  {
+    return;
+  }
+  multicastUdp.close();
+  listening = false;
+}
+
+bool isMulticastListening()
+{
+  return listening;
+}
+
+/**
+ * @brief This board's id in command entries: the same four hex digits as its hostname.
+ */
+uint16_t getMulticastNodeId()
+{
+  return (ESP.getEfuseMac() >> 32) & 0xFFFF;
+}
+
+MulticastSettings getMulticastSettings()
+{
+  if (!settingsLoaded)
+  {
+    loadMulticastSettings();
+  }
+  return multicastSettings;
+}
+
+/**
+ * @brief Persists new settings and rejoins the group with them.
+ *
+ * A new key starts a new sender history, so the accepted epoch and sequence go back to 0.
+ *
+ * @return false if the group is not an IPv4 multicast address, the port is 0,
+ * or the channel is enabled without a key.
+ */
+bool configureMulticast(const MulticastSettings &settings)
+{
+  if (settings.group[0] < 224 || settings.group[0] > 239 || settings.port == 0 ||
+      (settings.enabled && !settings.hasKey))
+  {
+    return false;
+  }
+  if (!settingsLoaded)
+  {
+    loadMulticastSettings();
+  }
+  bool keyChanged = settings.hasKey != multicastSettings.hasKey ||
+                    memcmp(settings.key, multicastSettings.key, MULTICAST_KEY_LENGTH) != 0;
+
+  stopMulticastCommands();
+  Preferences prefs;
+  prefs.begin("multicast", false);
+  prefs.putBool("enabled", settings.enabled);
+  prefs.putUInt("group", (uint32_t)settings.group);
+  prefs.putUShort("port", settings.port);
+  if (settings.hasKey)
+  {
+    prefs.putBytes("key", settings.key, MULTICAST_KEY_LENGTH);
+  }
+  else
+  {
+    prefs.remove("key");
+  }
+  prefs.end();
+
+  portENTER_CRITICAL(&multicastMux);
+  multicastSettings = settings;
+  if (keyChanged)
+  {
+    multicastStats.epoch = 0;
+    multicastStats.sequence = 0;
+  }
+  portEXIT_CRITICAL(&multicastMux);
+  if (keyChanged)
+  {
+    saveSequenceMark(0, 0);
+  }
+
+  beginMulticastCommands();
+  return true;
+}
+
+MulticastStats getMulticastStats()
+{
+  portENTER_CRITICAL(&multicastMux);
+  MulticastStats stats = multicastStats;
+  portEXIT_CRITICAL(&multicastMux);
+  return stats;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+
+// Administratively scoped group and port used until configured otherwise
+#define MULTICAST_DEFAULT_GROUP IPAddress(239, 255, 83, 80)
+#define MULTICAST_DEFAULT_PORT 47800
+#define MULTICAST_KEY_LENGTH 32
+// Entries in one command packet; 12 + 64 * 5 + 16 bytes stays well inside one frame
+#define MULTICAST_MAX_ENTRIES 64
+// NVS holds a mark this far ahead of the last accepted sequence number, and after a reboot
+// only packets above the mark are accepted; it is moved on when half of it is used up
+#define MULTICAST_SEQUENCE_SAVE_INTERVAL 256
+
+/**
+ * @brief Settings for the UDP multicast output command channel.
+ *
+ * Commands are only accepted once a key is set, since anyone on the LAN can
+ * send to the group. The key is never reported back.
+ */
+struct MulticastSettings
+{
+  bool enabled = false;
+  IPAddress group = MULTICAST_DEFAULT_GROUP;
+  uint16_t port = MULTICAST_DEFAULT_PORT;
+  bool hasKey = false;
+  uint8_t key[MULTICAST_KEY_LENGTH] = {};
+};
+
+/**
+ * @brief Packet counters since boot, plus the newest (epoch, sequence) accepted.
+ *
+ * Until the first packet after a reboot, epoch and sequence are the mark saved in NVS.
+ */
+struct MulticastStats
+{
+  uint32_t received;
+  uint32_t accepted;
+  uint32_t duplicates;     // same epoch and sequence as the last accepted packet
+  uint32_t stale;          // older than the last accepted packet
+  uint32_t authFailed;
+  uint32_t malformed;
+  uint32_t entriesApplied; // entries for this board written to a chip
+  uint32_t entriesFailed;  // entries for this board that could not be written
+  uint32_t lastApplyUs;    // from receipt to the last entry reaching its chip
+  uint32_t epoch;
+  uint32_t sequence;
+};
+
+void beginMulticastCommands();
+void stopMulticastCommands();
+bool isMulticastListening();
+uint16_t getMulticastNodeId();
+MulticastSettings getMulticastSettings();
+bool configureMulticast(const MulticastSettings &settings);
+MulticastStats getMulticastStats();
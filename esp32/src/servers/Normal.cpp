@@ -4,79 +4,214 @@
 #include <Preferences.h>
 #include <WiFi.h>
 
+#include "Features.h"
+#if FEATURE_DS18B20
 #include "sensors/Ds18b20.h"
+#endif
+#include "utils/i2cUtils.h"
+#include "utils/powerUtils.h"
+#include "utils/timeUtils.h"
+#include "utils/admissionUtils.h"
+#include "utils/httpUtils.h"
+#include "utils/inventoryUtils.h"
+#include "utils/logUtils.h"
+#include "utils/traceUtils.h"
+#include "filters/SignalFilter.h"
+#if FEATURE_PCA9685
+#include "outputs/Pca9685.h"
+#endif
 #include "handlers/SensorHandlers.h"
 #include "handlers/OutputHandlers.h"
 #include "handlers/SystemHandlers.h"
+#if FEATURE_MULTICAST
+#include "servers/Multicast.h"
+#endif
 #include "Version.h"
 
 void setupRoutes(AsyncWebServer& server);
 
+// Inventory version last published over mDNS; cleared when mDNS restarts
+static uint32_t advertisedVersion = 0;
+static bool advertised = false;
+static NormalModeStartup startup = {0, 0};
+
 void startNormalMode(AsyncWebServer& server)
 {
-  Serial.println("Starting Normal Mode...");
+  logInfo("Starting Normal Mode...");
   uint64_t chipid = ESP.getEfuseMac();
   char hostname[32];
   uint16_t last16 = (chipid >> 32) & 0xFFFF;
   snprintf(hostname, sizeof(hostname), "sproot-esp32-%04X", last16); // Should give something like sensor-1A2B
 
   if (!MDNS.begin(hostname)) {
-    Serial.println("Error starting mDNS");
+    logError("Error starting mDNS");
     return;
   }
   MDNS.addService("sproot-device", "tcp", 80);
 
-  ds18b20.begin();
+  uint32_t driversStart = micros();
+#if FEATURE_DS18B20
+  beginDS18B20();
+#endif
+#if FEATURE_PCA9685
+  beginPCA9685();
+#endif
+  beginSignalFilters();
+  beginAdmissionControl();
+  beginTimeSync();
+#if FEATURE_MULTICAST
+  beginMulticastCommands();
+#endif
+  // Queued on the bus workers; the first inventory slice advertises what it finds
+  probeI2CInventory();
+  startup.driversUs = micros() - driversStart;
+  advertiseInventory();
   setupRoutes(server);
 
   server.onNotFound([](AsyncWebServerRequest *request)
   {
-    String queryParams;
-    for (size_t i = 0; i < request->params(); ++i) {
-      const AsyncWebParameter* p = request->getParam(i);
-      if (i) queryParams += '&';
-      queryParams += p->name();
-      queryParams += '=';
-      queryParams += p->value();
-    }
-    String fullUrl = String(request->url());
-    if (queryParams.length()) {
-      fullUrl += '?';
-      fullUrl += queryParams;
-    }
-    Serial.println(String("404 Not Found: ") + fullUrl);
-
-    Serial.println("Method: " + String(request->method()));
+    logWarn("404 Not Found: %s %s", request->methodToString(), request->url());
     request->send(404, "application/json", "{\"error\":\"Not found\"}");
   });
 
   server.begin();
+  startup.readyMs = millis();
+  logInfo("Normal mode ready at %u ms, drivers took %u us (%s profile)", startup.readyMs, startup.driversUs, FIRMWARE_PROFILE);
+}
+
+NormalModeStartup getNormalModeStartup()
+{
+  return startup;
 }
 
 void setupRoutes(AsyncWebServer& server) 
 {
+  // ===== Middleware =====
+  static bool middlewareAdded = false;
+  if (!middlewareAdded)
+  {
+    // Count requests and connection setups, and keep the CPU at full clock for the duration of each request when frequency scaling is on
+    server.addMiddleware([](AsyncWebServerRequest *request, ArMiddlewareNext next)
+    {
+      recordHttpRequest(request);
+      bool locked = beginRequestPowerLock();
+      uint32_t start = micros();
+      TRACE_BEGIN("http.dispatch");
+      next();
+      TRACE_END("http.dispatch");
+      endRequestPowerLock(locked, micros() - start);
+    });
+    middlewareAdded = true;
+  }
+
+  // Each route runs under its class's admission limits; /ping and the admission
+  // report stay outside them so an overloaded board can still be inspected
   // ===== Sensor API Endpoints =====
-  server.on("/api/sensors/ds18b20/addresses", HTTP_GET, handleDs18b20AddressesGet);
-  server.on("/api/sensors/ds18b20/*", HTTP_GET, handleDs18b20Get);
+  // Routes of drivers left out of the profile fall through to the 404 handler
+#if FEATURE_DS18B20
+  server.on("/api/sensors/ds18b20/addresses", HTTP_GET, admitted(ADMISSION_SENSORS, handleDs18b20AddressesGet));
+  server.on("/api/sensors/ds18b20/inventory", HTTP_GET, admitted(ADMISSION_SENSORS, handleDs18b20InventoryGet));
+  server.on("/api/sensors/ds18b20/*", HTTP_GET, admitted(ADMISSION_SENSORS, handleDs18b20Get));
+#endif
 
-  server.on("/api/sensors/bme280/*", HTTP_GET, handleBme280Get);
+#if FEATURE_BME280
+  server.on("/api/sensors/bme280/*", HTTP_GET, admitted(ADMISSION_SENSORS, handleBme280Get));
+  server.on("/api/sensors/bme280/*", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SENSORS, handleBme280Put));
+#endif
 
-  server.on("/api/sensors/ads1115/*", HTTP_GET, handleADS1115Get);
+#if FEATURE_ADS1115
+  server.on("/api/sensors/ads1115/*", HTTP_GET, admitted(ADMISSION_SENSORS, handleADS1115Get));
+#endif
 
   // ===== Output API Endpoints =====
-  server.on("/api/outputs/pca9685/*", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, handlePCA9685Put);
+#if FEATURE_PCA9685
+  // Groups first: the per-chip wildcards below would match these paths too
+  server.on("/api/outputs/pca9685/groups", HTTP_GET, admitted(ADMISSION_OUTPUTS, handlePCA9685GroupsGet));
+  server.on("/api/outputs/pca9685/groups/*", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_OUTPUTS, handlePCA9685GroupPut));
+  server.on("/api/outputs/pca9685/groups/*", HTTP_DELETE, admitted(ADMISSION_OUTPUTS, handlePCA9685GroupDelete));
+  server.on("/api/outputs/pca9685/*", HTTP_GET, admitted(ADMISSION_OUTPUTS, handlePCA9685Get));
+  server.on("/api/outputs/pca9685/*", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_OUTPUTS, handlePCA9685Put));
+#endif
 
   // ===== System API Endpoints =====
-  server.on("/api/system/update", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, handleTriggerOTAUpdatePost);
+#if FEATURE_OTA
+  server.on("/api/system/update", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handleTriggerOTAUpdatePost));
+  // Image downloads by peers are capped by their own upload slots; info first,
+  // since the download route would match its path too
+  server.on("/api/system/firmware/info", HTTP_GET, admitted(ADMISSION_SYSTEM, handleFirmwareInfoGet));
+  server.on("/api/system/firmware", HTTP_GET, handleFirmwareGet);
+#endif
+  server.on("/api/system/status", HTTP_GET, admitted(ADMISSION_SYSTEM, handleStatusGet));
+  server.on("/api/system/inventory", HTTP_GET, admitted(ADMISSION_SYSTEM, handleInventoryGet));
+  server.on("/api/system/power", HTTP_GET, admitted(ADMISSION_SYSTEM, handlePowerGet));
+  server.on("/api/system/power", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handlePowerPut));
+  server.on("/api/system/time", HTTP_GET, admitted(ADMISSION_SYSTEM, handleTimeGet));
+  server.on("/api/system/time", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handleTimePut));
+  server.on("/api/system/i2c", HTTP_GET, admitted(ADMISSION_SYSTEM, handleI2CGet));
+  server.on("/api/system/i2c", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handleI2CPut));
+  server.on("/api/system/filters", HTTP_GET, admitted(ADMISSION_SYSTEM, handleFiltersGet));
+  server.on("/api/system/filters", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handleFiltersPut));
+  server.on("/api/system/filters", HTTP_DELETE, admitted(ADMISSION_SYSTEM, handleFiltersDelete));
+  server.on("/api/system/benchmark", HTTP_GET, admitted(ADMISSION_SYSTEM, handleBenchmarkGet));
+  server.on("/api/system/benchmark", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handleBenchmarkPost));
+  server.on("/api/system/logs", HTTP_GET, admitted(ADMISSION_SYSTEM, handleLogsGet));
+  server.on("/api/system/trace", HTTP_GET, admitted(ADMISSION_SYSTEM, handleTraceGet));
+  server.on("/api/system/admission", HTTP_GET, handleAdmissionGet);
+  server.on("/api/system/admission", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, handleAdmissionPut);
+#if FEATURE_MULTICAST
+  server.on("/api/system/multicast", HTTP_GET, admitted(ADMISSION_SYSTEM, handleMulticastGet));
+  server.on("/api/system/multicast", HTTP_PUT, [](AsyncWebServerRequest *request){}, NULL, admittedBody(ADMISSION_SYSTEM, handleMulticastPut));
+#endif
 
   // ===== General API Endpoints =====
   server.on("/ping", HTTP_GET, [](AsyncWebServerRequest *request)
   {
-    request->send(200, "application/json", "{ \"status\": \"pong\", \"version\": \"" + String(VERSION) + "\" }"); 
+    // The body only changes with the firmware, and the ETag changes with every boot
+    static const HttpCacheState pingCache = {0, 0};
+    if (sendIfNotModified(request, pingCache))
+    {
+      return;
+    }
+    sendCacheable(request, 200, "{ \"status\": \"pong\", \"version\": \"" + String(VERSION) + "\" }", pingCache);
   });
 }
 
+/**
+ * @brief Publishes firmware version, device counts, inventory version and multicast node id as mDNS TXT records.
+ *
+ * Only touches mDNS when the inventory version moved, so it is cheap to call often.
+ * A hub can browse once and only fetch /api/system/inventory from boards whose
+ * "inv" value changed.
+ */
+void advertiseInventory()
+{
+  refreshInventory();
+  const HttpCacheState &inventory = getInventoryCacheState();
+  if (advertised && inventory.version == advertisedVersion)
+  {
+    return;
+  }
+
+  InventoryCounts counts = getInventoryCounts();
+  MDNS.addServiceTxt("sproot-device", "tcp", "version", VERSION);
+  MDNS.addServiceTxt("sproot-device", "tcp", "api", API_FEATURES);
+  MDNS.addServiceTxt("sproot-device", "tcp", "inv", String(inventory.version));
+  MDNS.addServiceTxt("sproot-device", "tcp", "ds18b20", String(counts.ds18b20));
+  MDNS.addServiceTxt("sproot-device", "tcp", "bme280", String(counts.bme280));
+  MDNS.addServiceTxt("sproot-device", "tcp", "ads1115", String(counts.ads1115));
+  MDNS.addServiceTxt("sproot-device", "tcp", "pca9685", String(counts.pca9685));
+#if FEATURE_MULTICAST
+  MDNS.addServiceTxt("sproot-device", "tcp", "node", String(getMulticastNodeId()));
+#endif
+  advertisedVersion = inventory.version;
+  advertised = true;
+}
+
 void stopNormalMode(AsyncWebServer& server) {
+#if FEATURE_MULTICAST
+  stopMulticastCommands();
+#endif
   MDNS.end();
+  advertised = false;
   server.end();
 }
\ No newline at end of file
@@ -3,4 +3,16 @@
 #include <ESPAsyncWebServer.h>
 
 void startNormalMode(AsyncWebServer& server);
-void stopNormalMode(AsyncWebServer& server);
\ No newline at end of file
+void stopNormalMode(AsyncWebServer& server);
+void advertiseInventory();
+
+/**
+ * @brief How long the last start of normal mode took.
+ */
+struct NormalModeStartup
+{
+  uint32_t readyMs;   // millis() when the server started listening, i.e. since reset
+  uint32_t driversUs; // bus setup, driver start and settings loaded from NVS
+};
+
+NormalModeStartup getNormalModeStartup();
@@ -0,0 +1,109 @@
+#pragma once
+
+// Generated by portal/embed.py from portal/index.html; do not edit.
+// 3323 bytes minified, 1540 bytes gzipped.
+
+#include <Arduino.h>
+
+#define PORTAL_INDEX_ETAG "\"ccd159568fc93eff\""
+
+static const size_t PORTAL_INDEX_GZ_LENGTH = 1540;
+static const uint8_t PORTAL_INDEX_GZ[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x57, 0x6d, 0x6f, 0xdb, 0x36,
+  0x10, 0xfe, 0xee, 0x5f, 0xc1, 0xaa, 0x18, 0xe4, 0x00, 0x96, 0x6c, 0x27, 0x9d, 0x17, 0xc8, 0x71,
+  0xb6, 0xae, 0x2f, 0x68, 0x86, 0xa2, 0x0d, 0xe6, 0x14, 0xfb, 0x50, 0xf4, 0x03, 0x2d, 0x9d, 0x6c,
+  0x36, 0x94, 0xa8, 0x92, 0x94, 0x65, 0xd7, 0xf5, 0x7f, 0xdf, 0x1d, 0x25, 0xc5, 0x56, 0x9a, 0xa4,
+  0x08, 0x12, 0x9b, 0xe4, 0xf1, 0x5e, 0x9f, 0xe7, 0x8e, 0xb9, 0x78, 0x96, 0xa8, 0xd8, 0x6e, 0x0b,
+  0x60, 0x2b, 0x9b, 0xc9, 0xcb, 0xde, 0x45, 0xfb, 0x01, 0x3c, 0xc1, 0x8f, 0x0c, 0x2c, 0x67, 0x39,
+  0xcf, 0x60, 0xe6, 0xad, 0x05, 0x54, 0x85, 0xd2, 0xd6, 0x63, 0xb1, 0xca, 0x2d, 0xe4, 0x76, 0xe6,
+  0x55, 0x22, 0xb1, 0xab, 0x59, 0x02, 0x6b, 0x11, 0x43, 0xe0, 0x16, 0x03, 0x26, 0x72, 0x61, 0x05,
+  0x97, 0x81, 0x89, 0xb9, 0x84, 0xd9, 0xd8, 0x43, 0x25, 0xc6, 0x6e, 0x25, 0x5c, 0xf6, 0x48, 0xf3,
+  0x60, 0xa1, 0x92, 0xed, 0x6e, 0x05, 0x62, 0xb9, 0xb2, 0xd1, 0x78, 0x34, 0xfa, 0x6d, 0x9a, 0x71,
+  0xbd, 0x14, 0x79, 0x34, 0x9a, 0xa6, 0xa8, 0x35, 0x48, 0x79, 0x26, 0xe4, 0x36, 0x7a, 0xa9, 0x51,
+  0xc5, 0xe0, 0x1d, 0xc8, 0x35, 0x58, 0x11, 0xf3, 0x81, 0xe1, 0xb9, 0x09, 0x0c, 0x68, 0x91, 0x4e,
+  0x17, 0x3c, 0xbe, 0x5d, 0x6a, 0x55, 0xe6, 0x49, 0xf4, 0x3c, 0x7d, 0x91, 0x4e, 0xd2, 0xf3, 0x69,
+  0xac, 0xa4, 0xd2, 0xd1, 0xf3, 0xb3, 0xb3, 0xb3, 0x7d, 0x2f, 0xac, 0x34, 0x2f, 0x76, 0x99, 0xc8,
+  0x83, 0x63, 0x23, 0x89, 0x30, 0x85, 0xe4, 0xdb, 0x28, 0x95, 0xb0, 0x99, 0x72, 0x29, 0x96, 0x79,
+  0x20, 0x2c, 0x64, 0x26, 0x8a, 0x31, 0x0e, 0xd0, 0xd3, 0xaf, 0xa5, 0xb1, 0x22, 0xdd, 0x06, 0x4d,
+  0x64, 0xed, 0x76, 0xc1, 0x93, 0x44, 0xe4, 0xcb, 0xe8, 0xf4, 0x45, 0xb1, 0x41, 0xd5, 0x31, 0xd7,
+  0xc9, 0xce, 0x85, 0xd9, 0xba, 0xbe, 0xa9, 0xa3, 0x8e, 0x5e, 0x9c, 0x8e, 0x8a, 0x4d, 0xd7, 0xb5,
+  0x34, 0x3d, 0x5c, 0x77, 0x87, 0x4a, 0x27, 0xa0, 0x03, 0xcd, 0x13, 0x51, 0x9a, 0x68, 0x7c, 0xea,
+  0xb6, 0x36, 0x81, 0x59, 0xf1, 0x44, 0x55, 0xd1, 0x88, 0x4d, 0x8a, 0x0d, 0x1b, 0x9f, 0xe3, 0x1f,
+  0xbd, 0x5c, 0xf0, 0xfe, 0x68, 0xe0, 0x7e, 0xc2, 0xd1, 0xf9, 0xc9, 0xbe, 0xb7, 0x1a, 0xef, 0xda,
+  0x2c, 0xb1, 0x11, 0x73, 0x57, 0x5d, 0xb2, 0x8c, 0xf8, 0x0e, 0xb5, 0x72, 0x0b, 0x1b, 0x1b, 0xb8,
+  0xb8, 0x1a, 0xd7, 0xf7, 0xbd, 0x22, 0x4c, 0xc0, 0xc4, 0x9d, 0x8b, 0x93, 0xce, 0xc5, 0xf1, 0x19,
+  0x2e, 0x9b, 0xd4, 0x4d, 0x26, 0x93, 0x87, 0x74, 0x48, 0xbe, 0x00, 0xb9, 0x6b, 0x93, 0xb7, 0x90,
+  0x2a, 0xbe, 0xbd, 0xaf, 0xa0, 0xd6, 0x1f, 0x2c, 0x94, 0xb5, 0x2a, 0x8b, 0x26, 0x94, 0x27, 0x91,
+  0x17, 0xa5, 0xfd, 0x4c, 0x98, 0x9a, 0x91, 0xce, 0x2f, 0x84, 0x89, 0xbb, 0x9d, 0x82, 0x1b, 0x53,
+  0x61, 0x2a, 0xbe, 0x1c, 0x27, 0xb2, 0x4d, 0x14, 0x85, 0xc6, 0x9a, 0xd4, 0x50, 0xb6, 0xa2, 0x31,
+  0xae, 0x8d, 0x92, 0x22, 0x61, 0xcf, 0x93, 0x24, 0xb9, 0x97, 0xc3, 0xf3, 0x6e, 0x38, 0xbf, 0xb7,
+  0x19, 0x15, 0xdf, 0x49, 0x57, 0x23, 0x8b, 0x3b, 0x58, 0xb9, 0x54, 0x80, 0x4c, 0x76, 0x5d, 0x5f,
+  0xc9, 0x0e, 0x1e, 0x69, 0x55, 0xed, 0x3a, 0xf0, 0x58, 0xf2, 0x82, 0x54, 0xe3, 0x91, 0x55, 0xcb,
+  0xa5, 0x84, 0x60, 0x61, 0xf3, 0xdd, 0x71, 0x69, 0x01, 0xe0, 0x11, 0xff, 0xee, 0xe2, 0x18, 0x75,
+  0xe3, 0x38, 0xf6, 0x38, 0x2e, 0xb5, 0xc1, 0x94, 0x17, 0x4a, 0x38, 0x88, 0x75, 0xd3, 0x89, 0x46,
+  0x4d, 0xb9, 0xc8, 0x84, 0x7d, 0x2c, 0x3b, 0xad, 0xe1, 0x5c, 0xe5, 0xd0, 0xc1, 0xdb, 0x68, 0xf4,
+  0xc7, 0x02, 0x21, 0xd7, 0xd4, 0x93, 0xd0, 0xf7, 0x64, 0xb2, 0x26, 0x3f, 0x79, 0x42, 0xa6, 0x33,
+  0x2e, 0xe5, 0xee, 0x48, 0xea, 0xf4, 0x80, 0x90, 0xf3, 0xf3, 0xf3, 0xb6, 0xd6, 0x56, 0x15, 0x2e,
+  0xc2, 0x87, 0x10, 0xf3, 0x57, 0x06, 0x89, 0xe0, 0xac, 0x7f, 0xa0, 0xc6, 0xd9, 0x04, 0x45, 0x4f,
+  0x76, 0x35, 0x79, 0xee, 0x42, 0x21, 0xa0, 0xec, 0x7b, 0x17, 0xc3, 0xa6, 0x35, 0x5c, 0x0c, 0x9b,
+  0x7e, 0x43, 0xed, 0x01, 0x3f, 0x12, 0xb1, 0x66, 0xb1, 0x44, 0xa8, 0x60, 0x8f, 0x41, 0x3e, 0x7b,
+  0xdd, 0x2d, 0x52, 0x45, 0x5b, 0xab, 0xf1, 0xe5, 0xbc, 0xd0, 0x4a, 0x59, 0xf6, 0x66, 0x7e, 0x7d,
+  0x76, 0xca, 0xe6, 0x60, 0xcb, 0x02, 0x55, 0x8d, 0xf1, 0xac, 0x68, 0x85, 0x89, 0x05, 0xde, 0xe5,
+  0x2b, 0x95, 0xe7, 0x10, 0x5b, 0x66, 0x57, 0xc2, 0xb0, 0xba, 0x61, 0x31, 0xab, 0xd8, 0x56, 0x95,
+  0x9a, 0xfd, 0x27, 0x82, 0xb7, 0x82, 0xe5, 0x60, 0x11, 0x97, 0xb7, 0xe1, 0xc5, 0xb0, 0xc0, 0xeb,
+  0xcf, 0x82, 0x80, 0x7d, 0x32, 0xc0, 0xfe, 0x99, 0x33, 0x57, 0x10, 0x63, 0x84, 0xca, 0xe9, 0x86,
+  0xc8, 0xd0, 0xe2, 0x1a, 0xb0, 0x07, 0x66, 0x05, 0xb7, 0x62, 0x21, 0xa4, 0xb0, 0x5b, 0x56, 0x09,
+  0xbb, 0x62, 0x99, 0xc2, 0x15, 0x9e, 0xf0, 0xc2, 0x8a, 0x35, 0x04, 0xd4, 0x2b, 0xb9, 0x64, 0x15,
+  0x2c, 0xa8, 0x73, 0x1a, 0x16, 0x04, 0xa8, 0x37, 0x55, 0x3a, 0x63, 0x22, 0xa1, 0xd6, 0x99, 0x8a,
+  0xb7, 0xb8, 0xb8, 0x17, 0x9a, 0x03, 0x2a, 0xed, 0x39, 0xea, 0x31, 0x14, 0x9f, 0x79, 0x68, 0x1b,
+  0xb7, 0xe6, 0xf3, 0xab, 0xd7, 0x17, 0x43, 0xb7, 0x8d, 0xc7, 0x8e, 0x51, 0x4e, 0x91, 0x3b, 0x6d,
+  0x5a, 0x74, 0xfd, 0xdd, 0xf1, 0xcc, 0xa3, 0xe2, 0x78, 0x0c, 0x61, 0x1d, 0xc3, 0x4a, 0x49, 0x44,
+  0xc2, 0xcc, 0xfb, 0x50, 0x87, 0xe8, 0x84, 0x3d, 0xa6, 0xe1, 0x5b, 0x29, 0x34, 0x50, 0xd6, 0x87,
+  0xe8, 0xc1, 0xaf, 0xfd, 0x20, 0xea, 0x7a, 0x97, 0xd7, 0x0d, 0x81, 0x0f, 0xbe, 0x1c, 0x5d, 0x43,
+  0x32, 0x79, 0x1d, 0xef, 0xdc, 0x9d, 0xc6, 0xbb, 0xfa, 0x7b, 0xed, 0x5d, 0xdb, 0x06, 0x1e, 0xf1,
+  0xf0, 0x70, 0xcc, 0x4b, 0xab, 0x28, 0xd7, 0x12, 0x2c, 0x5e, 0xcb, 0xa1, 0x0a, 0xee, 0xce, 0x08,
+  0x2e, 0x25, 0x52, 0x39, 0x6f, 0x74, 0xd6, 0x0b, 0xaf, 0xb6, 0x5b, 0xdd, 0x38, 0xf2, 0x7a, 0xad,
+  0x67, 0x07, 0x2e, 0xa3, 0x4e, 0x9c, 0x2e, 0x41, 0xa1, 0xc1, 0x18, 0x40, 0xd1, 0x94, 0x4b, 0x03,
+  0x98, 0xdf, 0x95, 0xaa, 0x2e, 0x86, 0xb5, 0x8e, 0x43, 0x4a, 0x9a, 0x8f, 0xc6, 0x4e, 0xa3, 0xab,
+  0xa6, 0x68, 0x1b, 0x4a, 0xb3, 0x6a, 0x21, 0x76, 0xa4, 0xe3, 0x28, 0x31, 0x8e, 0x5a, 0xde, 0xe5,
+  0xcb, 0x14, 0x59, 0xc2, 0x0c, 0x5f, 0x23, 0x09, 0x06, 0x1d, 0x30, 0x56, 0x42, 0x4a, 0x2c, 0xc9,
+  0x82, 0xd0, 0xcc, 0xf3, 0x84, 0x71, 0x8b, 0xf3, 0xa9, 0xb0, 0x04, 0xb9, 0xaf, 0x48, 0x50, 0x94,
+  0x85, 0x23, 0x88, 0x36, 0xce, 0x11, 0x9a, 0x7e, 0xf2, 0xd5, 0xc4, 0x5a, 0x14, 0xf6, 0xb2, 0xd7,
+  0x4f, 0xcb, 0x3c, 0xb6, 0x08, 0xdb, 0xfe, 0xc9, 0xae, 0xb7, 0xe6, 0x9a, 0x15, 0x15, 0x9b, 0x31,
+  0x9c, 0xf6, 0x65, 0x86, 0x64, 0x0d, 0x97, 0x60, 0xdf, 0x48, 0xa0, 0xaf, 0x7f, 0x6f, 0xaf, 0x92,
+  0xbe, 0x4f, 0x69, 0xf5, 0x4f, 0xa6, 0x4e, 0x12, 0xb3, 0xf4, 0xa4, 0x68, 0x93, 0x5c, 0x12, 0x47,
+  0xd1, 0x10, 0x49, 0xfd, 0x66, 0x8d, 0xa7, 0xef, 0x85, 0xc1, 0xe9, 0x09, 0xba, 0xef, 0xc7, 0x52,
+  0xc4, 0xb7, 0xfe, 0x80, 0xdd, 0x77, 0x41, 0x98, 0x77, 0x22, 0x49, 0x80, 0xb4, 0x17, 0x55, 0xe8,
+  0x9e, 0x1d, 0xb3, 0xd9, 0x8c, 0xf9, 0x6d, 0x4d, 0xfd, 0x69, 0xef, 0x6e, 0xff, 0x20, 0xfc, 0x27,
+  0xf3, 0x09, 0xcd, 0x3e, 0x8b, 0x3a, 0x92, 0x64, 0x9a, 0xf6, 0x5f, 0xd5, 0x43, 0xfb, 0xde, 0x0d,
+  0xfc, 0x06, 0xee, 0x06, 0x15, 0xb6, 0x91, 0x36, 0x60, 0x5f, 0x5a, 0xab, 0x05, 0x56, 0x08, 0xfa,
+  0xfe, 0x31, 0x0c, 0xd0, 0xd7, 0x39, 0x1e, 0xe4, 0xcb, 0x7e, 0xab, 0xe3, 0x04, 0x83, 0xdb, 0xe3,
+  0xef, 0x70, 0xc8, 0xae, 0xa8, 0xb7, 0xc5, 0x80, 0xd5, 0x70, 0xf4, 0xad, 0x0b, 0xee, 0xaa, 0x74,
+  0xfd, 0x71, 0x7e, 0xc3, 0xd6, 0xd8, 0xf0, 0x52, 0xb0, 0xf1, 0x8a, 0x95, 0x06, 0x35, 0x30, 0x5e,
+  0x14, 0x18, 0x3e, 0xa7, 0xb8, 0x87, 0xd8, 0x05, 0xab, 0x2a, 0xa0, 0x6b, 0x41, 0xa9, 0x25, 0xe4,
+  0xb1, 0x4a, 0x20, 0x09, 0x49, 0xe9, 0x0d, 0x15, 0x9f, 0xca, 0x69, 0x10, 0x8f, 0xd4, 0xc3, 0x1f,
+  0x6d, 0x1c, 0x76, 0xc5, 0x2d, 0x4e, 0x19, 0x7c, 0x8a, 0x89, 0x0c, 0x0c, 0x73, 0x63, 0x98, 0xe5,
+  0xa8, 0x92, 0xcb, 0xda, 0x21, 0xf2, 0xc2, 0x84, 0x2e, 0xc1, 0x6e, 0xfd, 0x44, 0xe9, 0xda, 0xb6,
+  0x43, 0xa5, 0x23, 0xd9, 0x07, 0x6a, 0x57, 0x87, 0x77, 0x5c, 0x3c, 0xc0, 0xea, 0x41, 0x88, 0x99,
+  0x22, 0xc1, 0xd7, 0x90, 0xf2, 0x52, 0xda, 0x7e, 0x03, 0x95, 0x5a, 0xfa, 0x6f, 0x07, 0x18, 0xa7,
+  0xf0, 0x5b, 0x09, 0x7a, 0x3b, 0x07, 0x89, 0x54, 0x50, 0xa8, 0xad, 0x26, 0xc3, 0xe7, 0x0e, 0x55,
+  0xbe, 0x90, 0xf5, 0xbb, 0x8b, 0x21, 0x4e, 0x5f, 0xbe, 0x90, 0x90, 0xa0, 0x06, 0xab, 0x4b, 0x38,
+  0x3e, 0xea, 0x96, 0xd7, 0x9f, 0x3b, 0xe2, 0x84, 0x61, 0xe8, 0xd7, 0xc6, 0x13, 0x8e, 0xaf, 0xd3,
+  0x19, 0xf2, 0xa2, 0x62, 0x9f, 0xfe, 0x7d, 0x3f, 0x07, 0xae, 0xe3, 0xd5, 0x35, 0xd7, 0x3c, 0x33,
+  0x7d, 0xda, 0xa3, 0x40, 0x5f, 0xa3, 0x48, 0x9f, 0x1c, 0xa3, 0x7a, 0xba, 0x2a, 0xf5, 0xfd, 0x21,
+  0x12, 0x10, 0x30, 0xc0, 0x5d, 0x0f, 0x73, 0xba, 0x52, 0x09, 0x82, 0x84, 0x52, 0xe8, 0x0f, 0x7a,
+  0x34, 0x85, 0x40, 0x9b, 0x88, 0xed, 0x98, 0xdf, 0xd8, 0x0d, 0x6e, 0xd0, 0x75, 0x1f, 0x45, 0x7e,
+  0x59, 0x56, 0x9f, 0xed, 0x07, 0x3d, 0x1a, 0x60, 0x91, 0x73, 0x0c, 0x9f, 0x0f, 0x0d, 0xa4, 0x4e,
+  0x10, 0x48, 0x21, 0x12, 0x38, 0x3f, 0x50, 0x12, 0x51, 0x57, 0x60, 0x56, 0x35, 0x4e, 0x2c, 0x9d,
+  0x33, 0x5a, 0x85, 0x5f, 0x0d, 0xf1, 0x04, 0xe7, 0x24, 0xf9, 0x78, 0x44, 0x1c, 0xd6, 0x08, 0xed,
+  0x98, 0xb1, 0xdc, 0xe2, 0x28, 0x67, 0x3e, 0x68, 0xad, 0x34, 0x06, 0x80, 0x70, 0x30, 0x7c, 0x09,
+  0xb8, 0xf3, 0x41, 0xe1, 0xa8, 0xfa, 0xf8, 0xc1, 0x69, 0x52, 0xb9, 0x41, 0xe4, 0xef, 0xa7, 0x6c,
+  0xef, 0x20, 0x7c, 0xcf, 0x32, 0x99, 0x41, 0xcb, 0xf8, 0x38, 0xd7, 0xd6, 0x2d, 0xc2, 0x46, 0x0b,
+  0xfb, 0xf1, 0xc3, 0x65, 0x18, 0x03, 0xa9, 0xef, 0xdd, 0xf3, 0x04, 0x8d, 0xde, 0xdd, 0x73, 0x72,
+  0x2c, 0xe5, 0x38, 0xef, 0x5a, 0xe9, 0x54, 0xe4, 0xd8, 0xe2, 0xb6, 0x9d, 0xae, 0x83, 0x30, 0xbf,
+  0x05, 0x28, 0xd8, 0xa7, 0xab, 0xd6, 0x31, 0xc4, 0xf7, 0xb4, 0x6d, 0x73, 0x88, 0x7f, 0xcc, 0xcf,
+  0x72, 0x09, 0x38, 0x84, 0x18, 0x3e, 0xee, 0xd7, 0xf8, 0x5a, 0xc1, 0x01, 0x06, 0x0f, 0x43, 0xc3,
+  0xb5, 0xe9, 0x27, 0xb0, 0xd1, 0xb4, 0x5f, 0xbf, 0x66, 0x6d, 0xfd, 0x4b, 0x20, 0xc5, 0x37, 0x46,
+  0xd3, 0x10, 0xb1, 0x33, 0xd7, 0xaf, 0x8b, 0x61, 0xfd, 0x3f, 0xce, 0xff, 0x3c, 0xaa, 0xc9, 0x33,
+  0xfb, 0x0c, 0x00, 0x00,
+};
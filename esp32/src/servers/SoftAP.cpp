@@ -1,11 +1,48 @@
-#include "DNSServer.h"
+#include "SoftAP.h"
+#include "PortalAssets.h"
 #include <ESPAsyncWebServer.h>
 #include <Preferences.h>
 #include <WiFi.h>
 
 const byte DNS_PORT = 53;
 
-void startSoftAPMode(AsyncWebServer& server, DNSServer& dnsServer)
+static const char PORTAL_REDIRECT[] PROGMEM = "<meta http-equiv='refresh' content='0; url=/' />";
+// Long enough to cover one setup session; the ETag changes with the page
+static const char PORTAL_CACHE_CONTROL[] = "max-age=3600";
+
+/**
+ * @brief Sends the setup page straight from flash as stored, gzipped. A client
+ * revalidating with the current ETag gets an empty 304 instead.
+ */
+static void sendPortalPage(AsyncWebServerRequest *request)
+{
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == PORTAL_INDEX_ETAG)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", PORTAL_INDEX_ETAG);
+    response->addHeader("Cache-Control", PORTAL_CACHE_CONTROL);
+    request->send(response);
+    return;
+  }
+
+  AsyncWebServerResponse *response = request->beginResponse(200, "text/html", PORTAL_INDEX_GZ, PORTAL_INDEX_GZ_LENGTH);
+  response->addHeader("Content-Encoding", "gzip");
+  response->addHeader("ETag", PORTAL_INDEX_ETAG);
+  response->addHeader("Cache-Control", PORTAL_CACHE_CONTROL);
+  request->send(response);
+}
+
+/**
+ * @brief Answers an OS connectivity probe with a redirect to the setup page.
+ */
+static void sendPortalRedirect(AsyncWebServerRequest *request)
+{
+  AsyncWebServerResponse *response = request->beginResponse(200, "text/html", (const uint8_t *)PORTAL_REDIRECT, sizeof(PORTAL_REDIRECT) - 1);
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+void startSoftAPMode(AsyncWebServer& server, CaptiveDnsServer& dnsServer)
 { 
   uint64_t chipid = ESP.getEfuseMac();
   char networkName[32];
@@ -17,117 +54,20 @@ void startSoftAPMode(AsyncWebServer& server, DNSServer& dnsServer)
   WiFi.softAPConfig(IPAddress(192,168,1,1), IPAddress(192,168,1,1), IPAddress(255,255,255,0));
   WiFi.softAP(networkName, "");
 
-  dnsServer.start(DNS_PORT, "*", IPAddress(192,168,1,1));
+  dnsServer.start(DNS_PORT, IPAddress(192,168,1,1));
 
 
-  server.on("/generate_204", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(200, "text/html", "<meta http-equiv='refresh' content='0; url=/' />");
-  });
-  server.on("/hotspot-detect.html", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(200, "text/html", "<meta http-equiv='refresh' content='0; url=/' />");
-  });
-  server.on("/library/test/success.html", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(200, "text/html", "<meta http-equiv='refresh' content='0; url=/' />");
-  });
+  // Connectivity probes from Android, iOS and macOS all get the same small
+  // redirect; it must never be cached or the OS stops showing the portal.
+  server.on("/generate_204", HTTP_GET, sendPortalRedirect);
+  server.on("/hotspot-detect.html", HTTP_GET, sendPortalRedirect);
+  server.on("/library/test/success.html", HTTP_GET, sendPortalRedirect);
 
   server.onNotFound([](AsyncWebServerRequest *request){
     request->redirect("/");
   });
 
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(200, "text/html",
-      R"rawliteral(
-    <!doctype html>
-    <html>
-    <head>
-    <meta name="viewport" content="width=device-width, initial-scale=1">
-    <style>
-    html,body{height:100%;margin:0;font-family:Arial,Helvetica,sans-serif;background:#f4f6f8;color:#333}
-    .wrap{min-height:100%;display:flex;align-items:center;justify-content:center;padding:24px}
-    .card{width:100%;max-width:420px;background:#fff;padding:20px;border-radius:12px;box-shadow:0 6px 18px rgba(0,0,0,0.08)}
-    h1{margin:0 0 12px;font-size:20px;text-align:center}
-    p.desc{margin:0 0 16px;font-size:13px;color:#666;text-align:center}
-    label{display:block;font-size:13px;margin-bottom:6px}
-    input[type=text], input[type=password]{width:100%;padding:12px 12px;border:1px solid #ddd;border-radius:8px;font-size:15px;box-sizing:border-box}
-    .field{margin-bottom:12px}
-    .row{display:flex;gap:8px}
-    .toggle-btn{background:#eee;border:1px solid #ddd;padding:10px 12px;border-radius:8px;cursor:pointer;font-size:13px}
-    .submit{width:100%;padding:12px;border:none;background:#007bff;color:#fff;border-radius:8px;font-size:16px;cursor:pointer}
-    .small{font-size:12px;color:#888;margin-top:10px;text-align:center}
-    @media (max-width:360px){.card{padding:16px}}
-    </style>
-    </head>
-    <body>
-    <div class="wrap">
-    <div class="card">
-    <h1>Sproot ESP32 Setup</h1>
-    <p class="desc">Connect this device to your Wi-Fi network.</p>
-
-    <!-- Use JS submission to improve compatibility with mobile captive-portal webviews -->
-    <form id="wifiForm">
-      <div class="field">
-      <label for="ssid">SSID</label>
-      <input id="ssid" name="ssid" type="text" placeholder="Network name" required>
-      </div>
-      <div class="field">
-      <label for="pass">Password</label>
-      <div class="row">
-      <input id="pass" name="pass" type="password" placeholder="Network password" autocomplete="new-password">
-      <button type="button" id="pwToggle" class="toggle-btn" aria-pressed="false">Show</button>
-      </div>
-      </div>
-      <button class="submit" type="submit">Connect</button>
-      <div class="small">After saving, this device will reboot and attempt to join the network.</div>
-    </form>
-
-    </div>
-    </div>
-
-    <script>
-    (function(){
-    var pw = document.getElementById('pass');
-    var btn = document.getElementById('pwToggle');
-    btn.addEventListener('click', function(){
-      var isHidden = pw.type === 'password';
-      pw.type = isHidden ? 'text' : 'password';
-      btn.textContent = isHidden ? 'Hide' : 'Show';
-      btn.setAttribute('aria-pressed', String(isHidden));
-    });
-
-    // Intercept form submit and POST via fetch using application/x-www-form-urlencoded.
-    // This works around captive-portal webviews that sometimes block normal form POSTs.
-    var form = document.getElementById('wifiForm');
-    form.addEventListener('submit', function(e){
-      e.preventDefault();
-      var submitBtn = form.querySelector('button[type="submit"]');
-      submitBtn.disabled = true;
-      submitBtn.textContent = 'Saving...';
-
-      var data = new URLSearchParams(new FormData(form));
-
-      fetch('/save', {
-      method: 'POST',
-      headers: { 'Content-Type': 'application/x-www-form-urlencoded' },
-      body: data.toString()
-      }).then(function(resp){
-      return resp.json().catch(function(){ return { status: 'error', message: 'No JSON response' }; });
-      }).then(function(json){
-      alert(json.message || 'Saved');
-      }).catch(function(err){
-      alert('Save failed');
-      }).finally(function(){
-      // keep UI responsive; reboot is triggered server-side
-      submitBtn.disabled = false;
-      submitBtn.textContent = 'Connect';
-      });
-    });
-    })();
-    </script>
-    </body>
-    </html>
-    )rawliteral"
-    );
-  });
+  server.on("/", HTTP_GET, sendPortalPage);
 
   server.on("/save", HTTP_POST, [](AsyncWebServerRequest *request) {
     String ssid, pass;
@@ -147,7 +87,7 @@ void startSoftAPMode(AsyncWebServer& server, DNSServer& dnsServer)
   server.begin();
 }
 
-void stopSoftAPMode(AsyncWebServer& server, DNSServer& dnsServer) {
+void stopSoftAPMode(AsyncWebServer& server, CaptiveDnsServer& dnsServer) {
   dnsServer.stop();
   server.end();
 }
\ No newline at end of file
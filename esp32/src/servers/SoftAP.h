@@ -1,7 +1,8 @@
 #pragma once
 
-#include <DNSServer.h>
 #include <ESPAsyncWebServer.h>
 
-void startSoftAPMode(AsyncWebServer& serverm, DNSServer& dnsServer);
-void stopSoftAPMode(AsyncWebServer& serverm, DNSServer& dnsServer);
+#include "servers/CaptiveDns.h"
+
+void startSoftAPMode(AsyncWebServer& serverm, CaptiveDnsServer& dnsServer);
+void stopSoftAPMode(AsyncWebServer& serverm, CaptiveDnsServer& dnsServer);
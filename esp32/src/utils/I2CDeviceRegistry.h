@@ -0,0 +1,253 @@
+#pragma once
+
+#include <Arduino.h>
+#include <new>
+#include <utility>
+
+#include "utils/i2cUtils.h"
+
+/**
+ * @brief Fixed-capacity registry of I2C drivers, indexed by bus and address.
+ *
+ * Every address in [MinAddress, MaxAddress] on every bus owns one slot of
+ * in-place storage for a T. Lookups are a single index computation, and
+ * attaching or detaching a device constructs or destroys T in its slot
+ * without touching the heap.
+ *
+ * A device that stops answering is marked lost rather than destroyed. When it
+ * answers again it is re-initialized in the same slot. The inventory probe
+ * reports each miss through markMissing(); only I2C_DEVICE_DETACH_MISSES in a
+ * row destroy the driver, so a loose connector or a noisy bus does not cost a
+ * full re-attach.
+ *
+ * The bookkeeping is locked, so any task may look up, count or list devices.
+ * A driver itself belongs to whoever owns its bus: acquire, detach and use it
+ * only from that bus's read worker, or with the family's own bus lock held.
+ */
+// Consecutive inventory probes a device has to miss before its driver is destroyed
+#define I2C_DEVICE_DETACH_MISSES 3
+
+template <typename T, uint8_t MinAddress, uint8_t MaxAddress>
+class I2CDeviceRegistry
+{
+public:
+  typedef T Device;
+  static constexpr size_t AddressesPerBus = MaxAddress - MinAddress + 1;
+  static constexpr size_t Capacity = I2C_BUS_COUNT * AddressesPerBus;
+
+  I2CDeviceRegistry() : occupied{}, lost{}, misses{}, count(0), changes(0) {}
+  ~I2CDeviceRegistry()
+  {
+    for (size_t i = 0; i < Capacity; i++)
+    {
+      destroy(i);
+    }
+  }
+
+  I2CDeviceRegistry(const I2CDeviceRegistry &) = delete;
+  I2CDeviceRegistry &operator=(const I2CDeviceRegistry &) = delete;
+
+  /**
+   * @brief Returns the attached driver, or nullptr. Does not touch the bus.
+   */
+  T *find(uint8_t bus, uint8_t address)
+  {
+    size_t index;
+    if (!slotIndex(bus, address, index))
+    {
+      return nullptr;
+    }
+    portENTER_CRITICAL(&mux);
+    bool attached = occupied[index];
+    portEXIT_CRITICAL(&mux);
+    return attached ? slot(index) : nullptr;
+  }
+
+  /**
+   * @brief Returns a ready driver for a device that is answering on the bus.
+   *
+   * Probes the address first. On the first successful probe the driver is
+   * constructed in place from args and passed to init. If the device was lost
+   * since its last use, init runs again on the existing driver.
+   *
+   * @param bus I2C bus of the device.
+   * @param address 7-bit I2C address of the device.
+   * @param init Callable taking T& and returning true once the chip is configured.
+   * @param args Constructor arguments for T.
+   * @return The driver, or nullptr if the device is absent or failed to initialize.
+   */
+  template <typename Init, typename... Args>
+  T *acquire(uint8_t bus, uint8_t address, Init init, Args &&...args)
+  {
+    size_t index;
+    if (!slotIndex(bus, address, index))
+    {
+      return nullptr;
+    }
+
+    if (!probeI2CDevice(bus, address))
+    {
+      portENTER_CRITICAL(&mux);
+      lost[index] = occupied[index];
+      portEXIT_CRITICAL(&mux);
+      return nullptr;
+    }
+
+    // Only the bus owner attaches to this slot, so the driver is built outside the lock
+    portENTER_CRITICAL(&mux);
+    bool attached = occupied[index];
+    bool reinit = lost[index];
+    portEXIT_CRITICAL(&mux);
+    if (!attached)
+    {
+      new (storage[index].bytes) T(std::forward<Args>(args)...);
+      reinit = true;
+      portENTER_CRITICAL(&mux);
+      occupied[index] = true;
+      lost[index] = true;
+      count++;
+      changes++;
+      portEXIT_CRITICAL(&mux);
+    }
+
+    if (reinit && !init(*slot(index)))
+    {
+      return nullptr;
+    }
+    portENTER_CRITICAL(&mux);
+    lost[index] = false;
+    misses[index] = 0;
+    portEXIT_CRITICAL(&mux);
+    return slot(index);
+  }
+
+  /**
+   * @brief Records that an attached device did not answer or failed to initialize.
+   *
+   * The device is marked lost, so its next acquire re-initializes it. After
+   * I2C_DEVICE_DETACH_MISSES calls with no successful acquire in between, the
+   * driver is destroyed. Does nothing for an empty slot.
+   * @return true if this call detached the device.
+   */
+  bool markMissing(uint8_t bus, uint8_t address)
+  {
+    size_t index;
+    if (!slotIndex(bus, address, index))
+    {
+      return false;
+    }
+    portENTER_CRITICAL(&mux);
+    bool detaching = false;
+    if (occupied[index])
+    {
+      lost[index] = true;
+      misses[index]++;
+      detaching = misses[index] >= I2C_DEVICE_DETACH_MISSES;
+    }
+    portEXIT_CRITICAL(&mux);
+    if (detaching)
+    {
+      destroy(index);
+    }
+    return detaching;
+  }
+
+  /**
+   * @brief Destroys the driver for a device, freeing its slot.
+   */
+  void detach(uint8_t bus, uint8_t address)
+  {
+    size_t index;
+    if (slotIndex(bus, address, index))
+    {
+      destroy(index);
+    }
+  }
+
+  size_t size()
+  {
+    portENTER_CRITICAL(&mux);
+    size_t attached = count;
+    portEXIT_CRITICAL(&mux);
+    return attached;
+  }
+
+  /**
+   * @brief Counts attaches and detaches, so callers can tell the device set changed.
+   */
+  uint32_t generation()
+  {
+    portENTER_CRITICAL(&mux);
+    uint32_t generation = changes;
+    portEXIT_CRITICAL(&mux);
+    return generation;
+  }
+
+  /**
+   * @brief Calls f(bus, address) for every attached device.
+   *
+   * Passes addresses rather than drivers, since the caller need not own the bus.
+   */
+  template <typename F>
+  void forEach(F f)
+  {
+    for (size_t i = 0; i < Capacity; i++)
+    {
+      portENTER_CRITICAL(&mux);
+      bool attached = occupied[i];
+      portEXIT_CRITICAL(&mux);
+      if (attached)
+      {
+        f((uint8_t)(i / AddressesPerBus), (uint8_t)(MinAddress + i % AddressesPerBus));
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    alignas(T) unsigned char bytes[sizeof(T)];
+  };
+
+  static bool slotIndex(uint8_t bus, uint8_t address, size_t &index)
+  {
+    if (bus >= I2C_BUS_COUNT || address < MinAddress || address > MaxAddress)
+    {
+      return false;
+    }
+    index = bus * AddressesPerBus + (address - MinAddress);
+    return true;
+  }
+
+  T *slot(size_t index)
+  {
+    return reinterpret_cast<T *>(storage[index].bytes);
+  }
+
+  void destroy(size_t index)
+  {
+    portENTER_CRITICAL(&mux);
+    bool attached = occupied[index];
+    if (attached)
+    {
+      occupied[index] = false;
+      lost[index] = false;
+      misses[index] = 0;
+      count--;
+      changes++;
+    }
+    portEXIT_CRITICAL(&mux);
+    if (attached)
+    {
+      slot(index)->~T();
+    }
+  }
+
+  Slot storage[Capacity];
+  bool occupied[Capacity];
+  bool lost[Capacity];
+  uint8_t misses[Capacity]; // inventory probes missed since the device last answered
+  size_t count;
+  uint32_t changes;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,359 @@
+#include "admissionUtils.h"
+
+#include <Preferences.h>
+
+// Below this much free heap a response may no longer fit, so routes are shed
+static const uint32_t DEFAULT_MIN_FREE_HEAP = 24576;
+static const uint32_t MAX_MIN_FREE_HEAP = 131072;
+static const uint16_t MIN_QUEUE_MS = 100;
+static const uint16_t MAX_QUEUE_MS = 30000;
+
+static const char *const CLASS_NAMES[ADMISSION_CLASS_COUNT] = {"sensors", "outputs", "system"};
+
+// The hub reads every probe at once each cycle and a DS18B20 conversion takes
+// 750 ms, so the sensor queue fits five probes before it starts refusing
+static const AdmissionLimits DEFAULT_LIMITS[ADMISSION_CLASS_COUNT] = {
+  {6, 4000},
+  {6, 1000},
+  {4, 2000},
+};
+
+enum AdmissionResult : uint8_t
+{
+  ADMIT_OK = 0,
+  ADMIT_IN_FLIGHT,
+  ADMIT_QUEUE,
+  ADMIT_HEAP
+};
+
+struct AdmissionState
+{
+  AdmissionLimits limits;
+  uint8_t inFlight;
+  uint32_t queuedUs;
+  uint32_t admitted;
+  uint32_t rejectedInFlight;
+  uint32_t rejectedQueue;
+  uint32_t rejectedHeap;
+};
+
+static AdmissionState classes[ADMISSION_CLASS_COUNT];
+static uint8_t pendingRequests = 0;
+static uint32_t lastWorkEndMs = 0;
+static bool workRunning = false;
+static uint32_t minFreeHeap = DEFAULT_MIN_FREE_HEAP;
+static portMUX_TYPE admissionMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool isValidAdmissionLimits(const AdmissionLimits &limits)
+{
+  return limits.maxInFlight >= 1 && limits.maxInFlight <= ADMISSION_MAX_PENDING &&
+         limits.maxQueueMs >= MIN_QUEUE_MS && limits.maxQueueMs <= MAX_QUEUE_MS;
+}
+
+// Starts a new backlog once the handler task has gone a gap without admitted work. Call with admissionMux held.
+static void drainIfIdle(uint32_t now)
+{
+  if (workRunning || now - lastWorkEndMs < ADMISSION_IDLE_GAP_MS)
+  {
+    return;
+  }
+  for (uint8_t i = 0; i < ADMISSION_CLASS_COUNT; i++)
+  {
+    classes[i].queuedUs = 0;
+  }
+}
+
+/**
+ * @brief Loads saved limits.
+ */
+void beginAdmissionControl()
+{
+  Preferences prefs;
+  prefs.begin("admission", true);
+  minFreeHeap = prefs.getUInt("minHeap", DEFAULT_MIN_FREE_HEAP);
+  for (uint8_t i = 0; i < ADMISSION_CLASS_COUNT; i++)
+  {
+    String prefix = String(CLASS_NAMES[i]) + ".";
+    AdmissionLimits limits;
+    limits.maxInFlight = prefs.getUChar((prefix + "flight").c_str(), DEFAULT_LIMITS[i].maxInFlight);
+    limits.maxQueueMs = prefs.getUShort((prefix + "queue").c_str(), DEFAULT_LIMITS[i].maxQueueMs);
+    if (!isValidAdmissionLimits(limits))
+    {
+      limits = DEFAULT_LIMITS[i];
+    }
+
+    portENTER_CRITICAL(&admissionMux);
+    classes[i].limits = limits;
+    portEXIT_CRITICAL(&admissionMux);
+  }
+  prefs.end();
+}
+
+const char *admissionClassName(AdmissionClass admissionClass)
+{
+  return admissionClass < ADMISSION_CLASS_COUNT ? CLASS_NAMES[admissionClass] : "unknown";
+}
+
+bool parseAdmissionClass(const String &name, AdmissionClass &admissionClass)
+{
+  for (uint8_t i = 0; i < ADMISSION_CLASS_COUNT; i++)
+  {
+    if (name == CLASS_NAMES[i])
+    {
+      admissionClass = (AdmissionClass)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+AdmissionLimits getAdmissionLimits(AdmissionClass admissionClass)
+{
+  portENTER_CRITICAL(&admissionMux);
+  AdmissionLimits limits = classes[admissionClass].limits;
+  portEXIT_CRITICAL(&admissionMux);
+  return limits;
+}
+
+/**
+ * @brief Persists and applies new limits for one class.
+ *
+ * @return false if max_in_flight is not 1-ADMISSION_MAX_PENDING or the queue
+ * not 100-30000 ms.
+ */
+bool configureAdmissionLimits(AdmissionClass admissionClass, const AdmissionLimits &limits)
+{
+  if (admissionClass >= ADMISSION_CLASS_COUNT || !isValidAdmissionLimits(limits))
+  {
+    return false;
+  }
+
+  String prefix = String(CLASS_NAMES[admissionClass]) + ".";
+  Preferences prefs;
+  prefs.begin("admission", false);
+  prefs.putUChar((prefix + "flight").c_str(), limits.maxInFlight);
+  prefs.putUShort((prefix + "queue").c_str(), limits.maxQueueMs);
+  prefs.end();
+
+  portENTER_CRITICAL(&admissionMux);
+  classes[admissionClass].limits = limits;
+  portEXIT_CRITICAL(&admissionMux);
+  return true;
+}
+
+uint32_t getAdmissionMinFreeHeap()
+{
+  return minFreeHeap;
+}
+
+/**
+ * @brief Persists and applies the free-heap floor; 0 turns heap shedding off.
+ */
+bool configureAdmissionMinFreeHeap(uint32_t bytes)
+{
+  if (bytes > MAX_MIN_FREE_HEAP)
+  {
+    return false;
+  }
+
+  Preferences prefs;
+  prefs.begin("admission", false);
+  prefs.putUInt("minHeap", bytes);
+  prefs.end();
+
+  minFreeHeap = bytes;
+  return true;
+}
+
+AdmissionClassStatus getAdmissionStatus(AdmissionClass admissionClass)
+{
+  AdmissionClassStatus status;
+  portENTER_CRITICAL(&admissionMux);
+  AdmissionState &state = classes[admissionClass];
+  drainIfIdle(millis());
+  status.inFlight = state.inFlight;
+  status.queuedMs = state.queuedUs / 1000;
+  status.admitted = state.admitted;
+  status.rejectedInFlight = state.rejectedInFlight;
+  status.rejectedQueue = state.rejectedQueue;
+  status.rejectedHeap = state.rejectedHeap;
+  portEXIT_CRITICAL(&admissionMux);
+  return status;
+}
+
+uint32_t getAdmissionRejectedTotal()
+{
+  uint32_t total = 0;
+  portENTER_CRITICAL(&admissionMux);
+  for (uint8_t i = 0; i < ADMISSION_CLASS_COUNT; i++)
+  {
+    total += classes[i].rejectedInFlight + classes[i].rejectedQueue + classes[i].rejectedHeap;
+  }
+  portEXIT_CRITICAL(&admissionMux);
+  return total;
+}
+
+/**
+ * @brief Decides whether a request of this class may run now.
+ *
+ * Free heap is checked first, since building any response needs it. Then the
+ * in-flight caps, then the handler time the class has already committed to
+ * this backlog. An admitted request holds its in-flight slot until the client
+ * disconnects.
+ *
+ * @param retryAfterS Receives the seconds a rejected client should wait.
+ */
+static AdmissionResult tryAdmit(AdmissionClass admissionClass, uint32_t &retryAfterS)
+{
+  retryAfterS = 1;
+  bool heapLow = minFreeHeap > 0 && ESP.getFreeHeap() < minFreeHeap;
+
+  portENTER_CRITICAL(&admissionMux);
+  drainIfIdle(millis());
+  AdmissionState &state = classes[admissionClass];
+  AdmissionResult result = ADMIT_OK;
+  if (heapLow)
+  {
+    result = ADMIT_HEAP;
+    state.rejectedHeap++;
+  }
+  else if (state.inFlight >= state.limits.maxInFlight || pendingRequests >= ADMISSION_MAX_PENDING)
+  {
+    result = ADMIT_IN_FLIGHT;
+    state.rejectedInFlight++;
+  }
+  else if (state.queuedUs >= (uint32_t)state.limits.maxQueueMs * 1000)
+  {
+    result = ADMIT_QUEUE;
+    state.rejectedQueue++;
+    // The backlog ahead of the client is at most everything admitted so far
+    uint32_t backlogUs = 0;
+    for (uint8_t i = 0; i < ADMISSION_CLASS_COUNT; i++)
+    {
+      backlogUs += classes[i].queuedUs;
+    }
+    retryAfterS = (backlogUs + 999999) / 1000000;
+  }
+  else
+  {
+    state.inFlight++;
+    pendingRequests++;
+    state.admitted++;
+    workRunning = true;
+  }
+  portEXIT_CRITICAL(&admissionMux);
+
+  if (retryAfterS > ADMISSION_MAX_RETRY_AFTER_S)
+  {
+    retryAfterS = ADMISSION_MAX_RETRY_AFTER_S;
+  }
+  return result;
+}
+
+static void releaseRequest(AdmissionClass admissionClass)
+{
+  portENTER_CRITICAL(&admissionMux);
+  AdmissionState &state = classes[admissionClass];
+  if (state.inFlight > 0)
+  {
+    state.inFlight--;
+  }
+  if (pendingRequests > 0)
+  {
+    pendingRequests--;
+  }
+  portEXIT_CRITICAL(&admissionMux);
+}
+
+static void chargeHandler(AdmissionClass admissionClass, uint32_t handlerUs)
+{
+  portENTER_CRITICAL(&admissionMux);
+  classes[admissionClass].queuedUs += handlerUs;
+  lastWorkEndMs = millis();
+  workRunning = false;
+  portEXIT_CRITICAL(&admissionMux);
+}
+
+static void sendRejection(AsyncWebServerRequest *request, AdmissionResult result, uint32_t retryAfterS)
+{
+  const char *message;
+  const char *code;
+  switch (result)
+  {
+  case ADMIT_IN_FLIGHT: message = "Too many requests in progress"; code = "busy"; break;
+  case ADMIT_QUEUE: message = "Too much work queued for this route"; code = "queue_full"; break;
+  default: message = "Free heap below the admission floor"; code = "low_memory"; break;
+  }
+  AsyncWebServerResponse *response = request->beginResponse(503, "application/json", "{\"error\":\"" + String(message) + "\", \"code\":\"" + code + "\"}");
+  response->addHeader("Retry-After", String(retryAfterS));
+  request->send(response);
+}
+
+static bool admitRequest(AsyncWebServerRequest *request, AdmissionClass admissionClass)
+{
+  uint32_t retryAfterS;
+  AdmissionResult result = tryAdmit(admissionClass, retryAfterS);
+  if (result != ADMIT_OK)
+  {
+    sendRejection(request, result, retryAfterS);
+    return false;
+  }
+  request->onDisconnect([admissionClass]()
+                        { releaseRequest(admissionClass); });
+  return true;
+}
+
+/**
+ * @brief Wraps a route handler so it only runs when its class admits the request.
+ *
+ * A rejected request is answered 503 with Retry-After in seconds, without
+ * touching a bus. The handler's run time is charged to the class's backlog.
+ */
+ArRequestHandlerFunction admitted(AdmissionClass admissionClass, ArRequestHandlerFunction handler)
+{
+  return [admissionClass, handler](AsyncWebServerRequest *request)
+  {
+    if (!admitRequest(request, admissionClass))
+    {
+      return;
+    }
+    uint32_t start = micros();
+    handler(request);
+    chargeHandler(admissionClass, micros() - start);
+  };
+}
+
+/**
+ * @brief Body-handler form of admitted(), for routes that do their work as the body arrives.
+ *
+ * The decision is taken on the first chunk. A rejected request is marked
+ * through its _tempObject, which the library frees with the request, and every
+ * later chunk is dropped, so a handler that assembles the body never sees the
+ * tail of a request it did not get the start of.
+ */
+ArBodyHandlerFunction admittedBody(AdmissionClass admissionClass, ArBodyHandlerFunction handler)
+{
+  return [admissionClass, handler](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+  {
+    if (index == 0 && !admitRequest(request, admissionClass))
+    {
+      if (index + len < total)
+      {
+        request->_tempObject = malloc(1);
+        if (request->_tempObject == NULL)
+        {
+          // No room for the mark either, so the rest of the body is not read at all
+          request->client()->close();
+        }
+      }
+      return;
+    }
+    if (request->_tempObject != NULL)
+    {
+      return;
+    }
+    uint32_t start = micros();
+    handler(request, data, len, index, total);
+    chargeHandler(admissionClass, micros() - start);
+  };
+}
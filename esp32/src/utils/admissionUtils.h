@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Requests admitted and not yet answered, across every class; kept below lwIP's
+// pool of TCP PCBs so a refused request can still be answered
+#define ADMISSION_MAX_PENDING 12
+// Longest Retry-After a rejection asks for
+#define ADMISSION_MAX_RETRY_AFTER_S 30
+// Time without an admitted handler after which the backlog counts as drained
+#define ADMISSION_IDLE_GAP_MS 50
+
+/**
+ * @brief Routes that share one set of limits.
+ *
+ * Sensor reads block on the bus, output writes are short but latency sensitive,
+ * and system routes build large responses, so each gets its own budget and a
+ * flood of one cannot starve the others.
+ */
+enum AdmissionClass : uint8_t
+{
+  ADMISSION_SENSORS = 0,
+  ADMISSION_OUTPUTS,
+  ADMISSION_SYSTEM,
+  ADMISSION_CLASS_COUNT
+};
+
+/**
+ * @brief Limits for one class of routes.
+ *
+ * Handlers run one at a time on the async_tcp task, and requests wait for it in
+ * AsyncTCP's event queue where the firmware cannot see them. What it can bound
+ * is the handler time each class commits while that queue is backed up: from
+ * the first request after ADMISSION_IDLE_GAP_MS without work until the next
+ * such gap, a class may run at most maxQueueMs of handlers. A request behind a
+ * burst therefore waits at most the sum of the classes' maxQueueMs, plus one
+ * handler. maxInFlight caps requests admitted and not yet fully answered.
+ */
+struct AdmissionLimits
+{
+  uint8_t maxInFlight;
+  uint16_t maxQueueMs;
+};
+
+struct AdmissionClassStatus
+{
+  uint8_t inFlight;
+  uint32_t queuedMs;
+  uint32_t admitted;
+  uint32_t rejectedInFlight;
+  uint32_t rejectedQueue;
+  uint32_t rejectedHeap;
+};
+
+void beginAdmissionControl();
+
+const char *admissionClassName(AdmissionClass admissionClass);
+bool parseAdmissionClass(const String &name, AdmissionClass &admissionClass);
+
+AdmissionLimits getAdmissionLimits(AdmissionClass admissionClass);
+bool configureAdmissionLimits(AdmissionClass admissionClass, const AdmissionLimits &limits);
+uint32_t getAdmissionMinFreeHeap();
+bool configureAdmissionMinFreeHeap(uint32_t bytes);
+
+AdmissionClassStatus getAdmissionStatus(AdmissionClass admissionClass);
+uint32_t getAdmissionRejectedTotal();
+
+ArRequestHandlerFunction admitted(AdmissionClass admissionClass, ArRequestHandlerFunction handler);
+ArBodyHandlerFunction admittedBody(AdmissionClass admissionClass, ArBodyHandlerFunction handler);
@@ -0,0 +1,763 @@
+#include "benchmarkUtils.h"
+
+#include "Features.h"
+#include <Wire.h>
+#include <esp_partition.h>
+
+#include "utils/deadlineUtils.h"
+#include "utils/i2cUtils.h"
+#include "utils/logUtils.h"
+#if FEATURE_DS18B20
+#include "sensors/Ds18b20.h"
+#endif
+#if FEATURE_ADS1115
+#include "sensors/Ads1115.h"
+#endif
+#if FEATURE_PCA9685
+#include "outputs/Pca9685.h"
+#endif
+
+// 0x00-0x07 and 0x78-0x7F are reserved by the I2C specification and never probed
+#define BENCHMARK_FIRST_I2C_ADDRESS 0x08
+#define BENCHMARK_LAST_I2C_ADDRESS 0x77
+// Every PCA9685 answers here from power-up, so a probe would address all of them at once
+#define BENCHMARK_PCA9685_ALL_CALL 0x70
+// Twice a 12-bit DS18B20 conversion; after that the probes are taken not to be converting
+#define BENCHMARK_CONVERSION_TIMEOUT_MS 1500
+#define BENCHMARK_POLL_MS 5
+// Ticks a slice waits for a free job slot before it is given up
+#define BENCHMARK_SLICE_RETRIES 10
+
+// In BenchmarkTest bit order, which is also the order a run takes them in
+static const char *const BENCHMARK_TEST_NAMES[] = {"i2c", "onewire", "pca9685", "ads1115", "flash"};
+static const uint8_t BENCHMARK_TEST_COUNT = sizeof(BENCHMARK_TEST_NAMES) / sizeof(BENCHMARK_TEST_NAMES[0]);
+// Tests whose driver this image carries
+static const uint8_t BENCHMARK_AVAILABLE_TESTS = BENCHMARK_I2C | BENCHMARK_FLASH |
+                                                 (FEATURE_DS18B20 ? BENCHMARK_ONEWIRE : 0) |
+                                                 (FEATURE_PCA9685 ? BENCHMARK_PCA9685 : 0) |
+                                                 (FEATURE_ADS1115 ? BENCHMARK_ADS1115 : 0);
+
+static BenchmarkConfig benchmarkConfig = {};
+static BenchmarkState benchmarkState = BENCHMARK_IDLE;
+static uint64_t usedUs = 0; // slice time charged to the budget
+static uint32_t skippedSlices = 0; // never got onto their bus
+static uint32_t startedMs = 0;
+static uint32_t elapsedMs = 0; // of the last finished run
+static portMUX_TYPE benchmarkMux = portMUX_INITIALIZER_UNLOCKED;
+// Members of "results" for the tests finished so far
+static String resultsJson;
+static SemaphoreHandle_t resultsMutex = NULL;
+
+/**
+ * @brief Returns the test's BenchmarkTest bit, or 0 if the name is unknown or its driver is not in this image.
+ */
+uint8_t parseBenchmarkTest(const char *name)
+{
+  for (uint8_t i = 0; i < BENCHMARK_TEST_COUNT; i++)
+  {
+    if (strcmp(name, BENCHMARK_TEST_NAMES[i]) == 0)
+    {
+      return (1 << i) & BENCHMARK_AVAILABLE_TESTS;
+    }
+  }
+  return 0;
+}
+
+static uint64_t getUsedUs()
+{
+  portENTER_CRITICAL(&benchmarkMux);
+  uint64_t used = usedUs;
+  portEXIT_CRITICAL(&benchmarkMux);
+  return used;
+}
+
+static void chargeSlice(uint32_t elapsedUs)
+{
+  portENTER_CRITICAL(&benchmarkMux);
+  usedUs += elapsedUs;
+  portEXIT_CRITICAL(&benchmarkMux);
+  // Leaves the rest of the system a tick between slices
+  vTaskDelay(1);
+}
+
+/**
+ * @brief Length of the next slice of a share, given the budget used when the share began.
+ * @return 0 once the share is spent.
+ */
+static uint32_t nextSliceUs(uint64_t shareUs, uint64_t markUs)
+{
+  uint64_t spent = getUsedUs() - markUs;
+  if (spent >= shareUs)
+  {
+    return 0;
+  }
+  uint64_t left = shareUs - spent;
+  uint32_t sliceUs = benchmarkConfig.sliceMs * 1000;
+  return left < sliceUs ? (uint32_t)left : sliceUs;
+}
+
+// What is left of a share, split evenly between the parts still to run
+static uint64_t splitShare(uint64_t shareUs, uint64_t markUs, uint8_t parts)
+{
+  uint64_t spent = getUsedUs() - markUs;
+  return spent < shareUs && parts > 0 ? (shareUs - spent) / parts : 0;
+}
+
+// A slice and how long it held the bus, timed where it ran rather than from the wait for it
+struct BenchmarkSlice
+{
+  DeadlineJobFunction run;
+  void *arg;
+  uint32_t elapsedUs;
+};
+
+static void runTimedSlice(void *arg)
+{
+  BenchmarkSlice *slice = (BenchmarkSlice *)arg;
+  uint32_t start = micros();
+  slice->run(slice->arg);
+  slice->elapsedUs = micros() - start;
+}
+
+/**
+ * @brief Runs one slice on a bus's read worker and charges it to the budget.
+ *
+ * The worker takes it only once no read is waiting, so sampling on the bus is
+ * held up by at most one slice at a time. While every job slot is taken the
+ * slice waits a tick at a time; if none frees up it is counted as skipped and
+ * charged a full slice_ms, so a run kept off its buses still ends.
+ */
+static void runSlice(uint8_t worker, DeadlineJobFunction run, void *arg)
+{
+  BenchmarkSlice slice = {run, arg, 0};
+  for (uint8_t attempt = 0; attempt <= BENCHMARK_SLICE_RETRIES; attempt++)
+  {
+    // Waits for as long as the slice takes, since it works on this task's own state
+    if (runOnDeadlineWorker(worker, runTimedSlice, &slice, sizeof(slice), 0) == DEADLINE_JOB_DONE)
+    {
+      chargeSlice(slice.elapsedUs);
+      return;
+    }
+    vTaskDelay(1);
+  }
+  portENTER_CRITICAL(&benchmarkMux);
+  skippedSlices++;
+  portEXIT_CRITICAL(&benchmarkMux);
+  chargeSlice(benchmarkConfig.sliceMs * 1000);
+}
+
+static String perSecond(uint32_t count, uint64_t elapsedUs)
+{
+  return elapsedUs > 0 ? String((double)count * 1000000.0 / (double)elapsedUs, 1) : String("null");
+}
+
+// The probes are left out of the bus statistics, which describe the board's own traffic
+struct I2CScanSlice
+{
+  uint8_t bus;
+  uint8_t next;
+  uint32_t sliceUs;
+  uint8_t count;
+  uint8_t addresses[BENCHMARK_MAX_I2C_DEVICES];
+  uint8_t skipped[16]; // bit per 7-bit address
+};
+
+static bool isScanSkipped(const I2CScanSlice &scan, uint8_t address)
+{
+  return scan.skipped[address >> 3] & (1 << (address & 7));
+}
+
+static void skipScanAddress(I2CScanSlice &scan, uint8_t address)
+{
+  scan.skipped[address >> 3] |= 1 << (address & 7);
+}
+
+/**
+ * @brief Marks the addresses a probe could reach several chips through: ALL_CALL and configured PCA9685 groups.
+ */
+static void skipGroupAddresses(I2CScanSlice &scan)
+{
+  skipScanAddress(scan, BENCHMARK_PCA9685_ALL_CALL);
+#if FEATURE_PCA9685
+  for (uint8_t g = 0; g < PCA9685_GROUP_COUNT; g++)
+  {
+    Pca9685Group group = getPCA9685Group(g);
+    if (group.address != 0 && group.bus == scan.bus)
+    {
+      skipScanAddress(scan, group.address);
+    }
+  }
+#endif
+}
+
+// sliceUs is what is left of the share when less than a slice, so the budget is checked before every probe
+static void scanI2CSlice(void *arg)
+{
+  I2CScanSlice *scan = (I2CScanSlice *)arg;
+  TwoWire *wire = getI2CBus(scan->bus);
+  uint32_t start = micros();
+  while (scan->next <= BENCHMARK_LAST_I2C_ADDRESS && micros() - start < scan->sliceUs)
+  {
+    if (!isScanSkipped(*scan, scan->next))
+    {
+      wire->beginTransmission(scan->next);
+      if (wire->endTransmission() == 0 && scan->count < BENCHMARK_MAX_I2C_DEVICES)
+      {
+        scan->addresses[scan->count++] = scan->next;
+      }
+    }
+    scan->next++;
+  }
+}
+
+struct I2CProbeSlice
+{
+  uint8_t bus;
+  uint8_t address;
+  uint32_t sliceUs;
+  uint32_t transactions;
+  uint32_t errors;
+  uint64_t elapsedUs;
+};
+
+static void probeI2CSlice(void *arg)
+{
+  I2CProbeSlice *probe = (I2CProbeSlice *)arg;
+  TwoWire *wire = getI2CBus(probe->bus);
+  uint32_t start = micros();
+  do
+  {
+    wire->beginTransmission(probe->address);
+    if (wire->endTransmission() != 0)
+    {
+      probe->errors++;
+    }
+    probe->transactions++;
+  } while (micros() - start < probe->sliceUs);
+  probe->elapsedUs += micros() - start;
+}
+
+/**
+ * @brief Finds the addresses that answer on each enabled bus, then addresses each in turn.
+ *
+ * The scan is charged to the share like any other slice; one cut short by the
+ * budget leaves the rest of its bus unlisted. What is left of the share is
+ * split between the addresses found.
+ */
+static String benchmarkI2C(uint64_t shareUs)
+{
+  uint64_t mark = getUsedUs();
+  I2CScanSlice scans[I2C_BUS_COUNT] = {};
+  uint8_t devices = 0;
+  for (uint8_t bus = 0; bus < I2C_BUS_COUNT; bus++)
+  {
+    scans[bus].bus = bus;
+    scans[bus].next = BENCHMARK_FIRST_I2C_ADDRESS;
+    skipGroupAddresses(scans[bus]);
+    while (isI2CBusEnabled(bus) && scans[bus].next <= BENCHMARK_LAST_I2C_ADDRESS &&
+           (scans[bus].sliceUs = nextSliceUs(shareUs, mark)) > 0)
+    {
+      runSlice(deadlineWorkerForI2CBus(bus), scanI2CSlice, &scans[bus]);
+    }
+    if (isI2CBusEnabled(bus) && scans[bus].next <= BENCHMARK_LAST_I2C_ADDRESS)
+    {
+      logWarn("Benchmark scan of bus %u ended at 0x%02x", (unsigned)bus, (unsigned)scans[bus].next);
+    }
+    devices += scans[bus].count;
+  }
+
+  String json = "[";
+  uint8_t done = 0;
+  for (uint8_t bus = 0; bus < I2C_BUS_COUNT; bus++)
+  {
+    for (uint8_t i = 0; i < scans[bus].count; i++)
+    {
+      I2CProbeSlice probe = {bus, scans[bus].addresses[i], 0, 0, 0, 0};
+      uint64_t deviceShare = splitShare(shareUs, mark, devices - done);
+      uint64_t deviceMark = getUsedUs();
+      while ((probe.sliceUs = nextSliceUs(deviceShare, deviceMark)) > 0)
+      {
+        runSlice(deadlineWorkerForI2CBus(bus), probeI2CSlice, &probe);
+      }
+      if (done++ > 0)
+      {
+        json += ", ";
+      }
+      json += "{ \"bus\":" + String(bus) + ", ";
+      json += "\"address\":\"" + formatI2CDeviceAddress(bus, probe.address) + "\", ";
+      json += "\"transactions\":" + String(probe.transactions) + ", ";
+      json += "\"errors\":" + String(probe.errors) + ", ";
+      json += "\"per_second\":" + perSecond(probe.transactions, probe.elapsedUs) + ", ";
+      json += "\"error_rate\":" + (probe.transactions > 0 ? String((double)probe.errors / probe.transactions, 4) : String("null")) + " }";
+    }
+  }
+  json += "]";
+  return json;
+}
+
+#if FEATURE_DS18B20
+struct OneWireSlice
+{
+  uint32_t sliceUs;
+  bool done;
+  OneWireBenchmark result;
+};
+
+static void oneWireResetSlice(void *arg)
+{
+  OneWireSlice *slice = (OneWireSlice *)arg;
+  benchmarkOneWireResets(slice->sliceUs, slice->result);
+}
+
+static void oneWireSearchSlice(void *arg)
+{
+  OneWireSlice *slice = (OneWireSlice *)arg;
+  slice->done = benchmarkOneWireSearch(slice->sliceUs, slice->result);
+}
+
+static void oneWireConversionSlice(void *arg)
+{
+  OneWireSlice *slice = (OneWireSlice *)arg;
+  slice->done = benchmarkDS18B20Conversion(slice->result);
+}
+
+/**
+ * @brief Times bus resets, a full ROM search pass and one conversion.
+ *
+ * Resets get a third of the share. The search and the conversion then take
+ * what they need of the rest; the conversion costs only its polls, since the
+ * bus is free while the probes convert.
+ */
+static String benchmarkOneWire(uint64_t shareUs)
+{
+  uint64_t mark = getUsedUs();
+  OneWireSlice slice = {};
+  while ((slice.sliceUs = nextSliceUs(shareUs / 3, mark)) > 0)
+  {
+    runSlice(DEADLINE_WORKER_ONEWIRE, oneWireResetSlice, &slice);
+  }
+  OneWireBenchmark &result = slice.result;
+  bool present = result.noPresence < result.resets;
+  while (present && !slice.done && (slice.sliceUs = nextSliceUs(shareUs, mark)) > 0)
+  {
+    runSlice(DEADLINE_WORKER_ONEWIRE, oneWireSearchSlice, &slice);
+  }
+
+  slice.done = false;
+  uint32_t conversionStart = millis();
+  while (result.devices > 0 && !slice.done && nextSliceUs(shareUs, mark) > 0 && millis() - conversionStart < BENCHMARK_CONVERSION_TIMEOUT_MS)
+  {
+    runSlice(DEADLINE_WORKER_ONEWIRE, oneWireConversionSlice, &slice);
+    if (!slice.done)
+    {
+      vTaskDelay(pdMS_TO_TICKS(BENCHMARK_POLL_MS));
+    }
+  }
+
+  String json = "{ \"resets\":" + String(result.resets) + ", ";
+  json += "\"no_presence\":" + String(result.noPresence) + ", ";
+  json += "\"reset_avg_us\":" + (result.resets > 0 ? String(result.resetTotalUs / result.resets) : String("null")) + ", ";
+  json += "\"reset_max_us\":" + String(result.resetMaxUs) + ", ";
+  json += "\"search\":{ \"devices\":" + String(result.devices) + ", ";
+  json += "\"pass_us\":" + (result.searchComplete ? String(result.searchUs) : String("null")) + " }, ";
+  json += "\"conversion\":{ \"resolution\":" + (result.conversionStarted ? String(result.resolution) : String("null")) + ", ";
+  json += "\"us\":" + (result.conversionUs > 0 ? String(result.conversionUs) : String("null")) + " } }";
+  return json;
+}
+#endif
+
+// Chips the registry holds, i.e. those the board has already driven
+struct BenchmarkChip
+{
+  uint8_t bus;
+  uint8_t address;
+};
+
+static String chipJson(const BenchmarkChip &chip)
+{
+  return "{ \"bus\":" + String(chip.bus) + ", \"address\":\"" + formatI2CDeviceAddress(chip.bus, chip.address) + "\", ";
+}
+
+static String chipErrorJson(DriverError error)
+{
+  return String("\"error\":\"") + (error == DRIVER_NOT_FOUND ? "not found" : "bus error") + "\" }";
+}
+
+#if FEATURE_PCA9685
+struct Pca9685Slice
+{
+  BenchmarkChip chip;
+  uint32_t sliceUs;
+  DriverError error;
+  Pca9685Benchmark result;
+};
+
+static void pca9685Slice(void *arg)
+{
+  Pca9685Slice *slice = (Pca9685Slice *)arg;
+  slice->error = benchmarkPCA9685(slice->chip.bus, slice->chip.address, slice->sliceUs, slice->result);
+}
+
+/**
+ * @brief Times full-chip updates on every PCA9685, writing back the duties each already has.
+ */
+static String benchmarkPca9685Chips(uint64_t shareUs)
+{
+  BenchmarkChip chips[PCA9685_SCHEDULER_MAX_CHIPS];
+  uint8_t count = 0;
+  pca9685Registry.forEach([&](uint8_t bus, uint8_t address)
+  {
+    if (count < PCA9685_SCHEDULER_MAX_CHIPS)
+    {
+      chips[count++] = {bus, address};
+    }
+  });
+
+  uint64_t mark = getUsedUs();
+  String json = "[";
+  for (uint8_t i = 0; i < count; i++)
+  {
+    Pca9685Slice slice = {chips[i], 0, DRIVER_OK, {}};
+    uint64_t chipShare = splitShare(shareUs, mark, count - i);
+    uint64_t chipMark = getUsedUs();
+    while (slice.error == DRIVER_OK && (slice.sliceUs = nextSliceUs(chipShare, chipMark)) > 0)
+    {
+      runSlice(deadlineWorkerForI2CBus(chips[i].bus), pca9685Slice, &slice);
+    }
+    if (i > 0)
+    {
+      json += ", ";
+    }
+    json += chipJson(chips[i]);
+    const Pca9685Benchmark &result = slice.result;
+    if (slice.error != DRIVER_OK)
+    {
+      json += chipErrorJson(slice.error);
+      continue;
+    }
+    json += "\"updates\":" + String(result.updates) + ", ";
+    json += "\"failed\":" + String(result.failed) + ", ";
+    json += "\"update_avg_us\":" + (result.updates > 0 ? String(result.totalUs / result.updates) : String("null")) + ", ";
+    json += "\"update_max_us\":" + String(result.maxUs) + ", ";
+    json += "\"per_second\":" + perSecond(result.updates, result.totalUs) + " }";
+  }
+  json += "]";
+  return json;
+}
+#endif
+
+#if FEATURE_ADS1115
+struct Ads1115Slice
+{
+  BenchmarkChip chip;
+  uint8_t rateIndex;
+  uint32_t sliceUs;
+  DriverError error;
+  Ads1115RateBenchmark result;
+};
+
+static void ads1115Slice(void *arg)
+{
+  Ads1115Slice *slice = (Ads1115Slice *)arg;
+  slice->error = benchmarkADS1115Rate(slice->chip.bus, slice->chip.address, slice->rateIndex, slice->sliceUs, slice->result);
+}
+
+/**
+ * @brief Measures samples per second at each data rate of every ADS1115.
+ *
+ * A slice always finishes the conversion it started, so rates slower than one
+ * conversion per slice_ms are skipped rather than let hold the bus longer.
+ */
+static String benchmarkAds1115Chips(uint64_t shareUs)
+{
+  BenchmarkChip chips[decltype(ads1115Registry)::Capacity];
+  uint8_t count = 0;
+  ads1115Registry.forEach([&](uint8_t bus, uint8_t address)
+  {
+    chips[count++] = {bus, address};
+  });
+
+  uint64_t mark = getUsedUs();
+  uint32_t sliceLimitUs = benchmarkConfig.sliceMs * 1000;
+  String json = "[";
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (i > 0)
+    {
+      json += ", ";
+    }
+    json += chipJson(chips[i]);
+    json += "\"rates\":[";
+    DriverError error = DRIVER_OK;
+    for (uint8_t rate = 0; rate < ADS1115_DATA_RATE_COUNT && error == DRIVER_OK; rate++)
+    {
+      uint16_t sps = getADS1115DataRateSps(rate);
+      uint32_t conversionUs = 1000000UL / sps;
+      Ads1115Slice slice = {chips[i], rate, 0, DRIVER_OK, {}};
+      uint64_t rateShare = splitShare(shareUs, mark, (count - i) * ADS1115_DATA_RATE_COUNT - rate);
+      uint64_t rateMark = getUsedUs();
+      const char *skipped = conversionUs > sliceLimitUs ? "slice_ms" : (conversionUs > rateShare ? "budget" : nullptr);
+      while (skipped == nullptr && slice.error == DRIVER_OK && (slice.sliceUs = nextSliceUs(rateShare, rateMark)) >= conversionUs)
+      {
+        runSlice(deadlineWorkerForI2CBus(chips[i].bus), ads1115Slice, &slice);
+      }
+      error = slice.error;
+      if (rate > 0)
+      {
+        json += ", ";
+      }
+      json += "{ \"nominal_sps\":" + String(sps) + ", ";
+      json += "\"samples\":" + String(slice.result.samples) + ", ";
+      json += "\"sps\":" + perSecond(slice.result.samples, slice.result.elapsedUs);
+      if (skipped != nullptr)
+      {
+        json += ", \"skipped\":\"" + String(skipped) + "\"";
+      }
+      json += " }";
+    }
+    json += "]";
+    if (error != DRIVER_OK)
+    {
+      json += ", " + chipErrorJson(error);
+    }
+    else
+    {
+      json += " }";
+    }
+  }
+  json += "]";
+  return json;
+}
+#endif
+
+// Writes or reads back one sector in blocks. Each block holds a single byte value, so no second buffer is needed to verify it.
+static bool transferFlashSector(const esp_partition_t *partition, size_t offset, uint8_t value, bool write)
+{
+  static uint8_t block[BENCHMARK_FLASH_BLOCK_BYTES];
+  for (size_t done = 0; done < BENCHMARK_FLASH_SECTOR_BYTES; done += sizeof(block))
+  {
+    if (write)
+    {
+      memset(block, value, sizeof(block));
+      if (esp_partition_write(partition, offset + done, block, sizeof(block)) != ESP_OK)
+      {
+        return false;
+      }
+      continue;
+    }
+    if (esp_partition_read(partition, offset + done, block, sizeof(block)) != ESP_OK)
+    {
+      return false;
+    }
+    for (size_t i = 0; i < sizeof(block); i++)
+    {
+      if (block[i] != value)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Times sector erases, writes and verified reads on the scratch partition.
+ *
+ * Sectors are taken from the end of the partition, one per cycle, and a run
+ * stops after BENCHMARK_FLASH_MAX_SECTORS of them whatever its budget.
+ */
+static String benchmarkFlash(uint64_t shareUs)
+{
+  const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BENCHMARK_FLASH_PARTITION);
+  if (partition == NULL || partition->size < BENCHMARK_FLASH_MAX_SECTORS * BENCHMARK_FLASH_SECTOR_BYTES)
+  {
+    return "{ \"partition\":null }";
+  }
+
+  uint32_t sectors = 0;
+  uint32_t failed = 0;
+  uint64_t eraseUs = 0;
+  uint64_t writeUs = 0;
+  uint64_t readUs = 0;
+  uint64_t mark = getUsedUs();
+  while (sectors + failed < BENCHMARK_FLASH_MAX_SECTORS && nextSliceUs(shareUs, mark) > 0)
+  {
+    uint32_t cycle = sectors + failed;
+    size_t offset = partition->size - (cycle + 1) * BENCHMARK_FLASH_SECTOR_BYTES;
+    uint8_t value = (uint8_t)(0xA5 ^ cycle);
+    uint32_t start = micros();
+    bool ok = esp_partition_erase_range(partition, offset, BENCHMARK_FLASH_SECTOR_BYTES) == ESP_OK;
+    uint32_t erased = micros();
+    ok = ok && transferFlashSector(partition, offset, value, true);
+    uint32_t written = micros();
+    ok = ok && transferFlashSector(partition, offset, value, false);
+    uint32_t read = micros();
+    if (ok)
+    {
+      sectors++;
+      eraseUs += erased - start;
+      writeUs += written - erased;
+      readUs += read - written;
+    }
+    else
+    {
+      failed++;
+    }
+    chargeSlice(read - start);
+  }
+
+  double kib = (double)sectors * BENCHMARK_FLASH_SECTOR_BYTES / 1024;
+  String json = "{ \"partition\":\"" + String(partition->label) + "\", ";
+  json += "\"sector_bytes\":" + String(BENCHMARK_FLASH_SECTOR_BYTES) + ", ";
+  json += "\"sectors\":" + String(sectors) + ", ";
+  json += "\"failed\":" + String(failed) + ", ";
+  json += "\"erase_avg_us\":" + (sectors > 0 ? String((uint32_t)(eraseUs / sectors)) : String("null")) + ", ";
+  json += "\"write_kib_per_second\":" + (writeUs > 0 ? String(kib * 1000000.0 / (double)writeUs, 2) : String("null")) + ", ";
+  json += "\"read_kib_per_second\":" + (readUs > 0 ? String(kib * 1000000.0 / (double)readUs, 2) : String("null")) + " }";
+  return json;
+}
+
+static void appendResult(const char *name, const String &json)
+{
+  xSemaphoreTake(resultsMutex, portMAX_DELAY);
+  if (resultsJson.length() > 0)
+  {
+    resultsJson += ", ";
+  }
+  resultsJson += "\"" + String(name) + "\":" + json;
+  xSemaphoreGive(resultsMutex);
+}
+
+/// Runs the selected tests in order, each with an even split of the budget the earlier ones left.
+static void benchmarkTask(void *param)
+{
+  uint64_t budgetUs = (uint64_t)benchmarkConfig.budgetMs * 1000;
+  uint8_t left = 0;
+  for (uint8_t i = 0; i < BENCHMARK_TEST_COUNT; i++)
+  {
+    left += (benchmarkConfig.tests >> i) & 1;
+  }
+
+  for (uint8_t i = 0; i < BENCHMARK_TEST_COUNT; i++)
+  {
+    uint8_t test = 1 << i;
+    if (!(benchmarkConfig.tests & test))
+    {
+      continue;
+    }
+    uint64_t shareUs = splitShare(budgetUs, 0, left--);
+    String json;
+    switch (test)
+    {
+    case BENCHMARK_I2C:
+      json = benchmarkI2C(shareUs);
+      break;
+#if FEATURE_DS18B20
+    case BENCHMARK_ONEWIRE:
+      json = benchmarkOneWire(shareUs);
+      break;
+#endif
+#if FEATURE_PCA9685
+    case BENCHMARK_PCA9685:
+      json = benchmarkPca9685Chips(shareUs);
+      break;
+#endif
+#if FEATURE_ADS1115
+    case BENCHMARK_ADS1115:
+      json = benchmarkAds1115Chips(shareUs);
+      break;
+#endif
+    case BENCHMARK_FLASH:
+      json = benchmarkFlash(shareUs);
+      break;
+    default:
+      json = "null";
+      break;
+    }
+    appendResult(BENCHMARK_TEST_NAMES[i], json);
+  }
+
+  portENTER_CRITICAL(&benchmarkMux);
+  elapsedMs = millis() - startedMs;
+  benchmarkState = BENCHMARK_DONE;
+  uint32_t usedMs = (uint32_t)(usedUs / 1000);
+  portEXIT_CRITICAL(&benchmarkMux);
+  logInfo("Benchmark used %u ms of bus time", (unsigned)usedMs);
+  vTaskDelete(NULL);
+}
+
+/**
+ * @brief Starts a benchmark run in the background.
+ *
+ * Every bus slice runs on that bus's sensor read worker, so reads are never
+ * interleaved with benchmark traffic and wait at most one slice for it.
+ * @return false if a run is already going.
+ */
+bool startBenchmark(const BenchmarkConfig &config)
+{
+  if (resultsMutex == NULL)
+  {
+    resultsMutex = xSemaphoreCreateMutex();
+  }
+  portENTER_CRITICAL(&benchmarkMux);
+  if (benchmarkState == BENCHMARK_RUNNING)
+  {
+    portEXIT_CRITICAL(&benchmarkMux);
+    return false;
+  }
+  benchmarkState = BENCHMARK_RUNNING;
+  benchmarkConfig = config;
+  benchmarkConfig.tests &= BENCHMARK_AVAILABLE_TESTS;
+  usedUs = 0;
+  skippedSlices = 0;
+  startedMs = millis();
+  portEXIT_CRITICAL(&benchmarkMux);
+
+  xSemaphoreTake(resultsMutex, portMAX_DELAY);
+  resultsJson = "";
+  xSemaphoreGive(resultsMutex);
+  logInfo("Benchmark started, budget %u ms", (unsigned)config.budgetMs);
+  xTaskCreatePinnedToCore(benchmarkTask, "benchmark", 4096, NULL, 1, NULL, 1);
+  return true;
+}
+
+/**
+ * @brief Reports the running or last run, with the results of the tests finished so far.
+ */
+String getBenchmarkJson()
+{
+  portENTER_CRITICAL(&benchmarkMux);
+  BenchmarkState state = benchmarkState;
+  BenchmarkConfig config = benchmarkConfig;
+  uint64_t used = usedUs;
+  uint32_t skipped = skippedSlices;
+  uint32_t elapsed = state == BENCHMARK_RUNNING ? millis() - startedMs : elapsedMs;
+  portEXIT_CRITICAL(&benchmarkMux);
+
+  static const char *const STATE_NAMES[] = {"idle", "running", "done"};
+  String json = "{ \"state\":\"" + String(STATE_NAMES[state]) + "\"";
+  if (state == BENCHMARK_IDLE)
+  {
+    return json + " }";
+  }
+  json += ", \"budget_ms\":" + String(config.budgetMs) + ", ";
+  json += "\"slice_ms\":" + String(config.sliceMs) + ", ";
+  json += "\"tests\":[";
+  bool first = true;
+  for (uint8_t i = 0; i < BENCHMARK_TEST_COUNT; i++)
+  {
+    if (config.tests & (1 << i))
+    {
+      json += String(first ? "" : ",") + "\"" + BENCHMARK_TEST_NAMES[i] + "\"";
+      first = false;
+    }
+  }
+  json += "], ";
+  json += "\"used_ms\":" + String((uint32_t)(used / 1000)) + ", ";
+  json += "\"elapsed_ms\":" + String(elapsed) + ", ";
+  json += "\"skipped_slices\":" + String(skipped) + ", ";
+  xSemaphoreTake(resultsMutex, portMAX_DELAY);
+  json += "\"results\":{ " + resultsJson + " } }";
+  xSemaphoreGive(resultsMutex);
+  return json;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Bus and flash time a run may take in all, shared out between its tests
+#define BENCHMARK_DEFAULT_BUDGET_MS 2000
+#define BENCHMARK_MAX_BUDGET_MS 30000
+// The longest a run holds a bus at a stretch, and so the most it delays one sensor read
+#define BENCHMARK_DEFAULT_SLICE_MS 20
+#define BENCHMARK_MIN_SLICE_MS 2
+#define BENCHMARK_MAX_SLICE_MS 250
+// Responding I2C addresses timed per bus; the scan covers 0x08-0x77 but for PCA9685 ALL_CALL and group addresses
+#define BENCHMARK_MAX_I2C_DEVICES 16
+// The flash test erases and rewrites sectors of this data partition, which the default table
+// provides and this firmware never mounts; NVS, where the settings live, is left alone
+#define BENCHMARK_FLASH_PARTITION "spiffs"
+#define BENCHMARK_FLASH_SECTOR_BYTES 4096
+#define BENCHMARK_FLASH_BLOCK_BYTES 1024
+// Sectors cycled per run, each a different one, so a run costs a sector one of its ~100k erases
+#define BENCHMARK_FLASH_MAX_SECTORS 8
+
+enum BenchmarkTest : uint8_t
+{
+  BENCHMARK_I2C = 0x01,
+  BENCHMARK_ONEWIRE = 0x02,
+  BENCHMARK_PCA9685 = 0x04,
+  BENCHMARK_ADS1115 = 0x08,
+  BENCHMARK_FLASH = 0x10,
+};
+#define BENCHMARK_ALL_TESTS 0x1F
+
+enum BenchmarkState : uint8_t
+{
+  BENCHMARK_IDLE = 0,
+  BENCHMARK_RUNNING,
+  BENCHMARK_DONE
+};
+
+struct BenchmarkConfig
+{
+  uint32_t budgetMs;
+  uint32_t sliceMs;
+  uint8_t tests; // BenchmarkTest bits
+};
+
+uint8_t parseBenchmarkTest(const char *name);
+bool startBenchmark(const BenchmarkConfig &config);
+String getBenchmarkJson();
@@ -0,0 +1,83 @@
+#include "cpuUtils.h"
+
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+
+// Idle time is sampled from each core's tick interrupt: on every tick we note
+// whether that core's idle task was the one running. Windows are measured in
+// wall-clock time, so ticks skipped during tickless light sleep count as idle
+// (and as not awake) rather than disappearing from the sample.
+static const int64_t IDLE_WINDOW_US = 1000000;
+
+struct CpuIdleCounters
+{
+  int64_t windowStart;
+  uint32_t ticks;
+  uint32_t idleTicks;
+  uint8_t idlePercent;
+  uint8_t awakePercent;
+};
+static volatile CpuIdleCounters cpuIdleCounters[portNUM_PROCESSORS];
+
+static void IRAM_ATTR sampleIdle(uint8_t core)
+{
+  volatile CpuIdleCounters &counters = cpuIdleCounters[core];
+  counters.ticks++;
+  if (xTaskGetCurrentTaskHandleForCPU(core) == xTaskGetIdleTaskHandleForCPU(core))
+  {
+    counters.idleTicks++;
+  }
+
+  int64_t now = esp_timer_get_time();
+  int64_t elapsed = now - counters.windowStart;
+  if (elapsed >= IDLE_WINDOW_US)
+  {
+    uint32_t expectedTicks = (uint32_t)(elapsed * configTICK_RATE_HZ / 1000000);
+    uint32_t busyPercent = (counters.ticks - counters.idleTicks) * 100 / expectedTicks;
+    uint32_t awakePercent = counters.ticks * 100 / expectedTicks;
+    counters.idlePercent = busyPercent >= 100 ? 0 : 100 - busyPercent;
+    counters.awakePercent = awakePercent > 100 ? 100 : awakePercent;
+    counters.windowStart = now;
+    counters.ticks = 0;
+    counters.idleTicks = 0;
+  }
+}
+
+static void IRAM_ATTR sampleIdleCore0() { sampleIdle(0); }
+#if portNUM_PROCESSORS > 1
+static void IRAM_ATTR sampleIdleCore1() { sampleIdle(1); }
+#endif
+
+/**
+ * @brief Registers the per-core tick hooks that sample idle time.
+ */
+void beginCpuIdleMonitor()
+{
+  esp_register_freertos_tick_hook_for_cpu(sampleIdleCore0, 0);
+#if portNUM_PROCESSORS > 1
+  esp_register_freertos_tick_hook_for_cpu(sampleIdleCore1, 1);
+#endif
+}
+
+/**
+ * @brief Returns the share of the last complete one-second window a core spent idle.
+ *
+ * Idle includes time spent in light sleep.
+ *
+ * @param core Core index.
+ * @return Idle percentage (0-100).
+ */
+uint8_t getCpuIdlePercent(uint8_t core)
+{
+  return core < portNUM_PROCESSORS ? cpuIdleCounters[core].idlePercent : 0;
+}
+
+/**
+ * @brief Returns the share of the last complete one-second window a core was not in light sleep.
+ * @param core Core index.
+ * @return Awake percentage (0-100). Always 100 when light sleep is off.
+ */
+uint8_t getCpuAwakePercent(uint8_t core)
+{
+  return core < portNUM_PROCESSORS ? cpuIdleCounters[core].awakePercent : 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <Arduino.h>
+
+void beginCpuIdleMonitor();
+uint8_t getCpuIdlePercent(uint8_t core);
+uint8_t getCpuAwakePercent(uint8_t core);
@@ -0,0 +1,437 @@
+#include "deadlineUtils.h"
+
+#include "utils/traceUtils.h"
+
+enum DeadlineChannelState : uint8_t
+{
+  CHANNEL_FREE = 0,
+  CHANNEL_IDLE,
+  CHANNEL_QUEUED,
+  CHANNEL_RUNNING
+};
+
+struct DeadlineChannel
+{
+  DeadlineChannelState state;
+  uint8_t worker;
+  bool hasReading;
+  DriverError lastError;
+  uint32_t completed; // refreshes finished, good or not
+  uint32_t lastUsedMs;
+  TaskHandle_t waiter;
+  DeadlineReadFunction read;
+  char key[DEADLINE_KEY_LENGTH];
+  alignas(8) uint8_t params[DEADLINE_PARAMS_BYTES];
+  alignas(8) uint8_t reading[DEADLINE_READING_BYTES]; // last good
+};
+
+enum DeadlineJobState : uint8_t
+{
+  JOB_FREE = 0,
+  JOB_CLAIMED, // being filled in by the poster; not visible to the worker yet
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE
+};
+
+// Jobs run in the order they were posted, and only when none of their worker's channels is queued.
+// Completion is signalled on the slot's own semaphore, never through the poster's task notification,
+// which the loop task uses for its event bits.
+struct DeadlineJob
+{
+  DeadlineJobState state;
+  bool waiting; // the poster still wants the result; otherwise the worker frees the slot
+  uint8_t worker;
+  uint32_t sequence;
+  DeadlineJobFunction run;
+  SemaphoreHandle_t done;
+  alignas(8) uint8_t arg[DEADLINE_JOB_ARG_BYTES];
+};
+
+static DeadlineChannel channels[DEADLINE_CHANNELS];
+static TaskHandle_t workers[DEADLINE_WORKERS] = {};
+static DeadlineJob jobs[DEADLINE_JOB_SLOTS] = {};
+static uint32_t jobSequence = 0;
+static DeadlineStats stats = {};
+static portMUX_TYPE deadlineMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Takes the oldest-used queued channel of a worker and marks it running. Call with deadlineMux held.
+static DeadlineChannel *takeQueuedChannel(uint8_t worker)
+{
+  DeadlineChannel *next = nullptr;
+  for (uint8_t i = 0; i < DEADLINE_CHANNELS; i++)
+  {
+    DeadlineChannel &channel = channels[i];
+    if (channel.state == CHANNEL_QUEUED && channel.worker == worker &&
+        (next == nullptr || (int32_t)(channel.lastUsedMs - next->lastUsedMs) < 0))
+    {
+      next = &channel;
+    }
+  }
+  if (next != nullptr)
+  {
+    next->state = CHANNEL_RUNNING;
+  }
+  return next;
+}
+
+// Takes the earliest posted queued job of a worker and marks it running. Call with deadlineMux held.
+static DeadlineJob *takeQueuedJob(uint8_t worker)
+{
+  DeadlineJob *next = nullptr;
+  for (uint8_t i = 0; i < DEADLINE_JOB_SLOTS; i++)
+  {
+    DeadlineJob &job = jobs[i];
+    if (job.state == JOB_QUEUED && job.worker == worker &&
+        (next == nullptr || (int32_t)(job.sequence - next->sequence) < 0))
+    {
+      next = &job;
+    }
+  }
+  if (next != nullptr)
+  {
+    next->state = JOB_RUNNING;
+  }
+  return next;
+}
+
+static void refreshChannel(DeadlineChannel &channel)
+{
+  // Only this worker touches a running channel's params and read function
+  alignas(8) uint8_t reading[DEADLINE_READING_BYTES];
+  DriverError error;
+  {
+    TRACE_SCOPE("deadline.refresh");
+    error = channel.read(channel.params, reading);
+  }
+
+  portENTER_CRITICAL(&deadlineMux);
+  if (error == DRIVER_OK)
+  {
+    memcpy(channel.reading, reading, sizeof(reading));
+    channel.hasReading = true;
+  }
+  channel.lastError = error;
+  channel.completed++;
+  channel.state = CHANNEL_IDLE;
+  TaskHandle_t waiter = channel.waiter;
+  channel.waiter = NULL;
+  stats.refreshes++;
+  portEXIT_CRITICAL(&deadlineMux);
+
+  if (waiter != NULL)
+  {
+    xTaskNotifyGive(waiter);
+  }
+}
+
+/// Sleeps until a channel or job is queued, then refreshes queued channels in the order they were asked
+/// for. A job runs once no channel is waiting, so it delays a read by at most its own length.
+static void deadlineWorkerTask(void *param)
+{
+  uint8_t worker = (uint8_t)(uintptr_t)param;
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (true)
+    {
+      portENTER_CRITICAL(&deadlineMux);
+      DeadlineChannel *channel = takeQueuedChannel(worker);
+      DeadlineJob *job = channel == nullptr ? takeQueuedJob(worker) : nullptr;
+      portEXIT_CRITICAL(&deadlineMux);
+      if (channel != nullptr)
+      {
+        refreshChannel(*channel);
+        continue;
+      }
+      if (job == nullptr)
+      {
+        break;
+      }
+      {
+        TRACE_SCOPE("deadline.job");
+        job->run(job->arg);
+      }
+      portENTER_CRITICAL(&deadlineMux);
+      bool waiting = job->waiting;
+      job->state = waiting ? JOB_DONE : JOB_FREE;
+      portEXIT_CRITICAL(&deadlineMux);
+      if (waiting)
+      {
+        xSemaphoreGive(job->done);
+      }
+    }
+  }
+}
+
+// Workers start on first use. Handlers and the benchmark task can both get here, so the loser of a race deletes its task.
+static TaskHandle_t startWorker(uint8_t worker)
+{
+  portENTER_CRITICAL(&deadlineMux);
+  TaskHandle_t handle = workers[worker];
+  portEXIT_CRITICAL(&deadlineMux);
+  if (handle != NULL)
+  {
+    return handle;
+  }
+
+  TaskHandle_t created = NULL;
+  xTaskCreatePinnedToCore(deadlineWorkerTask, "sensorRead", 4096, (void *)(uintptr_t)worker, 2, &created, 1);
+  portENTER_CRITICAL(&deadlineMux);
+  if (workers[worker] == NULL)
+  {
+    workers[worker] = created;
+  }
+  handle = workers[worker];
+  portEXIT_CRITICAL(&deadlineMux);
+  if (handle != created)
+  {
+    vTaskDelete(created);
+  }
+  return handle;
+}
+
+// Finds the key's channel, or claims a free or the least recently used idle one. Call with deadlineMux held.
+static DeadlineChannel *findChannel(const char *key, uint8_t worker)
+{
+  DeadlineChannel *reuse = nullptr;
+  for (uint8_t i = 0; i < DEADLINE_CHANNELS; i++)
+  {
+    DeadlineChannel &channel = channels[i];
+    if (channel.state != CHANNEL_FREE && strcmp(channel.key, key) == 0)
+    {
+      return &channel;
+    }
+    if (channel.state == CHANNEL_FREE)
+    {
+      if (reuse == nullptr || reuse->state != CHANNEL_FREE)
+      {
+        reuse = &channel;
+      }
+    }
+    else if (channel.state == CHANNEL_IDLE && (reuse == nullptr || (reuse->state == CHANNEL_IDLE && (int32_t)(channel.lastUsedMs - reuse->lastUsedMs) < 0)))
+    {
+      reuse = &channel;
+    }
+  }
+  if (reuse == nullptr)
+  {
+    return nullptr;
+  }
+  reuse->state = CHANNEL_IDLE;
+  reuse->worker = worker;
+  reuse->hasReading = false;
+  reuse->lastError = DRIVER_OK;
+  reuse->completed = 0;
+  reuse->waiter = NULL;
+  strncpy(reuse->key, key, DEADLINE_KEY_LENGTH - 1);
+  reuse->key[DEADLINE_KEY_LENGTH - 1] = '\0';
+  return reuse;
+}
+
+/**
+ * @brief Reads a channel on its bus's worker, waiting at most deadlineMs for the result.
+ *
+ * A request for a channel whose refresh is already queued or running waits
+ * for that refresh rather than starting another. If the refresh misses the
+ * deadline, the channel's last good reading is returned marked stale and the
+ * refresh carries on, so the next request is likely to find it done. A failed
+ * refresh returns its error as before.
+ *
+ * @param key Names the channel and every parameter that changes its value, such as an ADS1115 gain.
+ * @param read Called on the worker with a copy of params.
+ * @param deadlineMs 0 to wait for as long as the read takes.
+ */
+DeadlineRead readWithDeadline(const char *key, uint8_t worker, DeadlineReadFunction read,
+                              const void *params, size_t paramsSize, void *reading, size_t readingSize, uint32_t deadlineMs)
+{
+  DeadlineRead result = {DRIVER_OK, false};
+  if (worker >= DEADLINE_WORKERS || paramsSize > DEADLINE_PARAMS_BYTES || readingSize > DEADLINE_READING_BYTES)
+  {
+    result.error = DRIVER_INVALID_ARGUMENT;
+    return result;
+  }
+
+  TaskHandle_t workerTask = startWorker(worker);
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  uint32_t start = millis();
+  portENTER_CRITICAL(&deadlineMux);
+  DeadlineChannel *channel = findChannel(key, worker);
+  if (channel == nullptr)
+  {
+    portEXIT_CRITICAL(&deadlineMux);
+    // Every channel is waiting on a refresh; the buses are too far behind to take more
+    result.error = DRIVER_TIMEOUT;
+    return result;
+  }
+  channel->lastUsedMs = start;
+  uint32_t target = channel->completed + 1;
+  bool queue = channel->state == CHANNEL_IDLE;
+  if (queue)
+  {
+    channel->read = read;
+    memcpy(channel->params, params, paramsSize);
+    channel->state = CHANNEL_QUEUED;
+  }
+  channel->waiter = self;
+  portEXIT_CRITICAL(&deadlineMux);
+
+  if (queue)
+  {
+    xTaskNotifyGive(workerTask);
+  }
+
+  // Wake-ups can be left over from earlier waits, so the count is checked after each one
+  TRACE_BEGIN("deadline.wait");
+  while (true)
+  {
+    portENTER_CRITICAL(&deadlineMux);
+    bool done = (int32_t)(channel->completed - target) >= 0;
+    portEXIT_CRITICAL(&deadlineMux);
+
+    uint32_t elapsed = millis() - start;
+    if (done || (deadlineMs > 0 && elapsed >= deadlineMs))
+    {
+      break;
+    }
+    ulTaskNotifyTake(pdTRUE, deadlineMs > 0 ? pdMS_TO_TICKS(deadlineMs - elapsed) : portMAX_DELAY);
+  }
+  TRACE_END("deadline.wait");
+
+  // Handlers run one at a time, so the channel cannot have been reused while this one waited
+  portENTER_CRITICAL(&deadlineMux);
+  if (channel->waiter == self)
+  {
+    channel->waiter = NULL;
+  }
+  if ((int32_t)(channel->completed - target) >= 0)
+  {
+    result.error = channel->lastError;
+    if (result.error == DRIVER_OK)
+    {
+      memcpy(reading, channel->reading, readingSize);
+    }
+    stats.fresh++;
+  }
+  else if (channel->hasReading)
+  {
+    memcpy(reading, channel->reading, readingSize);
+    result.stale = true;
+    stats.stale++;
+  }
+  else
+  {
+    result.error = DRIVER_TIMEOUT;
+    stats.timeouts++;
+  }
+  portEXIT_CRITICAL(&deadlineMux);
+  return result;
+}
+
+// Claims a free slot, fills it in and wakes the worker. waiting says whether the poster will collect the result.
+static DeadlineJob *queueJob(uint8_t worker, DeadlineJobFunction job, const void *arg, size_t argSize, bool waiting)
+{
+  if (worker >= DEADLINE_WORKERS || argSize > DEADLINE_JOB_ARG_BYTES)
+  {
+    return nullptr;
+  }
+  TaskHandle_t workerTask = startWorker(worker);
+
+  DeadlineJob *slot = nullptr;
+  portENTER_CRITICAL(&deadlineMux);
+  for (uint8_t i = 0; i < DEADLINE_JOB_SLOTS && slot == nullptr; i++)
+  {
+    if (jobs[i].state == JOB_FREE)
+    {
+      slot = &jobs[i];
+      slot->state = JOB_CLAIMED;
+    }
+  }
+  portEXIT_CRITICAL(&deadlineMux);
+  if (slot == nullptr)
+  {
+    return nullptr;
+  }
+
+  // A slot's semaphore is made by its first poster and kept; one left given by a job that finished
+  // just after its poster stopped waiting is cleared here
+  if (slot->done == NULL)
+  {
+    slot->done = xSemaphoreCreateBinary();
+  }
+  xSemaphoreTake(slot->done, 0);
+  slot->worker = worker;
+  slot->run = job;
+  slot->waiting = waiting;
+  memcpy(slot->arg, arg, argSize);
+  portENTER_CRITICAL(&deadlineMux);
+  slot->sequence = jobSequence++;
+  slot->state = JOB_QUEUED;
+  portEXIT_CRITICAL(&deadlineMux);
+  xTaskNotifyGive(workerTask);
+  return slot;
+}
+
+/**
+ * @brief Runs job on a bus's worker and waits up to timeoutMs for it to finish.
+ *
+ * The job goes after every read and job already queued on the worker, and
+ * reads queued while it runs wait for it, so it should be kept short. It is
+ * how anything other than a read reaches a bus: configuration changes as well
+ * as benchmark slices.
+ *
+ * arg is copied into the job's slot, and the job runs on that copy. Once the
+ * job finishes in time the copy is written back to arg, so results come back
+ * the same way parameters went in. A job that times out keeps its slot until it
+ * finishes, and its result is dropped.
+ *
+ * @param argSize At most DEADLINE_JOB_ARG_BYTES; arg must be safe to copy with memcpy.
+ * @param timeoutMs 0 to wait for as long as the job takes, which needs arg's own pointers to outlive it.
+ */
+DeadlineJobResult runOnDeadlineWorker(uint8_t worker, DeadlineJobFunction job, void *arg, size_t argSize, uint32_t timeoutMs)
+{
+  DeadlineJob *slot = queueJob(worker, job, arg, argSize, true);
+  if (slot == nullptr)
+  {
+    return DEADLINE_JOB_BUSY;
+  }
+
+  TRACE_BEGIN("deadline.job.wait");
+  xSemaphoreTake(slot->done, timeoutMs > 0 ? pdMS_TO_TICKS(timeoutMs) : portMAX_DELAY);
+  TRACE_END("deadline.job.wait");
+
+  portENTER_CRITICAL(&deadlineMux);
+  bool done = slot->state == JOB_DONE;
+  if (done)
+  {
+    memcpy(arg, slot->arg, argSize);
+    slot->state = JOB_FREE;
+  }
+  else
+  {
+    slot->waiting = false;
+  }
+  portEXIT_CRITICAL(&deadlineMux);
+  return done ? DEADLINE_JOB_DONE : DEADLINE_JOB_TIMEOUT;
+}
+
+/**
+ * @brief Queues job on a bus's worker without waiting for it.
+ *
+ * For callers that must not block, such as the loop task. arg is copied as for
+ * runOnDeadlineWorker(), and the slot is freed when the job finishes.
+ *
+ * @return false if every job slot is taken, in which case the job will not run.
+ */
+bool postToDeadlineWorker(uint8_t worker, DeadlineJobFunction job, const void *arg, size_t argSize)
+{
+  return queueJob(worker, job, arg, argSize, false) != nullptr;
+}
+
+DeadlineStats getDeadlineStats()
+{
+  portENTER_CRITICAL(&deadlineMux);
+  DeadlineStats snapshot = stats;
+  portEXIT_CRITICAL(&deadlineMux);
+  return snapshot;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "utils/driverError.h"
+#include "utils/i2cUtils.h"
+
+// Channels whose last good reading is kept; the least recently used idle one is reused
+#define DEADLINE_CHANNELS 32
+#define DEADLINE_KEY_LENGTH 32
+#define DEADLINE_PARAMS_BYTES 24
+#define DEADLINE_READING_BYTES 64
+// Longest ?deadline_ms= a request may ask for
+#define DEADLINE_MAX_MS 30000
+
+// One refresh worker for the 1-Wire bus and one per I2C bus, so a hung bus only stalls its own devices
+#define DEADLINE_WORKER_ONEWIRE 0
+#define DEADLINE_WORKERS (1 + I2C_BUS_COUNT)
+// Jobs waiting or running across all workers; one per task that posts them is enough
+#define DEADLINE_JOB_SLOTS 4
+// A job's argument is copied into its slot, so a caller that stops waiting leaves nothing dangling
+#define DEADLINE_JOB_ARG_BYTES 128
+// How long a handler waits for a configuration job; below the async_tcp task's 5 s watchdog
+#define DEADLINE_JOB_TIMEOUT_MS 2000
+
+inline uint8_t deadlineWorkerForI2CBus(uint8_t bus)
+{
+  return 1 + bus;
+}
+
+/**
+ * @brief Reads one channel. params and reading point at the caller's own types.
+ */
+typedef DriverError (*DeadlineReadFunction)(const void *params, void *reading);
+
+/**
+ * @brief Work other than a read that has to share a bus with the sensors, such as a configuration change or benchmark slice.
+ */
+typedef void (*DeadlineJobFunction)(void *arg);
+
+/**
+ * @brief How a read with a deadline ended.
+ *
+ * With stale set, the reading is the channel's last good one, because the
+ * refresh did not finish in time; it goes on in the background. error is
+ * DRIVER_TIMEOUT when there was no good reading to fall back on.
+ */
+struct DeadlineRead
+{
+  DriverError error;
+  bool stale;
+};
+
+/**
+ * @brief How a job posted with runOnDeadlineWorker() ended.
+ *
+ * On DEADLINE_JOB_TIMEOUT the job is still queued or running, and finishes on
+ * its own; only its result is lost.
+ */
+enum DeadlineJobResult : uint8_t
+{
+  DEADLINE_JOB_DONE = 0,
+  DEADLINE_JOB_BUSY,   // every job slot is taken; the job did not run
+  DEADLINE_JOB_TIMEOUT // the job did not finish within the caller's timeout
+};
+
+struct DeadlineStats
+{
+  uint32_t fresh;
+  uint32_t stale;
+  uint32_t timeouts;
+  uint32_t refreshes;
+};
+
+DeadlineRead readWithDeadline(const char *key, uint8_t worker, DeadlineReadFunction read,
+                              const void *params, size_t paramsSize, void *reading, size_t readingSize, uint32_t deadlineMs);
+DeadlineJobResult runOnDeadlineWorker(uint8_t worker, DeadlineJobFunction job, void *arg, size_t argSize, uint32_t timeoutMs);
+bool postToDeadlineWorker(uint8_t worker, DeadlineJobFunction job, const void *arg, size_t argSize);
+DeadlineStats getDeadlineStats();
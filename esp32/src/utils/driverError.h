@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Outcome of a sensor or output driver call.
+ *
+ * Drivers fill in a typed result and return one of these. Wording and HTTP
+ * status are chosen by the handlers, through sendDriverError().
+ */
+enum DriverError : uint8_t
+{
+  DRIVER_OK = 0,
+  DRIVER_INVALID_ARGUMENT, // a parameter the device cannot take
+  DRIVER_NOT_FOUND,        // nothing answered at the address
+  DRIVER_BUS_ERROR,        // the device answered, then a transfer or conversion failed
+  DRIVER_CONFLICT,         // the address is already used by another device or group
+  DRIVER_NOT_CONFIGURED,   // the target, such as an output group, has not been set up
+  DRIVER_TIMEOUT           // no reading within the caller's deadline
+};
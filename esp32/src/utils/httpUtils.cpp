@@ -0,0 +1,209 @@
+#include "httpUtils.h"
+
+#include <time.h>
+
+// Any earlier time means SNTP has not set the clock yet
+static const time_t WALL_CLOCK_VALID_AFTER = 1577836800; // 2020-01-01
+
+// Recently seen client endpoints; a request from an endpoint not in the list opened a new connection
+#define HTTP_TRACKED_CONNECTIONS 8
+
+struct HttpConnection
+{
+  uint32_t ip;
+  uint16_t port;
+};
+
+struct HttpCounters
+{
+  uint32_t requests;
+  uint32_t connections;
+  uint32_t notModified;
+  uint32_t windowStart;
+  uint32_t windowRequests;
+  uint32_t requestsPerSecond;
+};
+static HttpCounters httpCounters;
+static HttpConnection recentConnections[HTTP_TRACKED_CONNECTIONS];
+static uint8_t nextConnection = 0;
+static portMUX_TYPE httpCountersMux = portMUX_INITIALIZER_UNLOCKED;
+// Resources are marked changed from the sensor workers and the loop as well as the handlers
+static portMUX_TYPE httpCacheMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Distinguishes ETags across reboots, when version counters start over
+static uint32_t bootId = 0;
+
+/**
+ * @brief Bumps a resource's version and records when it changed.
+ */
+void markHttpResourceChanged(HttpCacheState &state)
+{
+  time_t now = time(nullptr);
+  portENTER_CRITICAL(&httpCacheMux);
+  state.version++;
+  state.lastModified = now > WALL_CLOCK_VALID_AFTER ? now : 0;
+  portEXIT_CRITICAL(&httpCacheMux);
+}
+
+// Copies version and lastModified together, so the ETag and Last-Modified sent describe the same change
+static HttpCacheState snapshotCacheState(const HttpCacheState &state)
+{
+  portENTER_CRITICAL(&httpCacheMux);
+  HttpCacheState snapshot = state;
+  portEXIT_CRITICAL(&httpCacheMux);
+  return snapshot;
+}
+
+/**
+ * @brief Counts a request, and a connection setup if it arrived on a new client endpoint.
+ *
+ * Also applies the idle limit, so a client that keeps the socket open without
+ * sending anything cannot hold one of lwIP's few PCBs indefinitely.
+ */
+void recordHttpRequest(AsyncWebServerRequest *request)
+{
+  AsyncClient *client = request->client();
+  client->setRxTimeout(HTTP_IDLE_TIMEOUT_S);
+  uint32_t ip = (uint32_t)client->remoteIP();
+  uint16_t port = client->remotePort();
+
+  uint32_t now = millis();
+  portENTER_CRITICAL(&httpCountersMux);
+  httpCounters.requests++;
+  bool known = false;
+  for (uint8_t i = 0; i < HTTP_TRACKED_CONNECTIONS && !known; i++)
+  {
+    known = recentConnections[i].ip == ip && recentConnections[i].port == port;
+  }
+  if (!known)
+  {
+    httpCounters.connections++;
+    recentConnections[nextConnection].ip = ip;
+    recentConnections[nextConnection].port = port;
+    nextConnection = (nextConnection + 1) % HTTP_TRACKED_CONNECTIONS;
+  }
+  uint32_t elapsed = now - httpCounters.windowStart;
+  if (elapsed >= 1000)
+  {
+    httpCounters.requestsPerSecond = (uint32_t)((uint64_t)httpCounters.windowRequests * 1000 / elapsed);
+    httpCounters.windowStart = now;
+    httpCounters.windowRequests = 0;
+  }
+  httpCounters.windowRequests++;
+  portEXIT_CRITICAL(&httpCountersMux);
+}
+
+/**
+ * @brief Returns request and connection totals and the rate over the last complete one-second window.
+ */
+HttpStats getHttpStats()
+{
+  HttpStats stats;
+  portENTER_CRITICAL(&httpCountersMux);
+  stats.requests = httpCounters.requests;
+  stats.connections = httpCounters.connections;
+  stats.notModified = httpCounters.notModified;
+  stats.requestsPerSecond = httpCounters.requestsPerSecond;
+  portEXIT_CRITICAL(&httpCountersMux);
+  return stats;
+}
+
+static String etagFor(const HttpCacheState &state)
+{
+  if (bootId == 0)
+  {
+    bootId = esp_random() | 1;
+  }
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%08lx-%lu\"", (unsigned long)bootId, (unsigned long)state.version);
+  return String(etag);
+}
+
+static String httpDate(time_t t)
+{
+  char date[32];
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return String(date);
+}
+
+static void addCacheHeaders(AsyncWebServerResponse *response, const HttpCacheState &state)
+{
+  response->addHeader("ETag", etagFor(state));
+  if (state.lastModified != 0)
+  {
+    response->addHeader("Last-Modified", httpDate(state.lastModified));
+  }
+  // Clients may store the response but must revalidate it on every use
+  response->addHeader("Cache-Control", "no-cache");
+}
+
+/**
+ * @brief Answers 304 if the client's cached copy is still current.
+ *
+ * If-None-Match takes precedence; If-Modified-Since is only used when the client
+ * sent no ETag and the resource has a wall-clock modification time.
+ *
+ * @return true if a 304 was sent and the handler should return without building a body.
+ */
+bool sendIfNotModified(AsyncWebServerRequest *request, const HttpCacheState &resource)
+{
+  HttpCacheState state = snapshotCacheState(resource);
+  bool current = false;
+  if (request->hasHeader("If-None-Match"))
+  {
+    current = request->header("If-None-Match") == etagFor(state);
+  }
+  else if (request->hasHeader("If-Modified-Since") && state.lastModified != 0)
+  {
+    current = request->header("If-Modified-Since") == httpDate(state.lastModified);
+  }
+  if (!current)
+  {
+    return false;
+  }
+
+  AsyncWebServerResponse *response = request->beginResponse(304);
+  addCacheHeaders(response, state);
+  request->send(response);
+
+  portENTER_CRITICAL(&httpCountersMux);
+  httpCounters.notModified++;
+  portEXIT_CRITICAL(&httpCountersMux);
+  return true;
+}
+
+/**
+ * @brief Sends a JSON response carrying the resource's validators.
+ */
+void sendCacheable(AsyncWebServerRequest *request, int code, const String &json, const HttpCacheState &state)
+{
+  AsyncWebServerResponse *response = request->beginResponse(code, "application/json", json);
+  addCacheHeaders(response, snapshotCacheState(state));
+  request->send(response);
+}
+
+/**
+ * @brief Sends a driver failure as { "error":message, "code":name } with a status that matches it.
+ *
+ * A device that is absent is 404; one that answered and then failed is 502,
+ * since the request itself was fine and the fault is downstream of the board.
+ * A read that missed the caller's deadline with nothing to fall back on is 504.
+ */
+void sendDriverError(AsyncWebServerRequest *request, DriverError error, const String &message)
+{
+  int status;
+  const char *code;
+  switch (error)
+  {
+  case DRIVER_INVALID_ARGUMENT: status = 400; code = "invalid_argument"; break;
+  case DRIVER_NOT_FOUND: status = 404; code = "not_found"; break;
+  case DRIVER_BUS_ERROR: status = 502; code = "bus_error"; break;
+  case DRIVER_CONFLICT: status = 409; code = "conflict"; break;
+  case DRIVER_NOT_CONFIGURED: status = 404; code = "not_configured"; break;
+  case DRIVER_TIMEOUT: status = 504; code = "timeout"; break;
+  default: status = 500; code = "internal"; break;
+  }
+  request->send(status, "application/json", "{\"error\":\"" + message + "\", \"code\":\"" + code + "\"}");
+}
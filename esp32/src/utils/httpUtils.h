@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "utils/driverError.h"
+
+// Idle time before an open client connection is dropped
+#define HTTP_IDLE_TIMEOUT_S 5
+
+struct HttpStats
+{
+  uint32_t requests;
+  uint32_t connections;
+  uint32_t notModified;
+  uint32_t requestsPerSecond;
+};
+
+/**
+ * @brief Change tracking for a cacheable resource.
+ *
+ * version is bumped whenever the resource's representation changes, and
+ * becomes the ETag. lastModified is wall-clock time, 0 until the clock is set.
+ */
+struct HttpCacheState
+{
+  uint32_t version;
+  time_t lastModified;
+};
+
+void markHttpResourceChanged(HttpCacheState &state);
+
+void recordHttpRequest(AsyncWebServerRequest *request);
+HttpStats getHttpStats();
+
+bool sendIfNotModified(AsyncWebServerRequest *request, const HttpCacheState &state);
+void sendCacheable(AsyncWebServerRequest *request, int code, const String &json, const HttpCacheState &state);
+
+void sendDriverError(AsyncWebServerRequest *request, DriverError error, const String &message);
@@ -1,5 +1,30 @@
 #include "i2cUtils.h"
 
+#include <Preferences.h>
+#include "logUtils.h"
+#include "traceUtils.h"
+
+// ===== Hardware Config =====
+// Bus 0 uses the devkit's default I2C pins. Bus 1 stays off until pins are configured.
+static const I2CBusConfig defaultBusConfigs[I2C_BUS_COUNT] = {
+    {21, 22, 100000},
+    {-1, -1, 100000},
+};
+
+static I2CBusConfig busConfigs[I2C_BUS_COUNT];
+static bool busEnabled[I2C_BUS_COUNT] = {false, false};
+
+struct I2CBusCounters
+{
+  uint32_t transactions;
+  uint32_t errors;
+  uint32_t windowStart;
+  uint32_t windowTransactions;
+  uint32_t transactionsPerSecond;
+};
+static I2CBusCounters busCounters[I2C_BUS_COUNT];
+static portMUX_TYPE busCountersMux = portMUX_INITIALIZER_UNLOCKED;
+
 uint8_t validateI2CHexAddress(const String &address_str, uint8_t min, uint8_t max)
 {
   if (address_str.length() > 4)
@@ -9,4 +34,217 @@ uint8_t validateI2CHexAddress(const String &address_str, uint8_t min, uint8_t ma
   uint8_t address = (uint8_t)strtoul(address_str.c_str(), nullptr, 16);
 
   return (address >= min && address <= max) ? address : 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Parses a device address of the form "0x76" (bus 0) or "1:0x76".
+ * @param address_str Address string from the request URL.
+ * @param min Lowest valid address for the device family.
+ * @param max Highest valid address for the device family.
+ * @return The bus and address, with address == 0 if invalid or the bus is not enabled.
+ */
+I2CDeviceAddress validateI2CDeviceAddress(const String &address_str, uint8_t min, uint8_t max)
+{
+  I2CDeviceAddress device = {0, 0};
+  String hex = address_str;
+
+  int separator = address_str.indexOf(':');
+  if (separator != -1)
+  {
+    if (separator != 1 || address_str.charAt(0) < '0' || address_str.charAt(0) >= '0' + I2C_BUS_COUNT)
+    {
+      return device;
+    }
+    device.bus = address_str.charAt(0) - '0';
+    hex = address_str.substring(separator + 1);
+  }
+
+  if (!isI2CBusEnabled(device.bus))
+  {
+    return device;
+  }
+  device.address = validateI2CHexAddress(hex, min, max);
+  return device;
+}
+
+/**
+ * @brief Formats a device address the same way it is accepted in URLs.
+ */
+String formatI2CDeviceAddress(uint8_t bus, uint8_t address)
+{
+  String prefix = bus == 0 ? "" : String(bus) + ":";
+  return prefix + "0x" + String(address, HEX);
+}
+
+TwoWire *getI2CBus(uint8_t bus)
+{
+  return bus == 1 ? &Wire1 : &Wire;
+}
+
+bool isI2CBusEnabled(uint8_t bus)
+{
+  return bus < I2C_BUS_COUNT && busEnabled[bus];
+}
+
+I2CBusConfig getI2CBusConfig(uint8_t bus)
+{
+  return busConfigs[bus];
+}
+
+bool isValidI2CFrequency(uint32_t frequency)
+{
+  return frequency == 100000 || frequency == 400000 || frequency == 1000000;
+}
+
+static bool startI2CBus(uint8_t bus)
+{
+  TwoWire *wire = getI2CBus(bus);
+  if (busEnabled[bus])
+  {
+    wire->end();
+    busEnabled[bus] = false;
+  }
+  const I2CBusConfig &config = busConfigs[bus];
+  if (config.sda < 0 || config.scl < 0)
+  {
+    return true;
+  }
+  busEnabled[bus] = wire->begin(config.sda, config.scl, config.frequency);
+  return busEnabled[bus];
+}
+
+/**
+ * @brief Loads the saved pin and clock configuration and starts each configured bus.
+ */
+void beginI2CBuses()
+{
+  Preferences prefs;
+  prefs.begin("i2c", true);
+  for (uint8_t bus = 0; bus < I2C_BUS_COUNT; bus++)
+  {
+    String key = String(bus);
+    busConfigs[bus].sda = prefs.getInt(("sda" + key).c_str(), defaultBusConfigs[bus].sda);
+    busConfigs[bus].scl = prefs.getInt(("scl" + key).c_str(), defaultBusConfigs[bus].scl);
+    busConfigs[bus].frequency = prefs.getUInt(("freq" + key).c_str(), defaultBusConfigs[bus].frequency);
+    if (!startI2CBus(bus))
+    {
+      logError("Failed to start I2C bus %u (SDA %d, SCL %d, %u Hz)", bus, busConfigs[bus].sda, busConfigs[bus].scl, busConfigs[bus].frequency);
+    }
+  }
+  prefs.end();
+}
+
+/**
+ * @brief Applies and persists a new pin/clock configuration for a bus.
+ *
+ * Drivers already attached to the bus keep their TwoWire pointer, so they pick
+ * up the new clock on their next transaction.
+ *
+ * @param bus Bus index (0 or 1).
+ * @param config New configuration. Negative pins disable the bus.
+ * @return true if the bus restarted (or was disabled) successfully.
+ */
+bool configureI2CBus(uint8_t bus, const I2CBusConfig &config)
+{
+  if (bus >= I2C_BUS_COUNT || !isValidI2CFrequency(config.frequency))
+  {
+    return false;
+  }
+
+  busConfigs[bus] = config;
+
+  Preferences prefs;
+  prefs.begin("i2c", false);
+  String key = String(bus);
+  prefs.putInt(("sda" + key).c_str(), config.sda);
+  prefs.putInt(("scl" + key).c_str(), config.scl);
+  prefs.putUInt(("freq" + key).c_str(), config.frequency);
+  prefs.end();
+
+  return startI2CBus(bus);
+}
+
+/**
+ * @brief Checks whether a device acknowledges its address, without counting the transaction.
+ *
+ * For callers that count the outcome themselves, or where silence is expected.
+ * @return true if the device ACKed.
+ */
+bool isI2CDeviceAnswering(uint8_t bus, uint8_t address)
+{
+  if (!isI2CBusEnabled(bus))
+  {
+    return false;
+  }
+  TRACE_SCOPE("i2c.probe");
+  TwoWire *wire = getI2CBus(bus);
+  wire->beginTransmission(address);
+  return wire->endTransmission() == 0;
+}
+
+/**
+ * @brief Checks whether a device acknowledges its address on the bus.
+ * @param bus Bus to probe.
+ * @param address 7-bit device address.
+ * @return true if the device ACKed.
+ */
+bool probeI2CDevice(uint8_t bus, uint8_t address)
+{
+  bool ok = isI2CDeviceAnswering(bus, address);
+  if (isI2CBusEnabled(bus))
+  {
+    recordI2CTransaction(bus, ok);
+  }
+  return ok;
+}
+
+/**
+ * @brief Counts one driver-level transaction on a bus, for rate reporting.
+ * @param bus Bus the transaction ran on.
+ * @param ok false if the device did not respond or returned an error.
+ */
+void recordI2CTransaction(uint8_t bus, bool ok)
+{
+  if (bus >= I2C_BUS_COUNT)
+  {
+    return;
+  }
+  uint32_t now = millis();
+  portENTER_CRITICAL(&busCountersMux);
+  I2CBusCounters &counters = busCounters[bus];
+  counters.transactions++;
+  if (!ok)
+  {
+    counters.errors++;
+  }
+  uint32_t elapsed = now - counters.windowStart;
+  if (elapsed >= 1000)
+  {
+    counters.transactionsPerSecond = (uint32_t)((uint64_t)counters.windowTransactions * 1000 / elapsed);
+    counters.windowStart = now;
+    counters.windowTransactions = 0;
+  }
+  counters.windowTransactions++;
+  portEXIT_CRITICAL(&busCountersMux);
+}
+
+/**
+ * @brief Returns transaction totals and the rate over the last complete one-second window.
+ */
+I2CBusStats getI2CBusStats(uint8_t bus)
+{
+  I2CBusStats stats = {0, 0, 0};
+  if (bus >= I2C_BUS_COUNT)
+  {
+    return stats;
+  }
+  uint32_t now = millis();
+  portENTER_CRITICAL(&busCountersMux);
+  const I2CBusCounters &counters = busCounters[bus];
+  stats.transactions = counters.transactions;
+  stats.errors = counters.errors;
+  // A bus that went quiet has no recent window; don't report a stale rate
+  stats.transactionsPerSecond = (now - counters.windowStart < 2000) ? counters.transactionsPerSecond : 0;
+  portEXIT_CRITICAL(&busCountersMux);
+  return stats;
+}
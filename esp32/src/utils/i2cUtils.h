@@ -1,5 +1,50 @@
 #pragma once
 
 #include <Arduino.h>
+#include <Wire.h>
+
+// Both ESP32 hardware I2C controllers (Wire and Wire1)
+#define I2C_BUS_COUNT 2
+
+struct I2CBusConfig
+{
+  int sda;
+  int scl;
+  uint32_t frequency;
+};
+
+struct I2CBusStats
+{
+  uint32_t transactions;
+  uint32_t errors;
+  uint32_t transactionsPerSecond;
+};
+
+// A device on a specific bus. address == 0 means invalid.
+struct I2CDeviceAddress
+{
+  uint8_t bus;
+  uint8_t address;
+};
+
+// Registry key for a device: 7-bit address plus bus number in the top bit
+inline uint8_t i2cRegistryKey(uint8_t bus, uint8_t address)
+{
+  return (uint8_t)((bus << 7) | (address & 0x7F));
+}
 
 uint8_t validateI2CHexAddress(const String &address_str, uint8_t min, uint8_t max);
+I2CDeviceAddress validateI2CDeviceAddress(const String &address_str, uint8_t min, uint8_t max);
+String formatI2CDeviceAddress(uint8_t bus, uint8_t address);
+
+void beginI2CBuses();
+TwoWire *getI2CBus(uint8_t bus);
+bool isI2CBusEnabled(uint8_t bus);
+I2CBusConfig getI2CBusConfig(uint8_t bus);
+bool configureI2CBus(uint8_t bus, const I2CBusConfig &config);
+bool isValidI2CFrequency(uint32_t frequency);
+
+bool isI2CDeviceAnswering(uint8_t bus, uint8_t address);
+bool probeI2CDevice(uint8_t bus, uint8_t address);
+void recordI2CTransaction(uint8_t bus, bool ok);
+I2CBusStats getI2CBusStats(uint8_t bus);
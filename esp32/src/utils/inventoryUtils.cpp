@@ -0,0 +1,302 @@
+#include "inventoryUtils.h"
+
+#include "utils/deadlineUtils.h"
+#include "utils/i2cUtils.h"
+#if FEATURE_DS18B20
+#include "sensors/Ds18b20.h"
+#endif
+#if FEATURE_BME280
+#include "sensors/Bme280.h"
+#endif
+#if FEATURE_ADS1115
+#include "sensors/Ads1115.h"
+#endif
+#if FEATURE_PCA9685
+#include "outputs/Pca9685.h"
+#endif
+#include "Version.h"
+
+static HttpCacheState inventoryCache = {0, 0};
+static uint32_t lastSignature = 0;
+static portMUX_TYPE inventoryMux = portMUX_INITIALIZER_UNLOCKED;
+// A bus's probe still queued or running; the next is only posted once it is done
+static bool probePending[I2C_BUS_COUNT] = {};
+
+/**
+ * @brief Bumps the inventory version if any device family changed since the last call.
+ *
+ * Every source only counts upwards, so their sum changes whenever one of them does.
+ * Nothing here touches a bus.
+ *
+ * @return true if the version was bumped.
+ */
+bool refreshInventory()
+{
+  uint32_t signature = 0;
+#if FEATURE_DS18B20
+  signature += ds18b20AddressesCache.version;
+#endif
+#if FEATURE_BME280
+  signature += bme280Registry.generation();
+#endif
+#if FEATURE_ADS1115
+  signature += ads1115Registry.generation();
+#endif
+#if FEATURE_PCA9685
+  signature += pca9685Registry.generation();
+#endif
+  bool changed = false;
+  portENTER_CRITICAL(&inventoryMux);
+  if (signature != lastSignature)
+  {
+    lastSignature = signature;
+    changed = true;
+  }
+  portEXIT_CRITICAL(&inventoryMux);
+  if (changed)
+  {
+    markHttpResourceChanged(inventoryCache);
+  }
+  return changed;
+}
+
+#if FEATURE_PCA9685
+// PCA9685 addresses tried per probe, so a sweep of the 64 takes 16 inventory slices
+#define PCA9685_SCAN_ADDRESSES_PER_SLICE 4
+
+// Offset from 0x40 of the next address each bus's sweep tries; only touched by that bus's worker
+static uint8_t pca9685ScanOffset[I2C_BUS_COUNT] = {};
+
+static bool isSensorAddress(uint8_t bus, uint8_t address)
+{
+#if FEATURE_BME280
+  if (bme280Registry.find(bus, address) != nullptr)
+  {
+    return true;
+  }
+#endif
+#if FEATURE_ADS1115
+  if (ads1115Registry.find(bus, address) != nullptr)
+  {
+    return true;
+  }
+#endif
+  return false;
+}
+
+/**
+ * @brief Tries the next few addresses of a bus's PCA9685 sweep. Call with the PCA9685 lock held.
+ *
+ * Attached chips are checked on every probe anyway, and attached sensors answer
+ * at their own addresses, so both are passed over.
+ */
+static void scanPCA9685Slice(uint8_t bus)
+{
+  for (uint8_t i = 0; i < PCA9685_SCAN_ADDRESSES_PER_SLICE; i++)
+  {
+    uint8_t address = 0x40 + pca9685ScanOffset[bus];
+    pca9685ScanOffset[bus] = (pca9685ScanOffset[bus] + 1) % decltype(pca9685Registry)::AddressesPerBus;
+    if (pca9685Registry.find(bus, address) == nullptr && !isSensorAddress(bus, address))
+    {
+      discoverPCA9685(bus, address);
+    }
+  }
+}
+#endif
+
+#if FEATURE_BME280 || FEATURE_ADS1115
+// A PCA9685 can sit at any address the sensors use, and would answer a sensor's probe
+static bool isPCA9685Address(uint8_t bus, uint8_t address)
+{
+#if FEATURE_PCA9685
+  return pca9685Registry.find(bus, address) != nullptr;
+#else
+  return false;
+#endif
+}
+#endif
+
+/**
+ * @brief Probes one bus's devices; runs on that bus's read worker, which owns their drivers.
+ *
+ * BME280 and ADS1115 addresses are few enough to try on every pass, so a sensor
+ * is listed once it is plugged in rather than once it is first read. A PCA9685
+ * could be anywhere in 0x40-0x7F, so attached chips are checked on every pass
+ * and the rest of the range a few addresses at a time. Whatever does not answer
+ * is marked missing, and detached once it has missed several probes in a row.
+ * Empty addresses are expected, so they are left out of the bus error counts.
+ */
+static void probeI2CBus(uint8_t bus)
+{
+#if FEATURE_BME280
+  for (uint8_t address = 0x76; address <= 0x77; address++)
+  {
+    if (!isPCA9685Address(bus, address) && (!isI2CDeviceAnswering(bus, address) || getBME280(bus, address) == nullptr))
+    {
+      bme280Registry.markMissing(bus, address);
+    }
+  }
+#endif
+#if FEATURE_ADS1115
+  for (uint8_t address = 0x48; address <= 0x4B; address++)
+  {
+    if (!isPCA9685Address(bus, address) && (!isI2CDeviceAnswering(bus, address) || getADS1115(bus, address) == nullptr))
+    {
+      ads1115Registry.markMissing(bus, address);
+    }
+  }
+#endif
+#if FEATURE_PCA9685
+  lockPCA9685Outputs();
+  pca9685Registry.forEach([&](uint8_t chipBus, uint8_t address)
+  {
+    if (chipBus == bus && getPCA9685(bus, address) == nullptr)
+    {
+      pca9685Registry.markMissing(bus, address);
+    }
+  });
+  scanPCA9685Slice(bus);
+  unlockPCA9685Outputs();
+#endif
+}
+
+static void probeI2CInventoryJob(void *arg)
+{
+  uint8_t bus = *(const uint8_t *)arg;
+  probeI2CBus(bus);
+  portENTER_CRITICAL(&inventoryMux);
+  probePending[bus] = false;
+  portEXIT_CRITICAL(&inventoryMux);
+}
+
+/**
+ * @brief Queues a probe of each enabled bus's devices on that bus's read worker.
+ *
+ * Called at startup and on every inventory slice, from the loop task, so it
+ * never waits: the inventory catches up when the probes have run. A bus whose
+ * last probe has not finished, or whose worker has no free job slot, is left
+ * for the next slice, so a hung bus holds at most one slot.
+ */
+void probeI2CInventory()
+{
+  for (uint8_t bus = 0; bus < I2C_BUS_COUNT; bus++)
+  {
+    if (!isI2CBusEnabled(bus))
+    {
+      continue;
+    }
+    portENTER_CRITICAL(&inventoryMux);
+    bool pending = probePending[bus];
+    probePending[bus] = true;
+    portEXIT_CRITICAL(&inventoryMux);
+    if (!pending && !postToDeadlineWorker(deadlineWorkerForI2CBus(bus), probeI2CInventoryJob, &bus, sizeof(bus)))
+    {
+      portENTER_CRITICAL(&inventoryMux);
+      probePending[bus] = false;
+      portEXIT_CRITICAL(&inventoryMux);
+    }
+  }
+}
+
+const HttpCacheState &getInventoryCacheState()
+{
+  return inventoryCache;
+}
+
+InventoryCounts getInventoryCounts()
+{
+  InventoryCounts counts = {0, 0, 0, 0};
+#if FEATURE_DS18B20
+  counts.ds18b20 = getDS18B20Count();
+#endif
+#if FEATURE_BME280
+  counts.bme280 = bme280Registry.size();
+#endif
+#if FEATURE_ADS1115
+  counts.ads1115 = ads1115Registry.size();
+#endif
+#if FEATURE_PCA9685
+  counts.pca9685 = pca9685Registry.size();
+#endif
+  return counts;
+}
+
+template <typename Registry>
+static String registryAddresses(Registry &registry)
+{
+  String json = "[";
+  bool first = true;
+  registry.forEach([&](uint8_t bus, uint8_t address)
+  {
+    if (!first)
+    {
+      json += ",";
+    }
+    first = false;
+    json += "\"" + formatI2CDeviceAddress(bus, address) + "\"";
+  });
+  json += "]";
+  return json;
+}
+
+/**
+ * @brief Lists the optional modules built into this image, as a JSON array of names.
+ */
+static String firmwareModulesArray()
+{
+  String json = "[";
+  for (const FirmwareModule &module : FIRMWARE_MODULES)
+  {
+    if (!module.enabled)
+    {
+      continue;
+    }
+    if (json.length() > 1)
+    {
+      json += ",";
+    }
+    json += "\"" + String(module.name) + "\"";
+  }
+  json += "]";
+  return json;
+}
+
+/**
+ * @brief Returns every known device in one document.
+ *
+ * DS18B20s come from the background ROM search. I2C devices are those with an
+ * attached driver, i.e. every device that answered its last probe. Families
+ * left out of the firmware profile are reported as empty.
+ */
+String getInventoryJson()
+{
+  String json = "{ ";
+  json += "\"version\":" + String(inventoryCache.version) + ", ";
+  json += "\"firmware\":\"" + String(VERSION) + "\", ";
+  json += "\"features\":\"" + String(API_FEATURES) + "\", ";
+  json += "\"profile\":\"" FIRMWARE_PROFILE "\", ";
+  json += "\"modules\":" + firmwareModulesArray() + ", ";
+  json += "\"devices\":{ ";
+#if FEATURE_DS18B20
+  json += "\"ds18b20\":" + getDS18B20AddressesArray() + ", ";
+#else
+  json += "\"ds18b20\":[], ";
+#endif
+#if FEATURE_BME280
+  json += "\"bme280\":" + registryAddresses(bme280Registry) + ", ";
+#else
+  json += "\"bme280\":[], ";
+#endif
+#if FEATURE_ADS1115
+  json += "\"ads1115\":" + registryAddresses(ads1115Registry) + ", ";
+#else
+  json += "\"ads1115\":[], ";
+#endif
+#if FEATURE_PCA9685
+  json += "\"pca9685\":" + registryAddresses(pca9685Registry) + " }";
+#else
+  json += "\"pca9685\":[] }";
+#endif
+  json += " }";
+  return json;
+}
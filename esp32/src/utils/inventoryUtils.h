@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "utils/httpUtils.h"
+#include "Features.h"
+
+#if FEATURE_DS18B20
+#define API_FEATURE_DS18B20_HOTPLUG ",ds18b20-hotplug"
+#else
+#define API_FEATURE_DS18B20_HOTPLUG ""
+#endif
+#if FEATURE_OTA
+#define API_FEATURE_FIRMWARE_PEERS ",firmware-peers"
+#else
+#define API_FEATURE_FIRMWARE_PEERS ""
+#endif
+#if FEATURE_MULTICAST
+#define API_FEATURE_MULTICAST ",multicast"
+#else
+#define API_FEATURE_MULTICAST ""
+#endif
+
+// API features a hub can rely on, advertised in the mDNS TXT record and the inventory
+#define API_FEATURES "inventory,etag,filters,i2c-buses,power" API_FEATURE_DS18B20_HOTPLUG ",logs" API_FEATURE_MULTICAST ",admission" API_FEATURE_FIRMWARE_PEERS ",sample-time,read-deadline,benchmark"
+
+struct InventoryCounts
+{
+  uint8_t ds18b20;
+  uint8_t bme280;
+  uint8_t ads1115;
+  uint8_t pca9685;
+};
+
+bool refreshInventory();
+void probeI2CInventory();
+const HttpCacheState &getInventoryCacheState();
+InventoryCounts getInventoryCounts();
+String getInventoryJson();
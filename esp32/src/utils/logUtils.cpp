@@ -0,0 +1,317 @@
+#include "logUtils.h"
+
+#include <atomic>
+
+// Entries live in a ring indexed by a ticket counter. Writers claim a ticket with
+// one atomic add and publish the slot by storing ticket + 1 in its sequence;
+// readers copy a slot and accept it only if the sequence was the same before and
+// after the copy. Nothing here takes a lock or disables interrupts, so logging
+// from a handler costs a few stores rather than a trip through the UART driver.
+struct LogSlot
+{
+  std::atomic<uint32_t> sequence;
+  LogEntry entry;
+};
+
+static const uint32_t LOG_SLOT_MASK = LOG_BUFFER_ENTRIES - 1;
+static_assert((LOG_BUFFER_ENTRIES & LOG_SLOT_MASK) == 0, "LOG_BUFFER_ENTRIES must be a power of two");
+
+// Drained text line, including the timestamp and level prefix
+static const size_t LOG_LINE_LENGTH = 160;
+
+static LogSlot logSlots[LOG_BUFFER_ENTRIES];
+static std::atomic<uint32_t> logHead(0);
+static std::atomic<uint32_t> logDropped(0);
+static TaskHandle_t logDrainTask = NULL;
+
+static const char *const LOG_LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+
+LogEntry *beginLogEntry(LogLevel level, const char *format, uint32_t &ticket)
+{
+  ticket = logHead.fetch_add(1, std::memory_order_relaxed);
+  LogSlot &slot = logSlots[ticket & LOG_SLOT_MASK];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  LogEntry &entry = slot.entry;
+  entry.format = format;
+  entry.timestampMs = millis();
+  entry.level = level;
+  entry.argCount = 0;
+  entry.textLength = 0;
+  return &entry;
+}
+
+void commitLogEntry(uint32_t ticket)
+{
+  logSlots[ticket & LOG_SLOT_MASK].sequence.store(ticket + 1, std::memory_order_release);
+}
+
+void packLogText(LogEntry &entry, const char *text)
+{
+  if (entry.textLength >= LOG_TEXT_LENGTH)
+  {
+    return;
+  }
+  size_t room = LOG_TEXT_LENGTH - entry.textLength - 1;
+  size_t len = text != NULL ? strnlen(text, room) : 0;
+  memcpy(entry.text + entry.textLength, text, len);
+  entry.text[entry.textLength + len] = '\0';
+  entry.textLength += len + 1;
+}
+
+/**
+ * @brief Copies the entry for a ticket out of the ring.
+ * @return false if the slot is still being written, or was overwritten by a later ticket.
+ */
+static bool readLogEntry(uint32_t ticket, LogEntry &entry)
+{
+  const LogSlot &slot = logSlots[ticket & LOG_SLOT_MASK];
+  uint32_t before = slot.sequence.load(std::memory_order_acquire);
+  if (before != ticket + 1)
+  {
+    return false;
+  }
+  entry = slot.entry;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.sequence.load(std::memory_order_relaxed) == before;
+}
+
+/**
+ * @brief True if the writer holding this ticket has not published it yet.
+ */
+static bool isLogEntryPending(uint32_t ticket)
+{
+  uint32_t sequence = logSlots[ticket & LOG_SLOT_MASK].sequence.load(std::memory_order_relaxed);
+  return sequence == 0 || (int32_t)(sequence - (ticket + 1)) < 0;
+}
+
+/**
+ * @brief Expands an entry's format with its stored arguments.
+ *
+ * Conversions are handed to snprintf one at a time, so flags, width and
+ * precision work as usual. %s takes the next copied string, float conversions
+ * take a stored float, and everything else a 32-bit integer.
+ */
+static void formatLogEntry(const LogEntry &entry, char *out, size_t size)
+{
+  size_t len = 0;
+  uint8_t arg = 0;
+  size_t textOffset = 0;
+  const char *p = entry.format;
+
+  while (*p != '\0' && len + 1 < size)
+  {
+    if (*p != '%')
+    {
+      out[len++] = *p++;
+      continue;
+    }
+    if (p[1] == '%')
+    {
+      out[len++] = '%';
+      p += 2;
+      continue;
+    }
+
+    char spec[16];
+    size_t specLen = 0;
+    spec[specLen++] = *p++;
+    while (*p != '\0' && strchr("diouxXcsfeEgG", *p) == NULL && specLen < sizeof(spec) - 2)
+    {
+      spec[specLen++] = *p++;
+    }
+    if (*p == '\0')
+    {
+      break;
+    }
+    char conversion = *p++;
+    // Length modifiers are applied by casting below, so only the conversion is kept
+    while (specLen > 1 && strchr("hlLqjzt", spec[specLen - 1]) != NULL)
+    {
+      specLen--;
+    }
+    spec[specLen++] = conversion;
+    spec[specLen] = '\0';
+
+    int written;
+    if (conversion == 's')
+    {
+      const char *text = textOffset < entry.textLength ? entry.text + textOffset : "";
+      textOffset += strlen(text) + 1;
+      written = snprintf(out + len, size - len, spec, text);
+    }
+    else
+    {
+      uint32_t word = arg < entry.argCount ? entry.args[arg] : 0;
+      arg++;
+      if (strchr("feEgG", conversion) != NULL)
+      {
+        float f;
+        memcpy(&f, &word, sizeof(f));
+        written = snprintf(out + len, size - len, spec, (double)f);
+      }
+      else if (conversion == 'd' || conversion == 'i')
+      {
+        written = snprintf(out + len, size - len, spec, (int)(int32_t)word);
+      }
+      else
+      {
+        written = snprintf(out + len, size - len, spec, (unsigned int)word);
+      }
+    }
+    if (written > 0)
+    {
+      len += (size_t)written < size - len ? (size_t)written : size - len - 1;
+    }
+  }
+  out[len] = '\0';
+}
+
+/**
+ * @brief Low-priority task that formats new entries and writes them to Serial.
+ *
+ * Blocking on the UART happens here instead of in whoever logged.
+ */
+static void drainLogs(void *param)
+{
+  uint32_t next = 0;
+  char line[LOG_LINE_LENGTH];
+  while (true)
+  {
+    uint32_t head = logHead.load(std::memory_order_acquire);
+    if (head - next > LOG_BUFFER_ENTRIES)
+    {
+      logDropped.fetch_add(head - next - LOG_BUFFER_ENTRIES, std::memory_order_relaxed);
+      next = head - LOG_BUFFER_ENTRIES;
+    }
+    while (next != head)
+    {
+      LogEntry entry;
+      if (!readLogEntry(next, entry))
+      {
+        if (isLogEntryPending(next))
+        {
+          break; // still being written; pick it up next round
+        }
+        logDropped.fetch_add(1, std::memory_order_relaxed); // lapped by newer entries
+        next++;
+        continue;
+      }
+      int prefix = snprintf(line, sizeof(line), "[%lu] %s: ", (unsigned long)entry.timestampMs, LOG_LEVEL_NAMES[entry.level]);
+      formatLogEntry(entry, line + prefix, sizeof(line) - prefix);
+      Serial.println(line);
+      next++;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
+
+/**
+ * @brief Starts the drain task. Entries logged before this are kept and drained once it runs.
+ */
+void beginLogging()
+{
+  if (logDrainTask != NULL)
+  {
+    return;
+  }
+  xTaskCreatePinnedToCore(drainLogs, "logDrain", 3072, NULL, tskIDLE_PRIORITY + 1, &logDrainTask, 1);
+}
+
+bool parseLogLevel(const String &name, LogLevel &level)
+{
+  for (uint8_t i = 0; i < sizeof(LOG_LEVEL_NAMES) / sizeof(LOG_LEVEL_NAMES[0]); i++)
+  {
+    if (name.equalsIgnoreCase(LOG_LEVEL_NAMES[i]))
+    {
+      level = (LogLevel)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void appendJsonEscaped(String &json, const char *text)
+{
+  for (const char *p = text; *p != '\0'; p++)
+  {
+    char c = *p;
+    if (c == '"' || c == '\\')
+    {
+      json += '\\';
+      json += c;
+    }
+    else if ((uint8_t)c < 0x20)
+    {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      json += escaped;
+    }
+    else
+    {
+      json += c;
+    }
+  }
+}
+
+/**
+ * @brief Returns the buffered entries from sequence number `since` on, oldest first.
+ *
+ * "next" is the value to pass as `since` on the following poll. "missed" counts
+ * entries after `since` that were overwritten before this call; "dropped" is the
+ * drain task's running count of entries that never reached Serial.
+ *
+ * @param since First sequence number wanted; older entries are skipped.
+ * @param minLevel Lowest level to include.
+ */
+String getLogsJson(uint32_t since, LogLevel minLevel)
+{
+  uint32_t head = logHead.load(std::memory_order_acquire);
+  uint32_t oldest = head > LOG_BUFFER_ENTRIES ? head - LOG_BUFFER_ENTRIES : 0;
+  uint32_t missed = 0;
+  if (since < oldest)
+  {
+    missed = oldest - since;
+    since = oldest;
+  }
+
+  String json = "{ \"entries\": [";
+  bool first = true;
+  char message[LOG_LINE_LENGTH];
+  for (uint32_t ticket = since; ticket < head; ticket++)
+  {
+    LogEntry entry;
+    if (!readLogEntry(ticket, entry))
+    {
+      if (isLogEntryPending(ticket))
+      {
+        head = ticket; // return it on the next poll
+        break;
+      }
+      missed++;
+      continue;
+    }
+    if (entry.level < minLevel)
+    {
+      continue;
+    }
+    formatLogEntry(entry, message, sizeof(message));
+    if (!first)
+    {
+      json += ", ";
+    }
+    first = false;
+    json += "{ \"seq\":" + String(ticket) + ", ";
+    json += "\"ms\":" + String(entry.timestampMs) + ", ";
+    json += "\"level\":\"" + String(LOG_LEVEL_NAMES[entry.level]) + "\", ";
+    json += "\"message\":\"";
+    appendJsonEscaped(json, message);
+    json += "\" }";
+  }
+  json += "], ";
+  json += "\"next\":" + String(head) + ", ";
+  json += "\"missed\":" + String(missed) + ", ";
+  json += "\"dropped\":" + String(logDropped.load(std::memory_order_relaxed)) + " }";
+  return json;
+}
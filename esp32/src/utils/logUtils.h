@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Entries kept in RAM; a power of two so tickets map to slots with a mask
+#define LOG_BUFFER_ENTRIES 64
+#define LOG_MAX_ARGS 4
+// Bytes for copied string arguments, shared by all %s of one entry
+#define LOG_TEXT_LENGTH 48
+#define LOG_DRAIN_INTERVAL_MS 50
+
+enum LogLevel : uint8_t
+{
+  LOG_LEVEL_DEBUG = 0,
+  LOG_LEVEL_INFO = 1,
+  LOG_LEVEL_WARN = 2,
+  LOG_LEVEL_ERROR = 3,
+};
+
+// Calls below this level compile to nothing; set with -DLOG_MIN_LEVEL=0 to keep debug logs
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * @brief One log call, stored unformatted.
+ *
+ * format must be a string literal: only its address is kept, and it is
+ * formatted later by the drain task or the logs endpoint. Integer and float
+ * arguments are stored as 32-bit words; string arguments are copied into text
+ * (truncated if the entry runs out of room).
+ */
+struct LogEntry
+{
+  const char *format;
+  uint32_t timestampMs;
+  uint8_t level;
+  uint8_t argCount;
+  uint8_t textLength;
+  uint32_t args[LOG_MAX_ARGS];
+  char text[LOG_TEXT_LENGTH];
+};
+
+LogEntry *beginLogEntry(LogLevel level, const char *format, uint32_t &ticket);
+void commitLogEntry(uint32_t ticket);
+void packLogText(LogEntry &entry, const char *text);
+
+inline void packLogWord(LogEntry &entry, uint32_t word)
+{
+  if (entry.argCount < LOG_MAX_ARGS)
+  {
+    entry.args[entry.argCount++] = word;
+  }
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type packLogArg(LogEntry &entry, const T &value)
+{
+  packLogWord(entry, (uint32_t)value);
+}
+
+inline void packLogArg(LogEntry &entry, double value)
+{
+  float f = (float)value;
+  uint32_t word;
+  memcpy(&word, &f, sizeof(word));
+  packLogWord(entry, word);
+}
+
+inline void packLogArg(LogEntry &entry, const char *text) { packLogText(entry, text); }
+inline void packLogArg(LogEntry &entry, const String &text) { packLogText(entry, text.c_str()); }
+
+/**
+ * @brief Records a log entry without formatting it or touching Serial.
+ *
+ * Safe from any task; never blocks. When the buffer is full the oldest entry
+ * is overwritten, and the drain task counts it as dropped.
+ */
+template <typename... Args>
+inline void logEvent(LogLevel level, const char *format, const Args &...args)
+{
+  if (level < LOG_MIN_LEVEL)
+  {
+    return;
+  }
+  uint32_t ticket;
+  LogEntry *entry = beginLogEntry(level, format, ticket);
+  int expand[] = {0, (packLogArg(*entry, args), 0)...};
+  (void)expand;
+  (void)entry;
+  commitLogEntry(ticket);
+}
+
+template <typename... Args>
+inline void logDebug(const char *format, const Args &...args) { logEvent(LOG_LEVEL_DEBUG, format, args...); }
+template <typename... Args>
+inline void logInfo(const char *format, const Args &...args) { logEvent(LOG_LEVEL_INFO, format, args...); }
+template <typename... Args>
+inline void logWarn(const char *format, const Args &...args) { logEvent(LOG_LEVEL_WARN, format, args...); }
+template <typename... Args>
+inline void logError(const char *format, const Args &...args) { logEvent(LOG_LEVEL_ERROR, format, args...); }
+
+void beginLogging();
+bool parseLogLevel(const String &name, LogLevel &level);
+String getLogsJson(uint32_t since, LogLevel minLevel);
@@ -0,0 +1,215 @@
+#include "powerUtils.h"
+
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_idf_version.h>
+#include <esp_pm.h>
+#include <esp_wifi.h>
+
+#include "utils/cpuUtils.h"
+
+static const uint16_t MAX_CPU_MHZ = 240;
+static const uint32_t BEACON_INTERVAL_US = 102400; // 100 TU, the usual AP default
+
+static PowerSettings powerSettings;
+static bool dynamicFrequencyScaling = false;
+static bool lightSleepActive = false;
+
+static esp_pm_lock_handle_t requestLock = NULL;
+
+static portMUX_TYPE handlerStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t handlerCount = 0;
+static uint64_t handlerTotalUs = 0;
+static uint32_t handlerMaxUs = 0;
+
+static esp_err_t configurePowerManagement(uint16_t minMhz, bool lightSleep)
+{
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t pm = {};
+#else
+  esp_pm_config_esp32_t pm = {};
+#endif
+  pm.max_freq_mhz = MAX_CPU_MHZ;
+  pm.min_freq_mhz = minMhz;
+  pm.light_sleep_enable = lightSleep;
+  return esp_pm_configure(&pm);
+}
+
+static void applyPowerSettings()
+{
+  WiFi.setSleep(powerSettings.lowPower ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+
+  uint16_t minMhz = powerSettings.lowPower ? powerSettings.minCpuMhz : MAX_CPU_MHZ;
+  bool lightSleep = powerSettings.lowPower && powerSettings.lightSleep;
+
+  esp_err_t err = configurePowerManagement(minMhz, lightSleep);
+  if (err != ESP_OK && lightSleep)
+  {
+    // Built without tickless idle: keep frequency scaling, skip light sleep
+    lightSleep = false;
+    err = configurePowerManagement(minMhz, false);
+  }
+
+  if (err == ESP_OK)
+  {
+    dynamicFrequencyScaling = minMhz < MAX_CPU_MHZ;
+    lightSleepActive = lightSleep;
+    if (requestLock == NULL)
+    {
+      esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "http", &requestLock);
+    }
+  }
+  else
+  {
+    // Core built without CONFIG_PM_ENABLE: fall back to a fixed clock
+    dynamicFrequencyScaling = false;
+    lightSleepActive = false;
+    setCpuFrequencyMhz(minMhz);
+  }
+}
+
+/**
+ * @brief Loads the saved power settings and applies the CPU and modem-sleep parts.
+ *
+ * Call before Wi-Fi starts. The listen interval is applied once connected, by
+ * applyStationListenInterval().
+ */
+void beginPowerManagement()
+{
+  Preferences prefs;
+  prefs.begin("power", true);
+  powerSettings.lowPower = prefs.getBool("lowPower", powerSettings.lowPower);
+  powerSettings.listenInterval = prefs.getUChar("listen", powerSettings.listenInterval);
+  powerSettings.minCpuMhz = prefs.getUShort("minMhz", powerSettings.minCpuMhz);
+  powerSettings.lightSleep = prefs.getBool("lightSleep", powerSettings.lightSleep);
+  prefs.end();
+
+  applyPowerSettings();
+}
+
+/**
+ * @brief Sets the station's DTIM listen interval and reconnects if it changed.
+ *
+ * WiFi.begin() always writes the default interval, and the AP only learns a new
+ * one on association, so this must run after connecting.
+ *
+ * @return true if a reconnect was started.
+ */
+bool applyStationListenInterval()
+{
+  if (!powerSettings.lowPower)
+  {
+    return false;
+  }
+
+  wifi_config_t conf;
+  if (esp_wifi_get_config(WIFI_IF_STA, &conf) != ESP_OK ||
+      conf.sta.listen_interval == powerSettings.listenInterval)
+  {
+    return false;
+  }
+
+  conf.sta.listen_interval = powerSettings.listenInterval;
+  esp_wifi_set_config(WIFI_IF_STA, &conf);
+  return WiFi.reconnect();
+}
+
+PowerSettings getPowerSettings()
+{
+  return powerSettings;
+}
+
+bool isValidPowerSettings(const PowerSettings &settings)
+{
+  return settings.listenInterval >= 1 && settings.listenInterval <= 10 &&
+         (settings.minCpuMhz == 80 || settings.minCpuMhz == 160 || settings.minCpuMhz == 240);
+}
+
+/**
+ * @brief Persists and applies new power settings.
+ *
+ * CPU scaling, light sleep and modem sleep change immediately. A new listen
+ * interval takes effect on the next boot, to avoid dropping the connection here.
+ *
+ * @param settings New settings.
+ * @return false if the settings are out of range.
+ */
+bool configurePower(const PowerSettings &settings)
+{
+  if (!isValidPowerSettings(settings))
+  {
+    return false;
+  }
+
+  Preferences prefs;
+  prefs.begin("power", false);
+  prefs.putBool("lowPower", settings.lowPower);
+  prefs.putUChar("listen", settings.listenInterval);
+  prefs.putUShort("minMhz", settings.minCpuMhz);
+  prefs.putBool("lightSleep", settings.lightSleep);
+  prefs.end();
+
+  powerSettings = settings;
+  applyPowerSettings();
+  return true;
+}
+
+/**
+ * @brief Reports what is actually active, plus duty-cycle and latency estimates.
+ *
+ * The duty cycle is the share of wall time core 0 spent out of light sleep. The
+ * wake latency is the worst case for a request arriving just after the radio
+ * went back to sleep: one listen interval of beacons plus the slowest handler.
+ */
+PowerStatus getPowerStatus()
+{
+  PowerStatus status;
+  status.dynamicFrequencyScaling = dynamicFrequencyScaling;
+  status.lightSleepActive = lightSleepActive;
+  status.cpuMhz = getCpuFrequencyMhz();
+  status.awakePercent = getCpuAwakePercent(0);
+
+  portENTER_CRITICAL(&handlerStatsMux);
+  status.averageHandlerUs = handlerCount ? (uint32_t)(handlerTotalUs / handlerCount) : 0;
+  status.maxHandlerUs = handlerMaxUs;
+  portEXIT_CRITICAL(&handlerStatsMux);
+
+  uint32_t radioWaitUs = powerSettings.lowPower ? powerSettings.listenInterval * BEACON_INTERVAL_US : 0;
+  status.estimatedWakeLatencyMs = (radioWaitUs + status.maxHandlerUs + 999) / 1000;
+  return status;
+}
+
+/**
+ * @brief Holds the CPU at full clock while a request is handled.
+ * @return true if the lock was taken and must be passed to endRequestPowerLock.
+ */
+bool beginRequestPowerLock()
+{
+  if (dynamicFrequencyScaling && requestLock != NULL)
+  {
+    return esp_pm_lock_acquire(requestLock) == ESP_OK;
+  }
+  return false;
+}
+
+/**
+ * @brief Releases the request clock lock and records the handler's run time.
+ * @param locked Value returned by beginRequestPowerLock.
+ * @param handlerUs Time spent in the handler, in microseconds.
+ */
+void endRequestPowerLock(bool locked, uint32_t handlerUs)
+{
+  if (locked)
+  {
+    esp_pm_lock_release(requestLock);
+  }
+
+  portENTER_CRITICAL(&handlerStatsMux);
+  handlerCount++;
+  handlerTotalUs += handlerUs;
+  if (handlerUs > handlerMaxUs)
+  {
+    handlerMaxUs = handlerUs;
+  }
+  portEXIT_CRITICAL(&handlerStatsMux);
+}
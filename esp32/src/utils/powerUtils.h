@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Low-power configuration for battery/solar subcontrollers.
+ *
+ * With modem sleep on, the radio wakes only every listenInterval beacons
+ * (~102.4 ms each) to check for traffic, which bounds how long an incoming
+ * hub request can wait. minCpuMhz is the floor for dynamic frequency scaling.
+ */
+struct PowerSettings
+{
+  bool lowPower = false;
+  uint8_t listenInterval = 3;
+  uint16_t minCpuMhz = 80;
+  bool lightSleep = false;
+};
+
+struct PowerStatus
+{
+  bool dynamicFrequencyScaling;
+  bool lightSleepActive;
+  uint32_t cpuMhz;
+  uint8_t awakePercent;
+  uint32_t estimatedWakeLatencyMs;
+  uint32_t averageHandlerUs;
+  uint32_t maxHandlerUs;
+};
+
+void beginPowerManagement();
+bool applyStationListenInterval();
+
+PowerSettings getPowerSettings();
+bool configurePower(const PowerSettings &settings);
+bool isValidPowerSettings(const PowerSettings &settings);
+PowerStatus getPowerStatus();
+
+bool beginRequestPowerLock();
+void endRequestPowerLock(bool locked, uint32_t handlerUs);
@@ -0,0 +1,159 @@
+#include "timeUtils.h"
+
+#include <Preferences.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+
+// lwIP keeps the pointer it is given rather than a copy, so the name lives in a fixed buffer
+static char timeServer[TIME_SERVER_MAX_LENGTH + 1] = TIME_DEFAULT_SERVER;
+
+static uint32_t syncs = 0;
+static int64_t lastSyncUs = 0;
+static uint32_t sampleSequence = 0;
+static portMUX_TYPE timeMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Runs on the lwIP task each time SNTP sets the clock
+static void onTimeSynced(struct timeval *tv)
+{
+  portENTER_CRITICAL(&timeMux);
+  syncs++;
+  lastSyncUs = esp_timer_get_time();
+  portEXIT_CRITICAL(&timeMux);
+}
+
+static void applyTimeServer()
+{
+  if (timeServer[0] == '\0')
+  {
+    sntp_stop();
+    return;
+  }
+  sntp_set_time_sync_notification_cb(onTimeSynced);
+  // Samples are stamped in UTC; the hub converts to local time
+  configTime(0, 0, timeServer);
+}
+
+/**
+ * @brief Loads the saved time server and starts SNTP against it.
+ *
+ * Call once Wi-Fi is up. Until the first sync, samples carry only their
+ * monotonic time.
+ */
+void beginTimeSync()
+{
+  Preferences prefs;
+  prefs.begin("time", true);
+  String server = prefs.getString("server", TIME_DEFAULT_SERVER);
+  prefs.end();
+
+  strncpy(timeServer, server.c_str(), TIME_SERVER_MAX_LENGTH);
+  timeServer[TIME_SERVER_MAX_LENGTH] = '\0';
+  applyTimeServer();
+}
+
+String getTimeServer()
+{
+  return String(timeServer);
+}
+
+/**
+ * @brief Persists and applies a new time server, usually the hub or a local router.
+ *
+ * @return false if the name is too long or holds characters no host name or address has.
+ */
+bool configureTimeServer(const String &server)
+{
+  if (server.length() > TIME_SERVER_MAX_LENGTH)
+  {
+    return false;
+  }
+  for (unsigned int i = 0; i < server.length(); i++)
+  {
+    char c = server[i];
+    if (!isalnum((unsigned char)c) && c != '.' && c != '-' && c != ':')
+    {
+      return false;
+    }
+  }
+
+  Preferences prefs;
+  prefs.begin("time", false);
+  prefs.putString("server", server);
+  prefs.end();
+
+  sntp_stop();
+  strncpy(timeServer, server.c_str(), TIME_SERVER_MAX_LENGTH);
+  timeServer[TIME_SERVER_MAX_LENGTH] = '\0';
+  applyTimeServer();
+  return true;
+}
+
+TimeSyncStatus getTimeSyncStatus()
+{
+  TimeSyncStatus status;
+  portENTER_CRITICAL(&timeMux);
+  status.synced = syncs > 0;
+  status.syncs = syncs;
+  status.lastSyncUs = lastSyncUs;
+  portEXIT_CRITICAL(&timeMux);
+  return status;
+}
+
+/**
+ * @brief Returns UTC in milliseconds, or 0 if SNTP has not set the clock since boot.
+ */
+int64_t getEpochMs()
+{
+  portENTER_CRITICAL(&timeMux);
+  bool synced = syncs > 0;
+  portEXIT_CRITICAL(&timeMux);
+  if (!synced)
+  {
+    return 0;
+  }
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+/**
+ * @brief Marks the start of an acquisition; pass the result to endSample().
+ */
+int64_t beginSample()
+{
+  return esp_timer_get_time();
+}
+
+/**
+ * @brief Stamps a sample whose acquisition started at startUs and ended now.
+ */
+void endSample(SampleStamp &stamp, int64_t startUs)
+{
+  int64_t now = esp_timer_get_time();
+  stamp.monotonicUs = now;
+  stamp.durationUs = (uint32_t)(now - startUs);
+  stamp.epochMs = getEpochMs();
+  portENTER_CRITICAL(&timeMux);
+  stamp.sequence = ++sampleSequence;
+  portEXIT_CRITICAL(&timeMux);
+}
+
+/**
+ * @brief Formats a stamp as the "sample" member of a reading response.
+ *
+ * age_us is how old the sample is as the response is built, on the board's own
+ * clock. With both clocks synced, the hub can add the network leg by comparing
+ * time_ms with its own clock on arrival.
+ * @param stale Set when a fresh read missed the request's deadline and this is the last good sample.
+ */
+String sampleStampJson(const SampleStamp &stamp, bool stale)
+{
+  String json = "\"sample\":{ \"seq\":" + String(stamp.sequence) + ", ";
+  json += "\"uptime_us\":" + String((long long)stamp.monotonicUs) + ", ";
+  json += "\"time_ms\":" + (stamp.epochMs > 0 ? String((long long)stamp.epochMs) : String("null")) + ", ";
+  json += "\"acquire_us\":" + String(stamp.durationUs) + ", ";
+  json += "\"age_us\":" + String((long long)(esp_timer_get_time() - stamp.monotonicUs)) + ", ";
+  json += "\"stale\":" + String(stale ? "true" : "false") + " }";
+  return json;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Used until a server is configured; an empty server turns SNTP off
+#define TIME_DEFAULT_SERVER "pool.ntp.org"
+#define TIME_SERVER_MAX_LENGTH 63
+
+/**
+ * @brief When and how one sensor sample was taken.
+ *
+ * Both timestamps mark the end of the acquisition, when the value was read.
+ * monotonicUs is time since boot and is always set; epochMs is UTC and 0 until
+ * SNTP has set the clock. sequence counts samples across all sensors since
+ * boot, so a gap shows samples the hub never saw and a reset shows a reboot.
+ */
+struct SampleStamp
+{
+  uint32_t sequence;
+  int64_t monotonicUs;
+  int64_t epochMs;
+  uint32_t durationUs;
+};
+
+struct TimeSyncStatus
+{
+  bool synced;
+  uint32_t syncs;
+  int64_t lastSyncUs; // monotonic time of the last sync
+};
+
+void beginTimeSync();
+String getTimeServer();
+bool configureTimeServer(const String &server);
+TimeSyncStatus getTimeSyncStatus();
+int64_t getEpochMs();
+
+int64_t beginSample();
+void endSample(SampleStamp &stamp, int64_t startUs);
+String sampleStampJson(const SampleStamp &stamp, bool stale = false);
@@ -0,0 +1,124 @@
+#include "traceUtils.h"
+
+#if TRACE_ENABLED
+
+struct TraceEvent
+{
+  const char *name;
+  uint32_t timestampUs;
+  char phase;
+  uint8_t task;
+};
+
+struct TraceTask
+{
+  TaskHandle_t handle;
+  char name[configMAX_TASK_NAME_LEN];
+};
+
+static TraceEvent traceEvents[TRACE_BUFFER_EVENTS];
+static uint32_t traceHead = 0; // events ever recorded; the next one goes to traceHead % TRACE_BUFFER_EVENTS
+static TraceTask traceTasks[TRACE_MAX_TASKS];
+static uint8_t traceTaskCount = 0;
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Returns the index of a task in traceTasks, adding it the first time it is seen.
+ *
+ * The name is copied because the task may be deleted before the trace is read.
+ * Tasks past TRACE_MAX_TASKS share the last slot. Call with traceMux held.
+ */
+static uint8_t traceTaskIndex(TaskHandle_t handle)
+{
+  for (uint8_t i = 0; i < traceTaskCount; i++)
+  {
+    if (traceTasks[i].handle == handle)
+    {
+      return i;
+    }
+  }
+  if (traceTaskCount == TRACE_MAX_TASKS)
+  {
+    return TRACE_MAX_TASKS - 1;
+  }
+  TraceTask &task = traceTasks[traceTaskCount];
+  task.handle = handle;
+  strncpy(task.name, pcTaskGetName(handle), sizeof(task.name) - 1);
+  task.name[sizeof(task.name) - 1] = '\0';
+  return traceTaskCount++;
+}
+
+/**
+ * @brief Records one trace event for the calling task.
+ * @param name Event name; must outlive the trace, e.g. a string literal.
+ * @param phase 'B' for begin or 'E' for end, as in the Chrome trace format.
+ */
+void traceEvent(const char *name, char phase)
+{
+  uint32_t now = micros();
+  TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+  portENTER_CRITICAL(&traceMux);
+  TraceEvent &event = traceEvents[traceHead % TRACE_BUFFER_EVENTS];
+  event.name = name;
+  event.timestampUs = now;
+  event.phase = phase;
+  event.task = traceTaskIndex(handle);
+  traceHead++;
+  portEXIT_CRITICAL(&traceMux);
+}
+
+/**
+ * @brief Returns the buffered events as Chrome trace-event JSON, oldest first.
+ *
+ * The result loads directly in Perfetto or chrome://tracing. Each task is a
+ * thread, named by a metadata event. The ring is copied out first so the
+ * JSON is built without holding the lock.
+ */
+String getTraceJson()
+{
+  TraceEvent *events = (TraceEvent *)malloc(sizeof(traceEvents));
+  if (events == NULL)
+  {
+    return "{\"error\":\"Out of memory\"}";
+  }
+  TraceTask tasks[TRACE_MAX_TASKS];
+
+  portENTER_CRITICAL(&traceMux);
+  uint32_t head = traceHead;
+  uint8_t taskCount = traceTaskCount;
+  memcpy(events, traceEvents, sizeof(traceEvents));
+  memcpy(tasks, traceTasks, sizeof(TraceTask) * taskCount);
+  portEXIT_CRITICAL(&traceMux);
+
+  uint32_t count = head < TRACE_BUFFER_EVENTS ? head : TRACE_BUFFER_EVENTS;
+  String json;
+  json.reserve(64 + count * 64);
+  json = "{ \"displayTimeUnit\":\"ms\", ";
+  json += "\"otherData\":{ \"recorded\":" + String(head) + ", \"dropped\":" + String(head - count) + " }, ";
+  json += "\"traceEvents\":[";
+  for (uint8_t i = 0; i < taskCount; i++)
+  {
+    if (i > 0)
+    {
+      json += ", ";
+    }
+    json += "{ \"name\":\"thread_name\", \"ph\":\"M\", \"pid\":1, \"tid\":" + String(i) + ", ";
+    json += "\"args\":{ \"name\":\"" + String(tasks[i].name) + "\" } }";
+  }
+  for (uint32_t seq = head - count; seq != head; seq++)
+  {
+    const TraceEvent &event = events[seq % TRACE_BUFFER_EVENTS];
+    if (seq != head - count || taskCount > 0)
+    {
+      json += ", ";
+    }
+    json += "{ \"name\":\"" + String(event.name) + "\", \"ph\":\"";
+    json += event.phase;
+    json += "\", \"ts\":" + String(event.timestampUs) + ", \"pid\":1, \"tid\":" + String(event.task) + " }";
+  }
+  json += "] }";
+  free(events);
+  return json;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Trace points compile to nothing unless the build sets -DTRACE_ENABLED=1
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+// Events kept in RAM; the oldest are overwritten once it is full
+#define TRACE_BUFFER_EVENTS 256
+// Distinct tasks that can appear in one trace
+#define TRACE_MAX_TASKS 12
+
+#if TRACE_ENABLED
+
+void traceEvent(const char *name, char phase);
+
+/**
+ * @brief Records a begin event now and the matching end event when it goes out of scope.
+ */
+class TraceScope
+{
+public:
+  explicit TraceScope(const char *name) : _name(name) { traceEvent(name, 'B'); }
+  ~TraceScope() { traceEvent(_name, 'E'); }
+
+private:
+  const char *_name;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// name must be a string literal (or __func__): only its address is stored
+#define TRACE_BEGIN(name) traceEvent(name, 'B')
+#define TRACE_END(name) traceEvent(name, 'E')
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+String getTraceJson();
+
+#else
+
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+
+#endif